@@ -0,0 +1,165 @@
+-- $Id: compare.lua $
+-- Compare two result files written by 'run.lua'.
+--
+-- usage: lua compare.lua [-t percent] [-k key] base.json new.json
+--   -t percent  slowdown that counts as a regression (default: 5)
+--   -k key      time to compare, "min" or "median" (default: "min")
+--
+-- Prints one line per benchmark present in both files, plus lines for
+-- their extra metrics, and exits with status 1 if some benchmark got
+-- slower than the threshold.
+
+local threshold, key = 5, "min"
+local files = {}
+
+local i = 1
+while arg[i] do
+  if arg[i] == "-t" then i = i + 1; threshold = tonumber(arg[i])
+  elseif arg[i] == "-k" then i = i + 1; key = arg[i]
+  else files[#files + 1] = arg[i]
+  end
+  i = i + 1
+end
+if #files ~= 2 or not threshold or (key ~= "min" and key ~= "median") then
+  io.stderr:write("usage: lua compare.lua [-t percent] [-k min|median] ",
+                  "base.json new.json\n")
+  os.exit(2)
+end
+
+
+-- {==================================================================
+-- A small JSON decoder (enough for the files from 'run.lua')
+-- ===================================================================
+
+local escapes = {b = "\b", f = "\f", n = "\n", r = "\r", t = "\t"}
+
+local decode
+
+local function skip (s, pos)
+  return string.find(s, "%S", pos) or #s + 1
+end
+
+local function decodestring (s, pos)
+  local buff = {}
+  pos = pos + 1  -- skip '"'
+  while true do
+    local c = string.sub(s, pos, pos)
+    if c == '"' then return table.concat(buff), pos + 1
+    elseif c == "\\" then
+      local e = string.sub(s, pos + 1, pos + 1)
+      if e == "u" then
+        buff[#buff + 1] = utf8.char(tonumber(string.sub(s, pos + 2, pos + 5), 16))
+        pos = pos + 6
+      else
+        buff[#buff + 1] = escapes[e] or e
+        pos = pos + 2
+      end
+    elseif c == "" then error("unfinished string in JSON")
+    else
+      buff[#buff + 1] = c
+      pos = pos + 1
+    end
+  end
+end
+
+local function decodelist (s, pos, close, item)
+  pos = skip(s, pos + 1)
+  if string.sub(s, pos, pos) == close then return pos + 1 end
+  while true do
+    pos = skip(s, item(pos))
+    local c = string.sub(s, pos, pos)
+    if c == close then return pos + 1
+    elseif c ~= "," then error("invalid JSON at position " .. pos)
+    end
+    pos = skip(s, pos + 1)
+  end
+end
+
+function decode (s, pos)
+  pos = skip(s, pos)
+  local c = string.sub(s, pos, pos)
+  if c == "{" then
+    local t = {}
+    pos = decodelist(s, pos, "}", function (p)
+      local k, v
+      k, p = decodestring(s, p)
+      p = skip(s, p)
+      assert(string.sub(s, p, p) == ":", "invalid JSON object")
+      v, p = decode(s, p + 1)
+      t[k] = v
+      return p
+    end)
+    return t, pos
+  elseif c == "[" then
+    local t = {}
+    pos = decodelist(s, pos, "]", function (p)
+      t[#t + 1], p = decode(s, p)
+      return p
+    end)
+    return t, pos
+  elseif c == '"' then
+    return decodestring(s, pos)
+  else
+    local lit = string.match(s, "^[%w%.%+%-]+", pos)
+    if lit == "true" then return true, pos + 4
+    elseif lit == "false" then return false, pos + 5
+    elseif lit == "null" then return nil, pos + 4
+    elseif lit and tonumber(lit) then return tonumber(lit), pos + #lit
+    else error("invalid JSON at position " .. pos)
+    end
+  end
+end
+
+-- }==================================================================
+
+
+local function load (fname)
+  local f = assert(io.open(fname, "r"))
+  local s = f:read("a")
+  f:close()
+  local data = decode(s, 1)
+  local byname = {}
+  for _, r in ipairs(data.results) do byname[r.name] = r end
+  return data, byname
+end
+
+local base, bbase = load(files[1])
+local new = load(files[2])
+
+local function change (a, b)
+  return (a > 0) and (b - a) / a * 100 or 0
+end
+
+print(string.format("%-28s %10s %10s %8s", "benchmark", "base", "new", "change"))
+local regressions = 0
+for _, r in ipairs(new.results) do
+  local b = bbase[r.name]
+  if b then
+    local pct = change(b[key], r[key])
+    local mark = ""
+    if pct > threshold then
+      mark = "  <- slower"
+      regressions = regressions + 1
+    elseif pct < -threshold then
+      mark = "  faster"
+    end
+    print(string.format("%-28s %10.4f %10.4f %+7.1f%%%s", r.name, b[key],
+                        r[key], pct, mark))
+    if r.metrics and b.metrics then
+      local names = {}
+      for m in pairs(r.metrics) do
+        if m ~= "check" and b.metrics[m] then names[#names + 1] = m end
+      end
+      table.sort(names)
+      for _, m in ipairs(names) do
+        local x, y = b.metrics[m], r.metrics[m]
+        print(string.format("  %-26s %10.4g %10.4g %+7.1f%%", m, x, y,
+                            change(x, y)))
+      end
+    end
+  end
+end
+print(string.format("%s (%s) -> %s (%s): %d regression(s) over %g%%",
+                    files[1], base.version, files[2], new.version,
+                    regressions, threshold))
+os.exit(regressions == 0 and 0 or 1)
@@ -0,0 +1,101 @@
+-- $Id: gc.lua $
+-- Benchmarks for the garbage collector: allocation throughput and the
+-- distribution of the delays that collector steps add to allocations
+
+local function loopn (scale, n)
+  return math.max(1, math.floor(n * scale))
+end
+
+-- collector statistics, when this build has them
+local function stats ()
+  local ok, st = pcall(collectgarbage, "stats")
+  return ok and st or nil
+end
+
+-- quantile 'q' of a sorted list
+local function quantile (s, q)
+  return s[math.max(1, math.ceil(#s * q))]
+end
+
+
+--[[
+Allocate 'n' objects in chunks of 100, keeping a window of live ones,
+and time each chunk: chunks where the collector ran take longer, so
+the tail of the distribution shows the collector's pauses.
+]]
+local function churn (mode, scale)
+  local old = collectgarbage(mode)
+  local st0 = stats()
+  local live = {}
+  local times = {}
+  local clock = os.clock
+  for c = 1, loopn(scale, 10000) do
+    local t0 = clock()
+    for i = 1, 100 do
+      live[(c * 100 + i) % 5000 + 1] = {c, i, tostring(i)}
+    end
+    times[c] = clock() - t0
+  end
+  local st1 = stats()
+  collectgarbage(old)
+  table.sort(times)
+  local res = {p50 = quantile(times, 0.5), p99 = quantile(times, 0.99),
+               max = times[#times]}
+  if st0 and st1 then
+    local gctime = 0
+    for _, p in ipairs{"propagate", "atomic", "sweep", "callfin",
+                       "minor", "major"} do
+      gctime = gctime + st1[p] - st0[p]
+    end
+    res.gctime = gctime
+    res.steps = st1.steps - st0.steps + st1.minors - st0.minors
+    res.cycles = st1.cycles - st0.cycles
+  end
+  return res
+end
+
+return {
+
+{"incremental", function (scale) return churn("incremental", scale) end},
+
+{"generational", function (scale) return churn("generational", scale) end},
+
+{"closures", function (scale)
+  local fs = {}
+  for i = 1, loopn(scale, 500000) do
+    fs[i & 4095] = function () return i end
+  end
+  return {check = #fs}
+end},
+
+{"strings", function (scale)
+  local t = {}
+  for i = 1, loopn(scale, 300000) do
+    t[i & 4095] = string.rep("x", i & 63) .. i
+  end
+  return {check = #t}
+end},
+
+{"ephemerons", function (scale)
+  -- a memoization cache where half the keys die, plus a chain of
+  -- entries whose values are the keys of other entries
+  local cache = setmetatable({}, {__mode = "k"})
+  local keep = {}
+  for i = 1, loopn(scale, 200000) do
+    local k = {}
+    cache[k] = {k}
+    if i % 2 == 0 then keep[i // 2] = k end
+  end
+  local k = keep
+  for _ = 1, loopn(scale, 20000) do
+    local nk = {}
+    cache[k] = nk
+    k = nk
+  end
+  collectgarbage()
+  local n = 0
+  for _ in pairs(cache) do n = n + 1 end
+  return {check = n}
+end},
+
+}
@@ -0,0 +1,70 @@
+-- $Id: load.lua $
+-- Benchmarks for start-up costs: compiling, undumping, requiring
+
+local function loopn (scale, n)
+  return math.max(1, math.floor(n * scale))
+end
+
+-- a chunk with some functions, tables and constants
+local source = {}
+for i = 1, 200 do
+  source[#source + 1] = string.format([[
+local function f%d (a, b, ...)
+  local t = {x = a, y = b, n = select("#", ...), "%d"}
+  for i = 1, #t do t[i] = t[i] .. i end
+  if a > b then return t.x * %d else return string.format("%%d", b) end
+end
+]], i, i, i)
+end
+source[#source + 1] = "return f1"
+source = table.concat(source)
+
+local binary = string.dump(assert(load(source)), true)
+
+-- a table of records, as a data file
+local data = {"return {\n"}
+for i = 1, 2000 do
+  data[#data + 1] = string.format(
+    '{id = %d, name = "item%d", w = %g, tags = {"a", "b"}},\n', i, i, i / 7)
+end
+data[#data + 1] = "}\n"
+data = table.concat(data)
+
+-- can 'load' read data chunks (mode "d")?
+local hasdata = type(load("{}", "=data", "d")) == "table"
+
+return {
+
+{"compile", function (scale)
+  for _ = 1, loopn(scale, 50) do assert(load(source, "=bench")) end
+end},
+
+{"datacode", function (scale)
+  for _ = 1, loopn(scale, 20) do assert(load(data, "=bench"))() end
+end},
+
+{"data", function (scale)
+  for _ = 1, loopn(scale, 20) do assert(load(data, "=bench", "d")) end
+end, skip = not hasdata},
+
+{"undump", function (scale)
+  for _ = 1, loopn(scale, 200) do assert(load(binary, "=bench", "b")) end
+end},
+
+{"require", function (scale)
+  local fname = os.tmpname()
+  local f = assert(io.open(fname, "w"))
+  f:write(source)
+  f:close()
+  local oldpath = package.path
+  package.path = fname  -- a template without '?' is a plain file name
+  for _ = 1, loopn(scale, 50) do
+    package.loaded.benchmodule = nil
+    require("benchmodule")
+  end
+  package.path = oldpath
+  package.loaded.benchmodule = nil
+  os.remove(fname)
+end},
+
+}
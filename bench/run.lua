@@ -0,0 +1,129 @@
+-- $Id: run.lua $
+-- Benchmark driver: runs the suites in this directory and writes the
+-- results in JSON.
+--
+-- usage: lua run.lua [-o file] [-r reps] [-s scale] [pattern ...]
+--   -o file   write the JSON results to 'file' (default: standard output)
+--   -r reps   number of timed runs of each benchmark (default: 5)
+--   -s scale  multiply the amount of work of each benchmark (default: 1)
+--   pattern   run only benchmarks whose names match some of the patterns
+--
+-- Each suite file returns a list of benchmarks {name, function (scale)};
+-- a function may return a table of extra numeric metrics, which goes
+-- to the results of its last run. Times are CPU seconds ('os.clock').
+-- A benchmark with a true field 'skip' (for a library or feature that
+-- this build lacks) is reported as skipped and left out of the results.
+-- See 'compare.lua' to compare two result files.
+
+local suites = {"vm", "table", "string", "gc", "load"}
+
+local dir = string.match(arg and arg[0] or "", "^(.*[/\\])") or ""
+
+local outname, reps, scale
+local patterns = {}
+
+local i = 1
+while arg and arg[i] do
+  local a = arg[i]
+  if a == "-o" then i = i + 1; outname = arg[i]
+  elseif a == "-r" then i = i + 1; reps = math.tointeger(tonumber(arg[i]))
+  elseif a == "-s" then i = i + 1; scale = tonumber(arg[i])
+  else patterns[#patterns + 1] = a
+  end
+  i = i + 1
+end
+reps = reps or 5
+scale = scale or 1
+assert(reps and reps > 0 and scale > 0, "invalid option value")
+
+
+local function selected (name)
+  if #patterns == 0 then return true end
+  for _, p in ipairs(patterns) do
+    if string.find(name, p) then return true end
+  end
+  return false
+end
+
+
+local function median (t)
+  local s = table.move(t, 1, #t, 1, {})
+  table.sort(s)
+  local n = #s
+  if n % 2 == 1 then return s[(n + 1) // 2]
+  else return (s[n // 2] + s[n // 2 + 1]) / 2
+  end
+end
+
+
+-- JSON encoding of the (restricted) values produced here
+local function encode (v, out)
+  local t = type(v)
+  if t == "table" then
+    if v[1] ~= nil or next(v) == nil then  -- array?
+      out[#out + 1] = "["
+      for k = 1, #v do
+        if k > 1 then out[#out + 1] = "," end
+        encode(v[k], out)
+      end
+      out[#out + 1] = "]"
+    else
+      local keys = {}
+      for k in pairs(v) do keys[#keys + 1] = k end
+      table.sort(keys)
+      out[#out + 1] = "{"
+      for k, key in ipairs(keys) do
+        if k > 1 then out[#out + 1] = "," end
+        encode(key, out)
+        out[#out + 1] = ":"
+        encode(v[key], out)
+      end
+      out[#out + 1] = "}"
+    end
+  elseif t == "string" then
+    out[#out + 1] = string.format("%q", v):gsub("\\\n", "\\n")
+  elseif math.type(v) == "integer" then
+    out[#out + 1] = string.format("%d", v)
+  elseif t == "number" then
+    out[#out + 1] = v ~= v and "null" or string.format("%.9g", v)
+  else
+    out[#out + 1] = tostring(v)
+  end
+end
+
+
+local results = {}
+for _, sname in ipairs(suites) do
+  local suite = dofile(dir .. sname .. ".lua")
+  for _, b in ipairs(suite) do
+    local name = sname .. "." .. b[1]
+    if selected(name) and b.skip then
+      io.stderr:write(string.format("%-24s   skipped\n", name))
+    elseif selected(name) then
+      local fn = b[2]
+      local runs, metrics = {}
+      collectgarbage()
+      fn(scale / 10)  -- warm up
+      for r = 1, reps do
+        collectgarbage()
+        local t0 = os.clock()
+        metrics = fn(scale)
+        runs[r] = os.clock() - t0
+      end
+      local res = {name = name, runs = runs, min = math.min(table.unpack(runs)),
+                   median = median(runs)}
+      if type(metrics) == "table" then res.metrics = metrics end
+      results[#results + 1] = res
+      io.stderr:write(string.format("%-24s %9.4f %9.4f\n", name, res.min,
+                                    res.median))
+    end
+  end
+end
+
+local out = {}
+encode({version = _VERSION, date = os.date("!%Y-%m-%dT%H:%M:%SZ"),
+        reps = reps, scale = scale, results = results}, out)
+out[#out + 1] = "\n"
+local f = outname and assert(io.open(outname, "w")) or io.stdout
+f:write(table.concat(out))
+if f ~= io.stdout then f:close() end
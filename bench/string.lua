@@ -0,0 +1,112 @@
+-- $Id: string.lua $
+-- Benchmarks for strings: interning, concatenation, patterns, formatting,
+-- serialization
+
+local json = require "json"
+local msgpack = require "msgpack"
+
+local function loopn (scale, n)
+  return math.max(1, math.floor(n * scale))
+end
+
+local text = string.rep("The quick brown fox jumps over the lazy dog 1234. ", 200)
+
+return {
+
+{"intern", function (scale)
+  local t = {}
+  for i = 1, loopn(scale, 500000) do t[i & 1023] = "s" .. (i & 4095) end
+  return {check = #t}
+end},
+
+{"concat", function (scale)
+  local s = 0
+  for _ = 1, loopn(scale, 200) do
+    local t = {}
+    for i = 1, 1000 do t[i] = "item" .. i end
+    s = s + #table.concat(t, ",")
+  end
+  local str = ""
+  for i = 1, loopn(scale, 5000) do str = str .. "x" end
+  return {check = s + #str}
+end},
+
+{"find", function (scale)
+  local c = 0
+  for _ = 1, loopn(scale, 100) do
+    for w in string.gmatch(text, "%a+") do c = c + #w end
+    c = c + select(2, string.gsub(text, "o", "0"))
+    c = c + (string.find(text, "lazy cat", 1, true) or 0)
+    c = c + (string.find(text, "%d+%.$") or 0)
+  end
+  return {check = c}
+end},
+
+{"format", function (scale)
+  local s = 0
+  for i = 1, loopn(scale, 200000) do
+    s = s + #string.format("%d:%s:%.3f", i, "abc", i / 3)
+  end
+  return {check = s}
+end},
+
+{"tonumber", function (scale)
+  local s = 0
+  for i = 1, loopn(scale, 300000) do
+    s = s + tonumber(tostring(i * 0.25)) + tonumber(tostring(i))
+  end
+  return {check = s}
+end},
+
+{"json", function (scale)
+  local doc = {}
+  for i = 1, 200 do
+    doc[i] = {id = i, name = "item " .. i, price = i * 0.25,
+              tags = {"a", "b", "c"}, ok = (i % 2 == 0)}
+  end
+  local s = 0
+  for _ = 1, loopn(scale, 100) do
+    local str = json.encode(doc)
+    s = s + #str + #json.decode(str)
+  end
+  return {check = s}
+end, skip = not json},
+
+{"msgpack", function (scale)
+  local doc = {}
+  for i = 1, 200 do
+    doc[i] = {id = i, name = "item " .. i, price = i * 0.25,
+              tags = {"a", "b", "c"}, ok = (i % 2 == 0)}
+  end
+  local s = 0
+  for _ = 1, loopn(scale, 100) do
+    local str = msgpack.encode(doc)
+    s = s + #str + #msgpack.decode(str)
+  end
+  return {check = s}
+end, skip = not msgpack},
+
+
+{"pack", function (scale)
+  local s = 0
+  for i = 1, loopn(scale, 200000) do
+    local str = string.pack("<I2 i4 d s1", i & 0xffff, -i, i / 2, "rec")
+    local a, b, c, d = string.unpack("<I2 i4 d s1", str)
+    s = s + a + b + #d
+  end
+  return {check = s}
+end},
+
+{"struct", function (scale)
+  local st = string.struct("<I2 i4 d s1")
+  local recs = {}
+  for i = 1, 1000 do recs[i] = {i, -i, i / 2, "rec"} end
+  local s = 0
+  for _ = 1, loopn(scale, 200) do
+    local str = st:encode(recs)
+    local l = st:decode(str)
+    s = s + #str + #l + l[#l][1]
+  end
+  return {check = s}
+end, skip = not string.struct},
+}
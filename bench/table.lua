@@ -0,0 +1,83 @@
+-- $Id: table.lua $
+-- Benchmarks for tables: lookups, insertions, rehashes, length
+
+local function loopn (scale, n)
+  return math.max(1, math.floor(n * scale))
+end
+
+return {
+
+{"get", function (scale)
+  local t = {}
+  local keys = {}
+  for i = 1, 64 do keys[i] = "key" .. i; t[keys[i]] = i end
+  local s = 0
+  for _ = 1, loopn(scale, 50000) do
+    for i = 1, 64 do s = s + t[keys[i]] end
+  end
+  return {check = s}
+end},
+
+{"newkey", function (scale)
+  local s = 0
+  for _ = 1, loopn(scale, 20000) do
+    local t = {}
+    for i = 1, 32 do t["k" .. (i & 7)] = i; t[i * 17] = i end
+    s = s + #t
+  end
+  return {check = s}
+end},
+
+{"rehash", function (scale)
+  local n = loopn(scale, 500000)
+  local t = {}
+  for i = 1, n do t[i * 7919 % 1000003] = i end
+  for i = 1, n, 2 do t[i * 7919 % 1000003] = nil end
+  local c = 0
+  for _ in pairs(t) do c = c + 1 end
+  return {check = c}
+end},
+
+{"array", function (scale)
+  local s = 0
+  for _ = 1, loopn(scale, 20) do
+    local t = {}
+    for i = 1, 50000 do t[#t + 1] = i end
+    for i = 1, #t do s = s + t[i] end
+  end
+  return {check = s}
+end},
+
+{"length", function (scale)
+  local t = {}
+  for i = 1, 1000 do t[i] = i end
+  local s = 0
+  for i = 1, loopn(scale, 1000000) do
+    t[1001] = (i & 1 == 0) and i or nil
+    s = s + #t
+  end
+  return {check = s}
+end},
+
+{"iterate", function (scale)
+  local t = {}
+  for i = 1, 10000 do t[i] = i; t["x" .. i] = i end
+  local s = 0
+  for _ = 1, loopn(scale, 30) do
+    for _, v in ipairs(t) do s = s + v end
+    for _, v in pairs(t) do s = s + v end
+  end
+  return {check = s}
+end},
+
+{"sort", function (scale)
+  local n = loopn(scale, 200000)
+  local t = {}
+  local x = 1
+  for i = 1, n do x = x * 1103515245 + 12345 & 0x7fffffff; t[i] = x end
+  table.sort(t)
+  table.sort(t, function (a, b) return a > b end)
+  return {check = t[1]}
+end},
+
+}
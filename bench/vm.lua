@@ -0,0 +1,90 @@
+-- $Id: vm.lua $
+-- Benchmarks for the virtual machine: dispatch, arithmetic, calls
+
+local function loopn (scale, n)
+  return math.max(1, math.floor(n * scale))
+end
+
+return {
+
+{"arith", function (scale)
+  local n = loopn(scale, 5000000)
+  local a, f = 0, 0.0
+  for i = 1, n do
+    a = (a + i * 3) % 1000003
+    f = f + i / 7.0 - (i & 15)
+  end
+  return {check = a + f}
+end},
+
+{"loops", function (scale)
+  local n = loopn(scale, 3000)
+  local s = 0
+  for i = 1, n do
+    local j = 0
+    while j < 1000 do
+      if j & 1 == 0 then s = s + 1 else s = s ~ j end
+      j = j + 1
+    end
+  end
+  return {check = s}
+end},
+
+{"calls", function (scale)
+  local function fib (n)
+    if n < 2 then return n end
+    return fib(n - 1) + fib(n - 2)
+  end
+  local s = 0
+  for _ = 1, loopn(scale, 10) do s = s + fib(24) end
+  return {check = s}
+end},
+
+{"closures", function (scale)
+  local s = 0
+  for i = 1, loopn(scale, 1000000) do
+    local function add (x) return x + i end
+    s = add(s) % 1000003
+  end
+  return {check = s}
+end},
+
+{"varargs", function (scale)
+  local function count (...) return select("#", ...) end
+  local function pass (...) return count(...) end
+  local s = 0
+  for i = 1, loopn(scale, 1000000) do s = s + pass(i, i, i) end
+  return {check = s}
+end},
+
+{"methods", function (scale)
+  local Point = {}
+  Point.__index = Point
+  function Point:norm1 () return math.abs(self.x) + math.abs(self.y) end
+  local p = setmetatable({x = 3, y = -4}, Point)
+  local s = 0
+  for _ = 1, loopn(scale, 1000000) do s = s + p:norm1() end
+  return {check = s}
+end},
+
+{"globals", function (scale)
+  local s = 0
+  for i = 1, loopn(scale, 2000000) do
+    s = s + (type(i) == "number" and math.floor(i / 2) or 0)
+  end
+  return {check = s}
+end},
+
+{"pcall", function (scale)
+  local function id (x) return x end
+  local function fail (x) error(x, 0) end
+  local s = 0
+  for i = 1, loopn(scale, 1000000) do
+    local _, a = pcall(id, i)
+    local _, b = pcall(fail, 1)
+    s = (s + a + b) % 1000003
+  end
+  return {check = s}
+end},
+
+}
@@ -459,6 +459,24 @@ LUA_API void *lua_touserdata (lua_State *L, int idx) {
 }
 
 
+/*
+** Returns the elements of the numeric array at index 'idx', setting
+** its kind and its number of elements. Returns NULL if the value is
+** not a numeric array.
+*/
+LUA_API void *lua_toarray (lua_State *L, int idx, int *kind,
+                                             lua_Unsigned *n) {
+  const TValue *o = index2value(L, idx);
+  Udata *u;
+  if (!ttisarray(o))
+    return NULL;
+  u = uvalue(o);
+  if (kind) *kind = u->arraykind;
+  if (n) *n = arraysize(u);
+  return getudatamem(u);
+}
+
+
 LUA_API lua_State *lua_tothread (lua_State *L, int idx) {
   const TValue *o = index2value(L, idx);
   return (!ttisthread(o)) ? NULL : thvalue(o);
@@ -759,6 +777,51 @@ LUA_API int lua_rawgetp (lua_State *L, int idx, const void *p) {
 }
 
 
+/*
+** Convert 'o' to a C value of the given kind, stored at 'p'.
+*/
+static int tocvalue (const TValue *o, int kind, void *p) {
+  if (kind == LUA_ARRNUMBER)
+    return tonumber(o, cast(lua_Number *, p));
+  else
+    return tointeger(o, cast(lua_Integer *, p));
+}
+
+
+LUA_API lua_Unsigned lua_rawgetiarray (lua_State *L, int idx, lua_Integer first,
+                                       lua_Unsigned n, int kind, void *v) {
+  Table *t;
+  lua_Unsigned k;
+  size_t esize = arrayelemsize(kind);
+  lua_lock(L);
+  api_check(L, kind == LUA_ARRNUMBER || kind == LUA_ARRINTEGER,
+               "invalid array kind");
+  t = gettable(L, idx);
+  for (k = 0; k < n; k++) {
+    const TValue *o = luaH_getint(t, l_castU2S(l_castS2U(first) + k));
+    if (!tocvalue(o, kind, cast_charp(v) + k * esize))
+      break;  /* absent or not convertible */
+  }
+  lua_unlock(L);
+  return k;
+}
+
+
+LUA_API int lua_rawgetfields (lua_State *L, int idx, const lua_Field *f,
+                              void *s) {
+  Table *t;
+  int n = 0;
+  lua_lock(L);
+  t = gettable(L, idx);
+  for (; f->name != NULL; f++) {
+    const TValue *o = luaH_getstr(t, luaS_new(L, f->name));
+    n += tocvalue(o, f->kind, cast_charp(s) + f->offset);
+  }
+  lua_unlock(L);
+  return n;
+}
+
+
 LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
   Table *t;
   lua_lock(L);
@@ -918,6 +981,15 @@ LUA_API void lua_rawsetp (lua_State *L, int idx, const void *p) {
 }
 
 
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  Table *t;
+  lua_lock(L);
+  t = gettable(L, idx);
+  luaH_clear(t);
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_rawseti (lua_State *L, int idx, lua_Integer n) {
   Table *t;
   lua_lock(L);
@@ -930,6 +1002,77 @@ LUA_API void lua_rawseti (lua_State *L, int idx, lua_Integer n) {
 }
 
 
+/*
+** Set 'o' to the C value of the given kind stored at 'p'.
+*/
+static void setcvalue (TValue *o, int kind, const void *p) {
+  if (kind == LUA_ARRNUMBER) {
+    setfltvalue(o, *cast(const lua_Number *, p));
+  }
+  else {
+    setivalue(o, *cast(const lua_Integer *, p));
+  }
+}
+
+
+/*
+** Numbers are not collectable, so these stores need no barriers. When
+** the range starts inside the array part or right after it, that part
+** grows once to hold the whole range and the values are written there
+** directly.
+*/
+LUA_API void lua_rawsetiarray (lua_State *L, int idx, lua_Integer first,
+                               lua_Unsigned n, int kind, const void *v) {
+  Table *t;
+  lua_Unsigned k = 0;
+  size_t esize = arrayelemsize(kind);
+  lua_lock(L);
+  api_check(L, kind == LUA_ARRNUMBER || kind == LUA_ARRINTEGER,
+               "invalid array kind");
+  t = gettable(L, idx);
+  if (n > 0 && first >= 1) {
+    lua_Unsigned last = l_castS2U(first) - 1u + n;  /* 0-based end + 1 */
+    unsigned int asize = luaH_realasize(t);
+    if (l_castS2U(first) - 1u <= asize && last <= cast_uint(INT_MAX)) {
+      if (last > asize)
+        luaH_resizearray(L, t, cast_uint(last));
+      for (; k < n; k++)
+        setcvalue(&t->array[l_castS2U(first) - 1u + k], kind,
+                  cast_charp(v) + k * esize);
+    }
+  }
+  for (; k < n; k++) {  /* range not in the array part */
+    TValue val;
+    setcvalue(&val, kind, cast_charp(v) + k * esize);
+    luaH_setint(L, t, l_castU2S(l_castS2U(first) + k), &val);
+  }
+  lua_unlock(L);
+}
+
+
+/*
+** The key being stored goes to the stack, so that it stays anchored if
+** inserting it into the table needs memory.
+*/
+LUA_API void lua_rawsetfields (lua_State *L, int idx, const lua_Field *f,
+                               const void *s) {
+  Table *t;
+  lua_lock(L);
+  t = gettable(L, idx);
+  for (; f->name != NULL; f++) {
+    TValue val;
+    setsvalue2s(L, L->top.p, luaS_new(L, f->name));
+    api_incr_top(L);
+    setcvalue(&val, f->kind, cast_charp(s) + f->offset);
+    luaH_set(L, t, s2v(L->top.p - 1), &val);
+    L->top.p--;
+  }
+  invalidateTMcache(t);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   TValue *obj;
   Table *mt;
@@ -1059,11 +1202,12 @@ LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
     func = savestack(L, o);
   }
   c.func = L->top.p - (nargs+1);  /* function to be called */
-  if (k == NULL || !yieldable(L)) {  /* no continuation or no yieldable? */
+  if (k == NULL || !(yieldable(L) || luaD_canrecover(L))) {
     c.nresults = nresults;  /* do a 'conventional' protected call */
-    status = luaD_pcall(L, f_call, &c, savestack(L, c.func), func);
+    status = luaD_pcallrecover(L, f_call, &c, savestack(L, c.func), func);
   }
-  else {  /* prepare continuation (call is already protected by 'resume') */
+  else {  /* prepare continuation (call is already protected by 'resume'
+             or by a recover point) */
     CallInfo *ci = L->ci;
     ci->u.c.k = k;  /* save continuation */
     ci->u.c.ctx = ctx;  /* save context */
@@ -1092,7 +1236,7 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
   if (!chunkname) chunkname = "?";
   luaZ_init(L, &z, reader, data);
   status = luaD_protectedparser(L, &z, chunkname, mode);
-  if (status == LUA_OK) {  /* no errors? */
+  if (status == LUA_OK && ttisLclosure(s2v(L->top.p - 1))) {  /* code? */
     LClosure *f = clLvalue(s2v(L->top.p - 1));  /* get new function */
     if (f->nupvalues >= 1) {  /* does it have an upvalue? */
       /* get global table from registry */
@@ -1221,6 +1365,14 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
       luaC_changemode(L, KGC_INC);
       break;
     }
+    case LUA_GCSTEPTIME: {
+      int usec = va_arg(argp, int);
+      int maxgrowth = va_arg(argp, int);
+      res = luaC_setsteptime(L, usec, maxgrowth);
+      if (usec > 0)  /* timed pacing works only in incremental mode */
+        luaC_changemode(L, KGC_INC);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   va_end(argp);
@@ -1230,6 +1382,50 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
 
 
 
+LUA_API void lua_gcstats (lua_State *L, lua_GCStats *stats) {
+  lua_lock(L);
+  *stats = G(L)->gcstats;
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_setgchook (lua_State *L, lua_GCHook f, void *ud) {
+  lua_lock(L);
+  G(L)->ud_gchook = ud;
+  G(L)->gchook = f;
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_setmemlimit (lua_State *L, size_t soft, size_t hard) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  g->memsoft = cast(lu_mem, soft);
+  g->memhard = cast(lu_mem, hard);
+  luaE_setmemcheck(g);
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_setmemhook (lua_State *L, lua_MemHook f, void *ud) {
+  lua_lock(L);
+  G(L)->ud_memhook = ud;
+  G(L)->memhook = f;
+  lua_unlock(L);
+}
+
+
+LUA_API size_t lua_threadalloc (lua_State *L) {
+  size_t n;
+  lua_lock(L);
+  n = cast_sizet(L->nalloc);
+  lua_unlock(L);
+  return n;
+}
+
+
+
 /*
 ** miscellaneous functions
 */
@@ -1267,6 +1463,15 @@ LUA_API int lua_next (lua_State *L, int idx) {
 }
 
 
+LUA_API void lua_setiterator (lua_State *L, int what, lua_CFunction f) {
+  lua_lock(L);
+  api_check(L, what == LUA_ITERNEXT || what == LUA_ITERIPAIRS,
+                "invalid iterator kind");
+  G(L)->iterf[what] = f;
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_toclose (lua_State *L, int idx) {
   int nresults;
   StkId o;
@@ -1282,6 +1487,82 @@ LUA_API void lua_toclose (lua_State *L, int idx) {
 }
 
 
+/*
+** Concatenate t[i], sep, t[i + 1], ..., sep, t[j], where 't' is the
+** table at index 'idx', in one pass to compute the length of the result
+** and another one to fill it. This is done only when 't' is a table
+** with all those fields present and holding strings or numbers (so that
+** no metamethods are involved); otherwise, nothing is pushed and the
+** function returns 0.
+*/
+LUA_API int lua_rawconcat (lua_State *L, int idx, lua_Integer i,
+                           lua_Integer j, const char *sep, size_t lsep) {
+  const TValue *o;
+  Table *t;
+  lua_Integer k;
+  size_t tl = 0;
+  char nbuff[MAXNUMBER2STR];
+  char sbuff[LUAI_MAXSHORTLEN + 1];  /* (+1 for a final '\0' from 'sprintf') */
+  TString *ts;
+  char *buff;
+  lua_lock(L);
+  o = index2value(L, idx);
+  if (!ttistable(o)) {
+    lua_unlock(L);
+    return 0;
+  }
+  t = hvalue(o);
+  for (k = i; k <= j; k++) {  /* compute total length */
+    const TValue *v = luaH_getint(t, k);
+    size_t l;
+    if (ttisstring(v))
+      l = tsslen(tsvalue(v));
+    else if (ttisnumber(v))
+      l = cast_sizet(luaO_tostringbuff(v, nbuff));
+    else {  /* absent field or invalid value; let the caller handle it */
+      lua_unlock(L);
+      return 0;
+    }
+    if (l_unlikely(l + lsep >= MAX_SIZE - sizeof(TString) - tl))
+      luaG_runerror(L, "string length overflow");
+    tl += l + lsep;
+    if (k == j)  /* last field? (avoid overflow in 'k++') */
+      break;
+  }
+  if (i <= j)
+    tl -= lsep;  /* no separator after the last field */
+  if (tl <= LUAI_MAXSHORTLEN) {  /* result is a short string? */
+    buff = sbuff;
+    ts = NULL;
+  }
+  else {  /* long string; fill it directly */
+    ts = luaS_createlngstrobj(L, tl);
+    buff = getstr(ts);
+  }
+  for (k = i, tl = 0; k <= j; k++) {  /* fill the result */
+    const TValue *v = luaH_getint(t, k);
+    if (ttisstring(v)) {
+      size_t l = tsslen(tsvalue(v));
+      memcpy(buff + tl, getstr(tsvalue(v)), l * sizeof(char));
+      tl += l;
+    }
+    else
+      tl += cast_sizet(luaO_tostringbuff(v, buff + tl));
+    if (k == j)
+      break;
+    memcpy(buff + tl, sep, lsep * sizeof(char));
+    tl += lsep;
+  }
+  if (ts == NULL)
+    ts = luaS_newlstr(L, buff, tl);
+  setsvalue2s(L, L->top.p, ts);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return 1;
+}
+
+
 LUA_API void lua_concat (lua_State *L, int n) {
   lua_lock(L);
   api_checknelems(L, n);
@@ -1324,6 +1605,24 @@ LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
 }
 
 
+LUA_API int lua_setstrcache (lua_State *L, int nsets, int maxsets) {
+  int res;
+  lua_lock(L);
+  res = cast_int(luaS_setcache(L, nsets, maxsets));
+  lua_unlock(L);
+  return res;
+}
+
+
+LUA_API void lua_strcachestats (lua_State *L, lua_Unsigned *hits,
+                                              lua_Unsigned *misses) {
+  lua_lock(L);
+  if (hits) *hits = cast(lua_Unsigned, G(L)->strcachehits);
+  if (misses) *misses = cast(lua_Unsigned, G(L)->strcachemisses);
+  lua_unlock(L);
+}
+
+
 void lua_setwarnf (lua_State *L, lua_WarnFunction f, void *ud) {
   lua_lock(L);
   G(L)->ud_warn = ud;
@@ -1353,6 +1652,52 @@ LUA_API void *lua_newuserdatauv (lua_State *L, size_t size, int nuvalue) {
 }
 
 
+/*
+** Creates a userdata whose native finalizer 'f' runs when the collector
+** frees it, after any '__gc' metamethod. 'f' is kept after the data.
+*/
+LUA_API void *lua_newuserdatafin (lua_State *L, size_t size, int nuvalue,
+                                  lua_Finalizer f) {
+  Udata *u;
+  lua_lock(L);
+  api_check(L, 0 <= nuvalue && nuvalue < USHRT_MAX, "invalid value");
+  api_check(L, f != NULL, "finalizer expected");
+  if (l_unlikely(size > MAX_SIZE - sizeof(lua_Finalizer)))
+    luaM_toobig(L);
+  u = luaS_newudata(L, size + sizeof(lua_Finalizer), nuvalue);
+  u->len = size;
+  u->nativefin = 1;
+  memcpy(getudatafin(u), &f, sizeof(lua_Finalizer));
+  setuvalue(L, s2v(L->top.p), u);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getudatamem(u);
+}
+
+
+/*
+** Creates a numeric array with 'n' elements, all zeros.
+*/
+LUA_API void *lua_newarray (lua_State *L, int kind, lua_Unsigned n) {
+  Udata *u;
+  size_t esize = arrayelemsize(kind);
+  lua_lock(L);
+  api_check(L, kind == LUA_ARRNUMBER || kind == LUA_ARRINTEGER,
+               "invalid array kind");
+  if (l_unlikely(n > MAX_SIZE / esize))
+    luaM_toobig(L);
+  u = luaS_newudata(L, cast_sizet(n) * esize, 0);
+  u->arraykind = cast_byte(kind);
+  memset(getudatamem(u), 0, u->len);
+  setuvalue(L, s2v(L->top.p), u);
+  api_incr_top(L);
+  luaC_checkGC(L);
+  lua_unlock(L);
+  return getudatamem(u);
+}
+
+
 
 static const char *aux_upvalue (TValue *fi, int n, TValue **val,
                                 GCObject **owner) {
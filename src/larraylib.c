@@ -0,0 +1,585 @@
+/*
+** $Id: larraylib.c $
+** Library for Numeric Arrays
+** See Copyright Notice in lua.h
+*/
+
+#define larraylib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/* name of the metatable for numeric arrays */
+#define ARRAYMT		LUA_ARRAYLIBNAME
+
+static const char *const kindnames[] = {"number", "integer", NULL};
+
+
+typedef struct Array {
+  void *elems;
+  lua_Unsigned n;  /* number of elements */
+  int kind;
+} Array;
+
+
+#define esize(a)  \
+	((a)->kind == LUA_ARRNUMBER ? sizeof(lua_Number) : sizeof(lua_Integer))
+
+#define eaddr(a,i)	(((char *)(a)->elems) + (i) * esize(a))
+
+
+static void checkarray (lua_State *L, int arg, Array *a) {
+  a->elems = lua_toarray(L, arg, &a->kind, &a->n);
+  if (l_unlikely(a->elems == NULL))
+    luaL_typeerror(L, arg, ARRAYMT);
+}
+
+
+static int getkind (lua_State *L, int arg) {
+  return luaL_checkoption(L, arg, "number", kindnames) + 1;
+}
+
+
+/*
+** Check that 'i' is a valid index in array 'a' (or its end + 1, when
+** 'past' is true) and return it as a 0-based index.
+*/
+static lua_Unsigned posindex (lua_State *L, const Array *a, lua_Integer i,
+                              int arg, int past) {
+  luaL_argcheck(L, 1 <= i && (lua_Unsigned)i - 1u < a->n + (past != 0),
+                   arg, "index out of range");
+  return (lua_Unsigned)i - 1u;
+}
+
+
+/*
+** Get optional range [i, j] (default is the whole array) as a 0-based
+** start plus a number of elements.
+*/
+static lua_Unsigned getrange (lua_State *L, const Array *a, int arg,
+                              lua_Unsigned *count) {
+  lua_Integer i = luaL_optinteger(L, arg, 1);
+  lua_Integer j = luaL_optinteger(L, arg + 1, (lua_Integer)a->n);
+  lua_Unsigned first = posindex(L, a, i, arg, 1);
+  if (i > j)
+    *count = 0;  /* empty range */
+  else {
+    posindex(L, a, j, arg + 1, 0);
+    *count = (lua_Unsigned)j - (lua_Unsigned)i + 1u;
+  }
+  return first;
+}
+
+
+/*
+** Store the value at index 'arg' into element 'i' of 'a'.
+*/
+static void setelem (lua_State *L, const Array *a, lua_Unsigned i, int arg) {
+  if (a->kind == LUA_ARRNUMBER)
+    ((lua_Number *)a->elems)[i] = luaL_checknumber(L, arg);
+  else
+    ((lua_Integer *)a->elems)[i] = luaL_checkinteger(L, arg);
+}
+
+
+static void newarray (lua_State *L, Array *a, int kind, lua_Integer n) {
+  luaL_argcheck(L, n >= 0, 1, "invalid size");
+  a->elems = lua_newarray(L, kind, (lua_Unsigned)n);
+  a->kind = kind;
+  a->n = (lua_Unsigned)n;
+  luaL_setmetatable(L, ARRAYMT);
+}
+
+
+static int arr_new (lua_State *L) {
+  Array a;
+  int hasinit = !lua_isnoneornil(L, 3);
+  lua_settop(L, 3);
+  newarray(L, &a, getkind(L, 2), luaL_checkinteger(L, 1));
+  if (hasinit) {  /* initial value? */
+    lua_Unsigned i;
+    setelem(L, &a, 0, 3);  /* also checks the value */
+    for (i = 1; i < a.n; i++)
+      memcpy(eaddr(&a, i), a.elems, esize(&a));
+  }
+  return 1;
+}
+
+
+/*
+** Set element 'i' of 'a' to the value on the top of the stack, which
+** came from index 'j' of the source table.
+*/
+static void settabelem (lua_State *L, const Array *a, lua_Unsigned i,
+                                      lua_Integer j) {
+  int isnum;
+  if (a->kind == LUA_ARRNUMBER) {
+    lua_Number x = lua_tonumberx(L, -1, &isnum);
+    if (isnum) {
+      ((lua_Number *)a->elems)[i] = x;
+      return;
+    }
+  }
+  else {
+    lua_Integer x = lua_tointegerx(L, -1, &isnum);
+    if (isnum) {
+      ((lua_Integer *)a->elems)[i] = x;
+      return;
+    }
+    else if (lua_isnumber(L, -1))
+      luaL_error(L, "bad element #%I in table "
+                    "(number has no integer representation)", j);
+  }
+  luaL_error(L, "bad element #%I in table (number expected, got %s)",
+                j, luaL_typename(L, -1));
+}
+
+
+static int arr_fromtable (lua_State *L) {
+  Array a;
+  lua_Integer i = luaL_optinteger(L, 3, 1);
+  lua_Integer e = luaL_opt(L, luaL_checkinteger, 4, luaL_len(L, 1));
+  lua_Unsigned k, n;
+  luaL_argcheck(L, i > 0 || e < LUA_MAXINTEGER + i, 4, "too many elements");
+  n = (i > e) ? 0 : (lua_Unsigned)e - (lua_Unsigned)i + 1u;
+  newarray(L, &a, getkind(L, 2), (lua_Integer)n);
+  k = 0;
+  if (lua_type(L, 1) == LUA_TTABLE) {
+    if (lua_getmetatable(L, 1))
+      lua_pop(L, 1);  /* accesses may need metamethods */
+    else
+      k = lua_rawgetiarray(L, 1, i, n, a.kind, a.elems);  /* raw fast path */
+  }
+  for (; k < n; k++) {  /* get (or report) remaining elements */
+    lua_geti(L, 1, i + (lua_Integer)k);
+    settabelem(L, &a, k, i + (lua_Integer)k);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
+
+static int arr_totable (lua_State *L) {
+  Array a;
+  lua_Unsigned first, n;
+  checkarray(L, 1, &a);
+  first = getrange(L, &a, 2, &n);
+  luaL_argcheck(L, n < (unsigned int)INT_MAX, 1, "too many elements");
+  lua_createtable(L, (int)n, 0);
+  lua_rawsetiarray(L, -1, 1, n, a.kind, eaddr(&a, first));
+  return 1;
+}
+
+
+static int arr_fill (lua_State *L) {
+  Array a;
+  lua_Unsigned first, n, k;
+  checkarray(L, 1, &a);
+  first = getrange(L, &a, 3, &n);
+  if (n > 0) {
+    setelem(L, &a, first, 2);
+    for (k = 1; k < n; k++)
+      memcpy(eaddr(&a, first + k), eaddr(&a, first), esize(&a));
+  }
+  lua_settop(L, 1);
+  return 1;  /* return the array */
+}
+
+
+/*
+** Copy elements a1[f..e] into a2[t..] (like 'table.move').
+*/
+static int arr_move (lua_State *L) {
+  Array a1, a2;
+  lua_Integer f = luaL_checkinteger(L, 2);
+  lua_Integer e = luaL_checkinteger(L, 3);
+  lua_Integer t = luaL_checkinteger(L, 4);
+  int tt = !lua_isnoneornil(L, 5) ? 5 : 1;  /* destination array */
+  checkarray(L, 1, &a1);
+  checkarray(L, tt, &a2);
+  luaL_argcheck(L, a1.kind == a2.kind, tt, "arrays of different kinds");
+  if (e >= f) {  /* otherwise, nothing to move */
+    lua_Unsigned n, from, to;
+    from = posindex(L, &a1, f, 2, 0);
+    posindex(L, &a1, e, 3, 0);
+    n = (lua_Unsigned)e - (lua_Unsigned)f + 1u;
+    to = posindex(L, &a2, t, 4, 0);
+    luaL_argcheck(L, n <= a2.n - to, 4, "destination wrap around");
+    memmove(eaddr(&a2, to), eaddr(&a1, from), n * esize(&a1));
+  }
+  lua_pushvalue(L, tt);  /* return destination array */
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Bulk operations
+** =======================================================
+*/
+
+/*
+** All loops here run over plain C vectors, with no API calls or type
+** checks inside them, so that the compiler can vectorize them.
+*/
+
+#define numelems(a)	((lua_Number *)(a)->elems)
+#define intelems(a)	((lua_Integer *)(a)->elems)
+
+/* integer arithmetic wraps around, as in Lua */
+#define intop(op,x,y)	((lua_Integer)((lua_Unsigned)(x) op (lua_Unsigned)(y)))
+
+
+/*
+** Float sums use four partial sums, which breaks the dependency between
+** consecutive additions (and usually loses less precision, too).
+*/
+static lua_Number sumnumbers (const lua_Number *v, lua_Unsigned n) {
+  lua_Number s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  lua_Unsigned k;
+  for (k = 0; n - k >= 4; k += 4) {
+    s0 += v[k]; s1 += v[k + 1]; s2 += v[k + 2]; s3 += v[k + 3];
+  }
+  for (; k < n; k++)
+    s0 += v[k];
+  return (s0 + s1) + (s2 + s3);
+}
+
+
+static int arr_sum (lua_State *L) {
+  Array a;
+  lua_Unsigned first, n, k;
+  checkarray(L, 1, &a);
+  first = getrange(L, &a, 2, &n);
+  if (a.kind == LUA_ARRNUMBER)
+    lua_pushnumber(L, sumnumbers(numelems(&a) + first, n));
+  else {
+    const lua_Integer *v = intelems(&a) + first;
+    lua_Unsigned s = 0;
+    for (k = 0; k < n; k++)
+      s += (lua_Unsigned)v[k];
+    lua_pushinteger(L, (lua_Integer)s);
+  }
+  return 1;
+}
+
+
+/*
+** Smallest (or largest, if 'max' is true) element in a range, compared
+** as 'math.min' and 'math.max' compare their arguments; fail if the
+** range is empty.
+*/
+static int minmax (lua_State *L, int max) {
+  Array a;
+  lua_Unsigned first, n, k;
+  checkarray(L, 1, &a);
+  first = getrange(L, &a, 2, &n);
+  if (n == 0)
+    luaL_pushfail(L);
+  else if (a.kind == LUA_ARRNUMBER) {
+    const lua_Number *v = numelems(&a) + first;
+    lua_Number m = v[0];
+    if (max) { for (k = 1; k < n; k++) if (m < v[k]) m = v[k]; }
+    else { for (k = 1; k < n; k++) if (v[k] < m) m = v[k]; }
+    lua_pushnumber(L, m);
+  }
+  else {
+    const lua_Integer *v = intelems(&a) + first;
+    lua_Integer m = v[0];
+    if (max) { for (k = 1; k < n; k++) if (m < v[k]) m = v[k]; }
+    else { for (k = 1; k < n; k++) if (v[k] < m) m = v[k]; }
+    lua_pushinteger(L, m);
+  }
+  return 1;
+}
+
+
+static int arr_min (lua_State *L) {
+  return minmax(L, 0);
+}
+
+
+static int arr_max (lua_State *L) {
+  return minmax(L, 1);
+}
+
+
+/*
+** Dot product of two arrays with the same size: an integer if both are
+** integer arrays, a float otherwise.
+*/
+static int arr_dot (lua_State *L) {
+  Array a, b;
+  lua_Unsigned k;
+  checkarray(L, 1, &a);
+  checkarray(L, 2, &b);
+  luaL_argcheck(L, a.n == b.n, 2, "arrays of different sizes");
+  if (a.kind == LUA_ARRINTEGER && b.kind == LUA_ARRINTEGER) {
+    const lua_Integer *u = intelems(&a), *v = intelems(&b);
+    lua_Unsigned s = 0;
+    for (k = 0; k < a.n; k++)
+      s += (lua_Unsigned)u[k] * (lua_Unsigned)v[k];
+    lua_pushinteger(L, (lua_Integer)s);
+  }
+  else {
+    lua_Number s0 = 0, s1 = 0;
+    if (a.kind == b.kind) {  /* both float arrays? */
+      const lua_Number *u = numelems(&a), *v = numelems(&b);
+      for (k = 0; a.n - k >= 2; k += 2) {
+        s0 += u[k] * v[k];
+        s1 += u[k + 1] * v[k + 1];
+      }
+      if (k < a.n)
+        s0 += u[k] * v[k];
+    }
+    else {  /* one of each kind */
+      const lua_Number *u = numelems(a.kind == LUA_ARRNUMBER ? &a : &b);
+      const lua_Integer *v = intelems(a.kind == LUA_ARRNUMBER ? &b : &a);
+      for (k = 0; k < a.n; k++)
+        s0 += u[k] * (lua_Number)v[k];
+    }
+    lua_pushnumber(L, s0 + s1);
+  }
+  return 1;
+}
+
+
+static const char *const opnames[] = {
+  "neg", "abs", "floor", "ceil", "sqrt", "exp", "log", "sin", "cos",
+  "add", "sub", "mul", "div", "min", "max", NULL};
+
+enum {OPNEG, OPABS, OPFLOOR, OPCEIL, OPSQRT, OPEXP, OPLOG, OPSIN, OPCOS,
+      OPADD, OPSUB, OPMUL, OPDIV, OPMIN, OPMAX};
+
+/* first operation that is not valid for integer arrays */
+#define FIRSTFLTOP	OPSQRT
+
+/* first binary operation */
+#define FIRSTBINOP	OPADD
+
+
+/* assign 'v[k] = e' for all elements, 'x' being the old value */
+#define mapelems(T,v,n,e)  \
+  { T *v_ = (v); lua_Unsigned k; \
+    for (k = 0; k < (n); k++) { T x = v_[k]; v_[k] = (e); } }
+
+
+static void mapnumber (lua_Number *v, lua_Unsigned n, int op) {
+  switch (op) {
+    case OPNEG: mapelems(lua_Number, v, n, -x); break;
+    case OPABS: mapelems(lua_Number, v, n, l_mathop(fabs)(x)); break;
+    case OPFLOOR: mapelems(lua_Number, v, n, l_mathop(floor)(x)); break;
+    case OPCEIL: mapelems(lua_Number, v, n, l_mathop(ceil)(x)); break;
+    case OPSQRT: mapelems(lua_Number, v, n, l_mathop(sqrt)(x)); break;
+    case OPEXP: mapelems(lua_Number, v, n, l_mathop(exp)(x)); break;
+    case OPLOG: mapelems(lua_Number, v, n, l_mathop(log)(x)); break;
+    case OPSIN: mapelems(lua_Number, v, n, l_mathop(sin)(x)); break;
+    case OPCOS: mapelems(lua_Number, v, n, l_mathop(cos)(x)); break;
+  }
+}
+
+
+static void mapinteger (lua_Integer *v, lua_Unsigned n, int op) {
+  switch (op) {
+    case OPNEG: mapelems(lua_Integer, v, n, intop(-, 0, x)); break;
+    case OPABS: mapelems(lua_Integer, v, n, x < 0 ? intop(-, 0, x) : x); break;
+    default: break;  /* floor and ceil do nothing */
+  }
+}
+
+
+/*
+** Binary operations; the second operand is 'y(k)', an element of
+** another array or a constant.
+*/
+#define binnumber(v,n,op,y)  \
+  switch (op) {  \
+    case OPADD: mapelems(lua_Number, v, n, x + y(k)); break;  \
+    case OPSUB: mapelems(lua_Number, v, n, x - y(k)); break;  \
+    case OPMUL: mapelems(lua_Number, v, n, x * y(k)); break;  \
+    case OPDIV: mapelems(lua_Number, v, n, x / y(k)); break;  \
+    case OPMIN: mapelems(lua_Number, v, n, y(k) < x ? y(k) : x); break;  \
+    case OPMAX: mapelems(lua_Number, v, n, x < y(k) ? y(k) : x); break;  \
+  }
+
+#define bininteger(v,n,op,y)  \
+  switch (op) {  \
+    case OPADD: mapelems(lua_Integer, v, n, intop(+, x, y(k))); break;  \
+    case OPSUB: mapelems(lua_Integer, v, n, intop(-, x, y(k))); break;  \
+    case OPMUL: mapelems(lua_Integer, v, n, intop(*, x, y(k))); break;  \
+    case OPMIN: mapelems(lua_Integer, v, n, y(k) < x ? y(k) : x); break;  \
+    case OPMAX: mapelems(lua_Integer, v, n, x < y(k) ? y(k) : x); break;  \
+  }
+
+#define constant(k)	c
+#define element(k)	w[k]
+
+
+/*
+** apply(a, op [, x]): apply the operation 'op' to all elements of
+** 'a', in place; binary operations take as second operand a number
+** or the elements of another array with the same kind and size.
+*/
+static int arr_apply (lua_State *L) {
+  Array a;
+  int op;
+  checkarray(L, 1, &a);
+  op = luaL_checkoption(L, 2, NULL, opnames);
+  luaL_argcheck(L, a.kind == LUA_ARRNUMBER || op < FIRSTFLTOP ||
+                   (op >= FIRSTBINOP && op != OPDIV), 2,
+                   "invalid operation for an integer array");
+  if (op < FIRSTBINOP) {
+    if (a.kind == LUA_ARRNUMBER)
+      mapnumber(numelems(&a), a.n, op);
+    else
+      mapinteger(intelems(&a), a.n, op);
+  }
+  else if (lua_type(L, 3) == LUA_TNUMBER) {  /* constant operand? */
+    if (a.kind == LUA_ARRNUMBER) {
+      lua_Number c = lua_tonumber(L, 3);
+      binnumber(numelems(&a), a.n, op, constant);
+    }
+    else {
+      lua_Integer c = luaL_checkinteger(L, 3);
+      bininteger(intelems(&a), a.n, op, constant);
+    }
+  }
+  else {
+    Array b;
+    checkarray(L, 3, &b);
+    luaL_argcheck(L, a.kind == b.kind, 3, "arrays of different kinds");
+    luaL_argcheck(L, a.n == b.n, 3, "arrays of different sizes");
+    if (a.kind == LUA_ARRNUMBER) {
+      const lua_Number *w = numelems(&b);
+      binnumber(numelems(&a), a.n, op, element);
+    }
+    else {
+      const lua_Integer *w = intelems(&b);
+      bininteger(intelems(&a), a.n, op, element);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;  /* return the array */
+}
+
+/* }====================================================== */
+
+
+static int arr_kind (lua_State *L) {
+  int kind;
+  if (lua_toarray(L, 1, &kind, NULL) == NULL)
+    luaL_pushfail(L);  /* not an array */
+  else
+    lua_pushstring(L, kindnames[kind - 1]);
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Metamethods
+** =======================================================
+*/
+
+/*
+** Only accesses that the VM does not handle directly get here: method
+** names and invalid indices, which give nil.
+*/
+static int arr_index (lua_State *L) {
+  if (lua_type(L, 2) == LUA_TSTRING) {
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));  /* get method */
+  }
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
+
+/*
+** Only invalid assignments get here.
+*/
+static int arr_newindex (lua_State *L) {
+  Array a;
+  int isnum;
+  lua_Integer i = lua_tointegerx(L, 2, &isnum);
+  checkarray(L, 1, &a);
+  if (lua_type(L, 2) != LUA_TNUMBER || !isnum || (lua_Unsigned)i - 1u >= a.n)
+    return luaL_error(L, "array index out of range");
+  else if (lua_type(L, 3) == LUA_TNUMBER)  /* must be a non-integral float */
+    return luaL_error(L, "number has no integer representation");
+  else
+    return luaL_error(L, "number expected, got %s", luaL_typename(L, 3));
+}
+
+
+static int arr_tostring (lua_State *L) {
+  Array a;
+  checkarray(L, 1, &a);
+  lua_pushfstring(L, "array(%s, %I): %p", kindnames[a.kind - 1],
+                     (LUAI_UACINT)a.n, a.elems);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg arr_funcs[] = {
+  {"new", arr_new},
+  {"fromtable", arr_fromtable},
+  {"kind", arr_kind},
+  {"totable", arr_totable},
+  {"fill", arr_fill},
+  {"move", arr_move},
+  {"sum", arr_sum},
+  {"min", arr_min},
+  {"max", arr_max},
+  {"dot", arr_dot},
+  {"apply", arr_apply},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg arr_meta[] = {
+  {"__index", NULL},  /* place holder */
+  {"__newindex", arr_newindex},
+  {"__tostring", arr_tostring},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg arr_methods[] = {
+  {"totable", arr_totable},
+  {"fill", arr_fill},
+  {"move", arr_move},
+  {"sum", arr_sum},
+  {"min", arr_min},
+  {"max", arr_max},
+  {"dot", arr_dot},
+  {"apply", arr_apply},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_array (lua_State *L) {
+  luaL_newlib(L, arr_funcs);
+  luaL_newmetatable(L, ARRAYMT);
+  luaL_setfuncs(L, arr_meta, 0);
+  luaL_newlib(L, arr_methods);
+  lua_pushcclosure(L, arr_index, 1);  /* methods are its upvalue */
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);  /* pop metatable */
+  return 1;
+}
+
@@ -641,6 +641,32 @@ LUALIB_API char *luaL_buffinitsize (lua_State *L, luaL_Buffer *B, size_t sz) {
   return prepbuffsize(B, sz, -1);
 }
 
+/*
+** Return the contents of the string buffer or buffer slice at index
+** 'idx' (and their length in '*len'), or NULL if the value is neither.
+** The result is valid only while the buffer does not change.
+*/
+LUALIB_API const char *luaL_tobuffer (lua_State *L, int idx, size_t *len) {
+  luaL_StrBuf *sb = (luaL_StrBuf *)luaL_testudata(L, idx, LUA_STRBUFHANDLE);
+  if (sb != NULL) {
+    *len = sb->n;
+    return (sb->b != NULL) ? sb->b : "";
+  }
+  else {
+    luaL_StrSlice *sl =
+        (luaL_StrSlice *)luaL_testudata(L, idx, LUA_STRSLICEHANDLE);
+    if (sl == NULL)
+      return NULL;  /* neither a buffer nor a slice */
+    lua_getiuservalue(L, idx, 1);
+    sb = (luaL_StrBuf *)lua_touserdata(L, -1);
+    lua_pop(L, 1);  /* the slice keeps the buffer alive */
+    if (l_unlikely(sb->n < sl->off || sb->n - sl->off < sl->len))
+      luaL_error(L, "slice out of its buffer's range");
+    *len = sl->len;
+    return (sl->len > 0) ? sb->b + sl->off : "";
+  }
+}
+
 /* }====================================================== */
 
 
@@ -1014,6 +1040,143 @@ LUALIB_API const char *luaL_gsub (lua_State *L, const char *s,
 }
 
 
+/*
+** {======================================================
+** Copying values between states
+** =======================================================
+*/
+
+/* maximum nesting of tables in a copied value */
+#if !defined(LUAL_MAXCOPYDEPTH)
+#define LUAL_MAXCOPYDEPTH	200
+#endif
+
+typedef struct CopyState {
+  lua_State *from;
+  int idx;  /* absolute index of the value to be copied in 'from' */
+} CopyState;
+
+
+/*
+** Copy a numeric array, giving it the metatable with the same name
+** in 'to', if there is one.
+*/
+static void copyarray (lua_State *from, lua_State *to, void *elems,
+                       int kind, lua_Unsigned n) {
+  size_t size = (size_t)n * ((kind == LUA_ARRNUMBER) ? sizeof(lua_Number)
+                                                   : sizeof(lua_Integer));
+  memcpy(lua_newarray(to, kind, n), elems, size);
+  if (luaL_getmetafield(from, -1, "__name") != LUA_TNIL) {
+    if (lua_type(from, -1) == LUA_TSTRING)
+      luaL_setmetatable(to, lua_tostring(from, -1));
+    lua_pop(from, 1);  /* remove name */
+  }
+}
+
+
+/*
+** Pushes onto 'to' a copy of the value on the top of 'from', and pops
+** that value. Table 'cache' in 'to' maps each table (or array) already
+** copied to its copy, so that shared parts and cycles are kept.
+*/
+static void copyvalue (lua_State *from, lua_State *to, int cache,
+                       int depth) {
+  switch (lua_type(from, -1)) {
+    case LUA_TNIL: lua_pushnil(to); break;
+    case LUA_TBOOLEAN: lua_pushboolean(to, lua_toboolean(from, -1)); break;
+    case LUA_TLIGHTUSERDATA:
+      lua_pushlightuserdata(to, lua_touserdata(from, -1));
+      break;
+    case LUA_TNUMBER: {
+      if (lua_isinteger(from, -1))
+        lua_pushinteger(to, lua_tointeger(from, -1));
+      else
+        lua_pushnumber(to, lua_tonumber(from, -1));
+      break;
+    }
+    case LUA_TSTRING: {
+      size_t l;
+      const char *s = lua_tolstring(from, -1, &l);
+      lua_pushlstring(to, s, l);
+      break;
+    }
+    case LUA_TTABLE: case LUA_TUSERDATA: {
+      const void *p = lua_topointer(from, -1);
+      int kind;
+      lua_Unsigned n;
+      void *elems;
+      if (lua_rawgetp(to, cache, p) != LUA_TNIL)  /* already copied? */
+        break;  /* keep the copy */
+      lua_pop(to, 1);
+      if (depth >= LUAL_MAXCOPYDEPTH)
+        luaL_error(to, "value too deeply nested to copy");
+      if (!lua_checkstack(from, 3))  /* (errors must be raised in 'to') */
+        luaL_error(to, "too many nested values");
+      luaL_checkstack(to, 4, "too many nested values");
+      elems = lua_toarray(from, -1, &kind, &n);
+      if (elems != NULL)
+        copyarray(from, to, elems, kind, n);
+      else if (lua_type(from, -1) == LUA_TUSERDATA)
+        luaL_error(to, "cannot copy a userdata");
+      else
+        lua_createtable(to, (int)lua_rawlen(from, -1), 0);
+      lua_pushvalue(to, -1);
+      lua_rawsetp(to, cache, p);  /* cache[p] = copy */
+      if (elems == NULL) {  /* a table? copy its contents */
+        lua_pushnil(from);  /* first key */
+        while (lua_next(from, -2)) {
+          lua_pushvalue(from, -2);  /* key */
+          copyvalue(from, to, cache, depth + 1);  /* copy (and pop) key */
+          copyvalue(from, to, cache, depth + 1);  /* copy (and pop) value */
+          lua_rawset(to, -3);
+        }
+      }
+      break;
+    }
+    default:
+      luaL_error(to, "cannot copy a %s", luaL_typename(from, -1));
+  }
+  lua_pop(from, 1);
+}
+
+
+static int pcopy (lua_State *to) {
+  CopyState *cs = (CopyState *)lua_touserdata(to, 1);
+  lua_newtable(to);  /* cache */
+  if (!lua_checkstack(cs->from, 1))
+    luaL_error(to, "cannot copy value");
+  lua_pushvalue(cs->from, cs->idx);
+  copyvalue(cs->from, to, lua_gettop(to), 0);
+  return 1;
+}
+
+
+/*
+** Pushes onto 'to' a deep copy of the value at index 'idx' of 'from'.
+** Tables are copied with all their keys and values, but not their
+** metatables; the copy runs protected in 'to', and returns its status,
+** leaving the error message in 'to' if it fails. (Errors are never
+** raised in 'from', which may not be running a protected call.)
+*/
+LUALIB_API int luaL_copyvalue (lua_State *from, int idx, lua_State *to) {
+  CopyState cs;
+  int top = lua_gettop(from);
+  int status;
+  cs.from = from;
+  cs.idx = lua_absindex(from, idx);
+  luaL_checkstack(to, 2, "cannot copy value");
+  lua_pushcfunction(to, pcopy);
+  lua_pushlightuserdata(to, &cs);
+  status = lua_pcall(to, 1, 1, 0);
+  lua_settop(from, top);  /* remove what an error may have left */
+  return status;
+}
+
+/* }====================================================== */
+
+
+#if !defined(LUAL_ARENA)
+
 static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   (void)ud; (void)osize;  /* not used */
   if (nsize == 0) {
@@ -1024,6 +1187,190 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
     return realloc(ptr, nsize);
 }
 
+#endif
+
+
+/*
+** {======================================================
+** Arena allocator
+** Small blocks (up to ARENA_MAXSMALL bytes) are served from size
+** classes ARENA_GRAIN bytes apart: each class keeps a free list of
+** released blocks, and new blocks are carved from large chunks
+** obtained from 'malloc'. Larger blocks go directly to
+** 'realloc'/'free'. The memory of the chunks is only released when
+** the state is closed (that is, when its last block is freed), which
+** keeps the resident size of long-running states stable.
+** =======================================================
+*/
+
+/* distance between size classes (must respect Lua's alignment) */
+#define ARENA_GRAIN	16
+
+/* number of size classes */
+#define ARENA_NCLASSES	16
+
+/* largest size served from the size classes */
+#define ARENA_MAXSMALL	(ARENA_GRAIN * ARENA_NCLASSES)
+
+/* size of each chunk */
+#define ARENA_CHUNK	(64 * 1024)
+
+/* size class of a small block with 'sz' bytes */
+#define sizeclass(sz)	(((sz) - 1) / ARENA_GRAIN)
+
+
+typedef struct Arena {
+  void *freeblocks[ARENA_NCLASSES];  /* free blocks of each class */
+  char *bump;  /* start of the unused part of the current chunk */
+  char *bumplimit;  /* end of the current chunk */
+  void *chunks;  /* list of all chunks (linked by their first word) */
+  size_t nblocks;  /* number of live blocks */
+  size_t inuse;  /* bytes in live blocks (rounded to their classes) */
+  size_t reserved;  /* bytes obtained from 'malloc' */
+  int owned;  /* true when the arena belongs to a fully built state */
+} Arena;
+
+
+static void arena_release (Arena *a) {
+  void *c = a->chunks;
+  while (c != NULL) {
+    void *next = *(void **)c;
+    free(c);
+    c = next;
+  }
+  free(a);
+}
+
+
+static void *arena_newsmall (Arena *a, int cl) {
+  size_t bsize = (size_t)(cl + 1) * ARENA_GRAIN;
+  void *b = a->freeblocks[cl];
+  if (b != NULL)  /* reuse a free block? */
+    a->freeblocks[cl] = *(void **)b;
+  else {
+    if ((size_t)(a->bumplimit - a->bump) < bsize) {  /* chunk exhausted? */
+      char *c = (char *)malloc(ARENA_CHUNK);
+      if (c == NULL) return NULL;
+      *(void **)c = a->chunks;  /* link new chunk */
+      a->chunks = c;
+      a->reserved += ARENA_CHUNK;
+      a->bump = c + ARENA_GRAIN;  /* first grain keeps the link */
+      a->bumplimit = c + ARENA_CHUNK;
+    }
+    b = a->bump;
+    a->bump += bsize;
+  }
+  a->inuse += bsize;
+  return b;
+}
+
+
+static void arena_freesmall (Arena *a, void *b, int cl) {
+  *(void **)b = a->freeblocks[cl];
+  a->freeblocks[cl] = b;
+  a->inuse -= (size_t)(cl + 1) * ARENA_GRAIN;
+}
+
+
+static void *arena_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Arena *a = (Arena *)ud;
+  void *nb;
+  if (ptr == NULL)
+    osize = 0;  /* 'osize' is not a size here */
+  if (nsize == 0) {  /* free? */
+    if (ptr == NULL) return NULL;
+    if (osize <= ARENA_MAXSMALL)
+      arena_freesmall(a, ptr, sizeclass(osize));
+    else {
+      free(ptr);
+      a->inuse -= osize;
+      a->reserved -= osize;
+    }
+    if (--a->nblocks == 0 && a->owned)  /* state closed? */
+      arena_release(a);
+    return NULL;
+  }
+  else if (nsize <= ARENA_MAXSMALL) {  /* new block is small? */
+    if (ptr != NULL && osize <= ARENA_MAXSMALL &&
+        sizeclass(osize) == sizeclass(nsize))
+      return ptr;  /* same class; nothing to be done */
+    nb = arena_newsmall(a, sizeclass(nsize));
+  }
+  else if (ptr != NULL && osize > ARENA_MAXSMALL) {  /* large to large? */
+    nb = realloc(ptr, nsize);
+    if (nb == NULL) return NULL;
+    a->inuse += nsize - osize;
+    a->reserved += nsize - osize;
+    return nb;
+  }
+  else {  /* new large block */
+    nb = malloc(nsize);
+    if (nb != NULL) {
+      a->inuse += nsize;
+      a->reserved += nsize;
+    }
+  }
+  if (nb == NULL) return NULL;
+  if (ptr == NULL)
+    a->nblocks++;
+  else {  /* move contents to the new block and free the old one */
+    memcpy(nb, ptr, (osize < nsize) ? osize : nsize);
+    if (osize <= ARENA_MAXSMALL)
+      arena_freesmall(a, ptr, sizeclass(osize));
+    else {
+      free(ptr);
+      a->inuse -= osize;
+      a->reserved -= osize;
+    }
+  }
+  return nb;
+}
+
+
+/*
+** Get the statistics of the arena allocator used by state 'L': bytes
+** in live blocks and bytes obtained from the system. (Their difference
+** is the memory lost to fragmentation and free blocks.) Returns 0 if
+** 'L' does not use the arena allocator.
+*/
+LUALIB_API int luaL_arenastats (lua_State *L, size_t *inuse,
+                                              size_t *reserved) {
+  void *ud;
+  Arena *a;
+  if (lua_getallocf(L, &ud) != arena_alloc)
+    return 0;
+  a = (Arena *)ud;
+  *inuse = a->inuse;
+  *reserved = a->reserved;
+  return 1;
+}
+
+
+#if defined(LUAL_ARENA)
+
+static lua_State *arena_newstate (void) {
+  lua_State *L;
+  Arena *a = (Arena *)malloc(sizeof(Arena));
+  int i;
+  if (a == NULL) return NULL;
+  for (i = 0; i < ARENA_NCLASSES; i++)
+    a->freeblocks[i] = NULL;
+  a->bump = a->bumplimit = NULL;
+  a->chunks = NULL;
+  a->nblocks = a->inuse = a->reserved = 0;
+  a->owned = 0;
+  L = lua_newstate(arena_alloc, a);
+  if (L == NULL)  /* state not built? */
+    arena_release(a);  /* arena still belongs to this function */
+  else
+    a->owned = 1;  /* 'lua_close' will release the arena */
+  return L;
+}
+
+#endif
+
+/* }====================================================== */
+
 
 static int panic (lua_State *L) {
   const char *msg = lua_tostring(L, -1);
@@ -1092,7 +1439,11 @@ static void warnfon (void *ud, const char *message, int tocont) {
 
 
 LUALIB_API lua_State *luaL_newstate (void) {
+#if defined(LUAL_ARENA)
+  lua_State *L = arena_newstate();
+#else
   lua_State *L = lua_newstate(l_alloc, NULL);
+#endif
   if (l_likely(L)) {
     lua_atpanic(L, &panic);
     lua_setwarnf(L, warnfoff, L);  /* default is warnings off */
@@ -35,6 +35,10 @@ typedef struct luaL_Buffer luaL_Buffer;
 #define LUA_PRELOAD_TABLE	"_PRELOAD"
 
 
+/* key, in the registry, for the flag telling whether 'print' flushes */
+#define LUA_PRINTFLUSH_KEY	"_PRINTFLUSH"
+
+
 typedef struct luaL_Reg {
   const char *name;
   lua_CFunction func;
@@ -99,6 +103,8 @@ LUALIB_API int (luaL_loadbufferx) (lua_State *L, const char *buff, size_t sz,
 LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
+LUALIB_API int (luaL_arenastats) (lua_State *L, size_t *inuse,
+                                                size_t *reserved);
 
 LUALIB_API lua_Integer (luaL_len) (lua_State *L, int idx);
 
@@ -117,6 +123,8 @@ LUALIB_API void (luaL_traceback) (lua_State *L, lua_State *L1,
 LUALIB_API void (luaL_requiref) (lua_State *L, const char *modname,
                                  lua_CFunction openf, int glb);
 
+LUALIB_API int (luaL_copyvalue) (lua_State *from, int idx, lua_State *to);
+
 /*
 ** ===============================================================
 ** some useful macros
@@ -249,6 +257,41 @@ typedef struct luaL_Stream {
 
 /* }====================================================== */
 
+
+/*
+** {======================================================
+** String buffers (see 'string.buffer')
+** =======================================================
+*/
+
+/*
+** A string buffer is a userdata with metatable 'LUA_STRBUFHANDLE' and
+** structure 'luaL_StrBuf'. A slice of a buffer is a userdata with
+** metatable 'LUA_STRSLICEHANDLE' and structure 'luaL_StrSlice', whose
+** first user value is the buffer.
+*/
+
+#define LUA_STRBUFHANDLE	"string.buffer"
+#define LUA_STRSLICEHANDLE	"string.slice"
+
+
+typedef struct luaL_StrBuf {
+  char *b;  /* storage (NULL when it has none) */
+  size_t size;  /* size of the storage */
+  size_t n;  /* number of bytes in the buffer */
+} luaL_StrBuf;
+
+
+typedef struct luaL_StrSlice {
+  size_t off;  /* offset of the slice in its buffer */
+  size_t len;  /* length of the slice */
+} luaL_StrSlice;
+
+
+LUALIB_API const char *(luaL_tobuffer) (lua_State *L, int idx, size_t *len);
+
+/* }====================================================== */
+
 /*
 ** {==================================================================
 ** "Abstraction Layer" for basic report of messages and errors
@@ -265,6 +308,11 @@ typedef struct luaL_Stream {
 #define lua_writeline()        (lua_writestring("\n", 1), fflush(stdout))
 #endif
 
+/* flush the output of 'print' */
+#if !defined(lua_writeflush)
+#define lua_writeflush()        fflush(stdout)
+#endif
+
 /* print an error message */
 #if !defined(lua_writestringerror)
 #define lua_writestringerror(s,p) \
@@ -250,18 +250,27 @@ int luaB_extends(lua_State *L) {
 
 //----------------------------------------------------------------------------------------------------------------------//
 
+/*
+** 'print' builds the whole line in a buffer and writes it at once.
+** It flushes the output unless the registry field LUA_PRINTFLUSH_KEY
+** is false (see 'file:setvbuf').
+*/
 static int luaB_print (lua_State *L) {
   int n = lua_gettop(L);  /* number of arguments */
   int i;
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
   for (i = 1; i <= n; i++) {  /* for each argument */
-    size_t l;
-    const char *s = luaL_tolstring(L, i, &l);  /* convert it to string */
     if (i > 1)  /* not the first element? */
-      lua_writestring("\t", 1);  /* add a tab before it */
-    lua_writestring(s, l);  /* print it */
-    lua_pop(L, 1);  /* pop result */
+      luaL_addchar(&b, '\t');  /* add a tab before it */
+    luaL_tolstring(L, i, NULL);  /* convert it to string */
+    luaL_addvalue(&b);  /* add it */
   }
-  lua_writeline();
+  luaL_addchar(&b, '\n');
+  lua_writestring(luaL_buffaddr(&b), luaL_bufflen(&b));  /* print it */
+  if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_PRINTFLUSH_KEY) != LUA_TBOOLEAN
+      || lua_toboolean(L, -1))
+    lua_writeflush();
   return 0;
 }
 
@@ -425,15 +434,55 @@ static int pushmode (lua_State *L, int oldmode) {
 */
 #define checkvalres(res) { if (res == -1) break; }
 
+/* options "arena" and "stats" do not correspond to 'lua_gc' options */
+#define GCARENA		(-1)
+#define GCSTATS		(-2)
+
+
+static void pushgcstats (lua_State *L) {
+  static const char *const phases[LUA_GCNPHASES] = {
+    "propagate", "atomic", "sweep", "callfin", "minor", "major"};
+  lua_GCStats s;
+  int i;
+  lua_gcstats(L, &s);
+  lua_createtable(L, 0, 4 + LUA_GCNPHASES);
+  lua_pushinteger(L, (lua_Integer)s.cycles);
+  lua_setfield(L, -2, "cycles");
+  lua_pushinteger(L, (lua_Integer)s.minors);
+  lua_setfield(L, -2, "minors");
+  lua_pushinteger(L, (lua_Integer)s.steps);
+  lua_setfield(L, -2, "steps");
+  lua_pushinteger(L, (lua_Integer)s.freed);
+  lua_setfield(L, -2, "freed");
+  for (i = 0; i < LUA_GCNPHASES; i++) {  /* times, in seconds */
+    lua_pushnumber(L, (lua_Number)s.time[i] / 1e6);
+    lua_setfield(L, -2, phases[i]);
+  }
+}
+
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", "generational", "incremental", NULL};
+    "isrunning", "generational", "incremental", "steptime", "arena",
+    "stats", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC};
+    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC, LUA_GCSTEPTIME, GCARENA,
+    GCSTATS};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   switch (o) {
+    case GCSTATS: {
+      pushgcstats(L);
+      return 1;
+    }
+    case GCARENA: {
+      size_t inuse, reserved;
+      if (!luaL_arenastats(L, &inuse, &reserved))
+        break;  /* state does not use the arena allocator */
+      lua_pushinteger(L, (lua_Integer)inuse);
+      lua_pushinteger(L, (lua_Integer)reserved);
+      return 2;
+    }
     case LUA_GCCOUNT: {
       int k = lua_gc(L, o);
       int b = lua_gc(L, LUA_GCCOUNTB);
@@ -473,6 +522,14 @@ static int luaB_collectgarbage (lua_State *L) {
       int stepsize = (int)luaL_optinteger(L, 4, 0);
       return pushmode(L, lua_gc(L, o, pause, stepmul, stepsize));
     }
+    case LUA_GCSTEPTIME: {
+      int usec = (int)luaL_optinteger(L, 2, 0);
+      int maxgrowth = (int)luaL_optinteger(L, 3, 0);
+      int previous = lua_gc(L, o, usec, maxgrowth);
+      checkvalres(previous);
+      lua_pushinteger(L, previous);
+      return 1;
+    }
     default: {
       int res = lua_gc(L, o);
       checkvalres(res);
@@ -797,5 +854,8 @@ LUAMOD_API int luaopen_base (lua_State *L) {
   /* set global _VERSION */
   lua_pushliteral(L, LUA_VERSION);
   lua_setfield(L, -2, "_VERSION");
+  /* let loops over 'pairs' and 'ipairs' skip calling the iterators */
+  lua_setiterator(L, LUA_ITERNEXT, luaB_next);
+  lua_setiterator(L, LUA_ITERIPAIRS, ipairsaux);
   return 1;
 }
@@ -14,6 +14,7 @@
 #include <limits.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -1143,6 +1144,10 @@ void luaK_goiftrue (FuncState *fs, expdesc *e) {
       pc = NO_JUMP;  /* always true; do nothing */
       break;
     }
+    case VFALSE: {  /* (not nil, whose value may be needed: 'nil and x') */
+      pc = luaK_jump(fs);  /* always false; always jump */
+      break;
+    }
     default: {
       pc = jumponcond(fs, e, 0);  /* jump when false */
       break;
@@ -1169,6 +1174,10 @@ void luaK_goiffalse (FuncState *fs, expdesc *e) {
       pc = NO_JUMP;  /* always false; do nothing */
       break;
     }
+    case VTRUE: {  /* (not other constants, whose values may be needed) */
+      pc = luaK_jump(fs);  /* always true; always jump */
+      break;
+    }
     default: {
       pc = jumponcond(fs, e, 1);  /* jump if true */
       break;
@@ -1836,6 +1845,275 @@ static int finaltarget (Instruction *code, int i) {
 }
 
 
+/*
+** Maximum number of instructions scanned after an OP_NEWTABLE when
+** estimating the number of fields of the new table.
+*/
+#define MAXRECSCAN	128
+
+
+/*
+** Estimate the number of fields of the table created by the
+** OP_NEWTABLE at 'pc', counting the distinct constant keys assigned
+** to it by OP_SETFIELD in the straight-line code that follows, as in
+** 'local o = {}; o.x = 1; o.y = 2'. (Assignments of a constant nil,
+** which create no field, do not count.) Record-like tables built that
+** way then get their hash part allocated once, instead of being rehashed
+** through sizes 1, 2, 4, ... The idiom 'setmetatable({}, mt)' is
+** followed through its call: when the new table is the first argument
+** of a call with one result, the count goes on with that result. (The
+** count is only a size hint; a wrong guess costs only memory.)
+*/
+static int recordsize (Proto *p, int pc, int lastpc) {
+  lu_byte seen[MAXARG_B / 8 + 1];  /* constant keys already counted */
+  int reg = GETARG_A(p->code[pc]);  /* register holding the table */
+  int n = 0;
+  if (lastpc > pc + MAXRECSCAN)
+    lastpc = pc + MAXRECSCAN;
+  memset(seen, 0, sizeof(seen));
+  for (pc += 2; pc < lastpc; pc++) {  /* skip OP_NEWTABLE and extra arg. */
+    Instruction i = p->code[pc];
+    OpCode op = GET_OPCODE(i);
+    if (op == OP_SETFIELD) {
+      int key = GETARG_B(i);
+      if (GETARG_A(i) == reg && !(seen[key / 8] & (1 << (key % 8))) &&
+          !(GETARG_k(i) && ttisnil(&p->k[GETARG_C(i)]))) {
+        seen[key / 8] |= cast_byte(1 << (key % 8));
+        n++;
+      }
+    }
+    else if (op == OP_CALL) {
+      int func = GETARG_A(i);
+      if (func + 1 == reg && GETARG_C(i) == 2)  /* 'f(t, ...)'? */
+        reg = func;  /* go on with the call result */
+      else if (func <= reg)  /* call overwrites the table register? */
+        break;
+    }
+    else if (getOpMode(op) == isJ || testTMode(op) ||
+             (OP_TAILCALL <= op && op <= OP_TFORLOOP))
+      break;  /* not straight-line code anymore */
+    else if ((op == OP_LOADNIL || op == OP_VARARG) && GETARG_A(i) <= reg)
+      break;  /* register may be overwritten */
+    else if (op == OP_SETLIST && GETARG_A(i) < reg)
+      break;  /* table was an item of a list, and its register is free */
+    else if (testAMode(op) &&
+             (GETARG_A(i) == reg || (op == OP_SELF && GETARG_A(i) + 1 == reg)))
+      break;  /* register overwritten */
+  }
+  return n;
+}
+
+
+/*
+** {======================================================
+** Whole-function optimizations
+** =======================================================
+*/
+
+#if LUAI_OPTIMIZE
+
+/*
+** Replace unconditional jumps to a return by a copy of that return.
+** (Jumps that follow a test are part of it and must stay jumps; a
+** return that uses 'top' from the previous instruction cannot move.)
+*/
+static void jumptoreturn (Proto *p, int n) {
+  int i;
+  for (i = 1; i < n; i++) {
+    if (GET_OPCODE(p->code[i]) == OP_JMP &&
+        !testTMode(GET_OPCODE(p->code[i - 1]))) {
+      Instruction ret = p->code[i + 1 + GETARG_sJ(p->code[i])];
+      OpCode op = GET_OPCODE(ret);
+      if ((op == OP_RETURN0 || op == OP_RETURN1 || op == OP_RETURN) &&
+          !isIT(ret))
+        p->code[i] = ret;
+    }
+  }
+}
+
+
+/*
+** Mark the instruction at 'pc' as reachable; return true if it was
+** not marked yet and it is before 'from' (so that another pass over
+** the code is needed).
+*/
+static int markpc (int *mark, int pc, int from) {
+  if (mark[pc])
+    return 0;
+  mark[pc] = 1;
+  return (pc < from);
+}
+
+
+/*
+** Unmark jumps that only skip dead code (including other such jumps),
+** which do nothing. (As in 'jumptoreturn', jumps that are part of a
+** test must stay.)
+*/
+static void unmarknopjumps (Proto *p, int n, int *mark) {
+  int i;
+  for (i = n - 1; i > 0; i--) {
+    Instruction inst = p->code[i];
+    if (mark[i] && GET_OPCODE(inst) == OP_JMP && GETARG_sJ(inst) >= 0 &&
+        !testTMode(GET_OPCODE(p->code[i - 1]))) {
+      int target = i + 1 + GETARG_sJ(inst);
+      int k = i + 1;
+      while (k < target && !mark[k])
+        k++;
+      if (k == target)  /* only dead code between jump and its target? */
+        mark[i] = 0;
+    }
+  }
+}
+
+
+/*
+** Mark all instructions reachable from the first one. Control flows
+** mostly forward, so each pass over the code marks the successors of
+** the instructions already marked; only backward jumps to unmarked
+** code (which are rare) need a new pass.
+*/
+static void markreachable (Proto *p, int n, int *mark) {
+  int again = 1;
+  memset(mark, 0, n * sizeof(int));
+  mark[0] = 1;
+  while (again) {
+    int i;
+    again = 0;
+    for (i = 0; i < n; i++) {
+      Instruction inst = p->code[i];
+      OpCode op = GET_OPCODE(inst);
+      if (!mark[i])
+        continue;
+      switch (op) {
+        case OP_RETURN: case OP_RETURN0: case OP_RETURN1:
+          break;  /* no successors */
+        case OP_JMP:
+          again |= markpc(mark, i + 1 + GETARG_sJ(inst), i);
+          break;
+        case OP_LFALSESKIP:
+          markpc(mark, i + 2, i);
+          break;
+        case OP_FORPREP:
+          markpc(mark, i + 1, i);
+          markpc(mark, i + 2 + GETARG_Bx(inst), i);
+          break;
+        case OP_TFORPREP:
+          markpc(mark, i + 1 + GETARG_Bx(inst), i);
+          break;
+        case OP_FORLOOP: case OP_TFORLOOP:
+          markpc(mark, i + 1, i);
+          again |= markpc(mark, i + 1 - GETARG_Bx(inst), i);
+          break;
+        default:
+          markpc(mark, i + 1, i);
+          if (testTMode(op))  /* test may skip the next jump */
+            markpc(mark, i + 2, i);
+          break;
+      }
+    }
+  }
+}
+
+
+/*
+** Remove unreachable instructions, correcting jump offsets, line
+** information and the ranges of local variables. 'newpc[i]' is the new
+** position of instruction 'i' (or of the first instruction kept after
+** it); 'lines[i]' is its line.
+*/
+static void removedead (FuncState *fs, int *newpc, int *lines) {
+  Proto *f = fs->f;
+  int n = fs->pc;
+  int i, j, ai = 0;
+  int line = f->linedefined;
+  for (i = 0; i < n; i++) {  /* decode line information */
+    if (f->lineinfo[i] != ABSLINEINFO)
+      line += f->lineinfo[i];
+    else {
+      lua_assert(f->abslineinfo[ai].pc == i);
+      line = f->abslineinfo[ai++].line;
+    }
+    lines[i] = line;
+  }
+  for (i = j = 0; i < n; i++) {  /* compute new positions */
+    int keep = newpc[i];
+    newpc[i] = j;
+    j += keep;
+  }
+  newpc[n] = j;
+  fs->pc = 0;
+  fs->previousline = f->linedefined;
+  fs->iwthabs = 0;
+  fs->nabslineinfo = 0;
+  for (i = 0; i < n; i++) {
+    Instruction inst = f->code[i];
+    if (newpc[i + 1] == newpc[i])
+      continue;  /* dead instruction */
+    j = newpc[i];
+    switch (GET_OPCODE(inst)) {
+      case OP_JMP:
+        SETARG_sJ(inst, newpc[i + 1 + GETARG_sJ(inst)] - (j + 1));
+        break;
+      case OP_FORPREP:
+        SETARG_Bx(inst, newpc[i + 2 + GETARG_Bx(inst)] - (j + 2));
+        break;
+      case OP_TFORPREP:
+        SETARG_Bx(inst, newpc[i + 1 + GETARG_Bx(inst)] - (j + 1));
+        break;
+      case OP_FORLOOP: case OP_TFORLOOP:
+        SETARG_Bx(inst, (j + 1) - newpc[i + 1 - GETARG_Bx(inst)]);
+        break;
+      case OP_LFALSESKIP:
+        if (newpc[i + 1] == newpc[i + 2])  /* skipped instruction is dead? */
+          SET_OPCODE(inst, OP_LOADFALSE);  /* no need to skip it */
+        break;
+      default: break;
+    }
+    f->code[j] = inst;
+    fs->pc = j + 1;
+    savelineinfo(fs, f, lines[i]);
+  }
+  for (i = 0; i < fs->ndebugvars; i++) {
+    f->locvars[i].startpc = newpc[f->locvars[i].startpc];
+    f->locvars[i].endpc = newpc[f->locvars[i].endpc];
+  }
+}
+
+
+/*
+** Optimize the code of a whole function: thread jumps to returns and
+** remove unreachable code (such as the final return of a function that
+** ends with a return, or blocks under compile-time false constants)
+** and jumps that do nothing.
+** The scratch arrays live in the lexer buffer, which is not in use
+** when a function is closed and is freed even in case of errors.
+*/
+static void optimize (FuncState *fs) {
+  Proto *p = fs->f;
+  int n = fs->pc;
+  Mbuffer *buff = fs->ls->buff;
+  size_t size = (2 * cast_sizet(n) + 1) * sizeof(int);
+  int *mark;
+  jumptoreturn(p, n);
+  if (luaZ_sizebuffer(buff) < size)
+    luaZ_resizebuffer(fs->ls->L, buff, size);
+  mark = cast(int *, luaZ_buffer(buff));
+  markreachable(p, n, mark);
+  unmarknopjumps(p, n, mark);
+  for (n = 0; n < fs->pc; n++) {
+    if (!mark[n]) {  /* some dead code? */
+      removedead(fs, mark, mark + fs->pc + 1);
+      break;
+    }
+  }
+}
+
+#endif
+
+/* }====================================================== */
+
+
 /*
 ** Do a final pass over the code of a function, doing small peephole
 ** optimizations and adjustments.
@@ -1865,7 +2143,21 @@ void luaK_finish (FuncState *fs) {
         fixjump(fs, i, target);
         break;
       }
+      case OP_NEWTABLE: {
+        /* (a constructor with named fields already sized the table) */
+        int nh = (GETARG_B(*pc) == 0) ? recordsize(p, i, fs->pc) : 0;
+        if (nh > 0) {
+          int rb = luaO_ceillog2(nh) + 1;  /* encoded hash size */
+          if (rb > GETARG_B(*pc))  /* larger than constructor's size? */
+            SETARG_B(*pc, rb);
+        }
+        break;
+      }
       default: break;
     }
   }
+#if LUAI_OPTIMIZE
+  optimize(fs);
+#endif
+  luaP_fuse(p->code, fs->pc);
 }
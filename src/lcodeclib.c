@@ -0,0 +1,1070 @@
+/*
+** $Id: lcodeclib.c $
+** Library for JSON and MessagePack
+** See Copyright Notice in lua.h
+*/
+
+#define lcodeclib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/* maximum nesting of tables in encoded and decoded values */
+#if !defined(LUA_CODECMAXDEPTH)
+#define LUA_CODECMAXDEPTH	1000
+#endif
+
+/*
+** Number of array elements (or pairs of object members) that the JSON
+** decoder keeps in the stack before creating their table, so that
+** small tables are created with their exact sizes.
+*/
+#define DECBATCH	32
+
+
+#define MAX_SIZET	((size_t)(~(size_t)0))
+
+
+/* the value representing JSON's null and MessagePack's nil */
+#define pushnull(L)	lua_pushlightuserdata(L, NULL)
+#define isnull(L,i)	(lua_islightuserdata(L, i) && lua_touserdata(L, i) == NULL)
+
+
+static const union {
+  int dummy;
+  char little;  /* true iff machine is little endian */
+} nativeendian = {1};
+
+
+
+/*
+** {======================================================
+** Output buffer
+** Like a 'luaL_Buffer', but its box has a fixed stack index, so that
+** the encoders can push and pop values (while traversing tables)
+** between additions to the buffer.
+** =======================================================
+*/
+
+typedef struct Buff {
+  lua_State *L;
+  char *b;  /* buffer address */
+  size_t n;  /* number of characters in buffer */
+  size_t size;  /* buffer size */
+  int box;  /* stack index of the userdata holding 'b' */
+  char init[LUAL_BUFFERSIZE];
+} Buff;
+
+
+static void buffinit (lua_State *L, Buff *B) {
+  B->L = L;
+  B->b = B->init;
+  B->n = 0;
+  B->size = sizeof(B->init);
+  lua_pushnil(L);  /* place holder for the box */
+  B->box = lua_gettop(L);
+}
+
+
+/*
+** Ensure room for 'sz' more characters, moving the buffer into a new
+** (larger) userdata when needed. The old one is left to the collector.
+*/
+static char *prepbuff (Buff *B, size_t sz) {
+  if (B->size - B->n < sz) {
+    size_t newsize = B->size * 2;
+    char *newb;
+    if (l_unlikely(MAX_SIZET - sz < B->n))  /* overflow in (B->n + sz)? */
+      luaL_error(B->L, "buffer too large");
+    if (newsize < B->n + sz)
+      newsize = B->n + sz;
+    newb = (char *)lua_newuserdatauv(B->L, newsize, 0);
+    memcpy(newb, B->b, B->n);
+    lua_replace(B->L, B->box);
+    B->b = newb;
+    B->size = newsize;
+  }
+  return B->b + B->n;
+}
+
+
+#define addchar(B,c)  \
+  ((void)((B)->n < (B)->size || prepbuff((B), 1)), ((B)->b[(B)->n++] = (c)))
+
+
+static void addlstring (Buff *B, const char *s, size_t l) {
+  if (l > 0) {
+    memcpy(prepbuff(B, l), s, l);
+    B->n += l;
+  }
+}
+
+
+static void pushresult (Buff *B) {
+  lua_pushlstring(B->L, B->b, B->n);
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** String scanning
+** Both codecs look for the characters that end a run of plain string
+** contents (quote, backslash, and control characters) a word at a
+** time, testing all bytes of the word at once with integer arithmetic.
+** =======================================================
+*/
+
+typedef lua_Unsigned Word;
+
+#define ONES		(~(Word)0 / 0xFF)	/* 0x0101...01 */
+#define HIGHS		(ONES * 0x80)	/* 0x8080...80 */
+
+/* true iff some byte in 'w' is less than 'n' (with 'n' <= 0x80) */
+#define hasless(w,n)	(((w) - ONES * (n)) & ~(w) & HIGHS)
+
+/* true iff some byte in 'w' is equal to 'c' */
+#define hasbyte(w,c)	hasless((w) ^ (ONES * (c)), 1)
+
+#define isspecial(c)	((c) < 0x20 || (c) == '"' || (c) == '\\')
+
+
+/*
+** Return the first special character in [p, e), or 'e' if there is
+** none.
+*/
+static const char *scanstring (const char *p, const char *e) {
+  while (e - p >= (ptrdiff_t)sizeof(Word)) {
+    Word w;
+    memcpy(&w, p, sizeof(Word));
+    if (hasless(w, 0x20) || hasbyte(w, '"') || hasbyte(w, '\\'))
+      break;  /* some special character in this word */
+    p += sizeof(Word);
+  }
+  while (p < e && !isspecial((unsigned char)*p))
+    p++;
+  return p;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Tables
+** =======================================================
+*/
+
+/*
+** Check whether the table at index 'idx' is a non-empty sequence
+** without holes (its keys are exactly 1..#t); if so, set '*n' to its
+** length. Traversal is raw, as for all other table accesses here.
+*/
+static int isarray (lua_State *L, int idx, lua_Unsigned *n) {
+  lua_Unsigned len = lua_rawlen(L, idx);
+  lua_Unsigned count = 0;
+  if (len == 0)
+    return 0;  /* empty tables are objects */
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    lua_Integer k;
+    lua_pop(L, 1);  /* remove value */
+    if (!lua_isinteger(L, -1) ||
+        (k = lua_tointeger(L, -1)) < 1 || (lua_Unsigned)k > len) {
+      lua_pop(L, 1);  /* remove key */
+      return 0;
+    }
+    count++;
+  }
+  *n = len;
+  return (count == len);
+}
+
+
+static void enterlevel (lua_State *L, int depth, int slots) {
+  if (l_unlikely(depth >= LUA_CODECMAXDEPTH))
+    luaL_error(L, "value nested too deeply (cyclic table?)");
+  luaL_checkstack(L, slots, "value nested too deeply");
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** JSON encoder
+** =======================================================
+*/
+
+static void addinteger (Buff *B, lua_Integer i) {
+  char buff[3 * sizeof(lua_Integer) + 1];
+  char *p = buff + sizeof(buff);
+  lua_Unsigned u = (i < 0) ? 0u - (lua_Unsigned)i : (lua_Unsigned)i;
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (i < 0)
+    *--p = '-';
+  addlstring(B, p, (size_t)(buff + sizeof(buff) - p));
+}
+
+
+/*
+** Floats use the same conversion as 'tostring', whose fast path covers
+** short decimals. When that conversion would not read back as the same
+** float, they use all the digits needed to round-trip.
+*/
+static void addfloat (Buff *B, int idx) {
+  lua_State *L = B->L;
+  lua_Number n = lua_tonumber(L, idx);
+  int top = lua_gettop(L);
+  size_t l;
+  const char *s;
+  if (l_unlikely(n != n || n - n != 0))  /* NaN or inf? */
+    luaL_error(L, "cannot encode %s in JSON", (n != n) ? "NaN" : "inf");
+  lua_pushvalue(L, idx);
+  s = lua_tolstring(L, -1, &l);
+  if (lua_stringtonumber(L, s) == 0 || lua_tonumber(L, -1) != n) {
+    char buff[32];
+    int len = l_sprintf(buff, sizeof(buff), "%.17g", (double)n);
+    addlstring(B, buff, (size_t)len);
+  }
+  else
+    addlstring(B, s, l);
+  lua_settop(L, top);
+}
+
+
+static void addescape (Buff *B, int c) {
+  addchar(B, '\\');
+  switch (c) {
+    case '"': case '\\': addchar(B, c); break;
+    case '\b': addchar(B, 'b'); break;
+    case '\f': addchar(B, 'f'); break;
+    case '\n': addchar(B, 'n'); break;
+    case '\r': addchar(B, 'r'); break;
+    case '\t': addchar(B, 't'); break;
+    default: {  /* other control characters */
+      static const char hex[] = "0123456789abcdef";
+      char buff[5];
+      buff[0] = 'u'; buff[1] = '0'; buff[2] = '0';
+      buff[3] = hex[c >> 4]; buff[4] = hex[c & 0xF];
+      addlstring(B, buff, sizeof(buff));
+      break;
+    }
+  }
+}
+
+
+static void addjsonstring (Buff *B, const char *s, size_t l) {
+  const char *e = s + l;
+  addchar(B, '"');
+  for (;;) {
+    const char *q = scanstring(s, e);
+    addlstring(B, s, (size_t)(q - s));
+    if (q == e) break;
+    addescape(B, (unsigned char)*q);
+    s = q + 1;
+  }
+  addchar(B, '"');
+}
+
+
+/* object keys are strings; numbers are converted to strings */
+static void addjsonkey (Buff *B, int idx) {
+  lua_State *L = B->L;
+  size_t l;
+  const char *s;
+  switch (lua_type(L, idx)) {
+    case LUA_TSTRING:
+      s = lua_tolstring(L, idx, &l);
+      addjsonstring(B, s, l);
+      break;
+    case LUA_TNUMBER:
+      addchar(B, '"');
+      if (lua_isinteger(L, idx))
+        addinteger(B, lua_tointeger(L, idx));
+      else
+        addfloat(B, idx);
+      addchar(B, '"');
+      break;
+    default:
+      luaL_error(L, "cannot encode %s key in JSON", luaL_typename(L, idx));
+  }
+}
+
+
+static void encjson (Buff *B, int idx, int depth) {
+  lua_State *L = B->L;
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+      addlstring(B, "null", 4);
+      break;
+    case LUA_TBOOLEAN:
+      if (lua_toboolean(L, idx))
+        addlstring(B, "true", 4);
+      else
+        addlstring(B, "false", 5);
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, idx))
+        addinteger(B, lua_tointeger(L, idx));
+      else
+        addfloat(B, idx);
+      break;
+    case LUA_TSTRING: {
+      size_t l;
+      const char *s = lua_tolstring(L, idx, &l);
+      addjsonstring(B, s, l);
+      break;
+    }
+    case LUA_TTABLE: {
+      lua_Unsigned n, i;
+      enterlevel(L, depth, 6);
+      if (isarray(L, idx, &n)) {
+        addchar(B, '[');
+        for (i = 1; i <= n; i++) {
+          if (i > 1) addchar(B, ',');
+          lua_rawgeti(L, idx, (lua_Integer)i);
+          encjson(B, lua_gettop(L), depth + 1);
+          lua_pop(L, 1);
+        }
+        addchar(B, ']');
+      }
+      else {
+        int first = 1;
+        addchar(B, '{');
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+          if (!first) addchar(B, ',');
+          first = 0;
+          addjsonkey(B, lua_gettop(L) - 1);
+          addchar(B, ':');
+          encjson(B, lua_gettop(L), depth + 1);
+          lua_pop(L, 1);  /* remove value; keep key for next iteration */
+        }
+        addchar(B, '}');
+      }
+      break;
+    }
+    default:
+      if (isnull(L, idx))
+        addlstring(B, "null", 4);
+      else
+        luaL_error(L, "cannot encode %s in JSON", luaL_typename(L, idx));
+  }
+}
+
+
+static int json_encode (lua_State *L) {
+  Buff B;
+  luaL_checkany(L, 1);
+  lua_settop(L, 1);
+  buffinit(L, &B);
+  encjson(&B, 1, 0);
+  pushresult(&B);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Decoders
+** =======================================================
+*/
+
+typedef struct Dec {
+  lua_State *L;
+  const char *s;  /* start of input */
+  const char *p;  /* current position */
+  const char *e;  /* end of input */
+} Dec;
+
+
+static int decerror (Dec *d, const char *msg) {
+  return luaL_error(d->L, "%s at position %I", msg,
+                   (LUAI_UACINT)(d->p - d->s + 1));
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** JSON decoder
+** Lua strings always have a '\0' after their contents, so the decoder
+** can look at '*p' when 'p' is at the end of the input: the '\0' does
+** not match anything it expects.
+** =======================================================
+*/
+
+static void decjson (Dec *d, int depth);
+
+
+static int skipspace (Dec *d) {
+  const char *p = d->p;
+  while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')
+    p++;
+  d->p = p;
+  return (p < d->e) ? (unsigned char)*p : -1;
+}
+
+
+static void expect (Dec *d, const char *word, size_t l) {
+  if ((size_t)(d->e - d->p) < l || memcmp(d->p, word, l) != 0)
+    decerror(d, "invalid literal");
+  d->p += l;
+}
+
+
+static int hexvalue (Dec *d, const char *p) {
+  int i, r = 0;
+  for (i = 0; i < 4; i++) {
+    int c = (unsigned char)p[i];
+    r <<= 4;
+    if ('0' <= c && c <= '9') r += c - '0';
+    else if ('a' <= (c | 0x20) && (c | 0x20) <= 'f') r += (c | 0x20) - 'a' + 10;
+    else decerror(d, "invalid unicode escape");
+  }
+  return r;
+}
+
+
+static void addutf8 (luaL_Buffer *b, unsigned long x) {
+  if (x < 0x80)
+    luaL_addchar(b, (char)x);
+  else if (x < 0x800) {
+    luaL_addchar(b, (char)(0xC0 | (x >> 6)));
+    luaL_addchar(b, (char)(0x80 | (x & 0x3F)));
+  }
+  else if (x < 0x10000) {
+    luaL_addchar(b, (char)(0xE0 | (x >> 12)));
+    luaL_addchar(b, (char)(0x80 | ((x >> 6) & 0x3F)));
+    luaL_addchar(b, (char)(0x80 | (x & 0x3F)));
+  }
+  else {
+    luaL_addchar(b, (char)(0xF0 | (x >> 18)));
+    luaL_addchar(b, (char)(0x80 | ((x >> 12) & 0x3F)));
+    luaL_addchar(b, (char)(0x80 | ((x >> 6) & 0x3F)));
+    luaL_addchar(b, (char)(0x80 | (x & 0x3F)));
+  }
+}
+
+
+/* read a '\u' escape at 'd->p' (after the backslash) */
+static unsigned long decunicode (Dec *d) {
+  unsigned long x;
+  if (d->e - d->p < 5)
+    decerror(d, "invalid unicode escape");
+  x = (unsigned long)(hexvalue(d, d->p + 1));
+  d->p += 5;
+  if (0xD800 <= x && x <= 0xDBFF) {  /* high surrogate? */
+    unsigned long lo;
+    if (d->e - d->p < 6 || d->p[0] != '\\' || d->p[1] != 'u')
+      decerror(d, "invalid unicode escape");
+    lo = (unsigned long)(hexvalue(d, d->p + 2));
+    if (!(0xDC00 <= lo && lo <= 0xDFFF))
+      decerror(d, "invalid unicode escape");
+    d->p += 6;
+    x = 0x10000 + ((x - 0xD800) << 10) + (lo - 0xDC00);
+  }
+  else if (0xDC00 <= x && x <= 0xDFFF)  /* lone low surrogate? */
+    decerror(d, "invalid unicode escape");
+  return x;
+}
+
+
+/*
+** Strings without escapes, the common case, are pushed directly from
+** the input; only strings with escapes go through a buffer.
+*/
+static void decstring (Dec *d) {
+  lua_State *L = d->L;
+  const char *p = d->p + 1;  /* skip opening quote */
+  const char *q = scanstring(p, d->e);
+  luaL_Buffer b;
+  if (q < d->e && *q == '"') {  /* no escapes? */
+    lua_pushlstring(L, p, (size_t)(q - p));
+    d->p = q + 1;
+    return;
+  }
+  luaL_buffinit(L, &b);
+  for (;;) {
+    luaL_addlstring(&b, p, (size_t)(q - p));
+    d->p = q;
+    if (q == d->e)
+      decerror(d, "unfinished string");
+    else if (*q == '"')
+      break;
+    else if (*q != '\\')
+      decerror(d, "control character in string");
+    switch (q[1]) {
+      case '"': case '\\': case '/': luaL_addchar(&b, q[1]); break;
+      case 'b': luaL_addchar(&b, '\b'); break;
+      case 'f': luaL_addchar(&b, '\f'); break;
+      case 'n': luaL_addchar(&b, '\n'); break;
+      case 'r': luaL_addchar(&b, '\r'); break;
+      case 't': luaL_addchar(&b, '\t'); break;
+      case 'u': {
+        d->p = q + 1;
+        addutf8(&b, decunicode(d));
+        p = d->p;
+        q = scanstring(p, d->e);
+        continue;
+      }
+      default: decerror(d, "invalid escape sequence");
+    }
+    p = q + 2;
+    q = scanstring(p, d->e);
+  }
+  luaL_pushresult(&b);
+  d->p = q + 1;  /* skip closing quote */
+}
+
+
+#define isdigit(c)	((unsigned)((c) - '0') < 10u)
+
+/*
+** Integer numerals with up to this many digits cannot overflow a
+** lua_Integer and are converted directly.
+*/
+#define MAXINTDIGITS	((int)(sizeof(lua_Integer) * CHAR_BIT * 3 / 10) - 1)
+
+/*
+** Numerals follow JSON's grammar. Short integers are converted here;
+** other numerals go through 'lua_stringtonumber', which has its own
+** fast path.
+*/
+static void decnumber (Dec *d) {
+  const char *p = d->p;
+  int isint = 1;
+  size_t len;
+  if (*p == '-') p++;
+  if (*p == '0') p++;
+  else if (isdigit(*p)) {
+    while (isdigit(*p)) p++;
+  }
+  else
+    decerror(d, "invalid number");
+  if (*p == '.') {
+    isint = 0;
+    if (!isdigit(*++p)) decerror(d, "invalid number");
+    while (isdigit(*p)) p++;
+  }
+  if (*p == 'e' || *p == 'E') {
+    isint = 0;
+    p++;
+    if (*p == '+' || *p == '-') p++;
+    if (!isdigit(*p)) decerror(d, "invalid number");
+    while (isdigit(*p)) p++;
+  }
+  len = (size_t)(p - d->p);
+  if (isint && len <= MAXINTDIGITS) {
+    const char *s = d->p;
+    lua_Integer i = 0;
+    int neg = (*s == '-');
+    for (s += neg; s < p; s++)
+      i = i * 10 + (*s - '0');
+    lua_pushinteger(d->L, neg ? -i : i);
+  }
+  else {
+    char buff[200];  /* same limit as the core's 'L_MAXLENNUM' */
+    if (len >= sizeof(buff))
+      decerror(d, "numeral too long");
+    memcpy(buff, d->p, len);
+    buff[len] = '\0';
+    if (lua_stringtonumber(d->L, buff) == 0)
+      decerror(d, "invalid number");
+  }
+  d->p = p;
+}
+
+
+/* move the 'n' values at the top into the table just below them */
+static void setarray (lua_State *L, int n, lua_Integer i) {
+  int t = lua_gettop(L) - n;
+  for (; n > 0; n--)
+    lua_rawseti(L, t, i + n);
+}
+
+
+static void decarray (Dec *d, int depth) {
+  lua_State *L = d->L;
+  lua_Integer i = 0;  /* number of elements already in the table */
+  int n = 0;  /* number of elements in the stack */
+  int t = 0;  /* stack index of the table (0 while not created) */
+  enterlevel(L, depth, DECBATCH + LUA_MINSTACK);
+  d->p++;  /* skip '[' */
+  if (skipspace(d) == ']') {
+    d->p++;
+    lua_createtable(L, 0, 0);
+    return;
+  }
+  for (;;) {
+    decjson(d, depth + 1);
+    if (t != 0)
+      lua_rawseti(L, t, ++i);
+    else if (++n == DECBATCH) {  /* too many to wait for the end? */
+      lua_createtable(L, 2 * DECBATCH, 0);
+      lua_insert(L, -(n + 1));
+      t = lua_gettop(L) - n;
+      setarray(L, n, 0);
+      i = n;
+    }
+    switch (skipspace(d)) {
+      case ',': d->p++; break;
+      case ']': {
+        d->p++;
+        if (t == 0) {  /* all elements in the stack? */
+          lua_createtable(L, n, 0);
+          lua_insert(L, -(n + 1));
+          setarray(L, n, 0);
+        }
+        return;
+      }
+      default: decerror(d, "',' or ']' expected");
+    }
+  }
+}
+
+
+/* set the 'n' pairs at the top, in order, into the table below them */
+static void setobject (lua_State *L, int n) {
+  int t = lua_gettop(L) - 2 * n;
+  int i;
+  for (i = 1; i <= n; i++) {
+    lua_pushvalue(L, t + 2 * i - 1);
+    lua_pushvalue(L, t + 2 * i);
+    lua_rawset(L, t);
+  }
+  lua_settop(L, t);
+}
+
+
+static void decobject (Dec *d, int depth) {
+  lua_State *L = d->L;
+  int n = 0;  /* number of pairs in the stack */
+  int t = 0;  /* stack index of the table (0 while not created) */
+  enterlevel(L, depth, 2 * DECBATCH + LUA_MINSTACK);
+  d->p++;  /* skip '{' */
+  if (skipspace(d) == '}') {
+    d->p++;
+    lua_createtable(L, 0, 0);
+    return;
+  }
+  for (;;) {
+    if (skipspace(d) != '"')
+      decerror(d, "string expected");
+    decstring(d);
+    if (skipspace(d) != ':')
+      decerror(d, "':' expected");
+    d->p++;
+    decjson(d, depth + 1);
+    if (t != 0)
+      lua_rawset(L, t);
+    else if (++n == DECBATCH) {  /* too many to wait for the end? */
+      lua_createtable(L, 0, 2 * DECBATCH);
+      lua_insert(L, -(2 * n + 1));
+      t = lua_gettop(L) - 2 * n;
+      setobject(L, n);
+    }
+    switch (skipspace(d)) {
+      case ',': d->p++; break;
+      case '}': {
+        d->p++;
+        if (t == 0) {  /* all pairs in the stack? */
+          lua_createtable(L, 0, n);
+          lua_insert(L, -(2 * n + 1));
+          setobject(L, n);
+        }
+        return;
+      }
+      default: decerror(d, "',' or '}' expected");
+    }
+  }
+}
+
+
+static void decjson (Dec *d, int depth) {
+  switch (skipspace(d)) {
+    case '{': decobject(d, depth); break;
+    case '[': decarray(d, depth); break;
+    case '"': decstring(d); break;
+    case 't': expect(d, "true", 4); lua_pushboolean(d->L, 1); break;
+    case 'f': expect(d, "false", 5); lua_pushboolean(d->L, 0); break;
+    case 'n': expect(d, "null", 4); pushnull(d->L); break;
+    case -1: decerror(d, "unexpected end of input"); break;
+    default: decnumber(d); break;
+  }
+}
+
+
+static int json_decode (lua_State *L) {
+  size_t l;
+  Dec d;
+  d.L = L;
+  d.s = d.p = luaL_checklstring(L, 1, &l);
+  d.e = d.s + l;
+  decjson(&d, 0);
+  if (skipspace(&d) != -1)
+    decerror(&d, "unexpected character");
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** MessagePack encoder
+** =======================================================
+*/
+
+/* add the 'size' lower bytes of 'u', big endian, after byte 'tag' */
+static void addtagged (Buff *B, int tag, lua_Unsigned u, int size) {
+  char *p = prepbuff(B, (size_t)size + 1);
+  int i;
+  p[0] = (char)tag;
+  for (i = size; i > 0; i--) {
+    p[i] = (char)(u & 0xFF);
+    u >>= 8;
+  }
+  B->n += (size_t)size + 1;
+}
+
+
+/* add a header with a length 'n', using the smallest of three forms */
+static void addheader (Buff *B, lua_Unsigned n, int fix, lua_Unsigned fixmax,
+                       int tag16) {
+  lua_State *L = B->L;
+  if (n <= fixmax)
+    addchar(B, (char)(fix | (int)n));
+  else if (n <= 0xFFFFu)
+    addtagged(B, tag16, n, 2);
+  else if (n <= 0xFFFFFFFFu)
+    addtagged(B, tag16 + 1, n, 4);  /* 32-bit form follows the 16-bit */
+  else
+    luaL_error(L, "value too large for MessagePack");
+}
+
+
+static void addmpinteger (Buff *B, lua_Integer i) {
+  if (i >= 0) {
+    lua_Unsigned u = (lua_Unsigned)i;
+    if (u <= 0x7F) addchar(B, (char)u);
+    else if (u <= 0xFF) addtagged(B, 0xCC, u, 1);
+    else if (u <= 0xFFFF) addtagged(B, 0xCD, u, 2);
+    else if (u <= 0xFFFFFFFFu) addtagged(B, 0xCE, u, 4);
+    else addtagged(B, 0xCF, u, 8);
+  }
+  else if (i >= -32) addchar(B, (char)(0xE0 | (i & 0x1F)));
+  else if (i >= -0x80) addtagged(B, 0xD0, (lua_Unsigned)i, 1);
+  else if (i >= -0x8000) addtagged(B, 0xD1, (lua_Unsigned)i, 2);
+  else if (i >= -(lua_Integer)0x7FFFFFFF - 1) addtagged(B, 0xD2, (lua_Unsigned)i, 4);
+  else addtagged(B, 0xD3, (lua_Unsigned)i, 8);
+}
+
+
+/* floats go as 64-bit IEEE doubles */
+static void addmpfloat (Buff *B, lua_Number n) {
+  double x = (double)n;
+  char bytes[sizeof(double)];
+  char *p = prepbuff(B, sizeof(double) + 1);
+  int i;
+  memcpy(bytes, &x, sizeof(double));
+  *p++ = (char)0xCB;
+  for (i = 0; i < (int)sizeof(double); i++)
+    p[i] = bytes[nativeendian.little ? (int)sizeof(double) - 1 - i : i];
+  B->n += sizeof(double) + 1;
+}
+
+
+static void encmp (Buff *B, int idx, int depth) {
+  lua_State *L = B->L;
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+      addchar(B, (char)0xC0);
+      break;
+    case LUA_TBOOLEAN:
+      addchar(B, (char)(lua_toboolean(L, idx) ? 0xC3 : 0xC2));
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, idx))
+        addmpinteger(B, lua_tointeger(L, idx));
+      else
+        addmpfloat(B, lua_tonumber(L, idx));
+      break;
+    case LUA_TSTRING: {
+      size_t l;
+      const char *s = lua_tolstring(L, idx, &l);
+      if (l <= 0xFF && l > 31)
+        addtagged(B, 0xD9, l, 1);
+      else
+        addheader(B, l, 0xA0, 31, 0xDA);
+      addlstring(B, s, l);
+      break;
+    }
+    case LUA_TTABLE: {
+      lua_Unsigned n, i;
+      enterlevel(L, depth, 6);
+      if (isarray(L, idx, &n)) {
+        addheader(B, n, 0x90, 15, 0xDC);
+        for (i = 1; i <= n; i++) {
+          lua_rawgeti(L, idx, (lua_Integer)i);
+          encmp(B, lua_gettop(L), depth + 1);
+          lua_pop(L, 1);
+        }
+      }
+      else {
+        n = 0;
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+          lua_pop(L, 1);
+          n++;
+        }
+        addheader(B, n, 0x80, 15, 0xDE);
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+          encmp(B, lua_gettop(L) - 1, depth + 1);
+          encmp(B, lua_gettop(L), depth + 1);
+          lua_pop(L, 1);  /* remove value; keep key for next iteration */
+        }
+      }
+      break;
+    }
+    default:
+      if (isnull(L, idx))
+        addchar(B, (char)0xC0);
+      else
+        luaL_error(L, "cannot encode %s in MessagePack",
+                      luaL_typename(L, idx));
+  }
+}
+
+
+static int mp_encode (lua_State *L) {
+  Buff B;
+  luaL_checkany(L, 1);
+  lua_settop(L, 1);
+  buffinit(L, &B);
+  encmp(&B, 1, 0);
+  pushresult(&B);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** MessagePack decoder
+** =======================================================
+*/
+
+static void decmp (Dec *d, int depth);
+
+
+static const char *need (Dec *d, size_t n) {
+  const char *p = d->p;
+  if ((size_t)(d->e - p) < n)
+    decerror(d, "truncated data");
+  d->p += n;
+  return p;
+}
+
+
+/* read a big-endian unsigned integer with 'size' bytes */
+static lua_Unsigned getuint (Dec *d, int size) {
+  const unsigned char *p = (const unsigned char *)need(d, (size_t)size);
+  lua_Unsigned u = 0;
+  int i;
+  for (i = 0; i < size; i++)
+    u = (u << 8) | p[i];
+  return u;
+}
+
+
+/* read a signed integer with 'size' bytes */
+static lua_Integer getint (Dec *d, int size) {
+  lua_Unsigned u = getuint(d, size);
+  if (size < (int)sizeof(lua_Integer)) {  /* extend sign */
+    lua_Unsigned mask = (lua_Unsigned)1 << (size * 8 - 1);
+    u = (u ^ mask) - mask;
+  }
+  return (lua_Integer)u;
+}
+
+
+static void getfloat (Dec *d, void *x, int size) {
+  const char *p = need(d, (size_t)size);
+  char *q = (char *)x;
+  int i;
+  for (i = 0; i < size; i++)
+    q[i] = p[nativeendian.little ? size - 1 - i : i];
+}
+
+
+static void mpstring (Dec *d, lua_Unsigned l) {
+  if (l > (lua_Unsigned)(d->e - d->p))
+    decerror(d, "truncated data");
+  lua_pushlstring(d->L, need(d, (size_t)l), (size_t)l);
+}
+
+
+static void mparray (Dec *d, lua_Unsigned n, int depth) {
+  lua_State *L = d->L;
+  lua_Unsigned i;
+  if (n > (lua_Unsigned)(d->e - d->p))  /* each element has >= 1 byte */
+    decerror(d, "truncated data");
+  enterlevel(L, depth, LUA_MINSTACK);
+  lua_createtable(L, (n <= INT_MAX) ? (int)n : INT_MAX, 0);
+  for (i = 1; i <= n; i++) {
+    decmp(d, depth + 1);
+    lua_rawseti(L, -2, (lua_Integer)i);
+  }
+}
+
+
+static void mpmap (Dec *d, lua_Unsigned n, int depth) {
+  lua_State *L = d->L;
+  lua_Unsigned i;
+  if (n > (lua_Unsigned)(d->e - d->p) / 2)  /* each pair has >= 2 bytes */
+    decerror(d, "truncated data");
+  enterlevel(L, depth, LUA_MINSTACK);
+  lua_createtable(L, 0, (n <= INT_MAX) ? (int)n : INT_MAX);
+  for (i = 0; i < n; i++) {
+    decmp(d, depth + 1);
+    decmp(d, depth + 1);
+    lua_rawset(L, -3);
+  }
+}
+
+
+static void decmp (Dec *d, int depth) {
+  lua_State *L = d->L;
+  int c = (unsigned char)*need(d, 1);
+  if (c <= 0x7F)
+    lua_pushinteger(L, c);
+  else if (c >= 0xE0)
+    lua_pushinteger(L, c - 0x100);
+  else if (c <= 0x8F)
+    mpmap(d, (lua_Unsigned)(c & 0x0F), depth);
+  else if (c <= 0x9F)
+    mparray(d, (lua_Unsigned)(c & 0x0F), depth);
+  else if (c <= 0xBF)
+    mpstring(d, (lua_Unsigned)(c & 0x1F));
+  else switch (c) {
+    case 0xC0: pushnull(L); break;
+    case 0xC2: lua_pushboolean(L, 0); break;
+    case 0xC3: lua_pushboolean(L, 1); break;
+    case 0xC4: case 0xD9: mpstring(d, getuint(d, 1)); break;
+    case 0xC5: case 0xDA: mpstring(d, getuint(d, 2)); break;
+    case 0xC6: case 0xDB: mpstring(d, getuint(d, 4)); break;
+    case 0xCA: {
+      float x;
+      getfloat(d, &x, (int)sizeof(x));
+      lua_pushnumber(L, (lua_Number)x);
+      break;
+    }
+    case 0xCB: {
+      double x;
+      getfloat(d, &x, (int)sizeof(x));
+      lua_pushnumber(L, (lua_Number)x);
+      break;
+    }
+    case 0xCC: lua_pushinteger(L, (lua_Integer)(getuint(d, 1))); break;
+    case 0xCD: lua_pushinteger(L, (lua_Integer)(getuint(d, 2))); break;
+    case 0xCE: lua_pushinteger(L, (lua_Integer)(getuint(d, 4))); break;
+    case 0xCF: {
+      lua_Unsigned u = getuint(d, 8);
+      if (u <= (lua_Unsigned)LUA_MAXINTEGER)
+        lua_pushinteger(L, (lua_Integer)u);
+      else  /* does not fit in an integer */
+        lua_pushnumber(L, (lua_Number)u);
+      break;
+    }
+    case 0xD0: lua_pushinteger(L, getint(d, 1)); break;
+    case 0xD1: lua_pushinteger(L, getint(d, 2)); break;
+    case 0xD2: lua_pushinteger(L, getint(d, 4)); break;
+    case 0xD3: lua_pushinteger(L, getint(d, 8)); break;
+    case 0xDC: mparray(d, getuint(d, 2), depth); break;
+    case 0xDD: mparray(d, getuint(d, 4), depth); break;
+    case 0xDE: mpmap(d, getuint(d, 2), depth); break;
+    case 0xDF: mpmap(d, getuint(d, 4), depth); break;
+    default:
+      d->p--;
+      decerror(d, (c == 0xC1) ? "invalid byte" : "extension types not supported");
+  }
+}
+
+
+static int mp_decode (lua_State *L) {
+  size_t l;
+  lua_Integer pos = luaL_optinteger(L, 2, 1);
+  Dec d;
+  d.L = L;
+  d.s = luaL_checklstring(L, 1, &l);
+  d.e = d.s + l;
+  luaL_argcheck(L, 1 <= pos && (lua_Unsigned)pos - 1u <= l, 2,
+                   "initial position out of string");
+  d.p = d.s + pos - 1;
+  decmp(&d, 0);
+  lua_pushinteger(L, (lua_Integer)(d.p - d.s) + 1);  /* next position */
+  return 2;
+}
+
+/* }====================================================== */
+
+
+static const luaL_Reg json_funcs[] = {
+  {"encode", json_encode},
+  {"decode", json_decode},
+  {"null", NULL},  /* place holder */
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg mp_funcs[] = {
+  {"encode", mp_encode},
+  {"decode", mp_decode},
+  {"null", NULL},  /* place holder */
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_json (lua_State *L) {
+  luaL_newlib(L, json_funcs);
+  pushnull(L);
+  lua_setfield(L, -2, "null");
+  return 1;
+}
+
+
+LUAMOD_API int luaopen_msgpack (lua_State *L) {
+  luaL_newlib(L, mp_funcs);
+  pushnull(L);
+  lua_setfield(L, -2, "null");
+  return 1;
+}
+
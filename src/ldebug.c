@@ -27,6 +27,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
+#include "lundump.h"
 #include "lvm.h"
 
 
@@ -95,7 +96,8 @@ int luaG_getfuncline (const Proto *f, int pc) {
 }
 
 
-static int getcurrentline (CallInfo *ci) {
+static int getcurrentline (lua_State *L, CallInfo *ci) {
+  luaU_checkdebug(L, ci_func(ci)->p);
   return luaG_getfuncline(ci_func(ci)->p, currentpc(ci));
 }
 
@@ -142,6 +144,119 @@ LUA_API void lua_sethook (lua_State *L, lua_Hook func, int mask, int count) {
 }
 
 
+/*
+** Set the hook called for profiling samples, which are requested with
+** 'lua_profrequest'.
+*/
+LUA_API void lua_setprofhook (lua_State *L, lua_Hook func) {
+  global_State *g = G(L);
+  g->profpending = 0;
+  g->profhook = func;
+}
+
+
+/*
+** Request a profiling sample: the profiling hook will be called before
+** the next instruction executed by the running thread. Like
+** 'lua_sethook', this function can be called during a signal.
+*/
+LUA_API void lua_profrequest (lua_State *L) {
+  global_State *g = G(L);
+  if (g->profhook) {
+    g->profpending++;
+    settraps(g->running->ci);  /* to stop inside 'luaV_execute' */
+  }
+}
+
+
+/*
+** Set the hook called for allocation samples, taken once for every
+** 'rate' bytes allocated. A non-positive 'rate' stops the samples.
+*/
+LUA_API void lua_setallochook (lua_State *L, lua_Hook func,
+                                             lua_Integer rate) {
+  global_State *g = G(L);
+  if (func == NULL || rate <= 0)
+    rate = 0;
+  else if (rate > MAX_LMEM / 2)
+    rate = MAX_LMEM / 2;
+  g->allochook = (rate > 0) ? func : NULL;
+  g->allocrate = cast(l_mem, rate);
+  g->allocdebt = (rate > 0) ? g->allocrate : MAX_LMEM;
+  g->allocpending = 0;
+}
+
+
+static const char *allocname (int tt) {
+  switch (tt) {
+    case LUA_VSHRSTR: return "short string";
+    case LUA_VLNGSTR: return "long string";
+    case LUA_VTABLE: return "table";
+    case LUA_VLCL: return "Lua closure";
+    case LUA_VCCL: return "C closure";
+    case LUA_VUSERDATA: return "userdata";
+    case LUA_VTHREAD: return "thread";
+    case LUA_VPROTO: return "prototype";
+    case LUA_VUPVAL: return "upvalue";
+    default: return "memory";
+  }
+}
+
+
+/*
+** To be called by the allocation hook: returns the type of the object
+** that triggered the sample and sets '*bytes' with the number of bytes
+** allocated that it represents.
+*/
+LUA_API const char *lua_allocsample (lua_State *L, size_t *bytes) {
+  global_State *g = G(L);
+  if (bytes)
+    *bytes = cast_sizet(g->allocpending) * cast_sizet(g->allocrate);
+  return allocname(g->alloctt);
+}
+
+
+/*
+** {======================================================
+** Execution budget
+** The VM counts safepoints (calls and back edges of loops) down in
+** 'g->budget', and it checks 'g->interrupt' at each of them (see
+** 'safepoint' in 'lvm.c'); when either asks for it, the VM calls
+** 'budgetstop'.
+** =======================================================
+*/
+
+/*
+** Set the hook called when the execution budget runs out or an
+** interrupt is requested: 'count' is the number of safepoints the code
+** can run before the hook is called, or a non-positive value for no
+** limit. A NULL 'func' turns off budgets.
+*/
+LUA_API void lua_setbudget (lua_State *L, lua_Hook func, lua_Integer count) {
+  global_State *g = G(L);
+  g->budgethook = func;
+  if (func == NULL || count <= 0 || count > MAX_LMEM)
+    g->budget = MAX_LMEM;  /* no limit */
+  else
+    g->budget = cast(l_mem, count);
+  if (func == NULL)
+    g->interrupt = 0;
+}
+
+
+/*
+** Request an interrupt: the budget hook will be called at the next
+** safepoint. This function only sets the (volatile, atomic) flag
+** 'g->interrupt', so it can be called during a signal or from another
+** thread.
+*/
+LUA_API void lua_interrupt (lua_State *L) {
+  G(L)->interrupt = 1;
+}
+
+/* }====================================================== */
+
+
 LUA_API lua_Hook lua_gethook (lua_State *L) {
   return L->hook;
 }
@@ -199,8 +314,10 @@ const char *luaG_findlocal (lua_State *L, CallInfo *ci, int n, StkId *pos) {
   if (isLua(ci)) {
     if (n < 0)  /* access to vararg values? */
       return findvararg(ci, n, pos);
-    else
+    else {
+      luaU_checkdebug(L, ci_func(ci)->p);
       name = luaF_getlocalname(ci_func(ci)->p, n, currentpc(ci));
+    }
   }
   if (name == NULL) {  /* no 'standard' name? */
     StkId limit = (ci == L->ci) ? L->top.p : ci->next->func.p;
@@ -223,8 +340,11 @@ LUA_API const char *lua_getlocal (lua_State *L, const lua_Debug *ar, int n) {
   if (ar == NULL) {  /* information about non-active function? */
     if (!isLfunction(s2v(L->top.p - 1)))  /* not a Lua function? */
       name = NULL;
-    else  /* consider live variables at function start (parameters) */
-      name = luaF_getlocalname(clLvalue(s2v(L->top.p - 1))->p, n, 0);
+    else {  /* consider live variables at function start (parameters) */
+      Proto *p = clLvalue(s2v(L->top.p - 1))->p;
+      luaU_checkdebug(L, p);
+      name = luaF_getlocalname(p, n, 0);
+    }
   }
   else {  /* active function; get information through 'ar' */
     StkId pos = NULL;  /* to avoid warnings */
@@ -300,6 +420,7 @@ static void collectvalidlines (lua_State *L, Closure *f) {
     Table *t = luaH_new(L);  /* new table to store active lines */
     sethvalue2s(L, L->top.p, t);  /* push it on stack */
     api_incr_top(L);
+    luaU_checkdebug(L, f->l.p);
     setbtvalue(&v);  /* boolean 'true' to be the value of all indices */
     if (!p->is_vararg)  /* regular function? */
       i = 0;  /* consider all instructions */
@@ -334,7 +455,7 @@ static int auxgetinfo (lua_State *L, const char *what, lua_Debug *ar,
         break;
       }
       case 'l': {
-        ar->currentline = (ci && isLua(ci)) ? getcurrentline(ci) : -1;
+        ar->currentline = (ci && isLua(ci)) ? getcurrentline(L, ci) : -1;
         break;
       }
       case 'u': {
@@ -470,7 +591,7 @@ static int findsetreg (const Proto *p, int lastpc, int reg) {
     lastpc--;  /* previous instruction was not actually executed */
   for (pc = 0; pc < lastpc; pc++) {
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = GET_BASICOP(i);
     int a = GETARG_A(i);
     int change;  /* true if current instruction changed 'reg' */
     switch (op) {
@@ -533,7 +654,7 @@ static const char *getobjname (const Proto *p, int lastpc, int reg,
   pc = findsetreg(p, lastpc, reg);
   if (pc != -1) {  /* could find instruction? */
     Instruction i = p->code[pc];
-    OpCode op = GET_OPCODE(i);
+    OpCode op = GET_BASICOP(i);
     switch (op) {
       case OP_MOVE: {
         int b = GETARG_B(i);  /* move from 'b' to 'a' */
@@ -595,7 +716,7 @@ static const char *funcnamefromcode (lua_State *L, const Proto *p,
                                      int pc, const char **name) {
   TMS tm = (TMS)0;  /* (initial value avoids warnings) */
   Instruction i = p->code[pc];  /* calling instruction */
-  switch (GET_OPCODE(i)) {
+  switch (GET_BASICOP(i)) {
     case OP_CALL:
     case OP_TAILCALL:
       return getobjname(p, pc, GETARG_A(i), name);  /* get function name */
@@ -645,8 +766,10 @@ static const char *funcnamefromcall (lua_State *L, CallInfo *ci,
     *name = "__gc";
     return "metamethod";  /* report it as such */
   }
-  else if (isLua(ci))
+  else if (isLua(ci)) {
+    luaU_checkdebug(L, ci_func(ci)->p);  /* names of locals */
     return funcnamefromcode(L, ci_func(ci)->p, currentpc(ci), name);
+  }
   else
     return NULL;
 }
@@ -711,8 +834,10 @@ static const char *varinfo (lua_State *L, const TValue *o) {
     kind = getupvalname(ci, o, &name);  /* check whether 'o' is an upvalue */
     if (!kind) {  /* not an upvalue? */
       int reg = instack(ci, o);  /* try a register */
-      if (reg >= 0)  /* is 'o' a register? */
+      if (reg >= 0) {  /* is 'o' a register? */
+        luaU_checkdebug(L, ci_func(ci)->p);  /* names of locals */
         kind = getobjname(ci_func(ci)->p, currentpc(ci), reg, &name);
+      }
     }
   }
   return formatvarinfo(L, kind, name);
@@ -828,7 +953,7 @@ l_noret luaG_runerror (lua_State *L, const char *fmt, ...) {
   msg = luaO_pushvfstring(L, fmt, argp);  /* format message */
   va_end(argp);
   if (isLua(ci)) {  /* if Lua function, add source:line information */
-    luaG_addinfo(L, msg, ci_func(ci)->p->source, getcurrentline(ci));
+    luaG_addinfo(L, msg, ci_func(ci)->p->source, getcurrentline(L, ci));
     setobjs2s(L, L->top.p - 2, L->top.p - 1);  /* remove 'msg' */
     L->top.p--;
   }
@@ -866,8 +991,94 @@ static int changedline (const Proto *p, int oldpc, int newpc) {
 
 
 /*
-** Traces the execution of a Lua function. Called before the execution
-** of each opcode, when debug is on. 'L->oldpc' stores the last
+** Register 'rate' bytes allocated since the last allocation sample
+** (with the allocation of an object of type 'tt'). The sample is
+** served by 'profsample'; as this function can be called anywhere,
+** it must not allocate memory.
+*/
+void luaG_allocsample (lua_State *L, int tt) {
+  global_State *g = G(L);
+  l_mem rate = g->allocrate;
+  l_mem n;
+  if (rate == 0) {  /* not sampling? */
+    g->allocdebt = MAX_LMEM;
+    return;
+  }
+  n = -g->allocdebt / rate + 1;  /* one sample for each 'rate' bytes */
+  g->allocdebt += n * rate;
+  if (g->allocpending == 0)
+    g->alloctt = tt;
+  if (n > MAX_INT - g->allocpending)  /* avoid overflows */
+    g->allocpending = MAX_INT;
+  else
+    g->allocpending += cast_int(n);
+  settraps(g->running->ci);  /* to stop inside 'luaV_execute' */
+}
+
+
+/*
+** Call the profiling hooks for the pending samples: once for each
+** requested profiling sample (samples requested while running C code
+** are all taken at the next Lua instruction) and once for the pending
+** allocation samples. Samples are kept pending while hooks are not
+** allowed. Allocations done by the hooks are not sampled.
+*/
+static void profsample (lua_State *L, const Instruction *pc) {
+  global_State *g = G(L);
+  CallInfo *ci = L->ci;
+  int n;
+  if (!L->allowhook)
+    return;  /* try again later */
+  if (!isIT(*pc))  /* top not being used? */
+    L->top.p = ci->top.p;  /* correct top */
+  if (g->allocpending > 0 && g->allochook) {
+    /* allocation was done by the previous instruction */
+    ci->u.l.savedpc = (pc > ci_func(ci)->p->code) ? pc : pc + 1;
+    luaD_callhook(L, g->allochook, LUA_HOOKCOUNT, -1, 0, 0);
+  }
+  n = g->profpending;
+  g->profpending = 0;
+  ci->u.l.savedpc = pc + 1;  /* reference is always next instruction */
+  while (n-- > 0 && g->profhook)
+    luaD_callhook(L, g->profhook, LUA_HOOKCOUNT, -1, 0, 0);
+  g->allocpending = 0;  /* discard samples from the hooks */
+}
+
+
+/*
+** The budget ran out or an interrupt was requested: call the budget
+** hook. The hook runs like a count hook: it can yield (then the
+** instruction runs when the coroutine is resumed, without calling any
+** hook again) or raise an error. The hook is called again at the next
+** safepoint while the budget is not renewed.
+*/
+static void budgetstop (lua_State *L, const Instruction *pc) {
+  global_State *g = G(L);
+  CallInfo *ci = L->ci;
+  if (g->budgethook == NULL) {  /* budgets are off? */
+    g->budget = MAX_LMEM;
+    g->interrupt = 0;
+    return;
+  }
+  if (!L->allowhook)
+    return;  /* try again at the next safepoint */
+  g->interrupt = 0;
+  if (!isIT(*pc))  /* top not being used? */
+    L->top.p = ci->top.p;  /* correct top */
+  ci->u.l.savedpc = pc + 1;  /* reference is always next instruction */
+  luaD_callhook(L, g->budgethook, LUA_HOOKCOUNT, -1, 0, 0);
+  if (L->status == LUA_YIELD) {  /* did hook yield? */
+    ci->u.l.savedpc--;  /* resume will run this instruction */
+    if (L->hookmask || g->budget <= 0)  /* will trace it again? */
+      ci->callstatus |= CIST_HOOKYIELD;  /* mark that it yielded */
+    luaD_throw(L, LUA_YIELD);
+  }
+}
+
+
+/*
+** Call the line and count hooks for the instruction at 'pc'; return
+** whether the VM must keep its 'trap' on. 'L->oldpc' stores the last
 ** instruction traced, to detect line changes. When entering a new
 ** function, 'npci' will be zero and will test as a new line whatever
 ** the value of 'oldpc'.  Some exceptional conditions may return to
@@ -877,7 +1088,7 @@ static int changedline (const Proto *p, int oldpc, int newpc) {
 ** This function is not "Protected" when called, so it should correct
 ** 'L->top.p' before calling anything that can run the GC.
 */
-int luaG_traceexec (lua_State *L, const Instruction *pc) {
+static int debughooks (lua_State *L, const Instruction *pc) {
   CallInfo *ci = L->ci;
   lu_byte mask = L->hookmask;
   const Proto *p = ci_func(ci)->p;
@@ -893,10 +1104,6 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
     resethookcount(L);  /* reset count */
   else if (!(mask & LUA_MASKLINE))
     return 1;  /* no line hook and count != 0; nothing to be done now */
-  if (ci->callstatus & CIST_HOOKYIELD) {  /* called hook last time? */
-    ci->callstatus &= ~CIST_HOOKYIELD;  /* erase mark */
-    return 1;  /* do not call hook again (VM yielded, so it did not move) */
-  }
   if (!isIT(*(ci->u.l.savedpc - 1)))  /* top not being used? */
     L->top.p = ci->top.p;  /* correct top */
   if (counthook)
@@ -905,6 +1112,7 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
     /* 'L->oldpc' may be invalid; use zero in this case */
     int oldpc = (L->oldpc < p->sizecode) ? L->oldpc : 0;
     int npci = pcRel(pc, p);
+    luaU_checkdebug(L, ci_func(ci)->p);
     if (npci <= oldpc ||  /* call hook when jump back (loop), */
         changedline(p, oldpc, npci)) {  /* or when enter new line */
       int newline = luaG_getfuncline(p, npci);
@@ -913,8 +1121,6 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
     L->oldpc = npci;  /* 'pc' of last call to line hook */
   }
   if (L->status == LUA_YIELD) {  /* did hook yield? */
-    if (counthook)
-      L->hookcount = 1;  /* undo decrement to zero */
     ci->u.l.savedpc--;  /* undo increment (resume will increment it again) */
     ci->callstatus |= CIST_HOOKYIELD;  /* mark that it yielded */
     luaD_throw(L, LUA_YIELD);
@@ -922,3 +1128,26 @@ int luaG_traceexec (lua_State *L, const Instruction *pc) {
   return 1;  /* keep 'trap' on */
 }
 
+
+/*
+** Traces the execution of a Lua function. Called before the execution
+** of each opcode, when debug is on. A hook that yields marks the call
+** with CIST_HOOKYIELD; when resumed, the instruction runs without
+** calling any hook again. (So the budget hook runs after the debug
+** hooks, which have already run when it yields.)
+*/
+int luaG_traceexec (lua_State *L, const Instruction *pc) {
+  CallInfo *ci = L->ci;
+  int trap;
+  if (l_unlikely(G(L)->profpending || G(L)->allocpending))  /* samples? */
+    profsample(L, pc);
+  if (ci->callstatus & CIST_HOOKYIELD) {  /* called hook last time? */
+    ci->callstatus &= ~CIST_HOOKYIELD;  /* erase mark */
+    return 1;  /* do not call hooks again (VM yielded, so it did not move) */
+  }
+  trap = debughooks(L, pc);
+  if (l_unlikely(G(L)->budget <= 0 || G(L)->interrupt))  /* stop? */
+    budgetstop(L, pc);
+  return trap;
+}
+
@@ -20,6 +20,13 @@
 
 #define resethookcount(L)	(L->hookcount = L->basehookcount)
 
+
+/*
+** Account 'n' new bytes, in an allocation of type 'tt' (-1 for blocks
+** that are not objects), for the allocation profiler.
+*/
+#define luaG_countalloc(L,g,tt,n)    { if (l_unlikely(((g)->allocdebt -= cast(l_mem, n)) < 0))        luaG_allocsample(L, tt); }
+
 /*
 ** mark for entries in 'lineinfo' array that has absolute information in
 ** 'abslineinfo' array
@@ -58,6 +65,7 @@ LUAI_FUNC const char *luaG_addinfo (lua_State *L, const char *msg,
                                                   TString *src, int line);
 LUAI_FUNC l_noret luaG_errormsg (lua_State *L);
 LUAI_FUNC int luaG_traceexec (lua_State *L, const Instruction *pc);
+LUAI_FUNC void luaG_allocsample (lua_State *L, int tt);
 
 
 #endif
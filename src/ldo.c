@@ -85,6 +85,7 @@ struct lua_longjmp {
   struct lua_longjmp *previous;
   luai_jmpbuf b;
   volatile int status;  /* error code */
+  l_uint32 nny;  /* non-yieldable part of 'nCcalls' it can recover, or 0 */
 };
 
 
@@ -135,10 +136,11 @@ l_noret luaD_throw (lua_State *L, int errcode) {
 }
 
 
-int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
+static int runprotected (lua_State *L, Pfunc f, void *ud, l_uint32 nny) {
   l_uint32 oldnCcalls = L->nCcalls;
   struct lua_longjmp lj;
   lj.status = LUA_OK;
+  lj.nny = nny;
   lj.previous = L->errorJmp;  /* chain new error handler */
   L->errorJmp = &lj;
   LUAI_TRY(L, &lj,
@@ -149,6 +151,11 @@ int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
   return lj.status;
 }
 
+
+int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
+  return runprotected(L, f, ud, 0);
+}
+
 /* }====================================================== */
 
 
@@ -321,13 +328,13 @@ void luaD_inctop (lua_State *L) {
 
 
 /*
-** Call a hook for the given event. Make sure there is a hook to be
-** called. (Both 'L->hook' and 'L->hookmask', which trigger this
-** function, can be changed asynchronously by signals.)
+** Call hook 'hook' for the given event ('luaD_hook' calls 'L->hook').
+** Make sure there is a hook to be called. (Both 'L->hook' and
+** 'L->hookmask', which trigger this function, can be changed
+** asynchronously by signals.)
 */
-void luaD_hook (lua_State *L, int event, int line,
-                              int ftransfer, int ntransfer) {
-  lua_Hook hook = L->hook;
+void luaD_callhook (lua_State *L, lua_Hook hook, int event, int line,
+                                   int ftransfer, int ntransfer) {
   if (hook && L->allowhook) {  /* make sure there is a hook */
     int mask = CIST_HOOKED;
     CallInfo *ci = L->ci;
@@ -564,6 +571,7 @@ int luaD_pretailcall (lua_State *L, CallInfo *ci, StkId func,
       lua_assert(ci->top.p <= L->stack_last.p);
       ci->u.l.savedpc = p->code;  /* starting point */
       ci->callstatus |= CIST_TAIL;
+      luaF_hotcount(L, p);
       L->top.p = func + narg1;  /* set top */
       return -1;
     }
@@ -603,6 +611,7 @@ CallInfo *luaD_precall (lua_State *L, StkId func, int nresults) {
       checkstackGCp(L, fsize, func);
       L->ci = ci = prepCallInfo(L, func, nresults, 0, func + 1 + fsize);
       ci->u.l.savedpc = p->code;  /* starting point */
+      luaF_hotcount(L, p);
       for (; narg < nfixparams; narg++)
         setnilvalue(s2v(L->top.p++));  /* complete missing arguments */
       lua_assert(ci->top.p <= L->stack_last.p);
@@ -714,8 +723,9 @@ static void finishCcall (lua_State *L, CallInfo *ci) {
   }
   else {
     int status = LUA_YIELD;  /* default if there were no errors */
-    /* must have a continuation and must be able to call it */
-    lua_assert(ci->u.c.k != NULL && yieldable(L));
+    /* must have a continuation (it may be recovering from an error
+       outside a coroutine, see 'luaD_pcallrecover') */
+    lua_assert(ci->u.c.k != NULL);
     if (ci->callstatus & CIST_YPCALL)   /* was inside a 'lua_pcallk'? */
       status = finishpcallk(L, ci);  /* finish it */
     adjustresults(L, LUA_MULTRET);  /* finish 'lua_callk' */
@@ -831,6 +841,9 @@ static int precover (lua_State *L, int status) {
 LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs,
                                       int *nresults) {
   int status;
+#if !defined(LUAI_THREADLOCK)
+  lua_State *prev;
+#endif
   lua_lock(L);
   if (L->status == LUA_OK) {  /* may be starting a coroutine */
     if (L->ci != &L->base_ci)  /* not in base level? */
@@ -846,7 +859,15 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs,
   L->nCcalls++;
   luai_userstateresume(L, nargs);
   api_checknelems(L, (L->status == LUA_OK) ? nargs + 1 : nargs);
+  /* (with several OS threads inside, 'lua_lock' sets 'running') */
+#if !defined(LUAI_THREADLOCK)
+  prev = G(L)->running;
+  G(L)->running = L;
+#endif
   status = luaD_rawrunprotected(L, resume, &nargs);
+#if !defined(LUAI_THREADLOCK)
+  G(L)->running = prev;
+#endif
    /* continue running after recoverable errors */
   status = precover(L, status);
   if (l_likely(!errorstatus(status)))
@@ -963,6 +984,99 @@ int luaD_pcall (lua_State *L, Pfunc func, void *u,
 }
 
 
+/*
+** {======================================================
+** Recover points
+** A 'lua_pcallk' with a continuation does not need its own 'setjmp'
+** when no non-yieldable call was made since the last recover point
+** (a 'luaD_pcallrecover'): as inside a coroutine, it only marks its
+** CallInfo with CIST_YPCALL, an error long-jumps to the recover point,
+** and the recover point finishes the interrupted calls down to its own
+** level, as 'precover' does for coroutines.
+** =======================================================
+*/
+
+
+/* non-yieldable part of 'nCcalls' */
+#define getnny(L)	((L)->nCcalls & 0xffff0000)
+
+
+/*
+** Can a 'lua_pcallk' with a continuation be recovered by the
+** current recover point?
+*/
+int luaD_canrecover (lua_State *L) {
+  return (L->errorJmp != NULL && L->errorJmp->nny == getnny(L));
+}
+
+
+/*
+** Try to find a recover point above 'base'.
+*/
+static CallInfo *findypcall (lua_State *L, CallInfo *base) {
+  CallInfo *ci;
+  for (ci = L->ci; ci != base; ci = ci->previous) {
+    if (ci->callstatus & CIST_YPCALL)
+      return ci;
+  }
+  return NULL;
+}
+
+
+/*
+** Finishes the interrupted calls above the level 'ud', inside the
+** non-yieldable call that made them.
+*/
+static void unrollto (lua_State *L, void *ud) {
+  CallInfo *base = cast(CallInfo *, ud);
+  CallInfo *ci;
+  L->nCcalls += nyci;  /* 'runprotected' restores it */
+  while ((ci = L->ci) != base) {
+    if (!isLua(ci))
+      finishCcall(L, ci);
+    else {
+      luaV_finishOp(L);
+      luaV_execute(L, ci);
+    }
+  }
+}
+
+
+/*
+** Like 'luaD_pcall', for a 'func' that does a non-yieldable call
+** ('luaD_callnoyield'). Errors inside protected calls made with
+** continuations inside that call are recovered here.
+*/
+int luaD_pcallrecover (lua_State *L, Pfunc func, void *u,
+                       ptrdiff_t old_top, ptrdiff_t ef) {
+  int status;
+  CallInfo *old_ci = L->ci;
+  lu_byte old_allowhooks = L->allowhook;
+  ptrdiff_t old_errfunc = L->errfunc;
+  l_uint32 nny = getnny(L) + 0x10000;  /* as inside the call */
+  CallInfo *ci;
+  L->errfunc = ef;
+  status = runprotected(L, func, u, nny);
+  while (l_unlikely(errorstatus(status)) &&
+         (ci = findypcall(L, old_ci)) != NULL) {
+    L->ci = ci;  /* go down to recovery functions */
+    setcistrecst(ci, status);  /* status to finish 'pcall' */
+    status = runprotected(L, unrollto, old_ci, nny);
+  }
+  if (l_unlikely(status != LUA_OK)) {  /* an error occurred? */
+    L->ci = old_ci;
+    L->allowhook = old_allowhooks;
+    status = luaD_closeprotected(L, old_top, status);
+    luaD_seterrorobj(L, status, restorestack(L, old_top));
+    luaD_shrinkstack(L);   /* restore stack size in case of overflow */
+  }
+  L->errfunc = old_errfunc;
+  return status;
+}
+
+/* }====================================================== */
+
+
 
 /*
 ** Execute a protected parser.
@@ -993,6 +1107,10 @@ static void f_parser (lua_State *L, void *ud) {
     checkmode(L, p->mode, "binary");
     cl = luaU_undump(L, p->z, p->name);
   }
+  else if (p->mode && strchr(p->mode, 'd') != NULL) {  /* data chunk? */
+    luaY_data(L, p->z, &p->buff, p->name, c);
+    return;  /* result is a table, not a closure */
+  }
   else {
     checkmode(L, p->mode, "text");
     cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
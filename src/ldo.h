@@ -63,8 +63,9 @@ typedef void (*Pfunc) (lua_State *L, void *ud);
 LUAI_FUNC void luaD_seterrorobj (lua_State *L, int errcode, StkId oldtop);
 LUAI_FUNC int luaD_protectedparser (lua_State *L, ZIO *z, const char *name,
                                                   const char *mode);
-LUAI_FUNC void luaD_hook (lua_State *L, int event, int line,
-                                        int fTransfer, int nTransfer);
+LUAI_FUNC void luaD_callhook (lua_State *L, lua_Hook hook, int event,
+                              int line, int fTransfer, int nTransfer);
+#define luaD_hook(L,e,l,ft,nt)	luaD_callhook(L, (L)->hook, e, l, ft, nt)
 LUAI_FUNC void luaD_hookcall (lua_State *L, CallInfo *ci);
 LUAI_FUNC int luaD_pretailcall (lua_State *L, CallInfo *ci, StkId func,
                                               int narg1, int delta);
@@ -75,6 +76,9 @@ LUAI_FUNC StkId luaD_tryfuncTM (lua_State *L, StkId func);
 LUAI_FUNC int luaD_closeprotected (lua_State *L, ptrdiff_t level, int status);
 LUAI_FUNC int luaD_pcall (lua_State *L, Pfunc func, void *u,
                                         ptrdiff_t oldtop, ptrdiff_t ef);
+LUAI_FUNC int luaD_pcallrecover (lua_State *L, Pfunc func, void *u,
+                                 ptrdiff_t oldtop, ptrdiff_t ef);
+LUAI_FUNC int luaD_canrecover (lua_State *L);
 LUAI_FUNC void luaD_poscall (lua_State *L, CallInfo *ci, int nres);
 LUAI_FUNC int luaD_reallocstack (lua_State *L, int newsize, int raiseerror);
 LUAI_FUNC int luaD_growstack (lua_State *L, int n, int raiseerror);
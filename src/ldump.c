@@ -16,6 +16,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -101,9 +102,25 @@ static void dumpString (DumpState *D, const TString *s) {
 }
 
 
+/*
+** Dump the code without superinstructions, so that binary chunks do
+** not depend on them. (They are created again by 'luaU_undump'.)
+*/
+#define CODEBS		64
+
 static void dumpCode (DumpState *D, const Proto *f) {
+  Instruction buff[CODEBS];
+  int i, n = 0;
   dumpInt(D, f->sizecode);
-  dumpVector(D, f->code, f->sizecode);
+  for (i = 0; i < f->sizecode; i++) {
+    Instruction inst = f->code[i];
+    SET_OPCODE(inst, GET_BASICOP(inst));
+    buff[n++] = inst;
+    if (n == CODEBS || i == f->sizecode - 1) {  /* buffer full or last? */
+      dumpVector(D, buff, n);
+      n = 0;
+    }
+  }
 }
 
 
@@ -157,21 +174,25 @@ static void dumpUpvalues (DumpState *D, const Proto *f) {
 
 static void dumpDebug (DumpState *D, const Proto *f) {
   int i, n;
-  n = (D->strip) ? 0 : f->sizelineinfo;
-  dumpInt(D, n);
-  dumpVector(D, f->lineinfo, n);
-  n = (D->strip) ? 0 : f->sizeabslineinfo;
-  dumpInt(D, n);
-  for (i = 0; i < n; i++) {
-    dumpInt(D, f->abslineinfo[i].pc);
-    dumpInt(D, f->abslineinfo[i].line);
-  }
-  n = (D->strip) ? 0 : f->sizelocvars;
-  dumpInt(D, n);
-  for (i = 0; i < n; i++) {
-    dumpString(D, f->locvars[i].varname);
-    dumpInt(D, f->locvars[i].startpc);
-    dumpInt(D, f->locvars[i].endpc);
+  if (f->debuginfo != NULL && !D->strip)  /* still encoded? */
+    dumpVector(D, f->debuginfo, f->sizedebuginfo);  /* already in format */
+  else {
+    n = (D->strip) ? 0 : f->sizelineinfo;
+    dumpInt(D, n);
+    dumpVector(D, f->lineinfo, n);
+    n = (D->strip) ? 0 : f->sizeabslineinfo;
+    dumpInt(D, n);
+    for (i = 0; i < n; i++) {
+      dumpInt(D, f->abslineinfo[i].pc);
+      dumpInt(D, f->abslineinfo[i].line);
+    }
+    n = (D->strip) ? 0 : f->sizelocvars;
+    dumpInt(D, n);
+    for (i = 0; i < n; i++) {
+      dumpString(D, f->locvars[i].varname);
+      dumpInt(D, f->locvars[i].startpc);
+      dumpInt(D, f->locvars[i].endpc);
+    }
   }
   n = (D->strip) ? 0 : f->sizeupvalues;
   dumpInt(D, n);
@@ -246,6 +246,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->sizep = 0;
   f->code = NULL;
   f->sizecode = 0;
+  f->icache = NULL;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
   f->abslineinfo = NULL;
@@ -257,20 +258,44 @@ Proto *luaF_newproto (lua_State *L) {
   f->maxstacksize = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
+  f->debuginfo = NULL;
+  f->sizedebuginfo = 0;
   f->linedefined = 0;
   f->lastlinedefined = 0;
+#if defined(LUAI_HOTCOUNT)
+  f->hotcount = 0;
+#endif
   f->source = NULL;
   return f;
 }
 
 
+/*
+** Create the inline caches for a prototype: one slot hint for each
+** instruction, used by the field-access opcodes. They are created by
+** the first such access, so that functions that never run (or never
+** access a field) do not pay for them.
+*/
+unsigned int *luaF_newcache (lua_State *L, Proto *f) {
+  int i;
+  unsigned int *ic = luaM_newvector(L, f->sizecode, unsigned int);
+  lua_assert(f->icache == NULL);
+  for (i = 0; i < f->sizecode; i++)
+    ic[i] = 0;
+  return (f->icache = ic);
+}
+
+
 void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->code, f->sizecode);
+  if (f->icache != NULL)
+    luaM_freearray(L, f->icache, f->sizecode);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
   luaM_freearray(L, f->lineinfo, f->sizelineinfo);
   luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
+  luaM_freearray(L, f->debuginfo, f->sizedebuginfo);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
   luaM_free(L, f);
 }
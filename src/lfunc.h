@@ -35,6 +35,15 @@
 #define uplevel(up)	check_exp(upisopen(up), cast(StkId, (up)->v.p))
 
 
+/*
+** True if there are open upvalues or to-be-closed variables at or
+** above 'level', that is, if 'luaF_close' for that level has any work.
+*/
+#define luaF_hasclose(L,level)  \
+	(((L)->openupval != NULL && uplevel((L)->openupval) >= (level)) || \
+	 (L)->tbclist.p >= (level))
+
+
 /*
 ** maximum number of misses before giving up the cache of closures
 ** in prototypes
@@ -43,6 +52,19 @@
 
 
 
+/*
+** count a hotness event (a call or the back edge of a loop) for
+** prototype 'p'
+*/
+#if defined(LUAI_HOTCOUNT)
+#define luaF_hotcount(L,p)  \
+	{ if (l_unlikely(++(p)->hotcount >= LUAI_HOTCOUNT)) \
+	    { (p)->hotcount = 0; luai_hotproto(L, p); } }
+#else
+#define luaF_hotcount(L,p)	((void)0)
+#endif
+
+
 /* special status to close upvalues preserving the top of the stack */
 #define CLOSEKTOP	(-1)
 
@@ -56,6 +78,7 @@ LUAI_FUNC void luaF_newtbcupval (lua_State *L, StkId level);
 LUAI_FUNC void luaF_closeupval (lua_State *L, StkId level);
 LUAI_FUNC StkId luaF_close (lua_State *L, StkId level, int status, int yy);
 LUAI_FUNC void luaF_unlinkupval (UpVal *uv);
+LUAI_FUNC unsigned int *luaF_newcache (lua_State *L, Proto *f);
 LUAI_FUNC void luaF_freeproto (lua_State *L, Proto *f);
 LUAI_FUNC const char *luaF_getlocalname (const Proto *func, int local_number,
                                          int pc);
@@ -105,10 +105,107 @@
 #define markobjectN(g,t)	{ if (t) markobject(g,t); }
 
 static void reallymarkobject (global_State *g, GCObject *o);
+static void ephmarked (global_State *g, GCObject *o);
 static lu_mem atomic (lua_State *L);
 static void entersweep (lua_State *L);
 
 
+/*
+** 'luai_gcclock' returns a reading of a clock in microseconds. By
+** default, it uses the monotonic clock on POSIX systems and 'clock'
+** (processor time) otherwise.
+*/
+#if !defined(luai_gcclock)
+
+#include <time.h>
+
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+
+static lu_mem luai_gcclock (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return cast(lu_mem, ts.tv_sec) * 1000000u + cast(lu_mem, ts.tv_nsec) / 1000u;
+}
+
+#else
+
+#define luai_gcclock()  \
+	cast(lu_mem, cast(double, clock()) * 1e6 / CLOCKS_PER_SEC)
+
+#endif
+
+#endif
+
+
+
+/*
+** {======================================================
+** Statistics: the time used by the collector is measured in segments
+** that start when the collector is called ('startclock') and end when
+** it changes phase or returns ('chargetime'), so that the clock is read
+** only a few times per step. Generational collections are measured as
+** a whole ('gcgenwork' is set meanwhile).
+** =======================================================
+*/
+
+/* phase of each state of the collector */
+static const lu_byte statephase[] = {
+  LUA_GCPPROPAGATE,  /* GCSpropagate */
+  LUA_GCPATOMIC, LUA_GCPATOMIC,  /* GCSenteratomic, GCSatomic */
+  LUA_GCPSWEEP, LUA_GCPSWEEP, LUA_GCPSWEEP, LUA_GCPSWEEP,  /* sweeps */
+  LUA_GCPCALLFIN,  /* GCScallfin */
+  LUA_GCPPAUSE  /* GCSpause */
+};
+
+/* phase that is charged for time spent in a given state */
+#define timephase(st)  \
+	((st) == GCSpause ? LUA_GCPPROPAGATE : statephase[st])
+
+
+#define startclock(g)	((g)->gcclock = luai_gcclock())
+
+
+static void chargetime (global_State *g, int phase) {
+  lu_mem now = luai_gcclock();
+  g->gcstats.time[phase] += cast(lua_Unsigned, now - g->gcclock);
+  g->gcclock = now;
+}
+
+
+/*
+** Called by 'singlestep' when the collector changed from state
+** 'oldstate'.
+*/
+static void phasechange (lua_State *L, global_State *g, int oldstate) {
+  int phase = statephase[g->gcstate];
+  if (phase != statephase[oldstate] && !g->gcgenwork) {
+    chargetime(g, timephase(oldstate));
+    if (g->gcstate == GCSpause)  /* finished a cycle? */
+      g->gcstats.cycles++;
+    if (g->gchook)
+      g->gchook(g->ud_gchook, L, phase);
+  }
+}
+
+
+/*
+** Account a generational collection, either LUA_GCPMINOR or
+** LUA_GCPMAJOR, that has just finished.
+*/
+static void genaccount (lua_State *L, global_State *g, int phase) {
+  chargetime(g, phase);
+  if (phase == LUA_GCPMINOR)
+    g->gcstats.minors++;
+  else
+    g->gcstats.cycles++;
+  if (g->gchook)
+    g->gchook(g->ud_gchook, L, phase);
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** Generic functions
@@ -263,6 +360,7 @@ GCObject *luaC_newobjdt (lua_State *L, int tt, size_t sz, size_t offset) {
   o->tt = tt;
   o->next = g->allgc;
   g->allgc = o;
+  luaG_countalloc(L, g, tt, sz);
   return o;
 }
 
@@ -295,6 +393,8 @@ GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
 ** (only closures can), and a userdata's metatable must be a table.
 */
 static void reallymarkobject (global_State *g, GCObject *o) {
+  if (g->ephindex != NULL)  /* converging ephemerons? */
+    ephmarked(g, o);  /* 'o' may be the key of some entries */
   switch (o->tt) {
     case LUA_VSHRSTR:
     case LUA_VLNGSTR: {
@@ -402,6 +502,7 @@ static void cleargraylists (global_State *g) {
 */
 static void restartcollection (global_State *g) {
   cleargraylists(g);
+  g->gcprecleaned = 0;
   markobject(g, g->mainthread);
   markvalue(g, &g->l_registry);
   markmt(g);
@@ -465,6 +566,123 @@ static void traverseweakvalue (global_State *g, Table *h) {
 }
 
 
+/*
+** {======================================================
+** Ephemeron index
+** During 'convergeephemerons', each entry "white key -> white value"
+** of an ephemeron table is recorded under its key, so that marking the
+** key can mark the value without traversing the table again. Its
+** memory is allocated directly, without emergency collections or
+** changes to the debt, and it lives only during the atomic phase.
+** =======================================================
+*/
+
+typedef struct EphEntry {
+  GCObject *key;  /* NULL after the key is marked */
+  TValue *value;  /* value of the entry, in its table */
+  int next;  /* next entry in the same bucket or in the ready list */
+} EphEntry;
+
+
+typedef struct EphIndex {
+  void *block;  /* memory for 'entries' followed by 'buckets' */
+  EphEntry *entries;
+  int *buckets;  /* first entry in each bucket (-1 if none) */
+  int nentries;  /* number of entries in use */
+  int size;  /* size of 'entries' and 'buckets' (a power of 2) */
+  int ready;  /* list of entries whose keys were marked */
+  int failed;  /* true if some entry could not be recorded */
+} EphIndex;
+
+
+#define ephrealloc(g,b,os,ns)	((*(g)->frealloc)((g)->ud, b, os, ns))
+
+#define ephblocksize(n)	(cast_sizet(n) * (sizeof(EphEntry) + sizeof(int)))
+
+/* aligned pointers have their low bits zero */
+#define ephbucket(ei,o)  \
+	lmod((point2uint(o) >> 3) ^ (point2uint(o) >> 13), (ei)->size)
+
+
+/*
+** Double the size of the index, rebuilding its buckets. Returns 0 if
+** the allocation fails (the index is unchanged in that case).
+*/
+static int ephgrow (global_State *g, EphIndex *ei) {
+  int i;
+  int nsize = (ei->size == 0) ? 64 : 2 * ei->size;
+  void *block;
+  if (nsize > MAX_INT / 2)
+    return 0;
+  block = ephrealloc(g, ei->block, ephblocksize(ei->size),
+                                   ephblocksize(nsize));
+  if (block == NULL)
+    return 0;
+  ei->block = block;
+  ei->entries = cast(EphEntry *, block);
+  ei->buckets = cast(int *, ei->entries + nsize);
+  ei->size = nsize;
+  for (i = 0; i < nsize; i++)
+    ei->buckets[i] = -1;
+  for (i = 0; i < ei->nentries; i++) {  /* rebuild the buckets */
+    EphEntry *e = &ei->entries[i];
+    if (e->key != NULL) {  /* still waiting for its key? */
+      int *b = &ei->buckets[ephbucket(ei, e->key)];
+      e->next = *b;
+      *b = i;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Record that 'value' must be marked when 'key' is marked.
+*/
+static void ephadd (global_State *g, GCObject *key, TValue *value) {
+  EphIndex *ei = g->ephindex;
+  EphEntry *e;
+  int *b;
+  if (ei->nentries == ei->size && !ephgrow(g, ei)) {
+    ei->failed = 1;  /* table will be traversed again by rounds */
+    return;
+  }
+  e = &ei->entries[ei->nentries];
+  b = &ei->buckets[ephbucket(ei, key)];
+  e->key = key;
+  e->value = value;
+  e->next = *b;
+  *b = ei->nentries++;
+}
+
+
+/*
+** Object 'o' is being marked: move the entries recorded under it to
+** the ready list.
+*/
+static void ephmarked (global_State *g, GCObject *o) {
+  EphIndex *ei = g->ephindex;
+  int *p;
+  if (ei->size == 0)  /* no entries? */
+    return;
+  p = &ei->buckets[ephbucket(ei, o)];
+  while (*p != -1) {
+    EphEntry *e = &ei->entries[*p];
+    if (e->key == o) {
+      int i = *p;
+      *p = e->next;  /* remove it from its bucket */
+      e->key = NULL;
+      e->next = ei->ready;  /* and put it in the ready list */
+      ei->ready = i;
+    }
+    else
+      p = &e->next;
+  }
+}
+
+/* }====================================================== */
+
+
 /*
 ** Traverse an ephemeron table and link it to proper list. Returns true
 ** iff any object was marked during this traversal (which implies that
@@ -499,8 +717,11 @@ static int traverseephemeron (global_State *g, Table *h, int inv) {
       clearkey(n);  /* clear its key */
     else if (iscleared(g, gckeyN(n))) {  /* key is not marked (yet)? */
       hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
+      if (valiswhite(gval(n))) {  /* value not marked yet? */
         hasww = 1;  /* white-white entry */
+        if (g->ephindex != NULL)  /* converging ephemerons? */
+          ephadd(g, gckeyN(n), gval(n));  /* value depends on key */
+      }
     }
     else if (valiswhite(gval(n))) {  /* value not marked yet? */
       marked = 1;
@@ -679,14 +900,47 @@ static lu_mem propagateall (global_State *g) {
 }
 
 
+/*
+** "Preclean" the 'grayagain' list: move the objects there back to the
+** gray list, so that they are traversed again incrementally, in the
+** propagate phase, instead of all at once in the atomic phase. (These
+** are mostly tables that were modified after being traversed; large
+** ones would make for long atomic pauses.) Threads and weak tables
+** stay in the list, as they always return to it while the collector
+** is propagating. Objects modified again after being precleaned will
+** be back in 'grayagain' for the atomic phase. Returns whether it
+** moved something.
+*/
+static int precleangrayagain (global_State *g) {
+  GCObject **p = &g->grayagain;
+  GCObject *o;
+  int moved = 0;
+  while ((o = *p) != NULL) {
+    GCObject **next = getgclist(o);
+    if (o->tt == LUA_VTHREAD ||
+        (o->tt == LUA_VTABLE &&
+         gfasttm(g, gco2t(o)->metatable, TM_MODE) != NULL))
+      p = next;  /* keep it in 'grayagain' */
+    else {
+      *p = *next;  /* remove 'o' from 'grayagain' */
+      *next = g->gray;  /* and put it back in 'gray' (it is already gray) */
+      g->gray = o;
+      moved = 1;
+    }
+  }
+  return moved;
+}
+
+
 /*
 ** Traverse all ephemeron tables propagating marks from keys to values.
 ** Repeat until it converges, that is, nothing new is marked. 'dir'
 ** inverts the direction of the traversals, trying to speed up
-** convergence on chains in the same table.
+** convergence on chains in the same table. (This is the fallback for
+** 'convergeephemerons', when its index cannot grow.)
 **
 */
-static void convergeephemerons (global_State *g) {
+static void convergerounds (global_State *g) {
   int changed;
   int dir = 0;
   do {
@@ -707,6 +961,216 @@ static void convergeephemerons (global_State *g) {
   } while (changed);  /* repeat until no more changes */
 }
 
+
+/*
+** Propagate marks from keys to values in all ephemeron tables. Each
+** table in the 'ephemeron' list is traversed once, recording its
+** white-white entries in the index; from then on, marking a recorded
+** key puts its entries in the ready list, and the loop marks their
+** values, until there is nothing more to mark. Tables reached during
+** the loop record their entries when traversed.
+*/
+static void convergeephemerons (global_State *g) {
+  EphIndex ei;
+  GCObject *w;
+  GCObject *next = g->ephemeron;  /* get ephemeron list */
+  g->ephemeron = NULL;  /* tables may return to this list when traversed */
+  ei.block = NULL;
+  ei.nentries = ei.size = 0;
+  ei.ready = -1;
+  ei.failed = 0;
+  g->ephindex = &ei;
+  while ((w = next) != NULL) {  /* for each ephemeron table */
+    Table *h = gco2t(w);
+    next = h->gclist;  /* list is rebuilt during loop */
+    nw2black(h);  /* out of the list (for now) */
+    traverseephemeron(g, h, 0);
+  }
+  do {
+    propagateall(g);
+    while (ei.ready != -1) {  /* mark values of entries with marked keys */
+      int i = ei.ready;
+      ei.ready = ei.entries[i].next;
+      markvalue(g, ei.entries[i].value);
+    }
+  } while (g->gray != NULL);
+  g->ephindex = NULL;
+  ephrealloc(g, ei.block, ephblocksize(ei.size), 0);
+  if (l_unlikely(ei.failed))  /* some entry was not recorded? */
+    convergerounds(g);
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Native finalizers
+** 'freeobj' does not free a userdata created by 'lua_newuserdatafin':
+** it counts its memory as freed and links it into 'g->nativefin'.
+** At the end of each collector step, 'flushnativefins' runs the whole
+** list, calling each finalizer and then freeing its block. Native
+** finalizers do not use the Lua state, so with LUAI_FINALIZERTHREAD the
+** list goes, as one batch, to a background thread, which also frees the
+** blocks.
+** =======================================================
+*/
+
+
+#define sizenativefin(u)  \
+	(sizeudata((u)->nuvalue, (u)->len) + sizeof(lua_Finalizer))
+
+
+static void queuenativefin (global_State *g, Udata *u) {
+  GCObject *o = obj2gco(u);
+  g->GCdebt -= sizenativefin(u);  /* block is already counted as freed */
+  o->next = g->nativefin;
+  g->nativefin = o;
+}
+
+
+static void runnativefins (lua_Alloc frealloc, void *ud, GCObject *l) {
+  while (l != NULL) {
+    Udata *u = gco2u(l);
+    lua_Finalizer f;
+    l = l->next;
+    memcpy(&f, getudatafin(u), sizeof(lua_Finalizer));
+    f(getudatamem(u), u->len);
+    (*frealloc)(ud, u, sizenativefin(u), 0);
+  }
+}
+
+
+#if defined(LUAI_FINALIZERTHREAD)
+
+typedef struct FinWorker {
+  pthread_t thread;
+  pthread_mutex_t mutex;  /* protects 'batch' and 'stop' */
+  pthread_cond_t cond;  /* signals a new batch or 'stop' */
+  GCObject *batch;  /* userdata handed over and not yet finalized */
+  int stop;  /* true when the state is being closed */
+  lua_Alloc frealloc;  /* allocator for the blocks (must be thread safe) */
+  void *ud;
+} FinWorker;
+
+
+static void *finworker (void *arg) {
+  FinWorker *w = cast(FinWorker *, arg);
+  pthread_mutex_lock(&w->mutex);
+  for (;;) {
+    GCObject *l = w->batch;
+    if (l != NULL) {
+      w->batch = NULL;
+      pthread_mutex_unlock(&w->mutex);
+      runnativefins(w->frealloc, w->ud, l);
+      pthread_mutex_lock(&w->mutex);
+    }
+    else if (w->stop)
+      break;
+    else
+      pthread_cond_wait(&w->cond, &w->mutex);
+  }
+  pthread_mutex_unlock(&w->mutex);
+  return NULL;
+}
+
+
+/*
+** Create the finalizer thread. Its memory is allocated directly, like
+** the ephemeron index. Returns NULL if anything fails; the finalizers
+** then run in the collector.
+*/
+static FinWorker *startworker (global_State *g) {
+  FinWorker *w = cast(FinWorker *,
+                      (*g->frealloc)(g->ud, NULL, 0, sizeof(FinWorker)));
+  if (w == NULL)
+    return NULL;
+  w->batch = NULL;
+  w->stop = 0;
+  w->frealloc = g->frealloc;
+  w->ud = g->ud;
+  if (pthread_mutex_init(&w->mutex, NULL) == 0) {
+    if (pthread_cond_init(&w->cond, NULL) == 0) {
+      if (pthread_create(&w->thread, NULL, finworker, w) == 0)
+        return w;  /* ok */
+      pthread_cond_destroy(&w->cond);
+    }
+    pthread_mutex_destroy(&w->mutex);
+  }
+  (*g->frealloc)(g->ud, w, sizeof(FinWorker), 0);
+  return NULL;
+}
+
+
+/*
+** Add list 'l' to the worker's batch, with a single lock.
+*/
+static void handover (FinWorker *w, GCObject *l) {
+  GCObject *last = l;
+  while (last->next != NULL)
+    last = last->next;
+  pthread_mutex_lock(&w->mutex);
+  last->next = w->batch;
+  w->batch = l;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+
+/*
+** Wait for the worker to finish its batch and release it.
+*/
+static void stopworker (global_State *g) {
+  FinWorker *w = g->finworker;
+  pthread_mutex_lock(&w->mutex);
+  w->stop = 1;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+  pthread_join(w->thread, NULL);
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->mutex);
+  (*g->frealloc)(g->ud, w, sizeof(FinWorker), 0);
+  g->finworker = NULL;
+}
+
+#endif
+
+
+static void flushnativefins (global_State *g) {
+  GCObject *l = g->nativefin;
+  if (l != NULL) {
+    g->nativefin = NULL;
+#if defined(LUAI_FINALIZERTHREAD)
+    if (g->finworker == NULL)
+      g->finworker = startworker(g);
+    if (g->finworker != NULL) {
+      handover(g->finworker, l);
+      return;
+    }
+#endif
+    runnativefins(g->frealloc, g->ud, l);
+  }
+}
+
+
+/*
+** Called when closing the state: run all pending native finalizers
+** and stop their thread.
+*/
+static void endnativefins (global_State *g) {
+#if defined(LUAI_FINALIZERTHREAD)
+  if (g->finworker != NULL) {
+    if (g->nativefin != NULL) {
+      handover(g->finworker, g->nativefin);
+      g->nativefin = NULL;
+    }
+    stopworker(g);
+  }
+#endif
+  runnativefins(g->frealloc, g->ud, g->nativefin);
+  g->nativefin = NULL;
+}
+
 /* }====================================================== */
 
 
@@ -768,6 +1232,8 @@ static void freeupval (lua_State *L, UpVal *uv) {
 
 
 static void freeobj (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  l_mem debt = g->GCdebt;  /* to count the bytes freed */
   switch (o->tt) {
     case LUA_VPROTO:
       luaF_freeproto(L, gco2p(o));
@@ -793,7 +1259,10 @@ static void freeobj (lua_State *L, GCObject *o) {
       break;
     case LUA_VUSERDATA: {
       Udata *u = gco2u(o);
-      luaM_freemem(L, o, sizeudata(u->nuvalue, u->len));
+      if (u->nativefin)
+        queuenativefin(g, u);
+      else
+        luaM_freemem(L, o, sizeudata(u->nuvalue, u->len));
       break;
     }
     case LUA_VSHRSTR: {
@@ -809,6 +1278,7 @@ static void freeobj (lua_State *L, GCObject *o) {
     }
     default: lua_assert(0);
   }
+  g->gcstats.freed += cast(lua_Unsigned, debt - g->GCdebt);
 }
 
 
@@ -1358,8 +1828,13 @@ static void enterinc (global_State *g) {
 void luaC_changemode (lua_State *L, int newmode) {
   global_State *g = G(L);
   if (newmode != g->gckind) {
-    if (newmode == KGC_GEN)  /* entering generational mode? */
-      entergen(L, g);
+    if (newmode == KGC_GEN) {  /* entering generational mode? */
+      startclock(g);
+      g->gcgenwork = 1;
+      entergen(L, g);  /* does a major collection */
+      g->gcgenwork = 0;
+      genaccount(L, g, LUA_GCPMAJOR);
+    }
     else
       enterinc(g);  /* entering incremental mode */
   }
@@ -1436,8 +1911,11 @@ static void stepgenfull (lua_State *L, global_State *g) {
 **
 ** 'GCdebt <= 0' means an explicit call to GC step with "size" zero;
 ** in that case, do a minor collection.
+**
+** Returns the kind of collection it did (LUA_GCPMINOR or LUA_GCPMAJOR).
 */
-static void genstep (lua_State *L, global_State *g) {
+static int genstep (lua_State *L, global_State *g) {
+  int kind = LUA_GCPMAJOR;
   if (g->lastatomic != 0)  /* last collection was a bad one? */
     stepgenfull(L, g);  /* do a full step */
   else {
@@ -1459,9 +1937,11 @@ static void genstep (lua_State *L, global_State *g) {
       youngcollection(L, g);
       setminordebt(g);
       g->GCestimate = majorbase;  /* preserve base value */
+      kind = LUA_GCPMINOR;
     }
   }
   lua_assert(isdecGCmodegen(g));
+  return kind;
 }
 
 /* }====================================================== */
@@ -1517,6 +1997,7 @@ void luaC_freeallobjects (lua_State *L) {
   lua_assert(g->finobj == NULL);  /* no new finalizers */
   deletelist(L, g->fixedgc, NULL);  /* collect fixed objects */
   lua_assert(g->strt.nuse == 0);
+  endnativefins(g);
 }
 
 
@@ -1582,6 +2063,7 @@ static int sweepstep (lua_State *L, global_State *g,
 
 static lu_mem singlestep (lua_State *L) {
   global_State *g = G(L);
+  int oldstate = g->gcstate;
   lu_mem work;
   lua_assert(!g->gcstopem);  /* collector is not reentrant */
   g->gcstopem = 1;  /* no emergency collections while collecting */
@@ -1594,6 +2076,13 @@ static lu_mem singlestep (lua_State *L) {
     }
     case GCSpropagate: {
       if (g->gray == NULL) {  /* no more gray objects? */
+        if (!g->gcprecleaned) {  /* first time in this cycle? */
+          g->gcprecleaned = 1;
+          if (precleangrayagain(g)) {  /* something to traverse again? */
+            work = 0;
+            break;  /* keep propagating */
+          }
+        }
         g->gcstate = GCSenteratomic;  /* finish propagate phase */
         work = 0;
       }
@@ -1638,6 +2127,8 @@ static lu_mem singlestep (lua_State *L) {
     }
     default: lua_assert(0); return 0;
   }
+  if (g->gcstate != oldstate)
+    phasechange(L, g, oldstate);
   g->gcstopem = 0;
   return work;
 }
@@ -1655,6 +2146,105 @@ void luaC_runtilstate (lua_State *L, int statesmask) {
 
 
 
+/*
+** {======================================================
+** Timed pacing: incremental steps are limited by an amount of work
+** that is adjusted from the measured duration of previous steps, so
+** that each one takes about 'gcsteptime' microseconds. (Atomic steps
+** and finalizers cannot be split, so they may take longer.) Work owed
+** beyond that limit stays as debt, making the next step come sooner.
+** =======================================================
+*/
+
+/*
+** True if the heap grew beyond the limit set by 'gcmaxgrowth' (a
+** percentage of the estimate of live data); then the collector goes
+** back to its regular pacing until the end of the cycle.
+*/
+static int overgrowth (global_State *g) {
+  return (g->gcmaxgrowth > 0 &&
+          gettotalbytes(g) / g->gcmaxgrowth > g->GCestimate / 100);
+}
+
+
+/*
+** Adjust the work per step so that a step doing 'done' units of work
+** in 'elapsed' microseconds would take 3/4 of 'gcsteptime', leaving
+** some room for the variation among steps. (Changes are smoothed to
+** absorb noise in the measures.)
+*/
+static void adjuststepwork (global_State *g, l_mem done, lu_mem elapsed) {
+  l_mem target = g->gcsteptime - g->gcsteptime / 4 + 1;
+  l_mem w;
+  if (elapsed == 0)  /* too fast to be measured? */
+    w = done * 2;
+  else if (done <= MAX_LMEM / target)
+    w = done * target / cast(l_mem, elapsed);
+  else  /* avoid overflows */
+    w = done / cast(l_mem, elapsed) * target;
+  w = g->gcstepwork / 2 + w / 2;
+  if (w < MINSTEPWORK)
+    w = MINSTEPWORK;
+  else if (w > MAX_LMEM / 4)
+    w = MAX_LMEM / 4;
+  g->gcstepwork = w;
+}
+
+
+/*
+** Run single steps until doing the current amount of work per step.
+** The clock is also checked after each eighth of that amount, to cut
+** steps slower than predicted.
+*/
+static void timedstep (lua_State *L, global_State *g, l_mem debt,
+                                                      int stepmul) {
+  l_mem done = 0;
+  l_mem check = g->gcstepwork / 8;
+  lu_mem start = luai_gcclock();
+  lu_mem elapsed = 0;
+  do {  /* repeat until pause, enough work, or time is up */
+    done += singlestep(L);
+    if (done >= check) {
+      elapsed = luai_gcclock() - start;
+      if (elapsed >= cast(lu_mem, g->gcsteptime))
+        break;
+      check += g->gcstepwork / 8;
+    }
+  } while (done < g->gcstepwork && g->gcstate != GCSpause);
+  if (done < check)  /* no clock reading after last single steps? */
+    elapsed = luai_gcclock() - start;
+  adjuststepwork(g, done, elapsed);
+  if (g->gcstate == GCSpause)
+    setpause(g);  /* pause until next cycle */
+  else {  /* keep the rest of the debt (or the credit) */
+    debt = ((debt - done) / stepmul) * WORK2MEM;  /* convert to bytes */
+    luaE_setdebt(g, debt);
+  }
+}
+
+
+/*
+** Set the target duration of incremental steps ('usec' microseconds;
+** 0 turns timed pacing off) and the heap growth (as a percentage of the
+** live data) above which that target is ignored (0 means no limit).
+** Returns the previous target.
+*/
+int luaC_setsteptime (lua_State *L, int usec, int maxgrowth) {
+  global_State *g = G(L);
+  int res = g->gcsteptime;
+  int stepmul = (getgcparam(g->gcstepmul) | 1);
+  g->gcsteptime = (usec > 0) ? usec : 0;
+  g->gcmaxgrowth = (maxgrowth > 0) ? maxgrowth : 0;
+  if (g->gcstepwork == 0)  /* first use? start with the regular step */
+    g->gcstepwork = (g->gcstepsize <= log2maxs(l_mem) - 10)
+                  ? ((cast(l_mem, 1) << g->gcstepsize) / WORK2MEM) * stepmul
+                  : MAX_LMEM / 4;
+  return res;
+}
+
+/* }====================================================== */
+
+
 /*
 ** Performs a basic incremental step. The debt and step size are
 ** converted from bytes to "units of work"; then the function loops
@@ -1668,6 +2258,10 @@ static void incstep (lua_State *L, global_State *g) {
   l_mem stepsize = (g->gcstepsize <= log2maxs(l_mem))
                  ? ((cast(l_mem, 1) << g->gcstepsize) / WORK2MEM) * stepmul
                  : MAX_LMEM;  /* overflow; keep maximum value */
+  if (g->gcsteptime > 0 && !overgrowth(g)) {
+    timedstep(L, g, debt, stepmul);
+    return;
+  }
   do {  /* repeat until pause or enough "credit" (negative debt) */
     lu_mem work = singlestep(L);  /* perform one single step */
     debt -= work;
@@ -1690,11 +2284,23 @@ void luaC_step (lua_State *L) {
   if (!gcrunning(g))  /* not running? */
     luaE_setdebt(g, -2000);
   else {
-    if(isdecGCmodegen(g))
-      genstep(L, g);
-    else
+    startclock(g);
+    g->gcstats.steps++;
+    if(isdecGCmodegen(g)) {
+      int kind;
+      g->gcgenwork = 1;
+      kind = genstep(L, g);
+      g->gcgenwork = 0;
+      genaccount(L, g, kind);
+    }
+    else {
       incstep(L, g);
+      chargetime(g, timephase(g->gcstate));
+    }
+    flushnativefins(g);
   }
+  if (!g->memarmed && g->memsoft != 0 && gettotalbytes(g) <= g->memsoft)
+    luaE_setmemcheck(g);  /* back below the soft limit: check it again */
 }
 
 
@@ -1727,10 +2333,19 @@ void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   lua_assert(!g->gcemergency);
   g->gcemergency = isemergency;  /* set flag */
-  if (g->gckind == KGC_INC)
+  startclock(g);
+  if (g->gckind == KGC_INC) {
     fullinc(L, g);
-  else
+    chargetime(g, timephase(g->gcstate));
+  }
+  else {
+    g->gcgenwork = 1;
     fullgen(L, g);
+    g->gcgenwork = 0;
+    genaccount(L, g, LUA_GCPMAJOR);
+  }
+  luaE_freestackpool(L);  /* release stacks kept for new threads */
+  flushnativefins(g);
   g->gcemergency = 0;
 }
 
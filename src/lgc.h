@@ -140,6 +140,9 @@
 /* how much to allocate before next GC step (log2) */
 #define LUAI_GCSTEPSIZE 13      /* 8 KB */
 
+/* minimum work (in units) for a step in timed pacing */
+#define MINSTEPWORK	64
+
 
 /*
 ** Check whether the declared GC mode is generational. While in
@@ -197,6 +200,7 @@ LUAI_FUNC void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v);
 LUAI_FUNC void luaC_barrierback_ (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_changemode (lua_State *L, int newmode);
+LUAI_FUNC int luaC_setsteptime (lua_State *L, int usec, int maxgrowth);
 
 
 #endif
@@ -54,6 +54,29 @@ static const luaL_Reg loadedlibs[] = {
 };
 
 
+/*
+** these libs are only preloaded: a Lua program must 'require' them
+*/
+static const luaL_Reg preloadedlibs[] = {
+  {LUA_PROFLIBNAME, luaopen_profile},
+  {LUA_ARRAYLIBNAME, luaopen_array},
+  {LUA_JSONLIBNAME, luaopen_json},
+  {LUA_MSGPACKLIBNAME, luaopen_msgpack},
+  {NULL, NULL}
+};
+
+
+static void preloadlibs (lua_State *L) {
+  const luaL_Reg *lib;
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+  for (lib = preloadedlibs; lib->func; lib++) {
+    lua_pushcfunction(L, lib->func);
+    lua_setfield(L, -2, lib->name);
+  }
+  lua_pop(L, 1);  /* remove PRELOAD table */
+}
+
+
 LUALIB_API void luaL_openlibs (lua_State *L) {
   const luaL_Reg *lib;
   /* "require" functions from 'loadedlibs' and set results to global table */
@@ -61,5 +84,134 @@ LUALIB_API void luaL_openlibs (lua_State *L) {
     luaL_requiref(L, lib->name, lib->func, 1);
     lua_pop(L, 1);  /* remove lib */
   }
+  preloadlibs(L);
+}
+
+
+/*
+** {======================================================
+** Lazy loading
+** 'luaL_openlibslazy' opens only the basic library and preloads the
+** libraries in 'preloadedlibs'. Any other library in 'loadedlibs' is
+** opened on its first use: an access to its global
+** name (through an '__index' metamethod in the global table), a call
+** to 'require' (through the preload table) or, for the string library,
+** an access to a string method or an arithmetic on a string (through a
+** provisory metatable for strings, which 'luaopen_string' replaces).
+** =======================================================
+*/
+
+
+/*
+** '__index' metamethod for the global table. Upvalue 1 maps the names
+** of libraries not yet opened to their indices in 'loadedlibs'; the
+** name "require" maps to the package library.
+*/
+static int lazyglobal (lua_State *L) {
+  lua_settop(L, 2);
+  lua_pushvalue(L, 2);
+  if (lua_rawget(L, lua_upvalueindex(1)) == LUA_TNUMBER) {
+    const luaL_Reg *lib = &loadedlibs[lua_tointeger(L, 3)];
+    luaL_requiref(L, lib->name, lib->func, 1);
+    lua_pushnil(L);
+    lua_setfield(L, lua_upvalueindex(1), lib->name);  /* done with it */
+    lua_settop(L, 2);
+    lua_rawget(L, 1);  /* get the name from the updated table */
+  }
+  return 1;
 }
 
+
+/*
+** Open the string library, which replaces the provisory metatable for
+** strings. Upvalue 1 is the same as in 'lazyglobal'.
+*/
+static void openstrlib (lua_State *L) {
+  luaL_requiref(L, LUA_STRLIBNAME, luaopen_string, 1);
+  lua_pushnil(L);
+  lua_setfield(L, lua_upvalueindex(1), LUA_STRLIBNAME);  /* done with it */
+}
+
+
+/* '__index' metamethod of the provisory metatable for strings */
+static int lazystring (lua_State *L) {
+  openstrlib(L);
+  lua_pushvalue(L, 2);
+  lua_gettable(L, -2);
+  return 1;
+}
+
+
+#if !defined(LUA_NOCVTS2N)
+
+/*
+** Arithmetic metamethods of the provisory metatable for strings (the
+** same ones the string library sets, for coercions of strings to
+** numbers): open the string library and redo the operation, whose
+** code is upvalue 2.
+*/
+static int lazyarith (lua_State *L) {
+  int op = (int)lua_tointeger(L, lua_upvalueindex(2));
+  openstrlib(L);
+  lua_settop(L, (op == LUA_OPUNM) ? 1 : 2);
+  lua_arith(L, op);
+  return 1;
+}
+
+
+static const struct {
+  const char *name;
+  int op;
+} arithevents[] = {
+  {"__add", LUA_OPADD}, {"__sub", LUA_OPSUB}, {"__mul", LUA_OPMUL},
+  {"__mod", LUA_OPMOD}, {"__pow", LUA_OPPOW}, {"__div", LUA_OPDIV},
+  {"__idiv", LUA_OPIDIV}, {"__unm", LUA_OPUNM}, {NULL, 0}
+};
+
+#endif
+
+
+LUALIB_API void luaL_openlibslazy (lua_State *L) {
+  const luaL_Reg *lib;
+#if !defined(LUA_NOCVTS2N)
+  int i;
+#endif
+  luaL_requiref(L, LUA_GNAME, luaopen_base, 1);
+  preloadlibs(L);
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+  lua_createtable(L, 0, sizeof(loadedlibs) / sizeof(loadedlibs[0]));
+  for (lib = loadedlibs + 1; lib->func; lib++) {  /* skip basic library */
+    lua_pushcfunction(L, lib->func);
+    lua_setfield(L, -3, lib->name);  /* preload[name] = func */
+    lua_pushinteger(L, lib - loadedlibs);
+    lua_setfield(L, -2, lib->name);
+    if (lib->func == luaopen_package) {
+      lua_pushinteger(L, lib - loadedlibs);
+      lua_setfield(L, -2, "require");
+    }
+  }
+  lua_pushliteral(L, "");
+  lua_createtable(L, 0, 9);  /* provisory metatable for strings */
+  lua_pushvalue(L, -3);
+  lua_pushcclosure(L, lazystring, 1);
+  lua_setfield(L, -2, "__index");
+#if !defined(LUA_NOCVTS2N)
+  for (i = 0; arithevents[i].name != NULL; i++) {
+    lua_pushvalue(L, -3);
+    lua_pushinteger(L, arithevents[i].op);
+    lua_pushcclosure(L, lazyarith, 2);
+    lua_setfield(L, -2, arithevents[i].name);
+  }
+#endif
+  lua_setmetatable(L, -2);
+  lua_pop(L, 1);  /* remove string */
+  lua_createtable(L, 0, 1);  /* metatable for the global table */
+  lua_rotate(L, -2, 1);
+  lua_pushcclosure(L, lazyglobal, 1);
+  lua_setfield(L, -2, "__index");
+  lua_setmetatable(L, -3);
+  lua_pop(L, 2);  /* remove preload table and global table */
+}
+
+/* }====================================================== */
+
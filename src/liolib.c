@@ -96,10 +96,12 @@ static int l_checkmode (const char *mode) {
 
 #if defined(LUA_USE_POSIX)
 #define l_getc(f)		getc_unlocked(f)
+#define l_putc(c,f)		putc_unlocked(c,f)
 #define l_lockfile(f)		flockfile(f)
 #define l_unlockfile(f)		funlockfile(f)
 #else
 #define l_getc(f)		getc(f)
+#define l_putc(c,f)		putc(c,f)
 #define l_lockfile(f)		((void)0)
 #define l_unlockfile(f)		((void)0)
 #endif
@@ -107,6 +109,40 @@ static int l_checkmode (const char *mode) {
 #endif				/* } */
 
 
+/*
+** l_writev writes the pieces gathered by 'g_write' straight to the
+** file descriptor of a stream, after flushing the stream. It is used
+** only for outputs of at least IO_VECTORSIZE bytes, which do not
+** profit from the stream buffer anyway.
+*/
+#if !defined(l_writev)		/* { */
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define l_iovec			struct iovec
+#define l_iobase(v)		((v).iov_base)
+#define l_iolen(v)		((v).iov_len)
+#define l_writev(f,v,n)		writev(fileno(f), v, n)
+
+#else				/* }{ */
+
+typedef struct l_iovec { void *iov_base; size_t iov_len; } l_iovec;
+#define l_iobase(v)		((v).iov_base)
+#define l_iolen(v)		((v).iov_len)
+
+#endif				/* } */
+
+#endif				/* } */
+
+
+#if !defined(IO_VECTORSIZE)
+#define IO_VECTORSIZE		(8 * LUAL_BUFFERSIZE)
+#endif
+
+
 /*
 ** {======================================================
 ** l_fseek: configuration for longer offsets
@@ -516,18 +552,53 @@ static int test_eof (lua_State *L, FILE *f) {
 }
 
 
+/*
+** Read the next piece of a line into 'buff' (a buffer with
+** LUAL_BUFFERSIZE bytes) and return its size. '*c' is set to '\n'
+** when the piece ends the line (the newline is not included), to EOF
+** at end of file, or to 0 when the buffer filled up first. 'fgets'
+** does not report how many bytes it read. Its last byte works as a
+** sentinel, which 'fgets' overwrites only when it fills the buffer;
+** otherwise, a line that did not end the file ended with the first
+** newline in the buffer, so embedded zeros are kept. (A last line
+** without a newline is measured with 'strlen', and so it is cut at an
+** embedded zero.)
+*/
+static size_t read_linepiece (FILE *f, char *buff, int *c) {
+  const char *nl;
+  buff[LUAL_BUFFERSIZE - 1] = '\n';  /* sentinel */
+  if (fgets(buff, LUAL_BUFFERSIZE, f) == NULL) {
+    *c = EOF;  /* nothing read */
+    return 0;
+  }
+  if (buff[LUAL_BUFFERSIZE - 1] == '\0') {  /* buffer filled up? */
+    *c = (buff[LUAL_BUFFERSIZE - 2] == '\n') ? '\n' : 0;
+    return LUAL_BUFFERSIZE - 1 - (*c == '\n');
+  }
+  else if (!feof(f) &&
+           (nl = (const char *)memchr(buff, '\n', LUAL_BUFFERSIZE)) != NULL) {
+    *c = '\n';  /* read a newline */
+    return nl - buff;
+  }
+  else {  /* line ended at the end of the file */
+    size_t l = strlen(buff);
+    if (l > 0 && buff[l - 1] == '\n') {  /* still read a newline? */
+      *c = '\n';
+      return l - 1;
+    }
+    *c = EOF;
+    return l;
+  }
+}
+
+
 static int read_line (lua_State *L, FILE *f, int chop) {
   luaL_Buffer b;
   int c;
   luaL_buffinit(L, &b);
   do {  /* may need to read several chunks to get whole line */
     char *buff = luaL_prepbuffer(&b);  /* preallocate buffer space */
-    int i = 0;
-    l_lockfile(f);  /* no memory errors can happen inside the lock */
-    while (i < LUAL_BUFFERSIZE && (c = l_getc(f)) != EOF && c != '\n')
-      buff[i++] = c;  /* read up to end of line or buffer limit */
-    l_unlockfile(f);
-    luaL_addsize(&b, i);
+    luaL_addsize(&b, read_linepiece(f, buff, &c));
   } while (c != EOF && c != '\n');  /* repeat until end of line */
   if (!chop && c == '\n')  /* want a newline and have one? */
     luaL_addchar(&b, c);  /* add ending newline to result */
@@ -657,25 +728,167 @@ static int io_readline (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** Maximum number of pieces 'g_write' gathers before writing them, and
+** space to format a number.
+*/
+#define IO_MAXPIECES	16
+#define IO_MAXNUMLEN	44
+
+/* pieces up to this size are copied into a locked stream with 'l_putc' */
+#define IO_SMALLPIECE	64
+
+
+/*
+** A piece with a NULL base is a float, kept in 'num' until it is
+** written; formatting it straight into the stream is cheaper than
+** going through a separate buffer.
+*/
+typedef struct Pieces {
+  int n;  /* number of pieces */
+  size_t total;  /* total length of the pieces */
+  l_iovec v[IO_MAXPIECES];
+  union {
+    lua_Number f;
+    char s[IO_MAXNUMLEN];
+  } num[IO_MAXPIECES];  /* space for numbers */
+} Pieces;
+
+
+/*
+** Convert an integer to decimal, as LUA_INTEGER_FMT does, at the end
+** of 'buff'; return the start of the result.
+*/
+static char *inttostr (char *buff, lua_Integer i) {
+  char *s = buff + IO_MAXNUMLEN;
+  lua_Unsigned u = (i < 0) ? 0u - (lua_Unsigned)i : (lua_Unsigned)i;
+  do {
+    *--s = (char)('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (i < 0)
+    *--s = '-';
+  return s;
+}
+
+
+#if defined(l_writev)
+
+/*
+** Write all pieces with 'l_writev', retrying after partial writes.
+*/
+static int writevector (FILE *f, Pieces *p) {
+  l_iovec *v = p->v;
+  int n = p->n;
+  int i;
+  for (i = 0; i < n; i++) {  /* format floats */
+    if (l_iobase(v[i]) == NULL) {
+      lua_Number x = p->num[i].f;
+      l_iobase(v[i]) = p->num[i].s;
+      l_iolen(v[i]) = (size_t)l_sprintf(p->num[i].s, IO_MAXNUMLEN,
+                                LUA_NUMBER_FMT, (LUAI_UACNUMBER)x);
+    }
+  }
+  if (fflush(f) != 0)
+    return 0;
+  while (n > 0) {
+    ssize_t w = l_writev(f, v, n);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+    while (n > 0 && (size_t)w >= l_iolen(*v)) {  /* skip written pieces */
+      w -= l_iolen(*v);
+      v++; n--;
+    }
+    if (n > 0) {  /* partial piece? */
+      l_iobase(*v) = (char *)l_iobase(*v) + w;
+      l_iolen(*v) -= w;
+    }
+  }
+  return 1;
+}
+
+#endif
+
+
+/*
+** Write the gathered pieces to 'f' and empty 'p'. Small outputs go
+** through the stream buffer under a single lock.
+*/
+static int writepieces (FILE *f, Pieces *p) {
+  int status = 1;
+  int i;
+  l_lockfile(f);
+#if defined(l_writev)
+  if (p->total >= IO_VECTORSIZE && p->n > 1)
+    status = writevector(f, p);
+  else
+#endif
+  for (i = 0; i < p->n && status; i++) {
+    const char *s = (const char *)l_iobase(p->v[i]);
+    size_t l = l_iolen(p->v[i]);
+    if (s == NULL)  /* float? */
+      status = (fprintf(f, LUA_NUMBER_FMT,
+                           (LUAI_UACNUMBER)p->num[i].f) > 0);
+    else if (l <= IO_SMALLPIECE) {
+      for (; l > 0 && status; l--)
+        status = (l_putc(*s++, f) != EOF);
+    }
+    else
+      status = (fwrite(s, sizeof(char), l, f) == l);
+  }
+  l_unlockfile(f);
+  p->n = 0;
+  p->total = 0;
+  return status;
+}
+
+
+/*
+** Gather the arguments into pieces and write them in batches of
+** IO_MAXPIECES. Pieces gathered before an invalid argument are
+** written before the error is raised, as if they were written one
+** by one.
+*/
 static int g_write (lua_State *L, FILE *f, int arg) {
   int nargs = lua_gettop(L) - arg;
   int status = 1;
+  Pieces p;
+  p.n = 0;
+  p.total = 0;
   for (; nargs--; arg++) {
+    size_t l;
+    const char *s;
     if (lua_type(L, arg) == LUA_TNUMBER) {
-      /* optimization: could be done exactly as for strings */
-      int len = lua_isinteger(L, arg)
-                ? fprintf(f, LUA_INTEGER_FMT,
-                             (LUAI_UACINT)lua_tointeger(L, arg))
-                : fprintf(f, LUA_NUMBER_FMT,
-                             (LUAI_UACNUMBER)lua_tonumber(L, arg));
-      status = status && (len > 0);
+      if (lua_isinteger(L, arg)) {
+        char *buff = p.num[p.n].s;
+        s = inttostr(buff, lua_tointeger(L, arg));
+        l = (size_t)(buff + IO_MAXNUMLEN - s);
+      }
+      else {
+        p.num[p.n].f = lua_tonumber(L, arg);
+        s = NULL;  /* formatted when written */
+        l = 0;
+      }
     }
     else {
-      size_t l;
-      const char *s = luaL_checklstring(L, arg, &l);
-      status = status && (fwrite(s, sizeof(char), l, f) == l);
+      s = (lua_type(L, arg) == LUA_TUSERDATA)
+        ? luaL_tobuffer(L, arg, &l) : NULL;  /* string buffer? */
+      if (s == NULL) {
+        if (!lua_isstring(L, arg) && p.n > 0)  /* going to raise an error? */
+          status = writepieces(f, &p) && status;  /* write previous ones */
+        s = luaL_checklstring(L, arg, &l);
+      }
     }
+    l_iobase(p.v[p.n]) = (void *)s;
+    l_iolen(p.v[p.n]) = l;
+    p.total += l;
+    if (++p.n == IO_MAXPIECES)
+      status = writepieces(f, &p) && status;
   }
+  if (p.n > 0)
+    status = writepieces(f, &p) && status;
   if (l_likely(status))
     return 1;  /* file handle already on stack top */
   else return luaL_fileresult(L, status, NULL);
@@ -720,6 +933,10 @@ static int f_setvbuf (lua_State *L) {
   int op = luaL_checkoption(L, 2, NULL, modenames);
   lua_Integer sz = luaL_optinteger(L, 3, LUAL_BUFFERSIZE);
   int res = setvbuf(f, NULL, mode[op], (size_t)sz);
+  if (f == stdout && res == 0) {  /* tell 'print' whether to flush */
+    lua_pushboolean(L, mode[op] != _IOFBF);
+    lua_setfield(L, LUA_REGISTRYINDEX, LUA_PRINTFLUSH_KEY);
+  }
   return luaL_fileresult(L, res == 0, NULL);
 }
 
@@ -8,12 +8,25 @@
 #undef vmdispatch
 #undef vmcase
 #undef vmbreak
+#undef updatedisp
+#undef vmtrapentry
 
 #define vmdispatch(x)     goto *disptab[x];
 
 #define vmcase(l)     L_##l:
 
-#define vmbreak		vmfetch(); vmdispatch(GET_OPCODE(i));
+/*
+** 'vmbreak' does not test 'trap': it dispatches through 'dt', which
+** is 'traptab' while there is a trap (stack reallocation or hooks).
+** All entries of 'traptab' go back to the top of the main loop, where
+** the instruction is fetched again by the full 'vmfetch', which handles
+** the trap, and dispatched through 'disptab'.
+*/
+#define vmbreak		{ i = *(pc++); goto *dt[GET_OPCODE(i)]; }
+
+#define updatedisp()	(dt = l_unlikely(trap) ? traptab : disptab)
+
+#define vmtrapentry()	if (0) { L_TRAP: pc--; /* undo the fetch */ }
 
 
 static const void *const disptab[NUM_OPCODES] = {
@@ -107,6 +120,28 @@ static const void *const disptab[NUM_OPCODES] = {
 &&L_OP_CLOSURE,
 &&L_OP_VARARG,
 &&L_OP_VARARGPREP,
-&&L_OP_EXTRAARG
+&&L_OP_EXTRAARG,
+&&L_OP_GETFIELD2,
+&&L_OP_GETFIELDEQK,
+&&L_OP_GETFIELDADD,
+&&L_OP_GETTABUPFIELD,
+&&L_OP_SETFIELD2
 
 };
+
+
+/* all possible opcodes go to 'L_TRAP' */
+#define TRAP8	&&L_TRAP, &&L_TRAP, &&L_TRAP, &&L_TRAP, \
+		&&L_TRAP, &&L_TRAP, &&L_TRAP, &&L_TRAP
+#define TRAP64	TRAP8, TRAP8, TRAP8, TRAP8, TRAP8, TRAP8, TRAP8, TRAP8
+
+static const void *const traptab[1 << SIZE_OP] = {
+  TRAP64, TRAP64
+};
+
+#undef TRAP8
+#undef TRAP64
+
+/* current dispatch table */
+const void *const *dt = disptab;
+
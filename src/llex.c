@@ -100,6 +100,8 @@ static const char *txtToken (LexState *ls, int token) {
   switch (token) {
     case TK_NAME: case TK_STRING:
     case TK_FLT: case TK_INT:
+      if (token == TK_NAME && luaZ_bufflen(ls->buff) == 0)  /* in block? */
+        return luaO_pushfstring(ls->L, "'%s'", getstr(ls->t.seminfo.ts));
       save(ls, '\0');
       return luaO_pushfstring(ls->L, "'%s'", luaZ_buffer(ls->buff));
     default:
@@ -122,18 +124,11 @@ l_noret luaX_syntaxerror (LexState *ls, const char *msg) {
 
 
 /*
-** Creates a new string and anchors it in scanner's table so that it
-** will not be collected until the end of the compilation; by that time
-** it should be anchored somewhere. It also internalizes long strings,
-** ensuring there is only one copy of each unique string.  The table
-** here is used as a set: the string enters as the key, while its value
-** is irrelevant. We use the string itself as the value only because it
-** is a TValue readily available. Later, the code generation can change
-** this value.
+** Anchor string 'ts' in the scanner table, returning the copy saved
+** there if there is one.
 */
-TString *luaX_newstring (LexState *ls, const char *str, size_t l) {
+static TString *anchorstring (LexState *ls, TString *ts) {
   lua_State *L = ls->L;
-  TString *ts = luaS_newlstr(L, str, l);  /* create new string */
   const TValue *o = luaH_getstr(ls->h, ts);
   if (!ttisnil(o))  /* string already present? */
     ts = keystrval(nodefromval(o));  /* get saved copy */
@@ -149,6 +144,21 @@ TString *luaX_newstring (LexState *ls, const char *str, size_t l) {
 }
 
 
+/*
+** Creates a new string and anchors it in scanner's table so that it
+** will not be collected until the end of the compilation; by that time
+** it should be anchored somewhere. It also internalizes long strings,
+** ensuring there is only one copy of each unique string.  The table
+** here is used as a set: the string enters as the key, while its value
+** is irrelevant. We use the string itself as the value only because it
+** is a TValue readily available. Later, the code generation can change
+** this value.
+*/
+TString *luaX_newstring (LexState *ls, const char *str, size_t l) {
+  return anchorstring(ls, luaS_newkstr(ls->L, str, l));
+}
+
+
 /*
 ** increment line number and skips newline sequence (any of
 ** \n, \r, \n\r, or \r\n)
@@ -211,6 +221,146 @@ static int check_next2 (LexState *ls, const char *set) {
 }
 
 
+/*
+** {======================================================
+** Block scanning
+** Most lexical elements end inside the block of input that the reader
+** gave to the ZIO, so they can be scanned right there, without going
+** through 'next' and 'save' for each character. The current character
+** is always the last one taken from the block, at 'z->p - 1'. Scanners
+** that need a whole element in the block give up (returning 0 or NULL)
+** when the element reaches the end of the block, before consuming any
+** input, and then the element is read character by character.
+** =======================================================
+*/
+
+/* position of the current character and end of the current block */
+#define currpos(ls)	((ls)->z->p - 1)
+#define blockend(ls)	((ls)->z->p + (ls)->z->n)
+
+
+/*
+** Make the character at 'p' (inside the current block) the current
+** one, or go to the next block if 'p' is the end of the current one.
+*/
+static void skipto (LexState *ls, const char *p) {
+  ZIO *z = ls->z;
+  lua_assert(z->p <= p && p <= blockend(ls));
+  z->n -= cast_sizet(p - z->p);
+  z->p = p;
+  next(ls);
+}
+
+
+/* add 'l' characters from 's' to the buffer */
+static void savespan (LexState *ls, const char *s, size_t l) {
+  Mbuffer *b = ls->buff;
+  if (luaZ_sizebuffer(b) - luaZ_bufflen(b) < l) {
+    size_t newsize = luaZ_sizebuffer(b);
+    if (l >= MAX_SIZE/2 - luaZ_bufflen(b))
+      lexerror(ls, "lexical element too long", 0);
+    while (newsize - luaZ_bufflen(b) < l)
+      newsize *= 2;
+    luaZ_resizebuffer(ls->L, b, newsize);
+  }
+  memcpy(b->buffer + luaZ_bufflen(b), s, l);
+  luaZ_bufflen(b) += l;
+}
+
+
+/* skip spaces on a line */
+static void skipspaces (LexState *ls) {
+  const char *p = ls->z->p;
+  const char *e = blockend(ls);
+  while (p < e && (*p == ' ' || *p == '\t'))
+    p++;
+  skipto(ls, p);
+}
+
+
+/* skip a short comment, up to the end of the line */
+static void skipline (LexState *ls) {
+  const char *p = ls->z->p;
+  const char *e = blockend(ls);
+  while (p < e && *p != '\n' && *p != '\r')
+    p++;
+  skipto(ls, p);
+}
+
+
+/*
+** Scan a name starting at the current character, returning its length,
+** or 0 if it may go on in the next block.
+*/
+static size_t scanname (LexState *ls) {
+  const char *s = currpos(ls);
+  const char *p = ls->z->p;
+  const char *e = blockend(ls);
+  while (p < e && lislalnum(cast_uchar(*p)))
+    p++;
+  return (p < e) ? cast_sizet(p - s) : 0;
+}
+
+
+/*
+** Scan a short string without escape sequences, returning it (without
+** the delimiters), or NULL if it has escapes or does not end in the
+** current block.
+*/
+static TString *scanstring (LexState *ls, int del) {
+  const char *s = ls->z->p;  /* first character after the delimiter */
+  const char *p = s;
+  const char *e = blockend(ls);
+  while (p < e && *p != del && *p != '\\' && *p != '\n' && *p != '\r')
+    p++;
+  if (p < e && *p == del) {
+    TString *ts = luaX_newstring(ls, s, cast_sizet(p - s));
+    savespan(ls, s - 1, cast_sizet(p - s) + 2);  /* text for messages */
+    skipto(ls, p + 1);  /* skip the string and its closing delimiter */
+    return ts;
+  }
+  else
+    return NULL;
+}
+
+
+/*
+** Copy to the buffer a numeral starting at the current character,
+** following 'read_numeral', and return 1; return 0 (with the buffer
+** untouched) if the numeral may go on in the next block.
+*/
+static int scannumeral (LexState *ls) {
+  const char *s = currpos(ls);
+  const char *p = ls->z->p;
+  const char *e = blockend(ls);
+  int expo = 'e';
+  if (*s == '0' && p < e && (*p == 'x' || *p == 'X')) {  /* hexadecimal? */
+    expo = 'p';
+    p++;
+  }
+  for (;;) {
+    if (p == e) return 0;
+    else if ((*p | ('a' ^ 'A')) == expo) {  /* exponent mark? */
+      p++;
+      if (p < e && (*p == '-' || *p == '+'))  /* optional exponent sign */
+        p++;
+    }
+    else if (lisxdigit(cast_uchar(*p)) || *p == '.')
+      p++;
+    else break;
+  }
+  if (lislalpha(cast_uchar(*p))) {  /* is numeral touching a letter? */
+    p++;  /* include it, to force an error */
+    if (p == e) return 0;
+  }
+  savespan(ls, s, cast_sizet(p - s));
+  skipto(ls, p);
+  return 1;
+}
+
+/* }====================================================== */
+
+
 /* LUA_NUMBER */
 /*
 ** This function is quite liberal in what it accepts, as 'luaO_str2num'
@@ -226,21 +376,23 @@ static int check_next2 (LexState *ls, const char *set) {
 */
 static int read_numeral (LexState *ls, SemInfo *seminfo) {
   TValue obj;
-  const char *expo = "Ee";
-  int first = ls->current;
   lua_assert(lisdigit(ls->current));
-  save_and_next(ls);
-  if (first == '0' && check_next2(ls, "xX"))  /* hexadecimal? */
-    expo = "Pp";
-  for (;;) {
-    if (check_next2(ls, expo))  /* exponent mark? */
-      check_next2(ls, "-+");  /* optional exponent sign */
-    else if (lisxdigit(ls->current) || ls->current == '.')  /* '%x|%.' */
-      save_and_next(ls);
-    else break;
+  if (luaZ_bufflen(ls->buff) > 0 || !scannumeral(ls)) {  /* slow path? */
+    const char *expo = "Ee";
+    int first = ls->current;
+    save_and_next(ls);
+    if (first == '0' && check_next2(ls, "xX"))  /* hexadecimal? */
+      expo = "Pp";
+    for (;;) {
+      if (check_next2(ls, expo))  /* exponent mark? */
+        check_next2(ls, "-+");  /* optional exponent sign */
+      else if (lisxdigit(ls->current) || ls->current == '.')  /* '%x|%.' */
+        save_and_next(ls);
+      else break;
+    }
+    if (lislalpha(ls->current))  /* is numeral touching a letter? */
+      save_and_next(ls);  /* force an error */
   }
-  if (lislalpha(ls->current))  /* is numeral touching a letter? */
-    save_and_next(ls);  /* force an error */
   save(ls, '\0');
   if (luaO_str2num(luaZ_buffer(ls->buff), &obj) == 0)  /* format error? */
     lexerror(ls, "malformed number", TK_FLT);
@@ -380,6 +532,8 @@ static int readdecesc (LexState *ls) {
 
 
 static void read_string (LexState *ls, int del, SemInfo *seminfo) {
+  if ((seminfo->ts = scanstring(ls, del)) != NULL)
+    return;  /* whole string was in the block */
   save_and_next(ls);  /* keep delimiter (for error messages) */
   while (ls->current != del) {
     switch (ls->current) {
@@ -450,7 +604,11 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         inclinenumber(ls);
         break;
       }
-      case ' ': case '\f': case '\t': case '\v': {  /* spaces */
+      case ' ': case '\t': {  /* spaces */
+        skipspaces(ls);
+        break;
+      }
+      case '\f': case '\v': {  /* other spaces */
         next(ls);
         break;
       }
@@ -469,6 +627,8 @@ static int llex (LexState *ls, SemInfo *seminfo) {
           }
         }
         /* else short comment */
+        if (!currIsNewline(ls) && ls->current != EOZ)
+          skipline(ls);
         while (!currIsNewline(ls) && ls->current != EOZ)
           next(ls);  /* skip until end of line (or end of file) */
         break;
@@ -539,17 +699,27 @@ static int llex (LexState *ls, SemInfo *seminfo) {
       default: {
         if (lislalpha(ls->current)) {  /* identifier or reserved word? */
           TString *ts;
-          do {
-            save_and_next(ls);
-          } while (lislalnum(ls->current));
-          ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
-                                  luaZ_bufflen(ls->buff));
-          seminfo->ts = ts;
+          const char *s = currpos(ls);
+          size_t l = scanname(ls);
+          int token;
+          if (l == 0) {  /* name may go on in the next block? */
+            do {
+              save_and_next(ls);
+            } while (lislalnum(ls->current));
+            s = luaZ_buffer(ls->buff);
+            l = luaZ_bufflen(ls->buff);
+          }
+          ts = luaS_newkstr(ls->L, s, l);
           if (isreserved(ts))  /* reserved word? */
-            return ts->extra - 1 + FIRST_RESERVED;
+            token = ts->extra - 1 + FIRST_RESERVED;  /* (never collected) */
           else {
-            return TK_NAME;
+            ts = anchorstring(ls, ts);
+            token = TK_NAME;
           }
+          seminfo->ts = ts;
+          if (s == currpos(ls))  /* name is still in the block? */
+            skipto(ls, s + l);  /* skip it */
+          return token;
         }
         else {  /* single-char tokens ('+', '*', '%', '{', '}', ...) */
           int c = ls->current;
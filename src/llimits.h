@@ -229,9 +229,10 @@ typedef l_uint32 Instruction;
 
 
 /*
-** Size of cache for strings in the API. 'N' is the number of
+** Size of cache for strings in the API. 'N' is the initial number of
 ** sets (better be a prime) and "M" is the size of each set (M == 1
-** makes a direct cache.)
+** makes a direct cache.) The number of sets can be changed with
+** 'lua_setstrcache'.
 */
 #if !defined(STRCACHE_N)
 #define STRCACHE_N		53
@@ -256,10 +257,113 @@ typedef l_uint32 Instruction;
 #endif
 
 
+/*
+** Maximum number of stacks from dead threads kept for reuse by new
+** threads (0 disables the reuse); see 'stack_init'.
+*/
+#if !defined(LUAI_STACKPOOL)
+#define LUAI_STACKPOOL		128
+#endif
+
+
+/*
+** Inline caches for field accesses: when true, each prototype keeps,
+** for its field-access instructions (including accesses to global
+** variables), the hash slot where the key was last found, so that
+** lookups in tables with the same layout can skip hashing. (Define it
+** as 0 to turn the caches off.)
+*/
+#if !defined(LUAI_FIELDCACHE)
+#define LUAI_FIELDCACHE		1
+#endif
+
+
+/*
+** Whole-function bytecode optimization: when true, the code generator
+** threads jumps to returns and removes unreachable code after
+** generating each function (see 'optimize' in lcode.c).
+*/
+#if !defined(LUAI_OPTIMIZE)
+#define LUAI_OPTIMIZE		1
+#endif
+
+
+/*
+** Superinstructions: when true, frequent pairs of instructions are
+** fused into single opcodes that run both without an intermediate
+** dispatch (see 'luaP_fuse'). (Define it as 0 to turn them off.)
+*/
+#if !defined(LUAI_SUPERINST)
+#define LUAI_SUPERINST		1
+#endif
+
+
+/*
+** Lazy debug information: when true, the undumper keeps the line and
+** local-variable information of each prototype in its encoded form,
+** which is decoded the first time something asks for it (see
+** 'luaU_loaddebug'). (Define it as 0 to decode it at load time.)
+*/
+#if !defined(LUAI_LAZYDEBUG)
+#define LUAI_LAZYDEBUG		1
+#endif
+
+
+/*
+** Hash layout of tables: when true, the hash part of a table uses open
+** addressing with linear probing instead of chained scatter with
+** Brent's variation (see ltable.c). This is experimental, kept for
+** comparisons. (Define it as 1 to use it.)
+*/
+#if !defined(LUAI_HASHPROBE)
+#define LUAI_HASHPROBE		0
+#endif
+
+
+/*
+** Hotness counting: when LUAI_HOTCOUNT is defined, each prototype
+** counts its calls and the back edges of its loops, and every
+** LUAI_HOTCOUNT such events 'luai_hotproto' is called with it. This
+** is the entry point for an execution tier for hot functions (e.g.,
+** a native compiler). The macro runs inside the interpreter loop, so
+** it must neither raise errors nor run Lua code. (Counting is off by
+** default, so that it costs nothing when nobody uses it.)
+*/
+#if defined(LUAI_HOTCOUNT) && !defined(luai_hotproto)
+#define luai_hotproto(L,p)	((void)L, (void)p)
+#endif
+
+
 /*
 ** macros that are executed whenever program enters the Lua core
 ** ('lua_lock') and leaves the core ('lua_unlock')
 */
+#if defined(LUA_USE_THREADLOCK) && !defined(lua_lock)
+/*
+** One mutex in the global state protects the whole core: only one OS
+** thread runs inside it at a time, but any number of them can run C
+** functions, which run outside the core. Lua code gives way to other
+** threads at every collector check ('luai_threadyield'), so those are
+** also the points where the collector runs. The thread entering the
+** core becomes the running one (see 'lua_profrequest').
+*/
+#include <pthread.h>
+#define LUAI_THREADLOCK
+#define lua_lock(L)  \
+	((void)pthread_mutex_lock(&G(L)->lock), (void)(G(L)->running = (L)))
+#define lua_unlock(L)	((void)pthread_mutex_unlock(&G(L)->lock))
+/* the mutex is created with the state and destroyed (unlocked) with it */
+#define luai_userstateopen(L)	((void)pthread_mutex_init(&G(L)->lock, NULL))
+#define luai_userstateclose(L)  \
+	(lua_unlock(L), (void)pthread_mutex_destroy(&G(L)->lock))
+#endif
+
+#if defined(LUA_USE_FINALIZERTHREAD)
+/* native finalizers run in their own thread (see 'flushnativefins') */
+#include <pthread.h>
+#define LUAI_FINALIZERTHREAD
+#endif
+
 #if !defined(lua_lock)
 #define lua_lock(L)	((void) 0)
 #define lua_unlock(L)	((void) 0)
@@ -589,6 +589,62 @@ static int math_random (lua_State *L) {
 }
 
 
+/*
+** fillrandom(a [, m [, n]]): fill the numeric array 'a' with random
+** numbers, as 'random' would return them for the same arguments.
+** (Floats only with no limits; limits must be integers.)
+*/
+static int math_fillrandom (lua_State *L) {
+  RanState *state = (RanState *)lua_touserdata(L, lua_upvalueindex(1));
+  int kind;
+  lua_Unsigned n, k;
+  void *elems = lua_toarray(L, 1, &kind, &n);
+  if (elems == NULL)
+    return luaL_typeerror(L, 1, LUA_ARRAYLIBNAME);
+  if (lua_gettop(L) == 1) {  /* no limits? */
+    if (kind == LUA_ARRNUMBER) {
+      lua_Number *v = (lua_Number *)elems;
+      for (k = 0; k < n; k++)
+        v[k] = I2d(nextrand(state->s));  /* float between 0 and 1 */
+    }
+    else {
+      lua_Integer *v = (lua_Integer *)elems;
+      for (k = 0; k < n; k++)
+        v[k] = (lua_Integer)I2UInt(nextrand(state->s));  /* full integer */
+    }
+  }
+  else {
+    lua_Integer low, up;
+    int full = 0;  /* full random integers? */
+    if (lua_gettop(L) == 2) {  /* only upper limit */
+      low = 1;
+      up = luaL_checkinteger(L, 2);
+      full = (up == 0);  /* single 0 as limit? */
+    }
+    else {  /* lower and upper limits */
+      low = luaL_checkinteger(L, 2);
+      up = luaL_checkinteger(L, 3);
+    }
+    luaL_argcheck(L, full || low <= up, 2, "interval is empty");
+    for (k = 0; k < n; k++) {
+      lua_Unsigned r;
+      if (full)
+        r = I2UInt(nextrand(state->s));
+      else
+        r = project(I2UInt(nextrand(state->s)),
+                    (lua_Unsigned)up - (lua_Unsigned)low, state) +
+            (lua_Unsigned)low;
+      if (kind == LUA_ARRNUMBER)
+        ((lua_Number *)elems)[k] = (lua_Number)(lua_Integer)r;
+      else
+        ((lua_Integer *)elems)[k] = (lua_Integer)r;
+    }
+  }
+  lua_settop(L, 1);
+  return 1;  /* return the array */
+}
+
+
 static void setseed (lua_State *L, Rand64 *state,
                      lua_Unsigned n1, lua_Unsigned n2) {
   int i;
@@ -632,6 +688,7 @@ static int math_randomseed (lua_State *L) {
 static const luaL_Reg randfuncs[] = {
   {"random", math_random},
   {"randomseed", math_randomseed},
+  {"fillrandom", math_fillrandom},
   {NULL, NULL}
 };
 
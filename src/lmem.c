@@ -60,6 +60,36 @@
 
 
 
+/*
+** Check whether an allocation of 'n' more bytes would take memory use
+** above the limit in 'memcheck' (see 'luaE_setmemcheck'). Without
+** limits, 'memcheck' is the maximum value, so that only this test is
+** added to allocations.
+*/
+#define abovelimit(g,n)	l_unlikely(gettotalbytes(g) + (n) > (g)->memcheck)
+
+
+/*
+** An allocation of 'n' more bytes would go above a limit. Run an
+** emergency collection (if possible) and, if memory use would still be
+** above the soft limit, call the hook and stop checking the soft limit
+** until memory use is back below it (see 'luaC_step'). Return whether
+** the allocation can proceed without going above the hard limit.
+*/
+static int checklimits (lua_State *L, size_t n) {
+  global_State *g = G(L);
+  if (cantryagain(g))
+    luaC_fullgc(L, 1);  /* try to free some memory */
+  if (g->memarmed && gettotalbytes(g) + n > g->memsoft) {
+    g->memarmed = 0;
+    g->memcheck = (g->memhard != 0) ? g->memhard : MAX_LUMEM;
+    if (g->memhook)
+      (*g->memhook)(g->ud_memhook, L, cast_sizet(gettotalbytes(g) + n));
+  }
+  return (g->memhard == 0 || gettotalbytes(g) + n <= g->memhard);
+}
+
+
 #if defined(EMERGENCYGCTESTS)
 /*
 ** First allocation will fail except when freeing a block (frees never
@@ -177,6 +207,9 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   void *newblock;
   global_State *g = G(L);
   lua_assert((osize == 0) == (block == NULL));
+  if (nsize > osize && abovelimit(g, nsize - osize) &&
+      !checklimits(L, nsize - osize))
+    return NULL;  /* do not go above the hard limit */
   newblock = firsttry(g, block, osize, nsize);
   if (l_unlikely(newblock == NULL && nsize > 0)) {
     newblock = tryagain(L, block, osize, nsize);
@@ -185,6 +218,10 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   }
   lua_assert((nsize == 0) == (newblock == NULL));
   g->GCdebt = (g->GCdebt + nsize) - osize;
+  if (nsize > osize) {
+    L->nalloc += nsize - osize;
+    luaG_countalloc(L, g, -1, nsize - osize);
+  }
   return newblock;
 }
 
@@ -203,13 +240,19 @@ void *luaM_malloc_ (lua_State *L, size_t size, int tag) {
     return NULL;  /* that's all */
   else {
     global_State *g = G(L);
-    void *newblock = firsttry(g, NULL, tag, size);
+    void *newblock;
+    if (abovelimit(g, size) && !checklimits(L, size))
+      luaM_error(L);  /* do not go above the hard limit */
+    newblock = firsttry(g, NULL, tag, size);
     if (l_unlikely(newblock == NULL)) {
       newblock = tryagain(L, NULL, tag, size);
       if (newblock == NULL)
         luaM_error(L);
     }
     g->GCdebt += size;
+    L->nalloc += size;
+    if (tag == 0)  /* not an object? (objects are counted by 'luaC_newobj') */
+      luaG_countalloc(L, g, -1, size);
     return newblock;
   }
 }
@@ -277,6 +277,23 @@ static lua_CFunction lsys_sym (lua_State *L, void *lib, const char *sym) {
 #define LUA_CPATH_VAR   "LUA_CPATH"
 #endif
 
+/*
+** LUA_CACHEDIR_VAR is the name of the environment variable with the
+** directory for the cache of compiled Lua modules (only read when
+** LUA_USE_CACHEDIRENV is defined).
+*/
+#if !defined(LUA_CACHEDIR_VAR)
+#define LUA_CACHEDIR_VAR   "LUA_CACHEDIR"
+#endif
+
+/*
+** LUA_DIRCACHE_VAR is the name of the environment variable that turns
+** on the cache of directory listings for module searches.
+*/
+#if !defined(LUA_DIRCACHE_VAR)
+#define LUA_DIRCACHE_VAR   "LUA_DIRCACHE"
+#endif
+
 
 
 /*
@@ -326,6 +343,45 @@ static void setpath (lua_State *L, const char *fieldname,
   lua_pop(L, 1);  /* pop versioned variable name ('nver') */
 }
 
+
+#if defined(LUA_USE_CACHEDIRENV)
+/*
+** Set 'package.cachedir' from the environment, if defined there
+*/
+static void setcachedir (lua_State *L) {
+  const char *nver = lua_pushfstring(L, "%s%s", LUA_CACHEDIR_VAR,
+                                            LUA_VERSUFFIX);
+  const char *dir = getenv(nver);  /* try versioned name */
+  if (dir == NULL)  /* no versioned environment variable? */
+    dir = getenv(LUA_CACHEDIR_VAR);  /* try unversioned name */
+  if (dir != NULL && *dir != '\0' && !noenv(L)) {
+    lua_pushstring(L, dir);
+    lua_setfield(L, -3, "cachedir");  /* package.cachedir = dir */
+  }
+  lua_pop(L, 1);  /* pop versioned variable name ('nver') */
+}
+#else
+#define setcachedir(L)	((void)0)
+#endif
+
+
+/*
+** Set 'package.dircache' to an empty table if the environment asks
+** for it
+*/
+static void setdircache (lua_State *L) {
+  const char *nver = lua_pushfstring(L, "%s%s", LUA_DIRCACHE_VAR,
+                                            LUA_VERSUFFIX);
+  const char *val = getenv(nver);  /* try versioned name */
+  if (val == NULL)  /* no versioned environment variable? */
+    val = getenv(LUA_DIRCACHE_VAR);  /* try unversioned name */
+  if (val != NULL && *val != '\0' && !noenv(L)) {
+    lua_newtable(L);
+    lua_setfield(L, -3, "dircache");  /* package.dircache = {} */
+  }
+  lua_pop(L, 1);  /* pop versioned variable name ('nver') */
+}
+
 /* }================================================================== */
 
 
@@ -439,6 +495,83 @@ static int readable (const char *filename) {
 }
 
 
+/*
+** Cache of directory listings. When 'package.dircache' is a table, the
+** searchers for Lua and C modules check each candidate file against a
+** listing of its directory, kept in that table with the directory name
+** as key, and try to open only the files that are listed. A listing
+** is a set of file names; it is false for a directory that does not
+** exist and true for one that cannot be listed, whose files are then
+** tried one by one. Each directory is listed only once.
+*/
+
+#if defined(LUA_USE_POSIX)
+
+#include <dirent.h>
+#include <errno.h>
+
+/*
+** Push the listing of directory 'dir'
+*/
+static void listdir (lua_State *L, const char *dir) {
+  DIR *d = opendir(dir);
+  if (d == NULL)
+    lua_pushboolean(L, !(errno == ENOENT || errno == ENOTDIR));
+  else {
+    struct dirent *e;
+    lua_newtable(L);
+    while ((e = readdir(d)) != NULL) {
+      lua_pushboolean(L, 1);
+      lua_setfield(L, -2, e->d_name);
+    }
+    closedir(d);
+  }
+}
+
+#else
+
+#define listdir(L,dir)	lua_pushboolean(L, 1)  /* cannot list it */
+
+#endif
+
+
+/*
+** Check whether file 'filename' can exist, according to the listings
+** in the table at index 'cache'.
+*/
+static int listed (lua_State *L, int cache, const char *filename) {
+  const char *base = strrchr(filename, *LUA_DIRSEP);
+  int res;
+  if (base == NULL) {  /* file in current directory? */
+    lua_pushliteral(L, ".");
+    base = filename;
+  }
+  else {
+    if (base == filename)  /* file in root directory? */
+      lua_pushliteral(L, LUA_DIRSEP);
+    else
+      lua_pushlstring(L, filename, base - filename);
+    base++;  /* skip separator */
+  }
+  lua_pushvalue(L, -1);
+  if (lua_rawget(L, cache) == LUA_TNIL) {  /* directory not listed yet? */
+    lua_pop(L, 1);
+    listdir(L, lua_tostring(L, -1));
+    lua_pushvalue(L, -2);  /* directory name */
+    lua_pushvalue(L, -2);  /* listing */
+    lua_rawset(L, cache);
+  }
+  if (lua_istable(L, -1)) {
+    res = (lua_getfield(L, -1, base) != LUA_TNIL);
+    lua_pop(L, 1);
+  }
+  else
+    res = lua_toboolean(L, -1);
+  lua_pop(L, 2);  /* pop directory name and its listing */
+  return res;
+}
+
+
 /*
 ** Get the next name in '*path' = 'name1;name2;name3;...', changing
 ** the ending ';' to '\0' to create a zero-terminated string. Return
@@ -478,10 +611,15 @@ static void pusherrornotfound (lua_State *L, const char *path) {
 }
 
 
+/*
+** Search 'name' in 'path'. If 'cache' is not 0, it is the index of the
+** table with the directory listings to be used.
+*/
 static const char *searchpath (lua_State *L, const char *name,
                                              const char *path,
                                              const char *sep,
-                                             const char *dirsep) {
+                                             const char *dirsep,
+                                             int cache) {
   luaL_Buffer buff;
   char *pathname;  /* path with name inserted */
   char *endpathname;  /* its end */
@@ -496,7 +634,8 @@ static const char *searchpath (lua_State *L, const char *name,
   pathname = luaL_buffaddr(&buff);  /* writable list of file names */
   endpathname = pathname + luaL_bufflen(&buff) - 1;
   while ((filename = getnextfilename(&pathname, endpathname)) != NULL) {
-    if (readable(filename))  /* does file exist and is readable? */
+    if ((cache == 0 || listed(L, cache, filename)) &&
+        readable(filename))  /* does file exist and is readable? */
       return lua_pushstring(L, filename);  /* save and return name */
   }
   luaL_pushresult(&buff);  /* push path to create error message */
@@ -509,7 +648,7 @@ static int ll_searchpath (lua_State *L) {
   const char *f = searchpath(L, luaL_checkstring(L, 1),
                                 luaL_checkstring(L, 2),
                                 luaL_optstring(L, 3, "."),
-                                luaL_optstring(L, 4, LUA_DIRSEP));
+                                luaL_optstring(L, 4, LUA_DIRSEP), 0);
   if (f != NULL) return 1;
   else {  /* error message is on top of the stack */
     luaL_pushfail(L);
@@ -523,11 +662,14 @@ static const char *findfile (lua_State *L, const char *name,
                                            const char *pname,
                                            const char *dirsep) {
   const char *path;
+  int cache = 0;
+  if (lua_getfield(L, lua_upvalueindex(1), "dircache") == LUA_TTABLE)
+    cache = lua_gettop(L);
   lua_getfield(L, lua_upvalueindex(1), pname);
   path = lua_tostring(L, -1);
   if (l_unlikely(path == NULL))
     luaL_error(L, "'package.%s' must be a string", pname);
-  return searchpath(L, name, path, ".", dirsep);
+  return searchpath(L, name, path, ".", dirsep, cache);
 }
 
 
@@ -542,12 +684,228 @@ static int checkload (lua_State *L, int stat, const char *filename) {
 }
 
 
+/*
+** Cache of compiled Lua modules. When 'package.cachedir' is a string,
+** the Lua searcher keeps the dump of each module it compiles in that
+** directory, in a file named after a hash of the module's file name.
+** The entry starts with a header holding the size and a hash of the
+** source contents, and it is used only while they still match the
+** source file. A new entry is written to a temporary file and then
+** renamed, so concurrent processes never see a partial one; a
+** truncated entry fails to load and the source is compiled again.
+** Binary chunks are not verified, so the cache is used only where the
+** directory and each entry can be checked to be owned by the current
+** user and not writable by others (that is, on POSIX systems).
+*/
+
+#define CACHEMARK	"\x1bLuaCache"
+
+#if LUA_MAXINTEGER > 2147483647		/* 64-bit 'lua_Unsigned'? */
+#define FNVBASIS	((lua_Unsigned)14695981039346656037u)
+#define FNVPRIME	((lua_Unsigned)1099511628211u)
+#else
+#define FNVBASIS	((lua_Unsigned)2166136261u)
+#define FNVPRIME	((lua_Unsigned)16777619u)
+#endif
+
+
+typedef struct CacheHeader {
+  char mark[sizeof(CACHEMARK)];
+  size_t size;  /* size of source file */
+  lua_Unsigned hash;  /* hash of source contents */
+} CacheHeader;
+
+
+typedef struct CacheF {
+  FILE *f;
+  char buff[BUFSIZ];
+} CacheF;
+
+
+/* FNV-1a hash */
+static lua_Unsigned hashbytes (lua_Unsigned h, const char *s, size_t l) {
+  for (; l > 0; l--, s++)
+    h = (h ^ (unsigned char)*s) * FNVPRIME;
+  return h;
+}
+
+
+/*
+** Fill header 'h' for the contents of file 'filename'; return 0 if
+** the file cannot be read.
+*/
+static int hashsource (const char *filename, CacheHeader *h) {
+  char buff[BUFSIZ];
+  size_t n;
+  int err;
+  FILE *f = fopen(filename, "rb");
+  if (f == NULL) return 0;
+  memset(h, 0, sizeof(*h));  /* also clear padding, which is written */
+  memcpy(h->mark, CACHEMARK, sizeof(CACHEMARK));
+  h->hash = FNVBASIS;
+  while ((n = fread(buff, 1, sizeof(buff), f)) > 0) {
+    h->size += n;
+    h->hash = hashbytes(h->hash, buff, n);
+  }
+  err = ferror(f);
+  fclose(f);
+  return !err;
+}
+
+
+#if defined(LUA_USE_POSIX)
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+** Check whether a file (or directory) is owned by the current user
+** and is not writable by anyone else
+*/
+static int trusted (const struct stat *st) {
+  return (st->st_uid == geteuid() &&
+          (st->st_mode & (S_IWGRP | S_IWOTH)) == 0);
+}
+
+static int trusteddir (const char *dir) {
+  struct stat st;
+  return (stat(dir, &st) == 0 && S_ISDIR(st.st_mode) && trusted(&st));
+}
+
+static int trustedfile (FILE *f) {
+  struct stat st;
+  return (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+          trusted(&st));
+}
+
+/* make a new entry private, whatever the process' umask */
+#define setprivate(f)	fchmod(fileno(f), S_IRUSR | S_IWUSR)
+
+#else
+
+#define trusteddir(dir)		0  /* cannot check it; do not use it */
+#define trustedfile(f)		0
+#define setprivate(f)		0
+
+#endif
+
+
+/*
+** Push and return the name of the cache entry for 'filename'. If there
+** is no (trusted) cache, push the value of 'package.cachedir' and
+** return NULL.
+*/
+static const char *cachename (lua_State *L, const char *filename) {
+  char hex[2 * sizeof(lua_Unsigned) + 1];  /* hexadecimal digits */
+  lua_Unsigned h;
+  lua_getfield(L, lua_upvalueindex(1), "cachedir");
+  if (lua_type(L, -1) != LUA_TSTRING || !trusteddir(lua_tostring(L, -1)))
+    return NULL;  /* no cache */
+  h = hashbytes(FNVBASIS, filename, strlen(filename));
+  l_sprintf(hex, sizeof(hex), "%" LUA_INTEGER_FRMLEN "x", h);
+  lua_pushfstring(L, "%s" LUA_DIRSEP "%s.luac", lua_tostring(L, -1), hex);
+  lua_remove(L, -2);  /* remove directory name */
+  return lua_tostring(L, -1);
+}
+
+
+static const char *getcache (lua_State *L, void *ud, size_t *size) {
+  CacheF *cf = (CacheF *)ud;
+  (void)L;  /* not used */
+  if (feof(cf->f)) return NULL;
+  *size = fread(cf->buff, 1, sizeof(cf->buff), cf->f);
+  return cf->buff;
+}
+
+
+/*
+** Try to load the cache entry 'cname' for a source with header 'h'.
+** Return true and push the loaded function if the entry is valid;
+** otherwise, return false and push nothing.
+*/
+static int readcache (lua_State *L, const char *cname,
+                      const CacheHeader *h) {
+  CacheHeader fh;
+  CacheF cf;
+  int stat;
+  cf.f = fopen(cname, "rb");
+  if (cf.f == NULL) return 0;  /* no entry */
+  if (!trustedfile(cf.f) ||
+      fread(&fh, sizeof(fh), 1, cf.f) != 1 ||
+      memcmp(fh.mark, CACHEMARK, sizeof(CACHEMARK)) != 0 ||
+      fh.size != h->size || fh.hash != h->hash) {
+    fclose(cf.f);
+    return 0;  /* stale or invalid entry */
+  }
+  stat = lua_load(L, getcache, &cf, cname, "b");
+  fclose(cf.f);
+  if (stat != LUA_OK) {
+    lua_pop(L, 1);  /* remove error message */
+    return 0;
+  }
+  return 1;
+}
+
+
+static int writer (lua_State *L, const void *b, size_t size, void *f) {
+  (void)L;  /* not used */
+  return (fwrite(b, size, 1, (FILE *)f) != 1) && (size != 0);
+}
+
+
+/*
+** Write the function on the top of the stack as cache entry 'cname'
+** for a source with header 'h'. Failures are ignored: the module
+** simply stays out of the cache.
+*/
+static void writecache (lua_State *L, const char *cname,
+                        const CacheHeader *h) {
+  const char *tmpname = lua_pushfstring(L, "%s.%p", cname, (void *)L);
+  FILE *f = fopen(tmpname, "wb");
+  if (f != NULL) {
+    int err;
+    lua_pushvalue(L, -2);  /* function to be dumped */
+    err = (setprivate(f) != 0);
+    err = err || (fwrite(h, sizeof(*h), 1, f) != 1);
+    err = err || lua_dump(L, writer, f, 0) != 0;
+    lua_pop(L, 1);  /* remove function copy */
+    err = ferror(f) || err;
+    err = (fclose(f) != 0) || err;
+    if (!err && rename(tmpname, cname) != 0) {  /* could not rename? */
+      remove(cname);  /* some systems do not rename over a file */
+      err = (rename(tmpname, cname) != 0);
+    }
+    if (err)
+      remove(tmpname);
+  }
+  lua_pop(L, 1);  /* remove temporary name */
+}
+
+
+/*
+** Load Lua file 'filename' through the cache, if there is one
+*/
+static int loadcached (lua_State *L, const char *filename) {
+  CacheHeader h;
+  int stat;
+  const char *cname = cachename(L, filename);
+  if (cname == NULL || !hashsource(filename, &h))
+    stat = luaL_loadfile(L, filename);  /* do not use the cache */
+  else if (readcache(L, cname, &h))
+    stat = LUA_OK;
+  else if ((stat = luaL_loadfile(L, filename)) == LUA_OK)
+    writecache(L, cname, &h);
+  lua_remove(L, -2);  /* remove cache name (or 'package.cachedir') */
+  return stat;
+}
+
+
 static int searcher_Lua (lua_State *L) {
   const char *filename;
   const char *name = luaL_checkstring(L, 1);
   filename = findfile(L, name, "path", LUA_LSUBSEP);
   if (filename == NULL) return 1;  /* module not found in this path */
-  return checkload(L, (luaL_loadfile(L, filename) == LUA_OK), filename);
+  return checkload(L, (loadcached(L, filename) == LUA_OK), filename);
 }
 
 
@@ -748,6 +1106,8 @@ LUAMOD_API int luaopen_package (lua_State *L) {
   /* set paths */
   setpath(L, "path", LUA_PATH_VAR, LUA_PATH_DEFAULT);
   setpath(L, "cpath", LUA_CPATH_VAR, LUA_CPATH_DEFAULT);
+  setcachedir(L);
+  setdircache(L);
   /* store config information */
   lua_pushliteral(L, LUA_DIRSEP "\n" LUA_PATH_SEP "\n" LUA_PATH_MARK "\n"
                      LUA_EXEC_DIR "\n" LUA_IGMARK "\n");
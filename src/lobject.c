@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
@@ -235,6 +236,75 @@ static const char *l_str2dloc (const char *s, lua_Number *result, int mode) {
 }
 
 
+/*
+** Fast conversions between floats and decimal numerals whose values
+** need at most 15 significant digits and small powers of 10 (which are
+** exact in a double). They need doubles evaluated without extra
+** precision, so that a single operation is correctly rounded.
+*/
+#if LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE && \
+    defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define l_fastnum
+
+#define MAXFASTPOW10	22	/* 10^22 is the largest power of 10 exact */
+#define MAXFASTDIG	15	/* 10^15 < 2^53 */
+
+static const lua_Number pow10[MAXFASTPOW10 + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/*
+** Convert a decimal numeral 'm * 10^e' with at most MAXFASTDIG digits
+** in 'm' and a small exponent 'e' with one (correctly rounded)
+** multiplication or division. Return NULL for other numerals (and
+** invalid ones), which are left to 'lua_str2number'.
+*/
+static const char *l_str2dfast (const char *s, lua_Number *result) {
+  lua_Unsigned m = 0;
+  int nd = 0;  /* number of significant digits */
+  int e = 0;  /* decimal exponent */
+  int empty = 1;
+  int neg;
+  lua_Number x;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  neg = isneg(&s);
+  for (; lisdigit(cast_uchar(*s)); s++, empty = 0) {
+    m = m * 10 + cast_uint(*s - '0');
+    if (m != 0 && ++nd > MAXFASTDIG) return NULL;
+  }
+  if (*s == '.') {
+    for (s++; lisdigit(cast_uchar(*s)); s++, e--, empty = 0) {
+      m = m * 10 + cast_uint(*s - '0');
+      if (m != 0 && ++nd > MAXFASTDIG) return NULL;
+    }
+  }
+  if (empty) return NULL;
+  if (*s == 'e' || *s == 'E') {
+    int exp = 0;
+    int eneg;
+    s++;
+    eneg = isneg(&s);
+    if (!lisdigit(cast_uchar(*s))) return NULL;
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      if (exp > 1000) return NULL;  /* too large */
+      exp = exp * 10 + (*s - '0');
+    }
+    e += (eneg) ? -exp : exp;
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (*s != '\0' || e < -MAXFASTPOW10 || e > MAXFASTPOW10)
+    return NULL;
+  x = cast_num(m);
+  x = (e < 0) ? x / pow10[-e] : x * pow10[e];
+  *result = (neg) ? -x : x;
+  return s;
+}
+
+#endif
+
+
 /*
 ** Convert string 's' to a Lua number (put in 'result') handling the
 ** current locale.
@@ -254,6 +324,10 @@ static const char *l_str2d (const char *s, lua_Number *result) {
   int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
   if (mode == 'n')  /* reject 'inf' and 'nan' */
     return NULL;
+#if defined(l_fastnum)
+  if (mode != 'x' && (endptr = l_str2dfast(s, result)) != NULL)
+    return endptr;
+#endif
   endptr = l_str2dloc(s, result, mode);  /* try to convert */
   if (endptr == NULL) {  /* failed? may be a different locale */
     char buff[L_MAXLENNUM + 1];
@@ -339,24 +413,109 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 
 
 /*
-** Maximum length of the conversion of a number to a string. Must be
-** enough to accommodate both LUA_INTEGER_FMT and LUA_NUMBER_FMT.
-** (For a long long int, this is 19 digits plus a sign and a final '\0',
-** adding to 21. For a long double, it can go to a sign, 33 digits,
-** the dot, an exponent letter, an exponent sign, 5 exponent digits,
-** and a final '\0', adding to 43.)
+** Convert an integer to a decimal numeral, two digits at a time.
+*/
+static int tostringint (char *buff, lua_Integer n) {
+  static const char digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+  char temp[MAXNUMBER2STR];
+  char *p = temp + MAXNUMBER2STR;
+  lua_Unsigned u = (n < 0) ? 0u - l_castS2U(n) : l_castS2U(n);
+  int len;
+  while (u >= 100) {
+    unsigned int d = cast_uint(u % 100) * 2;
+    u /= 100;
+    *--p = digits[d + 1];
+    *--p = digits[d];
+  }
+  if (u >= 10) {
+    *--p = digits[u * 2 + 1];
+    *--p = digits[u * 2];
+  }
+  else
+    *--p = cast_char('0' + u);
+  if (n < 0)
+    *--p = '-';
+  len = cast_int(temp + MAXNUMBER2STR - p);
+  memcpy(buff, p, len);
+  return len;
+}
+
+
+#if defined(l_fastnum) && defined(LUAI_NUMFMTDIGITS) && \
+    LUAI_NUMFMTDIGITS <= MAXFASTDIG
+#define l_fastfmt
+
+/*
+** Convert a float that is a short decimal: multiplied by some 10^k, it
+** gives an integer 'm' with at most LUAI_NUMFMTDIGITS digits. Then
+** 'm * 10^-k' is the rounding of the float to that many digits, which
+** is what LUA_NUMBER_FMT prints (the digits of 'm', with a point
+** before the last 'k' ones, without trailing zeros), unless it needs
+** an exponent. Return 0 for other floats, left to 'lua_number2str'.
 */
-#define MAXNUMBER2STR	44
+static int tostringflt (char *buff, lua_Number x) {
+  char digs[MAXNUMBER2STR];
+  int k, nd, len = 0;
+  lua_Number m;
+  if (x < 0) {
+    buff[len++] = '-';
+    x = -x;
+  }
+  if (!(x >= 1e-4 && x < pow10[LUAI_NUMFMTDIGITS]))  /* needs exponent? */
+    return 0;  /* (also zero, inf, and NaN) */
+  for (k = 0; ; k++) {  /* look for the smallest 'k' */
+    m = x * pow10[k];
+    if (m >= pow10[LUAI_NUMFMTDIGITS])
+      return 0;  /* too many digits */
+    else if (m == l_floor(m))
+      break;
+  }
+  nd = tostringint(digs, cast(lua_Integer, m));
+  while (k > 0 && digs[nd - 1] == '0') {  /* remove trailing zeros */
+    nd--; k--;
+  }
+  if (k == 0) {  /* integral value? */
+    memcpy(buff + len, digs, nd);
+    len += nd;
+    buff[len++] = lua_getlocaledecpoint();
+    buff[len++] = '0';  /* adds '.0' to result */
+  }
+  else if (nd > k) {  /* point inside the digits? */
+    memcpy(buff + len, digs, nd - k);
+    len += nd - k;
+    buff[len++] = lua_getlocaledecpoint();
+    memcpy(buff + len, digs + nd - k, k);
+    len += k;
+  }
+  else {  /* leading zeros */
+    buff[len++] = '0';
+    buff[len++] = lua_getlocaledecpoint();
+    memset(buff + len, '0', k - nd);
+    len += k - nd;
+    memcpy(buff + len, digs, nd);
+    len += nd;
+  }
+  return len;
+}
+
+#endif
 
 
 /*
 ** Convert a number object to a string, adding it to a buffer
 */
-static int tostringbuff (TValue *obj, char *buff) {
+int luaO_tostringbuff (const TValue *obj, char *buff) {
   int len;
   lua_assert(ttisnumber(obj));
   if (ttisinteger(obj))
-    len = lua_integer2str(buff, MAXNUMBER2STR, ivalue(obj));
+    len = tostringint(buff, ivalue(obj));
+#if defined(l_fastfmt)
+  else if ((len = tostringflt(buff, fltvalue(obj))) > 0)
+    return len;
+#endif
   else {
     len = lua_number2str(buff, MAXNUMBER2STR, fltvalue(obj));
     if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
@@ -373,7 +532,7 @@ static int tostringbuff (TValue *obj, char *buff) {
 */
 void luaO_tostring (lua_State *L, TValue *obj) {
   char buff[MAXNUMBER2STR];
-  int len = tostringbuff(obj, buff);
+  int len = luaO_tostringbuff(obj, buff);
   setsvalue(L, obj, luaS_newlstr(L, buff, len));
 }
 
@@ -468,7 +627,7 @@ static void addstr2buff (BuffFS *buff, const char *str, size_t slen) {
 */
 static void addnum2buff (BuffFS *buff, TValue *num) {
   char *numbuff = getbuff(buff, MAXNUMBER2STR);
-  int len = tostringbuff(num, numbuff);  /* format number into 'numbuff' */
+  int len = luaO_tostringbuff(num, numbuff);  /* format number into 'numbuff' */
   addsize(buff, len);
 }
 
@@ -461,6 +461,8 @@ typedef union UValue {
 typedef struct Udata {
   CommonHeader;
   unsigned short nuvalue;  /* number of user values */
+  lu_byte arraykind;  /* kind of numeric array (0 if not an array) */
+  lu_byte nativefin;  /* has a native finalizer after its data */
   size_t len;  /* number of bytes */
   struct Table *metatable;
   GCObject *gclist;
@@ -480,6 +482,8 @@ typedef struct Udata {
 typedef struct Udata0 {
   CommonHeader;
   unsigned short nuvalue;  /* number of user values */
+  lu_byte arraykind;  /* kind of numeric array (0 if not an array) */
+  lu_byte nativefin;  /* has a native finalizer after its data */
   size_t len;  /* number of bytes */
   struct Table *metatable;
   union {LUAI_MAXALIGN;} bindata;
@@ -497,6 +501,29 @@ typedef struct Udata0 {
 /* compute the size of a userdata */
 #define sizeudata(nuv,nb)	(udatamemoffset(nuv) + (nb))
 
+/*
+** A userdata with a native finalizer keeps the finalizer right after
+** its 'len' bytes of data, not necessarily aligned.
+*/
+#define getudatafin(u)	(getudatamem(u) + (u)->len)
+
+
+/*
+** Numeric arrays are userdata with no user values whose memory block
+** is a vector of raw numbers ('lua_Number' or 'lua_Integer', by
+** 'arraykind'). The VM indexes them directly (see 'luaV_finishget').
+*/
+#define ttisarray(o)	(ttisfulluserdata(o) && uvalue(o)->arraykind != 0)
+
+#define arrayelemsize(k)  \
+	((k) == LUA_ARRNUMBER ? sizeof(lua_Number) : sizeof(lua_Integer))
+
+/* number of elements in a numeric array */
+#define arraysize(u)	((u)->len / arrayelemsize((u)->arraykind))
+
+#define arraynumbers(u)	cast(lua_Number *, getudatamem(u))
+#define arrayintegers(u)	cast(lua_Integer *, getudatamem(u))
+
 /* }================================================================== */
 
 
@@ -561,15 +588,21 @@ typedef struct Proto {
   int sizep;  /* size of 'p' */
   int sizelocvars;
   int sizeabslineinfo;  /* size of 'abslineinfo' */
+  int sizedebuginfo;  /* size of 'debuginfo' */
   int linedefined;  /* debug information  */
   int lastlinedefined;  /* debug information  */
+#if defined(LUAI_HOTCOUNT)
+  unsigned int hotcount;  /* hotness counter (see LUAI_HOTCOUNT) */
+#endif
   TValue *k;  /* constants used by the function */
   Instruction *code;  /* opcodes */
+  unsigned int *icache;  /* inline caches (slot hints), parallel to 'code' */
   struct Proto **p;  /* functions defined inside the function */
   Upvaldesc *upvalues;  /* upvalue information */
   ls_byte *lineinfo;  /* information about source lines (debug information) */
   AbsLineInfo *abslineinfo;  /* idem */
   LocVar *locvars;  /* information about local variables (debug information) */
+  lu_byte *debuginfo;  /* 'lineinfo' to 'locvars' still encoded, or NULL */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
 } Proto;
@@ -796,6 +829,17 @@ typedef struct Table {
 /* size of buffer for 'luaO_utf8esc' function */
 #define UTF8BUFFSZ	8
 
+/*
+** Maximum length of the conversion of a number to a string. Must be
+** enough to accommodate both LUA_INTEGER_FMT and LUA_NUMBER_FMT.
+** (For a long long int, this is 19 digits plus a sign and a final '\0',
+** adding to 21. For a long double, it can go to a sign, 33 digits,
+** the dot, an exponent letter, an exponent sign, 5 exponent digits,
+** and a final '\0', adding to 43.)
+*/
+#define MAXNUMBER2STR	44
+
+
 LUAI_FUNC int luaO_utf8esc (char *buff, unsigned long x);
 LUAI_FUNC int luaO_ceillog2 (unsigned int x);
 LUAI_FUNC int luaO_rawarith (lua_State *L, int op, const TValue *p1,
@@ -804,6 +848,7 @@ LUAI_FUNC void luaO_arith (lua_State *L, int op, const TValue *p1,
                            const TValue *p2, StkId res);
 LUAI_FUNC size_t luaO_str2num (const char *s, TValue *o);
 LUAI_FUNC int luaO_hexavalue (int c);
+LUAI_FUNC int luaO_tostringbuff (const TValue *obj, char *buff);
 LUAI_FUNC void luaO_tostring (lua_State *L, TValue *obj);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
@@ -100,5 +100,46 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, 0, 0, 1, iABC)		/* OP_VARARG */
  ,opmode(0, 0, 1, 0, 1, iABC)		/* OP_VARARGPREP */
  ,opmode(0, 0, 0, 0, 0, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETFIELD2 */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETFIELDEQK */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETFIELDADD */
+ ,opmode(0, 0, 0, 0, 1, iABC)		/* OP_GETTABUPFIELD */
+ ,opmode(0, 0, 0, 0, 0, iABC)		/* OP_SETFIELD2 */
 };
 
+
+LUAI_DDEF const lu_byte luaP_superops[NUM_OPCODES - OP_FIRSTSUPER][2] = {
+  {OP_GETFIELD, OP_GETFIELD}		/* OP_GETFIELD2 */
+ ,{OP_GETFIELD, OP_EQK}			/* OP_GETFIELDEQK */
+ ,{OP_GETFIELD, OP_ADD}			/* OP_GETFIELDADD */
+ ,{OP_GETTABUP, OP_GETFIELD}		/* OP_GETTABUPFIELD */
+ ,{OP_SETFIELD, OP_SETFIELD}		/* OP_SETFIELD2 */
+};
+
+
+/*
+** Fuse pairs of instructions in 'code' into superinstructions. Only
+** the opcode of the first instruction of each pair changes, so jumps
+** into the second one are still valid. (Pairs do not overlap: after a
+** pair, the search restarts at the instruction following it.)
+*/
+void luaP_fuse (Instruction *code, int n) {
+#if LUAI_SUPERINST
+  int i;
+  for (i = 0; i < n - 1; i++) {
+    OpCode o1 = GET_OPCODE(code[i]);
+    OpCode o2 = GET_OPCODE(code[i + 1]);
+    int s;
+    for (s = 0; s < NUM_OPCODES - OP_FIRSTSUPER; s++) {
+      if (luaP_superops[s][0] == o1 && luaP_superops[s][1] == o2) {
+        SET_OPCODE(code[i], OP_FIRSTSUPER + s);
+        i++;  /* skip second component */
+        break;
+      }
+    }
+  }
+#else
+  (void)code; (void)n;
+#endif
+}
+
@@ -306,11 +306,20 @@ OP_VARARG,/*	A C	R[A], R[A+1], ..., R[A+C-2] = vararg		*/
 
 OP_VARARGPREP,/*A	(adjust vararg parameters)			*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* superinstructions (see luaP_fuse) */
+OP_GETFIELD2,/*	GETFIELD; GETFIELD					*/
+OP_GETFIELDEQK,/* GETFIELD; EQK						*/
+OP_GETFIELDADD,/* GETFIELD; ADD						*/
+OP_GETTABUPFIELD,/* GETTABUP; GETFIELD					*/
+OP_SETFIELD2/*	SETFIELD; SETFIELD					*/
 } OpCode;
 
 
-#define NUM_OPCODES	((int)(OP_EXTRAARG) + 1)
+#define NUM_OPCODES	((int)(OP_SETFIELD2) + 1)
+
+#define OP_FIRSTSUPER	OP_GETFIELD2
 
 
 
@@ -365,6 +374,13 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
   original operand was a float. (It must be corrected in case of
   metamethods.)
 
+  (*) A superinstruction replaces the opcode of the first instruction
+  of a frequent pair, keeping its arguments. It executes that
+  instruction and then the next one (which is kept unchanged) without
+  a dispatch. Superinstructions are created only by 'luaP_fuse', after
+  code generation and when loading binary chunks; they are never
+  dumped.
+
 ===========================================================================*/
 
 
@@ -387,6 +403,16 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
 #define testOTMode(m)	(luaP_opmodes[m] & (1 << 6))
 #define testMMMode(m)	(luaP_opmodes[m] & (1 << 7))
 
+/* components of superinstructions */
+LUAI_DDEC(const lu_byte luaP_superops[NUM_OPCODES - OP_FIRSTSUPER][2];)
+
+/* basic opcode of an instruction (first component of a superinstruction) */
+#define basicop(o)  \
+	((o) >= OP_FIRSTSUPER ? cast(OpCode, luaP_superops[(o) - OP_FIRSTSUPER][0]) \
+                              : (o))
+
+#define GET_BASICOP(i)	basicop(GET_OPCODE(i))
+
 /* "out top" (set top for next instruction) */
 #define isOT(i)  \
 	((testOTMode(GET_OPCODE(i)) && GETARG_C(i) == 0) || \
@@ -399,6 +425,9 @@ LUAI_DDEC(const lu_byte luaP_opmodes[NUM_OPCODES];)
     (((mm) << 7) | ((ot) << 6) | ((it) << 5) | ((t) << 4) | ((a) << 3) | (m))
 
 
+LUAI_FUNC void luaP_fuse (Instruction *code, int n);
+
+
 /* number of list items to accumulate before a SETLIST instruction */
 #define LFIELDS_PER_FLUSH	50
 
@@ -96,6 +96,11 @@ static const char *const opnames[] = {
   "VARARG",
   "VARARGPREP",
   "EXTRAARG",
+  "GETFIELD2",
+  "GETFIELDEQK",
+  "GETFIELDADD",
+  "GETTABUPFIELD",
+  "SETFIELD2",
   NULL
 };
 
@@ -504,6 +504,16 @@ static void adjust_assign (LexState *ls, int nvars, int nexps, expdesc *e) {
 #define enterlevel(ls)	luaE_incCstack(ls->L)
 
 
+/*
+** Let other OS threads enter the core (see 'lua_lock'), so that
+** compiling a large chunk does not stop the whole state. It is done
+** before each statement and each field of a constructor, where all
+** objects created by the parser are anchored, as they are for the
+** collector check in 'close_func'.
+*/
+#define yieldpoint(ls)	luai_threadyield(ls->L)
+
+
 #define leavelevel(ls) ((ls)->L->nCcalls--)
 
 
@@ -940,6 +950,7 @@ static void constructor (LexState *ls, expdesc *t) {
     lua_assert(cc.v.k == VVOID || cc.tostore > 0);
     if (ls->t.token == '}') break;
     closelistfield(fs, &cc);
+    yieldpoint(ls);
     field(ls, &cc);
   } while (testnext(ls, ',') || testnext(ls, ';'));
   check_match(ls, '}', '{', line);
@@ -1844,6 +1855,7 @@ static void retstat (LexState *ls) {
 
 static void statement (LexState *ls) {
   int line = ls->linenumber;  /* may be needed for error messages */
+  yieldpoint(ls);
   enterlevel(ls);
   switch (ls->t.token) {
     case ';': {  /* stat -> ';' (empty statement) */
@@ -1917,6 +1929,215 @@ static void statement (LexState *ls) {
 /* }====================================================================== */
 
 
+/*
+** {======================================================================
+** Data chunks
+** A data chunk is a single constructor, optionally preceded by 'return',
+** whose fields are literals: nil, booleans, numerals (possibly negated),
+** strings, and other such constructors. It is read directly into a
+** table, without generating code. Fields wait on the stack and go to
+** the table in batches, so that it is resized once for each batch.
+** =======================================================================
+*/
+
+
+static void dataconstructor (LexState *ls);
+
+
+/* datavalue -> nil | true | false | ['-'] Numeral | String | constructor */
+static void datavalue (LexState *ls) {
+  lua_State *L = ls->L;
+  TValue *v = s2v(L->top.p);
+  switch (ls->t.token) {
+    case TK_NIL: setnilvalue(v); break;
+    case TK_TRUE: setbtvalue(v); break;
+    case TK_FALSE: setbfvalue(v); break;
+    case TK_INT: setivalue(v, ls->t.seminfo.i); break;
+    case TK_FLT: setfltvalue(v, ls->t.seminfo.r); break;
+    case TK_STRING: setsvalue(L, v, ls->t.seminfo.ts); break;
+    case '-': {
+      luaX_next(ls);
+      if (ls->t.token == TK_INT) {
+        setivalue(v, l_castU2S(0u - l_castS2U(ls->t.seminfo.i)));
+      }
+      else if (ls->t.token == TK_FLT) {
+        setfltvalue(v, luai_numunm(L, ls->t.seminfo.r));
+      }
+      else
+        luaX_syntaxerror(ls, "numeral expected");
+      break;
+    }
+    case '{': {
+      dataconstructor(ls);  /* pushes the new table */
+      return;
+    }
+    default: {
+      luaX_syntaxerror(ls, "unexpected symbol");
+    }
+  }
+  luaD_inctop(L);
+  luaX_next(ls);
+}
+
+
+/*
+** Fields of a data constructor waiting on the stack: a list item takes
+** one slot, a record field two (key and value).
+*/
+typedef struct DataCons {
+  Table *t;  /* table being built */
+  unsigned int na;  /* number of array elements already stored */
+  unsigned int nh;  /* number of record fields already stored */
+  int tostore;  /* number of pending list items */
+  int torec;  /* number of pending record fields */
+  lu_byte isrec[2 * LFIELDS_PER_FLUSH];  /* kind of each pending field */
+} DataCons;
+
+
+/*
+** Store the pending record fields and, if 'lists', the pending list
+** items, resizing the table at once for all of them. Arrays that grow
+** in several batches double their size; 'dataconstructor' trims them.
+** As with the code for a constructor, record fields are set as soon as
+** their batch is full, but list items are stored only at their own
+** flush points (after all fields before them), so an explicit key
+** that collides with a list index gets the same value in both modes.
+** List items kept pending are moved down over the stored records.
+*/
+static void dataflush (lua_State *L, DataCons *dc, int lists) {
+  Table *t = dc->t;
+  int n = dc->tostore + dc->torec;
+  StkId first = L->top.p - (dc->tostore + 2 * dc->torec);
+  unsigned int asize = luaH_realasize(t);
+  unsigned int hsize = luaH_hashcapacity(t);
+  unsigned int needa = dc->na + dc->tostore;
+  unsigned int needh = dc->nh + dc->torec;
+  StkId p, q;
+  int i;
+  if (needa > asize || needh > hsize) {  /* needs more space? */
+    if (needa > asize)
+      asize = (asize <= UINT_MAX / 2 && 2 * asize > needa) ? 2 * asize
+                                                          : needa;
+    luaH_resize(L, t, asize, (needh > hsize) ? needh : hsize);
+  }
+  for (i = 0, p = first; i < n; i++) {  /* set record fields */
+    if (dc->isrec[i]) {
+      luaH_set(L, t, s2v(p), s2v(p + 1));
+      luaC_barrierback(L, obj2gco(t), s2v(p + 1));
+      p += 2;
+    }
+    else p++;
+  }
+  for (i = 0, p = q = first; i < n; i++) {  /* list items */
+    if (dc->isrec[i])
+      p += 2;
+    else if (lists) {  /* store it */
+      setobj2t(L, &t->array[dc->na++], s2v(p));
+      luaC_barrierback(L, obj2gco(t), s2v(p));
+      p++;
+    }
+    else {  /* keep it pending */
+      setobjs2s(L, q, p);
+      dc->isrec[q - first] = 0;
+      p++; q++;
+    }
+  }
+  dc->nh = needh;
+  if (lists) dc->tostore = 0;
+  dc->torec = 0;
+  L->top.p = first + dc->tostore;
+}
+
+
+/* datarecfield -> (NAME | '[' datavalue ']') '=' datavalue */
+static void datarecfield (LexState *ls) {
+  lua_State *L = ls->L;
+  if (ls->t.token == TK_NAME) {
+    setsvalue2s(L, L->top.p, str_checkname(ls));
+    luaD_inctop(L);
+  }
+  else {  /* ls->t.token == '[' */
+    int line = ls->linenumber;
+    luaX_next(ls);  /* skip '[' */
+    datavalue(ls);
+    check_match(ls, ']', '[', line);
+    if (ttisnil(s2v(L->top.p - 1)))
+      luaX_syntaxerror(ls, "table index is nil");
+  }
+  checknext(ls, '=');
+  datavalue(ls);
+}
+
+
+/* constructor -> '{' [ field { sep field } [sep] ] '}' */
+static void dataconstructor (LexState *ls) {
+  lua_State *L = ls->L;
+  int line = ls->linenumber;
+  DataCons dc;
+  dc.t = luaH_new(L);
+  dc.na = dc.nh = 0;
+  dc.tostore = dc.torec = 0;
+  enterlevel(ls);
+  sethvalue2s(L, L->top.p, dc.t);  /* anchor it */
+  luaD_inctop(L);
+  checknext(ls, '{');
+  do {
+    int isrec;
+    if (ls->t.token == '}') break;
+    if (dc.tostore == LFIELDS_PER_FLUSH)
+      dataflush(L, &dc, 1);
+    else if (dc.torec == LFIELDS_PER_FLUSH)
+      dataflush(L, &dc, 0);  /* list items wait for their flush point */
+    yieldpoint(ls);
+    isrec = (ls->t.token == '[' ||
+             (ls->t.token == TK_NAME && luaX_lookahead(ls) == '='));
+    if (isrec) {
+      datarecfield(ls);
+      dc.torec++;
+    }
+    else {
+      datavalue(ls);
+      dc.tostore++;
+    }
+    dc.isrec[dc.tostore + dc.torec - 1] = cast_byte(isrec);
+  } while (testnext(ls, ',') || testnext(ls, ';'));
+  check_match(ls, '}', '{', line);
+  if (dc.tostore + dc.torec > 0)
+    dataflush(L, &dc, 1);
+  if (dc.na < luaH_realasize(dc.t))  /* array grew more than needed? */
+    luaH_resizearray(L, dc.t, dc.na);
+  leavelevel(ls);
+}
+
+
+/*
+** Read a data chunk and push the resulting table.
+*/
+void luaY_data (lua_State *L, ZIO *z, Mbuffer *buff, const char *name,
+                int firstchar) {
+  LexState lexstate;
+  TString *source = luaS_new(L, name);
+  setsvalue2s(L, L->top.p, source);  /* anchor it */
+  luaD_inctop(L);
+  lexstate.h = luaH_new(L);  /* create table for scanner */
+  sethvalue2s(L, L->top.p, lexstate.h);  /* anchor it */
+  luaD_inctop(L);
+  lexstate.buff = buff;
+  lexstate.dyd = NULL;  /* not used */
+  luaX_setinput(L, &lexstate, z, source, firstchar);
+  luaX_next(&lexstate);  /* read first token */
+  testnext(&lexstate, TK_RETURN);
+  check(&lexstate, '{');
+  dataconstructor(&lexstate);
+  testnext(&lexstate, ';');
+  check(&lexstate, TK_EOS);
+  setobjs2s(L, L->top.p - 3, L->top.p - 1);  /* move table over 'source' */
+  L->top.p -= 2;  /* remove scanner's table and the copy */
+}
+
+/* }====================================================================== */
+
+
 /*
 ** compiles the main function, which is a regular vararg function with an
 ** upvalue named LUA_ENV
@@ -166,6 +166,8 @@ typedef struct FuncState {
 LUAI_FUNC int luaY_nvarstack (FuncState *fs);
 LUAI_FUNC LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
                                  Dyndata *dyd, const char *name, int firstchar);
+LUAI_FUNC void luaY_data (lua_State *L, ZIO *z, Mbuffer *buff,
+                          const char *name, int firstchar);
 
 
 #endif
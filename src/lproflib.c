@@ -0,0 +1,316 @@
+/*
+** $Id: lproflib.c $
+** Sampling Profiler Library
+** See Copyright Notice in lua.h
+*/
+
+#define lproflib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/*
+** {==================================================================
+** Samples
+** ===================================================================
+*/
+
+/* keys, in the registry, for the tables with the sample counts */
+static const char *const PROFKEY = "_PROFILE";
+static const char *const ALLOCKEY = "_PROFILEALLOC";
+
+/* maximum number of frames recorded for a sample */
+#if !defined(LUA_PROFMAXFRAMES)
+#define LUA_PROFMAXFRAMES	64
+#endif
+
+/* default sampling interval, in microseconds */
+#if !defined(LUA_PROFINTERVAL)
+#define LUA_PROFINTERVAL	10000
+#endif
+
+/* default allocation sampling rate, in bytes */
+#if !defined(LUA_PROFALLOCRATE)
+#define LUA_PROFALLOCRATE	(512 * 1024)
+#endif
+
+
+/*
+** Add a frame to a stack: 'cur' tells whether to use the current line
+** of the function (the call site) or the line where it was defined.
+*/
+static void addframe (luaL_Buffer *b, lua_Debug *ar, int cur) {
+  if (*ar->what == 'm')  /* main chunk? */
+    luaL_addstring(b, "main");
+  else
+    luaL_addstring(b, ar->name ? ar->name : "?");
+  luaL_addchar(b, '@');
+  if (*ar->what == 'C')
+    luaL_addstring(b, "[C]");
+  else {
+    luaL_addstring(b, ar->short_src);
+    luaL_addchar(b, ':');
+    lua_pushinteger(b->L, cur ? ar->currentline : ar->linedefined);
+    luaL_addvalue(b);
+  }
+}
+
+
+/*
+** Build the collapsed stack of the running thread (outermost function
+** first, frames separated by ';'), followed by 'leaf' if not NULL, and
+** add 'weight' to its count in the table with the given registry key.
+*/
+static void addsample (lua_State *L, const char *key, int cur,
+                       const char *leaf, lua_Integer weight) {
+  luaL_Buffer b;
+  lua_Debug fr;
+  int level = 0;
+  while (level < LUA_PROFMAXFRAMES && lua_getstack(L, level, &fr))
+    level++;
+  if (level == 0)
+    return;  /* no frames to sample */
+  lua_getfield(L, LUA_REGISTRYINDEX, key);
+  luaL_buffinit(L, &b);
+  if (lua_getstack(L, level, &fr))  /* stack was truncated? */
+    luaL_addstring(&b, "...;");
+  while (level-- > 0) {
+    lua_getstack(L, level, &fr);
+    lua_getinfo(L, cur ? "Snl" : "Sn", &fr);
+    addframe(&b, &fr, cur);
+    if (level > 0)
+      luaL_addchar(&b, ';');
+  }
+  if (leaf != NULL) {
+    luaL_addchar(&b, ';');
+    luaL_addstring(&b, leaf);
+  }
+  luaL_pushresult(&b);
+  lua_pushvalue(L, -1);  /* key */
+  lua_rawget(L, -3);
+  lua_pushinteger(L, lua_tointeger(L, -1) + weight);
+  lua_remove(L, -2);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);  /* counts table */
+}
+
+
+/*
+** Hook called for each CPU sample: count one more sample for the stack
+** of the running functions.
+*/
+static void profhook (lua_State *L, lua_Debug *ar) {
+  (void)ar;  /* not used */
+  addsample(L, PROFKEY, 0, NULL, 1);
+}
+
+
+/*
+** Hook called for allocation samples: add the bytes they represent to
+** the call sites, with the type of the allocated object as a leaf.
+*/
+static void allochook (lua_State *L, lua_Debug *ar) {
+  size_t bytes;
+  const char *what = lua_allocsample(L, &bytes);
+  (void)ar;  /* not used */
+  addsample(L, ALLOCKEY, 1, what, (lua_Integer)bytes);
+}
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Timer
+** ===================================================================
+*/
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <signal.h>
+#include <sys/time.h>
+
+/* state being profiled ('NULL' when no profiler is running) */
+static lua_State *volatile profstate = NULL;
+
+
+static void profsignal (int i) {
+  lua_State *L = profstate;
+  (void)i;  /* not used */
+  if (L != NULL)
+    lua_profrequest(L);
+}
+
+
+static int settimer (long interval) {
+  struct itimerval it;
+  it.it_interval.tv_sec = interval / 1000000;
+  it.it_interval.tv_usec = interval % 1000000;
+  it.it_value = it.it_interval;
+  return setitimer(ITIMER_PROF, &it, NULL);
+}
+
+
+static int starttimer (lua_State *L, long interval) {
+  struct sigaction sa;
+  if (profstate != NULL)
+    return luaL_error(L, "profiler already running");
+  sa.sa_handler = profsignal;
+  sa.sa_flags = SA_RESTART;  /* do not interrupt system calls */
+  sigemptyset(&sa.sa_mask);
+  profstate = L;
+  if (sigaction(SIGPROF, &sa, NULL) != 0 || settimer(interval) != 0) {
+    profstate = NULL;
+    signal(SIGPROF, SIG_DFL);
+    return 0;
+  }
+  return 1;
+}
+
+
+static void stoptimer (lua_State *L) {
+  if (profstate == L) {
+    settimer(0);
+    signal(SIGPROF, SIG_DFL);
+    profstate = NULL;
+  }
+}
+
+#else				/* }{ */
+
+#define starttimer(L,i)	((void)(i), luaL_error(L, "profiling not supported"))
+#define stoptimer(L)	((void)(L))
+
+#endif				/* } */
+
+/* }================================================================== */
+
+
+static lua_State *getmainthread (lua_State *L) {
+  lua_State *mt;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  mt = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  return mt;
+}
+
+
+static int prof_start (lua_State *L) {
+  lua_Integer interval = luaL_optinteger(L, 1, LUA_PROFINTERVAL);
+  lua_State *mt = getmainthread(L);
+  luaL_argcheck(L, 0 < interval && interval <= 0x7fffffff, 1,
+                   "interval out of range");
+  lua_setprofhook(mt, profhook);
+  if (!starttimer(mt, (long)interval)) {
+    lua_setprofhook(mt, NULL);
+    return luaL_fileresult(L, 0, NULL);
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
+static int prof_stop (lua_State *L) {
+  lua_State *mt = getmainthread(L);
+  stoptimer(mt);
+  lua_setprofhook(mt, NULL);
+  return 0;
+}
+
+
+static int prof_alloc (lua_State *L) {
+  lua_Integer rate = luaL_optinteger(L, 1, LUA_PROFALLOCRATE);
+  lua_setallochook(getmainthread(L), allochook, rate);
+  return 0;
+}
+
+
+static const char *const kinds[] = {"cpu", "alloc", NULL};
+
+static const char *getkind (lua_State *L, int arg) {
+  return (luaL_checkoption(L, arg, "cpu", kinds) == 0) ? PROFKEY : ALLOCKEY;
+}
+
+
+static int prof_dump (lua_State *L) {
+  luaL_Buffer b;
+  lua_Integer total = 0;
+  int i, n = 0;
+  const char *key = getkind(L, 1);
+  lua_settop(L, 0);
+  lua_getfield(L, LUA_REGISTRYINDEX, key);  /* 1: counts */
+  lua_newtable(L);  /* 2: lines */
+  lua_pushnil(L);  /* first key */
+  while (lua_next(L, 1) != 0) {
+    lua_Integer count = lua_tointeger(L, -1);
+    total += count;
+    lua_pushfstring(L, "%s %I\n", lua_tostring(L, -2), (LUAI_UACINT)count);
+    lua_rawseti(L, 2, ++n);
+    lua_pop(L, 1);  /* remove value */
+  }
+  luaL_buffinit(L, &b);
+  for (i = 1; i <= n; i++) {
+    lua_rawgeti(L, 2, i);
+    luaL_addvalue(&b);
+  }
+  luaL_pushresult(&b);
+  lua_pushinteger(L, total);
+  return 2;
+}
+
+
+static void clearcounts (lua_State *L, const char *key) {
+  lua_getfield(L, LUA_REGISTRYINDEX, key);
+  lua_pushnil(L);  /* first key */
+  while (lua_next(L, -2) != 0) {
+    lua_pop(L, 1);  /* remove value */
+    lua_pushvalue(L, -1);  /* key */
+    lua_pushnil(L);
+    lua_rawset(L, -4);  /* clearing existing fields is allowed by 'next' */
+  }
+  lua_pop(L, 1);  /* counts table */
+}
+
+
+static int prof_clear (lua_State *L) {
+  if (lua_isnoneornil(L, 1)) {
+    clearcounts(L, PROFKEY);
+    clearcounts(L, ALLOCKEY);
+  }
+  else
+    clearcounts(L, getkind(L, 1));
+  return 0;
+}
+
+
+static const luaL_Reg prof_funcs[] = {
+  {"alloc", prof_alloc},
+  {"start", prof_start},
+  {"stop", prof_stop},
+  {"dump", prof_dump},
+  {"clear", prof_clear},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_profile (lua_State *L) {
+  /* create table of counts, which stops the profiler when collected */
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, PROFKEY);
+  lua_createtable(L, 0, 1);
+  lua_pushcfunction(L, prof_stop);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  lua_pop(L, 1);
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, ALLOCKEY);
+  lua_pop(L, 1);
+  luaL_newlib(L, prof_funcs);
+  return 1;
+}
+
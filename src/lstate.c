@@ -96,6 +96,22 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 }
 
 
+/*
+** (re)arm the soft limit and set the limit checked by allocations: the
+** soft limit, while it is below the hard one, or else the hard limit
+** (or no limit at all)
+*/
+void luaE_setmemcheck (global_State *g) {
+  g->memarmed = (g->memsoft != 0);
+  if (g->memarmed && (g->memhard == 0 || g->memsoft < g->memhard))
+    g->memcheck = g->memsoft;
+  else if (g->memhard != 0)
+    g->memcheck = g->memhard;
+  else
+    g->memcheck = MAX_LUMEM;
+}
+
+
 LUA_API int lua_setcstacklimit (lua_State *L, unsigned int limit) {
   UNUSED(L); UNUSED(limit);
   return LUAI_MAXCCALLS;  /* warning?? */
@@ -177,10 +193,44 @@ LUAI_FUNC void luaE_incCstack (lua_State *L) {
 }
 
 
+/*
+** Stacks of dead threads that still have the basic size are kept in
+** a list (linked through their first slots), up to LUAI_STACKPOOL of
+** them, and reused by new threads; programs that create many
+** short-lived coroutines then skip most of the allocator traffic.
+** Pooled stacks still count as allocated memory. Full collections
+** release them.
+*/
+#define poolnext(s)	((s)->val.value_.p)
+
+
+static StackValue *newstack (lua_State *L) {
+  global_State *g = G(L);
+  StackValue *s = g->stackpool;
+  if (s != NULL) {  /* reuse a pooled stack */
+    g->stackpool = cast(StackValue *, poolnext(s));
+    g->nstackpool--;
+    return s;
+  }
+  return luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+}
+
+
+void luaE_freestackpool (lua_State *L) {
+  global_State *g = G(L);
+  while (g->stackpool != NULL) {
+    StackValue *s = g->stackpool;
+    g->stackpool = cast(StackValue *, poolnext(s));
+    luaM_freearray(L, s, BASIC_STACK_SIZE + EXTRA_STACK);
+  }
+  g->nstackpool = 0;
+}
+
+
 static void stack_init (lua_State *L1, lua_State *L) {
   int i; CallInfo *ci;
   /* initialize stack array */
-  L1->stack.p = luaM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+  L1->stack.p = newstack(L);
   L1->tbclist.p = L1->stack.p;
   for (i = 0; i < BASIC_STACK_SIZE + EXTRA_STACK; i++)
     setnilvalue(s2v(L1->stack.p + i));  /* erase new stack */
@@ -206,7 +256,14 @@ static void freestack (lua_State *L) {
   L->ci = &L->base_ci;  /* free the entire 'ci' list */
   luaE_freeCI(L);
   lua_assert(L->nci == 0);
-  luaM_freearray(L, L->stack.p, stacksize(L) + EXTRA_STACK);  /* free stack */
+  if (stacksize(L) == BASIC_STACK_SIZE && G(L)->nstackpool < LUAI_STACKPOOL) {
+    global_State *g = G(L);
+    poolnext(L->stack.p) = g->stackpool;  /* keep stack for a new thread */
+    g->stackpool = L->stack.p;
+    g->nstackpool++;
+  }
+  else
+    luaM_freearray(L, L->stack.p, stacksize(L) + EXTRA_STACK);
 }
 
 
@@ -263,6 +320,7 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->status = LUA_OK;
   L->errfunc = 0;
   L->oldpc = 0;
+  L->nalloc = 0;
 }
 
 
@@ -277,7 +335,9 @@ static void close_state (lua_State *L) {
     luai_userstateclose(L);
   }
   luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaM_freearray(L, G(L)->strcache, G(L)->strcachesize);
   freestack(L);
+  luaE_freestackpool(L);
   lua_assert(gettotalbytes(g) == sizeof(LG));
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
@@ -374,8 +434,30 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   incnny(L);  /* main thread is always non yieldable */
   g->frealloc = f;
   g->ud = ud;
+  g->stackpool = NULL;
+  g->nstackpool = 0;
+  g->strcache = NULL;
+  g->strcachesize = 0;
   g->warnf = NULL;
   g->ud_warn = NULL;
+  g->gchook = NULL;
+  g->ud_gchook = NULL;
+  g->memsoft = g->memhard = 0;
+  g->memarmed = 0;
+  g->memcheck = MAX_LUMEM;  /* no limits */
+  g->memhook = NULL;
+  g->ud_memhook = NULL;
+  g->running = L;
+  g->profhook = NULL;
+  g->profpending = 0;
+  g->allochook = NULL;
+  g->allocrate = 0;
+  g->allocdebt = MAX_LMEM;  /* no allocation samples */
+  g->allocpending = 0;
+  g->budgethook = NULL;
+  g->budget = MAX_LMEM;  /* no budget */
+  g->interrupt = 0;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
   g->mainthread = L;
   g->seed = luai_makeseed(L);
   g->gcstp = GCSTPGC;  /* no GC while building state */
@@ -383,15 +465,23 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->strt.hash = NULL;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
+  g->iterf[LUA_ITERNEXT] = g->iterf[LUA_ITERIPAIRS] = NULL;
   g->gcstate = GCSpause;
   g->gckind = KGC_INC;
   g->gcstopem = 0;
   g->gcemergency = 0;
+  g->gcprecleaned = 0;
+  g->gcgenwork = 0;
   g->finobj = g->tobefnz = g->fixedgc = NULL;
   g->firstold1 = g->survival = g->old1 = g->reallyold = NULL;
   g->finobjsur = g->finobjold1 = g->finobjrold = NULL;
   g->sweepgc = NULL;
   g->gray = g->grayagain = NULL;
+  g->ephindex = NULL;
+  g->nativefin = NULL;
+#if defined(LUAI_FINALIZERTHREAD)
+  g->finworker = NULL;
+#endif
   g->weak = g->ephemeron = g->allweak = NULL;
   g->twups = NULL;
   g->totalbytes = sizeof(LG);
@@ -401,6 +491,8 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   setgcparam(g->gcpause, LUAI_GCPAUSE);
   setgcparam(g->gcstepmul, LUAI_GCMUL);
   g->gcstepsize = LUAI_GCSTEPSIZE;
+  g->gcsteptime = g->gcmaxgrowth = 0;
+  g->gcstepwork = 0;
   setgcparam(g->genmajormul, LUAI_GENMAJORMUL);
   g->genminormul = LUAI_GENMINORMUL;
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
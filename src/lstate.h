@@ -142,7 +142,10 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define EXTRA_STACK   5
 
 
+/* initial stack size of a thread (must be larger than LUA_MINSTACK) */
+#if !defined(BASIC_STACK_SIZE)
 #define BASIC_STACK_SIZE        (2*LUA_MINSTACK)
+#endif
 
 #define stacksize(th)	cast_int((th)->stack_last.p - (th)->stack.p)
 
@@ -270,9 +273,16 @@ typedef struct global_State {
   lu_byte genmajormul;  /* control for major generational collections */
   lu_byte gcstp;  /* control whether GC is running */
   lu_byte gcemergency;  /* true if this is an emergency collection */
+  lu_byte gcprecleaned;  /* true if 'grayagain' was precleaned in cycle */
+  lu_byte gcgenwork;  /* true while doing a generational collection */
   lu_byte gcpause;  /* size of pause between successive GCs */
   lu_byte gcstepmul;  /* GC "speed" */
   lu_byte gcstepsize;  /* (log2 of) GC granularity */
+  int gcsteptime;  /* target duration of GC steps (microseconds; 0 = none) */
+  int gcmaxgrowth;  /* heap growth that overrides 'gcsteptime' (0 = none) */
+  l_mem gcstepwork;  /* work per step with 'gcsteptime' (adjusted) */
+  lu_mem gcclock;  /* start of current time segment for 'gcstats' */
+  lua_GCStats gcstats;  /* statistics of the collector */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -280,6 +290,8 @@ typedef struct global_State {
   GCObject *grayagain;  /* list of objects to be traversed atomically */
   GCObject *weak;  /* list of tables with weak values */
   GCObject *ephemeron;  /* list of ephemeron tables (weak keys) */
+  struct EphIndex *ephindex;  /* ephemeron entries being converged */
+  GCObject *nativefin;  /* freed userdata waiting for native finalizers */
   GCObject *allweak;  /* list of all-weak tables */
   GCObject *tobefnz;  /* list of userdata to be GC */
   GCObject *fixedgc;  /* list of objects not to be collected */
@@ -293,13 +305,46 @@ typedef struct global_State {
   GCObject *finobjrold;  /* list of really old objects with finalizers */
   struct lua_State *twups;  /* list of threads with open upvalues */
   lua_CFunction panic;  /* to be called in unprotected errors */
+  lua_CFunction iterf[2];  /* iterators run inline by the VM */
   struct lua_State *mainthread;
   TString *memerrmsg;  /* message for memory-allocation errors */
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[LUA_NUMTYPES];  /* metatables for basic types */
-  TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+  TString *(*strcache)[STRCACHE_M];  /* cache for strings in API */
+  unsigned int strcachesize;  /* number of sets in 'strcache' */
+  unsigned int strcachemax;  /* limit for automatic growth of 'strcache' */
+  lu_mem strcachehits;  /* number of hits in 'strcache' */
+  lu_mem strcachemisses;  /* number of misses in 'strcache' */
+  lu_mem strcachelast[2];  /* hits and misses at last growth check */
+  StackValue *stackpool;  /* list of free stacks kept for new threads */
+  int nstackpool;  /* number of stacks in 'stackpool' */
   lua_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+  struct lua_State *running;  /* thread running Lua code (see 'lua_resume') */
+  lua_Hook profhook;  /* hook for profiling samples */
+  volatile l_signalT profpending;  /* number of samples requested */
+  lua_Hook allochook;  /* hook for allocation samples */
+  l_mem allocrate;  /* bytes allocated between allocation samples */
+  l_mem allocdebt;  /* bytes to be allocated before next sample */
+  int allocpending;  /* number of allocation samples not yet served */
+  int alloctt;  /* type of the first object in pending samples */
+  lua_Hook budgethook;  /* hook called when the budget runs out */
+  l_mem budget;  /* safepoints left in the budget (MAX_LMEM if no limit) */
+  volatile l_signalT interrupt;  /* an interrupt was requested */
+  lua_GCHook gchook;  /* function called when the collector changes phase */
+  void *ud_gchook;  /* auxiliary data to 'gchook' */
+  lu_mem memcheck;  /* limit checked by allocations (see 'abovelimit') */
+  lu_mem memsoft;  /* soft limit for memory use (0 if none) */
+  lu_mem memhard;  /* hard limit for memory use (0 if none) */
+  lu_byte memarmed;  /* true while the soft limit is being checked */
+  lua_MemHook memhook;  /* function called above the soft limit */
+  void *ud_memhook;  /* auxiliary data to 'memhook' */
+#if defined(LUAI_THREADLOCK)
+  pthread_mutex_t lock;  /* serializes the core (see 'lua_lock') */
+#endif
+#if defined(LUAI_FINALIZERTHREAD)
+  struct FinWorker *finworker;  /* thread running native finalizers */
+#endif
 } global_State;
 
 
@@ -329,6 +374,7 @@ struct lua_State {
   int basehookcount;
   int hookcount;
   volatile l_signalT hookmask;
+  lu_mem nalloc;  /* bytes allocated by this thread */
 };
 
 
@@ -394,6 +440,7 @@ union GCUnion {
 #define gettotalbytes(g)	cast(lu_mem, (g)->totalbytes + (g)->GCdebt)
 
 LUAI_FUNC void luaE_setdebt (global_State *g, l_mem debt);
+LUAI_FUNC void luaE_setmemcheck (global_State *g);
 LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
@@ -403,6 +450,7 @@ LUAI_FUNC void luaE_incCstack (lua_State *L);
 LUAI_FUNC void luaE_warning (lua_State *L, const char *msg, int tocont);
 LUAI_FUNC void luaE_warnerror (lua_State *L, const char *where);
 LUAI_FUNC int luaE_resetthread (lua_State *L, int status);
+LUAI_FUNC void luaE_freestackpool (lua_State *L);
 
 
 #endif
@@ -36,14 +36,30 @@ int luaS_eqlngstr (TString *a, TString *b) {
   lua_assert(a->tt == LUA_VLNGSTR && b->tt == LUA_VLNGSTR);
   return (a == b) ||  /* same instance or... */
     ((len == b->u.lnglen) &&  /* equal length and ... */
+     (!(a->extra && b->extra) || a->hash == b->hash) &&  /* ...hashes and */
      (memcmp(getstr(a), getstr(b), len) == 0));  /* equal contents */
 }
 
 
+/*
+** Hash function. The string is consumed four bytes at a time (read
+** with 'memcpy', so alignment does not matter), each block mixed in
+** with a multiplication; remaining bytes go one at a time. The state
+** seed enters the initial value, as before.
+*/
+#define HASHMUL		0x9E3779B1u  /* 2^32 divided by the golden ratio */
+
+#define mixhash(h,w)	((h) = ((h) ^ (w)) * HASHMUL, (h) ^= (h) >> 15)
+
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   unsigned int h = seed ^ cast_uint(l);
+  for (; l >= 4; l -= 4, str += 4) {
+    l_uint32 w;
+    memcpy(&w, str, sizeof(w));
+    mixhash(h, cast_uint(w));
+  }
   for (; l > 0; l--)
-    h ^= ((h<<5) + (h>>2) + cast_byte(str[l - 1]));
+    mixhash(h, cast_byte(str[l - 1]));
   return h;
 }
 
@@ -108,8 +124,9 @@ void luaS_resize (lua_State *L, int nsize) {
 ** a non-collectable string.)
 */
 void luaS_clearcache (global_State *g) {
-  int i, j;
-  for (i = 0; i < STRCACHE_N; i++)
+  unsigned int i;
+  int j;
+  for (i = 0; i < g->strcachesize; i++)
     for (j = 0; j < STRCACHE_M; j++) {
       if (iswhite(g->strcache[i][j]))  /* will entry be collected? */
         g->strcache[i][j] = g->memerrmsg;  /* replace it with something fixed */
@@ -117,12 +134,96 @@ void luaS_clearcache (global_State *g) {
 }
 
 
+/*
+** Replace the API string cache by an empty one with 'nsets' sets.
+** (Entries cannot be moved to the new cache, as the addresses that
+** index them are not kept.) Return false if there is not enough
+** memory, keeping the old cache.
+*/
+static int resizecache (lua_State *L, unsigned int nsets) {
+  global_State *g = G(L);
+  TString *(*nc)[STRCACHE_M];
+  unsigned int i;
+  int j;
+  nc = cast(TString *(*)[STRCACHE_M],
+            luaM_realloc_(L, NULL, 0, nsets * sizeof(*nc)));
+  if (nc == NULL)
+    return 0;
+  for (i = 0; i < nsets; i++)  /* fill cache with valid strings */
+    for (j = 0; j < STRCACHE_M; j++)
+      nc[i][j] = g->memerrmsg;
+  luaM_freearray(L, g->strcache, g->strcachesize);
+  g->strcache = nc;
+  g->strcachesize = nsets;
+  g->strcachelast[0] = g->strcachehits;
+  g->strcachelast[1] = g->strcachemisses;
+  return 1;
+}
+
+
+/*
+** Sizes for the API string cache: primes (as its sets are indexed by
+** addresses modulo its size) that roughly double at each step.
+*/
+static const unsigned int cachesizes[] = {
+  2, 3, 5, 11, 17, 37, 67, 131, 257, 521, 1031, 2053, 4099, 8209,
+  16411, 32771, 65537
+};
+
+#define NCACHESIZES	(sizeof(cachesizes) / sizeof(cachesizes[0]))
+
+
+/* smallest valid size not smaller than 'n' (or the largest one) */
+static unsigned int cachesize (unsigned int n) {
+  unsigned int i;
+  for (i = 0; i < NCACHESIZES - 1 && cachesizes[i] < n; i++) ;
+  return cachesizes[i];
+}
+
+
+/*
+** Set the number of sets of the API string cache and the limit for
+** its automatic growth (both rounded up to valid sizes). A
+** non-positive 'nsets' keeps the current size; a non-positive
+** 'maxsets' disables growth. Return the resulting number of sets.
+*/
+unsigned int luaS_setcache (lua_State *L, int nsets, int maxsets) {
+  global_State *g = G(L);
+  if (nsets > 0) {
+    unsigned int ns = cachesize(cast_uint(nsets));
+    if (ns != g->strcachesize)
+      resizecache(L, ns);  /* on failure, keep the old cache */
+  }
+  g->strcachemax = (maxsets > 0) ? cachesize(cast_uint(maxsets)) : 0;
+  return g->strcachesize;
+}
+
+
+/*
+** Check whether the API string cache should grow: it is doubled when,
+** since the last check, there were at least 4 misses per entry and
+** more than a quarter of the lookups missed.
+*/
+static void checkcachesize (lua_State *L) {
+  global_State *g = G(L);
+  lu_mem misses = g->strcachemisses - g->strcachelast[1];
+  if (misses >= 4u * STRCACHE_M * g->strcachesize) {
+    lu_mem hits = g->strcachehits - g->strcachelast[0];
+    if (misses > hits / 3 && g->strcachesize < g->strcachemax) {
+      if (!resizecache(L, cachesize(g->strcachesize + 1)))
+        g->strcachemax = g->strcachesize;  /* stop trying */
+    }
+    g->strcachelast[0] = g->strcachehits;
+    g->strcachelast[1] = g->strcachemisses;
+  }
+}
+
+
 /*
 ** Initialize the string table and the string cache
 */
 void luaS_init (lua_State *L) {
   global_State *g = G(L);
-  int i, j;
   stringtable *tb = &G(L)->strt;
   tb->hash = luaM_newvector(L, MINSTRTABSIZE, TString*);
   tablerehash(tb->hash, 0, MINSTRTABSIZE);  /* clear array */
@@ -130,9 +231,10 @@ void luaS_init (lua_State *L) {
   /* pre-create memory-error message */
   g->memerrmsg = luaS_newliteral(L, MEMERRMSG);
   luaC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected */
-  for (i = 0; i < STRCACHE_N; i++)  /* fill cache with valid strings */
-    for (j = 0; j < STRCACHE_M; j++)
-      g->strcache[i][j] = g->memerrmsg;
+  g->strcachehits = g->strcachemisses = 0;
+  g->strcachemax = STRCACHE_N;  /* no automatic growth */
+  if (!resizecache(L, STRCACHE_N))
+    luaM_error(L);
 }
 
 
@@ -185,7 +287,115 @@ static void growstrtab (lua_State *L, stringtable *tb) {
 /*
 ** Checks whether short string exists and reuses it or creates a new one.
 */
-static TString *internshrstr (lua_State *L, const char *str, size_t l) {
+/*
+** {==================================================================
+** Shared strings
+** With LUA_SHAREDSTRINGS, short strings that are constants of some
+** code (names and literals from source code or precompiled chunks)
+** go to a process-wide table shared by all states, so that each state
+** does not need its own copy (and hash) of the same field names. These
+** strings are immortal: they are created with 'malloc', belong to no
+** state, and are painted gray (and old), so that no collector ever
+** marks them, sweeps them, or writes into them. The table has a fixed
+** size and uses open addressing; entries are only added (with a
+** compare-and-swap) and never removed, so lookups need no locks.
+** Each state keeps short strings unique among its values by always
+** looking for a string in its own table before the shared one: once a
+** state has a private copy of some contents, it keeps using it.
+** ===================================================================
+*/
+
+#if defined(LUA_SHAREDSTRINGS)
+
+#include <stdlib.h>
+#include <time.h>
+
+/* size of the shared table (must be a power of 2) */
+#if !defined(LUAI_SHAREDSTRSIZE)
+#define LUAI_SHAREDSTRSIZE	(1 << 16)
+#endif
+
+/* maximum number of slots tried in the shared table */
+#define MAXSHAREDPROBE		32
+
+#define sharedload(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define sharedcas(p,e,v)  \
+	__atomic_compare_exchange_n(p, e, v, 0, __ATOMIC_ACQ_REL, \
+	                            __ATOMIC_ACQUIRE)
+
+
+static TString *sharedtable[LUAI_SHAREDSTRSIZE];
+static unsigned int sharedseed = 0;
+
+
+static unsigned int getsharedseed (void) {
+  unsigned int seed = sharedload(&sharedseed);
+  if (l_unlikely(seed == 0)) {  /* first use? */
+    unsigned int expected = 0;
+    void *p = sharedtable;
+    seed = luaS_hash((const char *)&p, sizeof(p), cast_uint(time(NULL))) | 1;
+    if (!sharedcas(&sharedseed, &expected, seed))
+      seed = expected;  /* another thread set it first */
+  }
+  return seed;
+}
+
+
+static TString *newsharedstr (const char *str, size_t l, unsigned int h) {
+  TString *ts = cast(TString *, malloc(sizelstring(l)));
+  if (ts != NULL) {
+    ts->next = NULL;
+    ts->tt = LUA_VSHRSTR;
+    ts->marked = G_OLD;  /* gray and old: collectors never touch it */
+    ts->extra = 0;
+    ts->shrlen = cast_byte(l);
+    ts->hash = h;
+    ts->u.hnext = NULL;
+    memcpy(getstr(ts), str, l * sizeof(char));
+    getstr(ts)[l] = '\0';  /* ending 0 */
+  }
+  return ts;
+}
+
+
+/*
+** Look for a string in the shared table. If it is not there and
+** 'create' is true, try to add it. Returns NULL when the string is
+** absent (or could not be added).
+*/
+static TString *getsharedstr (const char *str, size_t l, int create) {
+  unsigned int h = luaS_hash(str, l, getsharedseed());
+  TString *nts = NULL;  /* new string (if created) */
+  unsigned int n;
+  for (n = 0; n < MAXSHAREDPROBE; n++) {
+    TString **slot = &sharedtable[(h + n) & (LUAI_SHAREDSTRSIZE - 1)];
+    TString *ts = sharedload(slot);
+    if (ts == NULL) {  /* free slot? */
+      if (!create)
+        return NULL;
+      if (nts == NULL && (nts = newsharedstr(str, l, h)) == NULL)
+        return NULL;  /* no memory; string stays private */
+      if (sharedcas(slot, &ts, nts))  /* got the slot? */
+        return nts;
+      /* else 'ts' is the string that another thread stored there */
+    }
+    if (ts->hash == h && ts->shrlen == l &&
+        memcmp(str, getstr(ts), l * sizeof(char)) == 0) {
+      free(nts);  /* not needed (if created) */
+      return ts;
+    }
+  }
+  free(nts);  /* not published (if created) */
+  return NULL;  /* too many collisions; string stays private */
+}
+
+#endif
+
+/* }================================================================== */
+
+
+static TString *internshrstr (lua_State *L, const char *str, size_t l,
+                              int share) {
   TString *ts;
   global_State *g = G(L);
   stringtable *tb = &g->strt;
@@ -200,6 +410,14 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
       return ts;
     }
   }
+#if defined(LUA_SHAREDSTRINGS)
+  /* strings created while building the state (reserved words, etc.)
+     are fixed in the state, so they must be private to it */
+  if (completestate(g) && (ts = getsharedstr(str, l, share)) != NULL)
+    return ts;
+#else
+  UNUSED(share);
+#endif
   /* else must create a new string */
   if (tb->nuse >= tb->size) {  /* need to grow string table? */
     growstrtab(L, tb);
@@ -220,7 +438,7 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
 */
 TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
   if (l <= LUAI_MAXSHORTLEN)  /* short string? */
-    return internshrstr(L, str, l);
+    return internshrstr(L, str, l, 0);
   else {
     TString *ts;
     if (l_unlikely(l >= (MAX_SIZE - sizeof(TString))/sizeof(char)))
@@ -232,6 +450,20 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+#if defined(LUA_SHAREDSTRINGS)
+/*
+** Create a string that is a constant of some code. Short ones can go
+** to (or come from) the shared table.
+*/
+TString *luaS_newkstr (lua_State *L, const char *str, size_t l) {
+  if (l <= LUAI_MAXSHORTLEN)  /* short string? */
+    return internshrstr(L, str, l, 1);
+  else
+    return luaS_newlstr(L, str, l);
+}
+#endif
+
+
 /*
 ** Create or reuse a zero-terminated string, first checking in the
 ** cache (using the string address as a key). The cache can contain
@@ -239,14 +471,21 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 ** check hits.
 */
 TString *luaS_new (lua_State *L, const char *str) {
-  unsigned int i = point2uint(str) % STRCACHE_N;  /* hash */
+  global_State *g = G(L);
   int j;
-  TString **p = G(L)->strcache[i];
+  TString **p = g->strcache[point2uint(str) % g->strcachesize];
   for (j = 0; j < STRCACHE_M; j++) {
-    if (strcmp(str, getstr(p[j])) == 0)  /* hit? */
+    if (strcmp(str, getstr(p[j])) == 0) {  /* hit? */
+      g->strcachehits++;
       return p[j];  /* that is it */
+    }
   }
   /* normal route */
+  g->strcachemisses++;
+  if (g->strcachesize < g->strcachemax) {  /* can grow? */
+    checkcachesize(L);
+    p = g->strcache[point2uint(str) % g->strcachesize];  /* may have changed */
+  }
   for (j = STRCACHE_M - 1; j > 0; j--)
     p[j] = p[j - 1];  /* move out last element */
   /* new element is first in the list */
@@ -265,6 +504,8 @@ Udata *luaS_newudata (lua_State *L, size_t s, int nuvalue) {
   u = gco2u(o);
   u->len = s;
   u->nuvalue = nuvalue;
+  u->arraykind = 0;
+  u->nativefin = 0;
   u->metatable = NULL;
   for (i = 0; i < nuvalue; i++)
     setnilvalue(&u->uv[i].uv);
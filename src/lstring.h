@@ -46,6 +46,7 @@ LUAI_FUNC unsigned int luaS_hashlongstr (TString *ts);
 LUAI_FUNC int luaS_eqlngstr (TString *a, TString *b);
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUAI_FUNC void luaS_clearcache (global_State *g);
+LUAI_FUNC unsigned int luaS_setcache (lua_State *L, int nsets, int maxsets);
 LUAI_FUNC void luaS_init (lua_State *L);
 LUAI_FUNC void luaS_remove (lua_State *L, TString *ts);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, int nuvalue);
@@ -53,5 +54,11 @@ LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
 LUAI_FUNC TString *luaS_createlngstrobj (lua_State *L, size_t l);
 
+#if defined(LUA_SHAREDSTRINGS)
+LUAI_FUNC TString *luaS_newkstr (lua_State *L, const char *str, size_t l);
+#else
+#define luaS_newkstr(L,s,l)	luaS_newlstr(L,s,l)
+#endif
+
 
 #endif
@@ -361,6 +361,7 @@ typedef struct MatchState {
   const char *p_end;  /* end ('\0') of pattern */
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
+  int firstc;  /* character every match must start with (or -1) */
   unsigned char level;  /* total number of captures (finished or unfinished) */
   struct {
     const char *init;
@@ -754,6 +755,45 @@ static int nospecials (const char *p, size_t l) {
 }
 
 
+/*
+** If the pattern starts with a literal character that is not optional
+** (not followed by '*', '?', or '-'), any match must start with that
+** character; return it. Otherwise, return -1. Only ordinary bytes
+** count: a pattern starting with any special (including ')' and ']')
+** is left to the matcher, which also reports its errors.
+*/
+static int firstliteral (const char *p, const char *p_end) {
+  int c;
+  if (p >= p_end)
+    return -1;
+  else if (*p == L_ESC) {  /* escaped punctuation is also a literal */
+    if (p + 1 >= p_end || isalnum(uchar(p[1])))
+      return -1;
+    c = uchar(p[1]);
+    p += 2;
+  }
+  else if (*p != '\0' && strchr(SPECIALS ")]", *p) != NULL)
+    return -1;
+  else
+    c = uchar(*p++);
+  if (p < p_end && (*p == '*' || *p == '?' || *p == '-'))
+    return -1;  /* character is optional */
+  return c;
+}
+
+
+/*
+** Return the first position from 's' where a match may start, or NULL
+** if no match can start before the end of the subject. Positions that
+** do not hold the pattern's first literal are skipped with 'memchr'.
+*/
+static const char *nextstart (MatchState *ms, const char *s) {
+  if (ms->firstc < 0)
+    return s;
+  return (const char *)memchr(s, ms->firstc, ms->src_end - s);
+}
+
+
 static void prepstate (MatchState *ms, lua_State *L,
                        const char *s, size_t ls, const char *p, size_t lp) {
   ms->L = L;
@@ -761,6 +801,7 @@ static void prepstate (MatchState *ms, lua_State *L,
   ms->src_init = s;
   ms->src_end = s + ls;
   ms->p_end = p + lp;
+  ms->firstc = firstliteral(p, p + lp);
 }
 
 
@@ -799,6 +840,8 @@ static int str_find_aux (lua_State *L, int find) {
     prepstate(&ms, L, s, ls, p, lp);
     do {
       const char *res;
+      if (!anchor && (s1 = nextstart(&ms, s1)) == NULL)
+        break;  /* no more possible matches */
       reprepstate(&ms);
       if ((res=match(&ms, s1, p)) != NULL) {
         if (find) {
@@ -841,6 +884,8 @@ static int gmatch_aux (lua_State *L) {
   gm->ms.L = L;
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if ((src = nextstart(&gm->ms, src)) == NULL)
+      break;  /* no more possible matches */
     reprepstate(&gm->ms);
     if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
@@ -961,6 +1006,13 @@ static int str_gsub (lua_State *L) {
   prepstate(&ms, L, src, srcl, p, lp);
   while (n < max_s) {
     const char *e;
+    if (!anchor) {
+      const char *s1 = nextstart(&ms, src);
+      if (s1 == NULL)
+        break;  /* no more possible matches; rest is copied below */
+      luaL_addlstring(&b, src, s1 - src);  /* keep skipped text */
+      src = s1;
+    }
     reprepstate(&ms);  /* (re)prepare state for new match */
     if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
       n++;
@@ -1270,24 +1322,26 @@ static void addlenmod (char *form, const char *lenmod) {
 }
 
 
-static int str_format (lua_State *L) {
-  int top = lua_gettop(L);
-  int arg = 1;
+/*
+** Add to buffer 'b' the result of formatting the values after
+** index 'arg', up to index 'top', with the format at that index.
+** ('top' must be taken before 'b' is initialized, as the buffer
+** may push a placeholder.)
+*/
+static int addformat (lua_State *L, luaL_Buffer *b, int arg, int top) {
   size_t sfl;
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
   const char *strfrmt_end = strfrmt+sfl;
   const char *flags;
-  luaL_Buffer b;
-  luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
     if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
+      luaL_addchar(b, *strfrmt++);
     else if (*++strfrmt == L_ESC)
-      luaL_addchar(&b, *strfrmt++);  /* %% */
+      luaL_addchar(b, *strfrmt++);  /* %% */
     else { /* format item */
       char form[MAX_FORMAT];  /* to store the format ('%...') */
       int maxitem = MAX_ITEM;  /* maximum length for the result */
-      char *buff = luaL_prepbuffsize(&b, maxitem);  /* to put result */
+      char *buff = luaL_prepbuffsize(b, maxitem);  /* to put result */
       int nb = 0;  /* number of bytes in result */
       if (++arg > top)
         return luaL_argerror(L, arg, "no value");
@@ -1321,7 +1375,7 @@ static int str_format (lua_State *L) {
           break;
         case 'f':
           maxitem = MAX_ITEMF;  /* extra space for '%f' */
-          buff = luaL_prepbuffsize(&b, maxitem);
+          buff = luaL_prepbuffsize(b, maxitem);
           /* FALLTHROUGH */
         case 'e': case 'E': case 'g': case 'G': {
           lua_Number n = luaL_checknumber(L, arg);
@@ -1343,20 +1397,20 @@ static int str_format (lua_State *L) {
         case 'q': {
           if (form[2] != '\0')  /* modifiers? */
             return luaL_error(L, "specifier '%%q' cannot have modifiers");
-          addliteral(L, &b, arg);
+          addliteral(L, b, arg);
           break;
         }
         case 's': {
           size_t l;
           const char *s = luaL_tolstring(L, arg, &l);
           if (form[2] == '\0')  /* no modifiers? */
-            luaL_addvalue(&b);  /* keep entire string */
+            luaL_addvalue(b);  /* keep entire string */
           else {
             luaL_argcheck(L, l == strlen(s), arg, "string contains zeros");
             checkformat(L, form, L_FMTFLAGSC, 1);
             if (strchr(form, '.') == NULL && l >= 100) {
               /* no precision and string is too long to be formatted */
-              luaL_addvalue(&b);  /* keep entire string */
+              luaL_addvalue(b);  /* keep entire string */
             }
             else {  /* format the string into 'buff' */
               nb = l_sprintf(buff, maxitem, form, s);
@@ -1370,9 +1424,18 @@ static int str_format (lua_State *L) {
         }
       }
       lua_assert(nb < maxitem);
-      luaL_addsize(&b, nb);
+      luaL_addsize(b, nb);
     }
   }
+  return 0;
+}
+
+
+static int str_format (lua_State *L) {
+  int top = lua_gettop(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 1, top);
   luaL_pushresult(&b);
   return 1;
 }
@@ -1530,49 +1593,83 @@ static KOption getoption (Header *h, const char **fmt, int *size) {
 
 
 /*
-** Read, classify, and fill other details about the next option.
-** 'psize' is filled with option's size, 'notoalign' with its
-** alignment requirements.
-** Local variable 'size' gets the size to be aligned. (Kpadal option
-** always gets its full alignment, other options are limited by
-** the maximum alignment ('maxalign'). Kchar option needs no alignment
+** Read the alignment requirements of option 'opt' (already read, with
+** size 'size'). Return 1 if it needs no alignment. Option Kpaddalign
+** always gets its full alignment, other options are limited by the
+** maximum alignment ('maxalign'). Kchar option needs no alignment
 ** despite its size.
 */
-static KOption getdetails (Header *h, size_t totalsize,
-                           const char **fmt, int *psize, int *ntoalign) {
-  KOption opt = getoption(h, fmt, psize);
-  int align = *psize;  /* usually, alignment follows size */
+static int getalign (Header *h, const char **fmt, KOption opt, int size) {
+  int align = size;  /* usually, alignment follows size */
   if (opt == Kpaddalign) {  /* 'X' gets alignment from following option */
     if (**fmt == '\0' || getoption(h, fmt, &align) == Kchar || align == 0)
       luaL_argerror(h->L, 1, "invalid next option for option 'X'");
   }
   if (align <= 1 || opt == Kchar)  /* need no alignment? */
-    *ntoalign = 0;
-  else {
-    if (align > h->maxalign)  /* enforce maximum alignment */
-      align = h->maxalign;
-    if (l_unlikely((align & (align - 1)) != 0))  /* not a power of 2? */
-      luaL_argerror(h->L, 1, "format asks for alignment not power of 2");
-    *ntoalign = (align - (int)(totalsize & (align - 1))) & (align - 1);
-  }
+    return 1;
+  if (align > h->maxalign)  /* enforce maximum alignment */
+    align = h->maxalign;
+  if (l_unlikely((align & (align - 1)) != 0))  /* not a power of 2? */
+    luaL_argerror(h->L, 1, "format asks for alignment not power of 2");
+  return align;
+}
+
+
+/* number of bytes to skip at 'pos' to get alignment 'align' */
+#define padding(pos,align)	((int)((0u - (size_t)(pos)) & ((align) - 1)))
+
+
+/*
+** Read, classify, and fill other details about the next option.
+** 'psize' is filled with option's size, 'notoalign' with its
+** alignment requirements.
+*/
+static KOption getdetails (Header *h, size_t totalsize,
+                           const char **fmt, int *psize, int *ntoalign) {
+  KOption opt = getoption(h, fmt, psize);
+  *ntoalign = padding(totalsize, getalign(h, fmt, opt, *psize));
   return opt;
 }
 
 
+/*
+** Copy 'size' bytes from 'src' to 'dest'. Usual sizes are constants
+** in their calls to 'memcpy', which compilers turn into plain moves.
+*/
+static void copynative (char *dest, const char *src, int size) {
+  switch (size) {
+    case 1: *dest = *src; break;
+    case 2: memcpy(dest, src, 2); break;
+    case 4: memcpy(dest, src, 4); break;
+    case 8: memcpy(dest, src, 8); break;
+    default: memcpy(dest, src, size); break;
+  }
+}
+
+
+/* offset of the 'size' lower bytes inside a native lua_Unsigned */
+#define lowoffset(size)	(nativeendian.little ? 0 : SZINT - (size))
+
+
 /*
 ** Pack integer 'n' with 'size' bytes and 'islittle' endianness.
-** The final 'if' handles the case when 'size' is larger than
-** the size of a Lua integer, correcting the extra sign-extension
-** bytes if necessary (by default they would be zeros).
+** Integers in native byte order are copied directly. The final 'if'
+** handles the case when 'size' is larger than the size of a Lua
+** integer, correcting the extra sign-extension bytes if necessary (by
+** default they would be zeros).
 */
 static void packint (luaL_Buffer *b, lua_Unsigned n,
                      int islittle, int size, int neg) {
   char *buff = luaL_prepbuffsize(b, size);
   int i;
-  buff[islittle ? 0 : size - 1] = (char)(n & MC);  /* first byte */
-  for (i = 1; i < size; i++) {
-    n >>= NB;
-    buff[islittle ? i : size - 1 - i] = (char)(n & MC);
+  if (islittle == nativeendian.little && size <= SZINT)
+    copynative(buff, (char *)&n + lowoffset(size), size);
+  else {
+    buff[islittle ? 0 : size - 1] = (char)(n & MC);  /* first byte */
+    for (i = 1; i < size; i++) {
+      n >>= NB;
+      buff[islittle ? i : size - 1 - i] = (char)(n & MC);
+    }
   }
   if (neg && size > SZINT) {  /* negative number need sign extension? */
     for (i = SZINT; i < size; i++)  /* correct extra bytes */
@@ -1589,7 +1686,7 @@ static void packint (luaL_Buffer *b, lua_Unsigned n,
 static void copywithendian (char *dest, const char *src,
                             int size, int islittle) {
   if (islittle == nativeendian.little)
-    memcpy(dest, src, size);
+    copynative(dest, src, size);
   else {
     dest += size - 1;
     while (size-- != 0)
@@ -1598,100 +1695,193 @@ static void copywithendian (char *dest, const char *src,
 }
 
 
-static int str_pack (lua_State *L) {
-  luaL_Buffer b;
+/*
+** Message for a value at index 'arg' that is not a 'tname', as given
+** by 'luaL_typeerror'.
+*/
+static const char *typemsg (lua_State *L, int arg, const char *tname) {
+  const char *typearg;  /* name for the type of the actual argument */
+  if (luaL_getmetafield(L, arg, "__name") == LUA_TSTRING)
+    typearg = lua_tostring(L, -1);  /* use the given type name */
+  else if (lua_type(L, arg) == LUA_TLIGHTUSERDATA)
+    typearg = "light userdata";  /* special name for messages */
+  else
+    typearg = luaL_typename(L, arg);  /* standard name */
+  return lua_pushfstring(L, "%s expected, got %s", tname, typearg);
+}
+
+
+static const char *tointeger (lua_State *L, int arg, lua_Integer *n) {
+  int isnum;
+  *n = lua_tointegerx(L, arg, &isnum);
+  if (l_likely(isnum))
+    return NULL;
+  else if (lua_isnumber(L, arg))
+    return "number has no integer representation";
+  else
+    return typemsg(L, arg, "number");
+}
+
+
+static const char *tonumber (lua_State *L, int arg, lua_Number *n) {
+  int isnum;
+  *n = lua_tonumberx(L, arg, &isnum);
+  return (l_likely(isnum)) ? NULL : typemsg(L, arg, "number");
+}
+
+
+static const char *tolstring (lua_State *L, int arg, const char **s,
+                              size_t *len) {
+  *s = lua_tolstring(L, arg, len);
+  return (l_likely(*s != NULL)) ? NULL : typemsg(L, arg, "string");
+}
+
+
+/*
+** Add to buffer 'b' the value at index 'arg' packed as option 'opt',
+** which is not a padding or a no-op. (The buffer must be above the
+** value in the stack.) Return an error message for an invalid value,
+** or NULL.
+*/
+static const char *packitem (lua_State *L, luaL_Buffer *b, KOption opt,
+                             int size, int islittle, int arg,
+                             size_t *totalsize) {
+  const char *msg;
+  switch (opt) {
+    case Kint: {  /* signed integers */
+      lua_Integer n;
+      if ((msg = tointeger(L, arg, &n)) != NULL)
+        return msg;
+      if (size < SZINT) {  /* need overflow check? */
+        lua_Integer lim = (lua_Integer)1 << ((size * NB) - 1);
+        if (!(-lim <= n && n < lim))
+          return "integer overflow";
+      }
+      packint(b, (lua_Unsigned)n, islittle, size, (n < 0));
+      break;
+    }
+    case Kuint: {  /* unsigned integers */
+      lua_Integer n;
+      if ((msg = tointeger(L, arg, &n)) != NULL)
+        return msg;
+      if (size < SZINT &&  /* need overflow check? */
+          (lua_Unsigned)n >= ((lua_Unsigned)1 << (size * NB)))
+        return "unsigned overflow";
+      packint(b, (lua_Unsigned)n, islittle, size, 0);
+      break;
+    }
+    case Kfloat: {  /* C float */
+      lua_Number n;
+      float f;
+      if ((msg = tonumber(L, arg, &n)) != NULL)
+        return msg;
+      f = (float)n;
+      /* move 'f' to final result, correcting endianness if needed */
+      copywithendian(luaL_prepbuffsize(b, sizeof(f)), (char *)&f,
+                     sizeof(f), islittle);
+      luaL_addsize(b, size);
+      break;
+    }
+    case Knumber: {  /* Lua float */
+      lua_Number f;
+      if ((msg = tonumber(L, arg, &f)) != NULL)
+        return msg;
+      copywithendian(luaL_prepbuffsize(b, sizeof(f)), (char *)&f,
+                     sizeof(f), islittle);
+      luaL_addsize(b, size);
+      break;
+    }
+    case Kdouble: {  /* C double */
+      lua_Number n;
+      double f;
+      if ((msg = tonumber(L, arg, &n)) != NULL)
+        return msg;
+      f = (double)n;
+      copywithendian(luaL_prepbuffsize(b, sizeof(f)), (char *)&f,
+                     sizeof(f), islittle);
+      luaL_addsize(b, size);
+      break;
+    }
+    case Kchar: {  /* fixed-size string */
+      size_t len;
+      const char *s;
+      if ((msg = tolstring(L, arg, &s, &len)) != NULL)
+        return msg;
+      if (len > (size_t)size)
+        return "string longer than given size";
+      luaL_addlstring(b, s, len);  /* add string */
+      while (len++ < (size_t)size)  /* pad extra space */
+        luaL_addchar(b, LUAL_PACKPADBYTE);
+      break;
+    }
+    case Kstring: {  /* strings with length count */
+      size_t len;
+      const char *s;
+      if ((msg = tolstring(L, arg, &s, &len)) != NULL)
+        return msg;
+      if (!(size >= (int)sizeof(size_t) || len < ((size_t)1 << (size * NB))))
+        return "string length does not fit in given size";
+      packint(b, (lua_Unsigned)len, islittle, size, 0);  /* pack length */
+      luaL_addlstring(b, s, len);
+      *totalsize += len;
+      break;
+    }
+    case Kzstr: {  /* zero-terminated string */
+      size_t len;
+      const char *s;
+      if ((msg = tolstring(L, arg, &s, &len)) != NULL)
+        return msg;
+      if (strlen(s) != len)
+        return "string contains zeros";
+      luaL_addlstring(b, s, len);
+      luaL_addchar(b, '\0');  /* add zero at the end */
+      *totalsize += len + 1;
+      break;
+    }
+    default: lua_assert(0);
+  }
+  return NULL;
+}
+
+
+/*
+** Add to buffer 'b' the values after index 'arg' packed with the format
+** at that index. (The buffer must be above the values in the stack.)
+*/
+static int addpack (lua_State *L, luaL_Buffer *b, int arg) {
   Header h;
-  const char *fmt = luaL_checkstring(L, 1);  /* format string */
-  int arg = 1;  /* current argument to pack */
+  const char *fmt = luaL_checkstring(L, arg);  /* format string */
   size_t totalsize = 0;  /* accumulate total size of result */
   initheader(L, &h);
-  lua_pushnil(L);  /* mark to separate arguments from string buffer */
-  luaL_buffinit(L, &b);
   while (*fmt != '\0') {
     int size, ntoalign;
     KOption opt = getdetails(&h, totalsize, &fmt, &size, &ntoalign);
     totalsize += ntoalign + size;
     while (ntoalign-- > 0)
-     luaL_addchar(&b, LUAL_PACKPADBYTE);  /* fill alignment */
-    arg++;
+     luaL_addchar(b, LUAL_PACKPADBYTE);  /* fill alignment */
     switch (opt) {
-      case Kint: {  /* signed integers */
-        lua_Integer n = luaL_checkinteger(L, arg);
-        if (size < SZINT) {  /* need overflow check? */
-          lua_Integer lim = (lua_Integer)1 << ((size * NB) - 1);
-          luaL_argcheck(L, -lim <= n && n < lim, arg, "integer overflow");
-        }
-        packint(&b, (lua_Unsigned)n, h.islittle, size, (n < 0));
-        break;
-      }
-      case Kuint: {  /* unsigned integers */
-        lua_Integer n = luaL_checkinteger(L, arg);
-        if (size < SZINT)  /* need overflow check? */
-          luaL_argcheck(L, (lua_Unsigned)n < ((lua_Unsigned)1 << (size * NB)),
-                           arg, "unsigned overflow");
-        packint(&b, (lua_Unsigned)n, h.islittle, size, 0);
-        break;
-      }
-      case Kfloat: {  /* C float */
-        float f = (float)luaL_checknumber(L, arg);  /* get argument */
-        char *buff = luaL_prepbuffsize(&b, sizeof(f));
-        /* move 'f' to final result, correcting endianness if needed */
-        copywithendian(buff, (char *)&f, sizeof(f), h.islittle);
-        luaL_addsize(&b, size);
-        break;
-      }
-      case Knumber: {  /* Lua float */
-        lua_Number f = luaL_checknumber(L, arg);  /* get argument */
-        char *buff = luaL_prepbuffsize(&b, sizeof(f));
-        /* move 'f' to final result, correcting endianness if needed */
-        copywithendian(buff, (char *)&f, sizeof(f), h.islittle);
-        luaL_addsize(&b, size);
-        break;
-      }
-      case Kdouble: {  /* C double */
-        double f = (double)luaL_checknumber(L, arg);  /* get argument */
-        char *buff = luaL_prepbuffsize(&b, sizeof(f));
-        /* move 'f' to final result, correcting endianness if needed */
-        copywithendian(buff, (char *)&f, sizeof(f), h.islittle);
-        luaL_addsize(&b, size);
-        break;
-      }
-      case Kchar: {  /* fixed-size string */
-        size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, len <= (size_t)size, arg,
-                         "string longer than given size");
-        luaL_addlstring(&b, s, len);  /* add string */
-        while (len++ < (size_t)size)  /* pad extra space */
-          luaL_addchar(&b, LUAL_PACKPADBYTE);
-        break;
-      }
-      case Kstring: {  /* strings with length count */
-        size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, size >= (int)sizeof(size_t) ||
-                         len < ((size_t)1 << (size * NB)),
-                         arg, "string length does not fit in given size");
-        packint(&b, (lua_Unsigned)len, h.islittle, size, 0);  /* pack length */
-        luaL_addlstring(&b, s, len);
-        totalsize += len;
+      case Kpadding: luaL_addchar(b, LUAL_PACKPADBYTE);  /* FALLTHROUGH */
+      case Kpaddalign: case Knop:
         break;
-      }
-      case Kzstr: {  /* zero-terminated string */
-        size_t len;
-        const char *s = luaL_checklstring(L, arg, &len);
-        luaL_argcheck(L, strlen(s) == len, arg, "string contains zeros");
-        luaL_addlstring(&b, s, len);
-        luaL_addchar(&b, '\0');  /* add zero at the end */
-        totalsize += len + 1;
+      default: {
+        const char *msg = packitem(L, b, opt, size, h.islittle, ++arg,
+                                   &totalsize);
+        if (l_unlikely(msg != NULL))
+          luaL_argerror(L, arg, msg);
         break;
       }
-      case Kpadding: luaL_addchar(&b, LUAL_PACKPADBYTE);  /* FALLTHROUGH */
-      case Kpaddalign: case Knop:
-        arg--;  /* undo increment */
-        break;
     }
   }
+  return 0;
+}
+
+
+static int str_pack (lua_State *L) {
+  luaL_Buffer b;
+  luaL_checkstring(L, 1);  /* format string */
+  lua_pushnil(L);  /* mark to separate arguments from string buffer */
+  luaL_buffinit(L, &b);
+  addpack(L, &b, 1);
   luaL_pushresult(&b);
   return 1;
 }
@@ -1719,6 +1909,7 @@ static int str_packsize (lua_State *L) {
 
 /*
 ** Unpack an integer with 'size' bytes and 'islittle' endianness.
+** Integers in native byte order are copied directly.
 ** If size is smaller than the size of a Lua integer and integer
 ** is signed, must do sign extension (propagating the sign to the
 ** higher bits); if size is larger than the size of a Lua integer,
@@ -1730,9 +1921,13 @@ static lua_Integer unpackint (lua_State *L, const char *str,
   lua_Unsigned res = 0;
   int i;
   int limit = (size  <= SZINT) ? size : SZINT;
-  for (i = limit - 1; i >= 0; i--) {
-    res <<= NB;
-    res |= (lua_Unsigned)(unsigned char)str[islittle ? i : size - 1 - i];
+  if (islittle == nativeendian.little && size <= SZINT)
+    copynative((char *)&res + lowoffset(size), str, size);
+  else {
+    for (i = limit - 1; i >= 0; i--) {
+      res <<= NB;
+      res |= (lua_Unsigned)(unsigned char)str[islittle ? i : size - 1 - i];
+    }
   }
   if (size < SZINT) {  /* real size smaller than lua_Integer? */
     if (issigned) {  /* needs sign extension? */
@@ -1751,6 +1946,63 @@ static lua_Integer unpackint (lua_State *L, const char *str,
 }
 
 
+/*
+** Push the value of option 'opt' (not a padding or a no-op) from
+** position 'pos' of string 'data' (argument 2), where there are
+** already 'size' bytes available. Return the number of bytes it uses
+** after those 'size' bytes.
+*/
+static size_t unpackitem (lua_State *L, KOption opt, int size,
+                          int islittle, const char *data, size_t ld,
+                          size_t pos) {
+  switch (opt) {
+    case Kint:
+    case Kuint: {
+      lua_Integer res = unpackint(L, data + pos, islittle, size,
+                                     (opt == Kint));
+      lua_pushinteger(L, res);
+      return 0;
+    }
+    case Kfloat: {
+      float f;
+      copywithendian((char *)&f, data + pos, sizeof(f), islittle);
+      lua_pushnumber(L, (lua_Number)f);
+      return 0;
+    }
+    case Knumber: {
+      lua_Number f;
+      copywithendian((char *)&f, data + pos, sizeof(f), islittle);
+      lua_pushnumber(L, f);
+      return 0;
+    }
+    case Kdouble: {
+      double f;
+      copywithendian((char *)&f, data + pos, sizeof(f), islittle);
+      lua_pushnumber(L, (lua_Number)f);
+      return 0;
+    }
+    case Kchar: {
+      lua_pushlstring(L, data + pos, size);
+      return 0;
+    }
+    case Kstring: {
+      size_t len = (size_t)unpackint(L, data + pos, islittle, size, 0);
+      luaL_argcheck(L, len <= ld - pos - size, 2, "data string too short");
+      lua_pushlstring(L, data + pos + size, len);
+      return len;  /* skip string */
+    }
+    case Kzstr: {
+      size_t len = strlen(data + pos);
+      luaL_argcheck(L, pos + len < ld, 2,
+                       "unfinished string for format 'z'");
+      lua_pushlstring(L, data + pos, len);
+      return len + 1;  /* skip string plus final '\0' */
+    }
+    default: lua_assert(0); return 0;
+  }
+}
+
+
 static int str_unpack (lua_State *L) {
   Header h;
   const char *fmt = luaL_checkstring(L, 1);
@@ -1766,57 +2018,11 @@ static int str_unpack (lua_State *L) {
     luaL_argcheck(L, (size_t)ntoalign + size <= ld - pos, 2,
                     "data string too short");
     pos += ntoalign;  /* skip alignment */
-    /* stack space for item + next position */
-    luaL_checkstack(L, 2, "too many results");
-    n++;
-    switch (opt) {
-      case Kint:
-      case Kuint: {
-        lua_Integer res = unpackint(L, data + pos, h.islittle, size,
-                                       (opt == Kint));
-        lua_pushinteger(L, res);
-        break;
-      }
-      case Kfloat: {
-        float f;
-        copywithendian((char *)&f, data + pos, sizeof(f), h.islittle);
-        lua_pushnumber(L, (lua_Number)f);
-        break;
-      }
-      case Knumber: {
-        lua_Number f;
-        copywithendian((char *)&f, data + pos, sizeof(f), h.islittle);
-        lua_pushnumber(L, f);
-        break;
-      }
-      case Kdouble: {
-        double f;
-        copywithendian((char *)&f, data + pos, sizeof(f), h.islittle);
-        lua_pushnumber(L, (lua_Number)f);
-        break;
-      }
-      case Kchar: {
-        lua_pushlstring(L, data + pos, size);
-        break;
-      }
-      case Kstring: {
-        size_t len = (size_t)unpackint(L, data + pos, h.islittle, size, 0);
-        luaL_argcheck(L, len <= ld - pos - size, 2, "data string too short");
-        lua_pushlstring(L, data + pos + size, len);
-        pos += len;  /* skip string */
-        break;
-      }
-      case Kzstr: {
-        size_t len = strlen(data + pos);
-        luaL_argcheck(L, pos + len < ld, 2,
-                         "unfinished string for format 'z'");
-        lua_pushlstring(L, data + pos, len);
-        pos += len + 1;  /* skip string plus final '\0' */
-        break;
-      }
-      case Kpaddalign: case Kpadding: case Knop:
-        n--;  /* undo increment */
-        break;
+    if (opt < Kpadding) {  /* not a padding or a no-op? */
+      /* stack space for item + next position */
+      luaL_checkstack(L, 2, "too many results");
+      n++;
+      pos += unpackitem(L, opt, size, h.islittle, data, ld, pos);
     }
     pos += size;
   }
@@ -1826,8 +2032,545 @@ static int str_unpack (lua_State *L) {
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** STRING BUFFERS
+** =======================================================
+*/
+
+#define checkstrbuf(L,i)  \
+	((luaL_StrBuf *)luaL_checkudata(L, i, LUA_STRBUFHANDLE))
+
+
+/*
+** Ensure space for 'sz' more bytes in buffer 'sb'. (Its storage comes
+** directly from the allocator, as in the boxes of 'luaL_Buffer', so
+** that it can be reused after a reset.)
+*/
+static char *strbuf_prep (lua_State *L, luaL_StrBuf *sb, size_t sz) {
+  if (sb->size - sb->n < sz) {  /* not enough space? */
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    size_t newsize = (sb->size / 2) * 3;  /* buffer size * 1.5 */
+    char *nb;
+    if (l_unlikely(MAX_SIZET - sz < sb->n))  /* overflow in (n + sz)? */
+      luaL_error(L, "buffer too large");
+    if (newsize < sb->n + sz)  /* not big enough? */
+      newsize = sb->n + sz;
+    if (newsize < LUAL_BUFFERSIZE)
+      newsize = LUAL_BUFFERSIZE;
+    nb = (char *)allocf(ud, sb->b, sb->size, newsize);
+    if (l_unlikely(nb == NULL)) {  /* allocation error? */
+      lua_pushliteral(L, "not enough memory");
+      lua_error(L);  /* raise a memory error */
+    }
+    sb->b = nb;
+    sb->size = newsize;
+  }
+  return sb->b + sb->n;
+}
+
+
+static void strbuf_add (lua_State *L, luaL_StrBuf *sb, const char *s,
+                        size_t l) {
+  if (l > 0) {  /* avoid 'memcpy' when 's' can be NULL */
+    memcpy(strbuf_prep(L, sb, l), s, l * sizeof(char));
+    sb->n += l;
+  }
+}
+
+
+/*
+** Add the contents of a 'luaL_Buffer' (on the top of the stack) and
+** remove it.
+*/
+static void strbuf_addbuffer (lua_State *L, luaL_StrBuf *sb,
+                              luaL_Buffer *b) {
+  strbuf_add(L, sb, luaL_buffaddr(b), luaL_bufflen(b));
+  lua_pop(L, 1);  /* remove box or placeholder */
+}
+
+
+static luaL_StrBuf *newstrbuf (lua_State *L) {
+  luaL_StrBuf *sb;
+  sb = (luaL_StrBuf *)lua_newuserdatauv(L, sizeof(luaL_StrBuf), 0);
+  sb->b = NULL;
+  sb->size = sb->n = 0;
+  luaL_setmetatable(L, LUA_STRBUFHANDLE);
+  return sb;
+}
+
+
+/*
+** Free the storage of buffer 'sb'.
+*/
+static void strbuf_release (lua_State *L, luaL_StrBuf *sb) {
+  if (sb->b != NULL) {
+    void *ud;
+    lua_Alloc allocf = lua_getallocf(L, &ud);
+    allocf(ud, sb->b, sb->size, 0);
+    sb->b = NULL;
+    sb->size = sb->n = 0;
+  }
+}
+
+
+static int strbuf_new (lua_State *L) {
+  lua_Integer sz = luaL_optinteger(L, 1, 0);
+  luaL_StrBuf *sb;
+  luaL_argcheck(L, 0 <= sz && (lua_Unsigned)sz <= MAXSIZE, 1,
+                   "invalid size");
+  sb = newstrbuf(L);
+  if (sz > 0)
+    strbuf_prep(L, sb, (size_t)sz);
+  return 1;
+}
+
+
+static int strbuf_put (lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L, 1);
+  int n = lua_gettop(L);
+  int i;
+  for (i = 2; i <= n; i++) {
+    size_t l;
+    const char *s = (lua_type(L, i) == LUA_TUSERDATA)
+                  ? luaL_tobuffer(L, i, &l) : NULL;
+    if (s != NULL) {  /* a buffer or a slice? */
+      strbuf_prep(L, sb, l);
+      s = luaL_tobuffer(L, i, &l);  /* it may be 'sb' itself */
+      strbuf_add(L, sb, s, l);
+    }
+    else {
+      s = luaL_checklstring(L, i, &l);
+      strbuf_add(L, sb, s, l);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_putf (lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L, 1);
+  int top = lua_gettop(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 2, top);
+  strbuf_addbuffer(L, sb, &b);
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_pack (lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L, 1);
+  luaL_Buffer b;
+  luaL_checkstring(L, 2);  /* format string */
+  lua_pushnil(L);  /* mark to separate arguments from string buffer */
+  luaL_buffinit(L, &b);
+  addpack(L, &b, 2);
+  strbuf_addbuffer(L, sb, &b);
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_reserve (lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L, 1);
+  lua_Integer sz = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, 0 <= sz && (lua_Unsigned)sz <= MAXSIZE, 2,
+                   "invalid size");
+  strbuf_prep(L, sb, (size_t)sz);
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_reset (lua_State *L) {
+  luaL_StrBuf *sb = checkstrbuf(L, 1);
+  sb->n = 0;  /* keep its storage */
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+/*
+** Free the storage of a buffer ('__gc' and '__close').
+*/
+static int strbuf_free (lua_State *L) {
+  strbuf_release(L, checkstrbuf(L, 1));
+  return 0;
+}
+
+
+/*
+** Get range [i, j] (as in 'string.sub') of the buffer or slice at
+** index 1, from arguments 2 and 3: return its offset, its length in
+** '*len', and the contents of the buffer or slice in '*s'.
+*/
+static size_t getrange (lua_State *L, const char **s, size_t *len) {
+  size_t l, start, end;
+  *s = luaL_tobuffer(L, 1, &l);
+  if (*s == NULL)
+    luaL_typeerror(L, 1, LUA_STRBUFHANDLE);
+  start = posrelatI(luaL_optinteger(L, 2, 1), l);
+  end = getendpos(L, 3, -1, l);
+  *len = (start <= end) ? (end - start) + 1 : 0;
+  return start - 1;
+}
+
+
+static int strbuf_tostring (lua_State *L) {
+  const char *s;
+  size_t l;
+  size_t off = getrange(L, &s, &l);
+  lua_pushlstring(L, s + off, l);
+  return 1;
+}
+
+
+static int strbuf_len (lua_State *L) {
+  size_t l;
+  if (luaL_tobuffer(L, 1, &l) == NULL)
+    luaL_typeerror(L, 1, LUA_STRBUFHANDLE);
+  lua_pushinteger(L, (lua_Integer)l);
+  return 1;
+}
+
+
+static int strbuf_slice (lua_State *L) {
+  const char *s;
+  size_t l, off;
+  luaL_StrSlice *sl;
+  checkstrbuf(L, 1);
+  off = getrange(L, &s, &l);
+  sl = (luaL_StrSlice *)lua_newuserdatauv(L, sizeof(luaL_StrSlice), 1);
+  sl->off = off;
+  sl->len = l;
+  luaL_setmetatable(L, LUA_STRSLICEHANDLE);
+  lua_pushvalue(L, 1);
+  lua_setiuservalue(L, -2, 1);  /* slice keeps its buffer */
+  return 1;
+}
+
+
+static const luaL_Reg strbuf_meth[] = {
+  {"put", strbuf_put},
+  {"putf", strbuf_putf},
+  {"pack", strbuf_pack},
+  {"reserve", strbuf_reserve},
+  {"reset", strbuf_reset},
+  {"slice", strbuf_slice},
+  {"tostring", strbuf_tostring},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg strbuf_metameth[] = {
+  {"__index", NULL},  /* place holder */
+  {"__len", strbuf_len},
+  {"__tostring", strbuf_tostring},
+  {"__gc", strbuf_free},
+  {"__close", strbuf_free},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg strslice_metameth[] = {
+  {"__len", strbuf_len},
+  {"__tostring", strbuf_tostring},
+  {NULL, NULL}
+};
+
+
+static void createbufmeta (lua_State *L) {
+  luaL_newmetatable(L, LUA_STRBUFHANDLE);
+  luaL_setfuncs(L, strbuf_metameth, 0);
+  luaL_newlibtable(L, strbuf_meth);
+  luaL_setfuncs(L, strbuf_meth, 0);
+  lua_setfield(L, -2, "__index");  /* metatable.__index = methods */
+  lua_pop(L, 1);  /* pop metatable */
+  luaL_newmetatable(L, LUA_STRSLICEHANDLE);
+  luaL_setfuncs(L, strslice_metameth, 0);
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** COMPILED FORMATS
+** A compiled format ('string.struct') keeps the options of a format
+** already read and checked, so that packing and unpacking do not read
+** the format again. Alignments depend on positions, so they are kept
+** as requirements and applied while packing or unpacking.
+** =======================================================
+*/
+
+#define STRUCTHANDLE	"string.struct"
+
+#define checkstruct(L,i)	((Struct *)luaL_checkudata(L, i, STRUCTHANDLE))
+
+
+typedef struct StructItem {
+  unsigned char opt;  /* KOption */
+  unsigned char islittle;
+  int size;
+  int align;  /* alignment requirement (1 for none) */
+} StructItem;
+
+
+typedef struct Struct {
+  int nitems;
+  int nvalues;  /* number of values in a record */
+  size_t minsize;  /* size of a record without padding for alignment */
+  lua_Integer packsize;  /* as given by 'string.packsize', or -1 */
+  StructItem items[1];
+} Struct;
+
+
+static int str_struct (lua_State *L) {
+  size_t lfmt;
+  const char *fmt = luaL_checklstring(L, 1, &lfmt);
+  Header h;
+  Struct *st;
+  size_t totalsize = 0;
+  int n = 0;
+  /* each option uses at least one character of the format */
+  luaL_argcheck(L, lfmt < (MAXSIZE - sizeof(Struct)) / sizeof(StructItem),
+                   1, "format too long");
+  st = (Struct *)lua_newuserdatauv(L, sizeof(Struct) +
+                                      lfmt * sizeof(StructItem), 0);
+  st->nvalues = 0;
+  st->minsize = 0;
+  st->packsize = 0;
+  initheader(L, &h);
+  while (*fmt != '\0') {
+    int size;
+    KOption opt = getoption(&h, &fmt, &size);
+    int align = getalign(&h, &fmt, opt, size);
+    if (opt == Knop)
+      continue;
+    st->items[n].opt = (unsigned char)opt;
+    st->items[n].islittle = (unsigned char)h.islittle;
+    st->items[n].size = size;
+    st->items[n].align = align;
+    n++;
+    if (opt < Kpadding)  /* a value? */
+      st->nvalues++;
+    st->minsize += (opt == Kzstr) ? 1 : (size_t)size;
+    if (opt == Kstring || opt == Kzstr)
+      st->packsize = -1;
+    else if (st->packsize >= 0) {
+      size += padding(totalsize, align);
+      luaL_argcheck(L, totalsize <= MAXSIZE - size, 1,
+                       "format result too large");
+      totalsize += size;
+      st->packsize = (lua_Integer)totalsize;
+    }
+  }
+  st->nitems = n;
+  luaL_setmetatable(L, STRUCTHANDLE);
+  return 1;
+}
+
+
+/*
+** Pack one record of 'st' into buffer 'b', which is on the top of the
+** stack, with the values after index 'base'. 'recno' is the number of
+** the record, for error messages, or 0 if the values are arguments.
+*/
+static void packrecord (lua_State *L, luaL_Buffer *b, Struct *st,
+                        int base, lua_Integer recno, size_t *totalsize) {
+  int arg = base;
+  int i;
+  for (i = 0; i < st->nitems; i++) {
+    StructItem *it = &st->items[i];
+    int ntoalign = padding(*totalsize, it->align);
+    *totalsize += ntoalign + it->size;
+    while (ntoalign-- > 0)
+     luaL_addchar(b, LUAL_PACKPADBYTE);  /* fill alignment */
+    if (it->opt == Kpadding)
+      luaL_addchar(b, LUAL_PACKPADBYTE);
+    else if (it->opt != Kpaddalign) {
+      const char *msg = packitem(L, b, (KOption)it->opt, it->size,
+                                    it->islittle, ++arg, totalsize);
+      if (l_likely(msg == NULL))
+        continue;
+      else if (recno == 0)
+        luaL_argerror(L, arg, msg);
+      else
+        luaL_error(L, "bad field #%d in record #%I (%s)", arg - base,
+                      (LUAI_UACINT)recno, msg);
+    }
+  }
+}
+
+
+/*
+** Unpack one record of 'st' from position '*pos' of 'data' (argument
+** 2), pushing its values (or setting them in the table on the top,
+** if 'intable').
+*/
+static void unpackrecord (lua_State *L, Struct *st, const char *data,
+                          size_t ld, size_t *pos, int intable) {
+  int field = 0;
+  int i;
+  for (i = 0; i < st->nitems; i++) {
+    StructItem *it = &st->items[i];
+    int ntoalign = padding(*pos, it->align);
+    luaL_argcheck(L, (size_t)ntoalign + it->size <= ld - *pos, 2,
+                     "data string too short");
+    *pos += ntoalign;  /* skip alignment */
+    if (it->opt < Kpadding) {  /* not a padding? */
+      *pos += unpackitem(L, (KOption)it->opt, it->size, it->islittle,
+                            data, ld, *pos);
+      if (intable)
+        lua_rawseti(L, -2, ++field);
+    }
+    *pos += it->size;
+  }
+}
+
+
+static int struct_pack (lua_State *L) {
+  Struct *st = checkstruct(L, 1);
+  luaL_Buffer b;
+  size_t totalsize = 0;
+  lua_pushnil(L);  /* mark to separate arguments from string buffer */
+  luaL_buffinit(L, &b);
+  packrecord(L, &b, st, 1, 0, &totalsize);
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+static int struct_unpack (lua_State *L) {
+  Struct *st = checkstruct(L, 1);
+  size_t ld;
+  const char *data = luaL_checklstring(L, 2, &ld);
+  size_t pos = posrelatI(luaL_optinteger(L, 3, 1), ld) - 1;
+  luaL_argcheck(L, pos <= ld, 3, "initial position out of string");
+  /* stack space for all items + next position */
+  luaL_checkstack(L, st->nvalues + 1, "too many results");
+  unpackrecord(L, st, data, ld, &pos, 0);
+  lua_pushinteger(L, pos + 1);  /* next position */
+  return st->nvalues + 1;
+}
+
+
+/*
+** Pack records 'list[i]' through 'list[j]', each one a table with
+** the values of the record. Each record is packed above its values
+** and then added to a string buffer with the result.
+*/
+static int struct_encode (lua_State *L) {
+  Struct *st = checkstruct(L, 1);
+  lua_Integer i, j;
+  luaL_StrBuf *sb;
+  size_t totalsize = 0;
+  luaL_checktype(L, 2, LUA_TTABLE);
+  i = luaL_optinteger(L, 3, 1);
+  j = luaL_opt(L, luaL_checkinteger, 4, (lua_Integer)lua_rawlen(L, 2));
+  lua_settop(L, 4);
+  /* space for the string buffer, a record, its values, and a buffer */
+  luaL_checkstack(L, st->nvalues + 3, "record too large");
+  sb = newstrbuf(L);
+  for (; i <= j; i++) {
+    luaL_Buffer b;
+    int k;
+    if (l_unlikely(lua_rawgeti(L, 2, i) != LUA_TTABLE))
+      luaL_error(L, "bad record #%I (table expected, got %s)",
+                    (LUAI_UACINT)i, luaL_typename(L, -1));
+    for (k = 1; k <= st->nvalues; k++)
+      lua_rawgeti(L, 6, k);
+    luaL_buffinit(L, &b);
+    packrecord(L, &b, st, 6, i, &totalsize);
+    strbuf_addbuffer(L, sb, &b);
+    lua_settop(L, 5);  /* remove record and its values */
+    if (i == j) break;  /* avoid overflow in 'i++' */
+  }
+  lua_pushlstring(L, sb->b, sb->n);
+  strbuf_release(L, sb);
+  return 1;
+}
+
+
+/*
+** Unpack 'n' records (default is all records up to the end of the
+** data), returning a list of tables with their values and the next
+** position.
+*/
+static int struct_decode (lua_State *L) {
+  Struct *st = checkstruct(L, 1);
+  size_t ld;
+  const char *data = luaL_checklstring(L, 2, &ld);
+  size_t pos = posrelatI(luaL_optinteger(L, 3, 1), ld) - 1;
+  lua_Integer n = luaL_optinteger(L, 4, -1);
+  lua_Integer k;
+  luaL_argcheck(L, pos <= ld, 3, "initial position out of string");
+  if (n < 0) {  /* read up to the end? */
+    luaL_argcheck(L, st->minsize > 0, 4,
+                     "count needed for a format without data");
+    n = (lua_Integer)((ld - pos) / st->minsize);  /* maximum count */
+    if (st->packsize < 0)  /* variable size? */
+      lua_createtable(L, 0, 0);
+    else
+      lua_createtable(L, (n < INT_MAX) ? (int)n : INT_MAX, 0);
+    for (k = 1; pos < ld; k++) {
+      lua_createtable(L, st->nvalues, 0);
+      unpackrecord(L, st, data, ld, &pos, 1);
+      lua_rawseti(L, -2, k);
+    }
+  }
+  else {
+    luaL_argcheck(L, st->minsize == 0 ||
+                     (lua_Unsigned)n <= (ld - pos) / st->minsize, 2,
+                     "data string too short");
+    lua_createtable(L, (n < INT_MAX) ? (int)n : INT_MAX, 0);
+    for (k = 1; k <= n; k++) {
+      lua_createtable(L, st->nvalues, 0);
+      unpackrecord(L, st, data, ld, &pos, 1);
+      lua_rawseti(L, -2, k);
+    }
+  }
+  lua_pushinteger(L, pos + 1);  /* next position */
+  return 2;
+}
+
+
+static int struct_packsize (lua_State *L) {
+  Struct *st = checkstruct(L, 1);
+  luaL_argcheck(L, st->packsize >= 0, 1, "variable-length format");
+  lua_pushinteger(L, st->packsize);
+  return 1;
+}
+
+
+static const luaL_Reg struct_meth[] = {
+  {"pack", struct_pack},
+  {"unpack", struct_unpack},
+  {"packsize", struct_packsize},
+  {"encode", struct_encode},
+  {"decode", struct_decode},
+  {NULL, NULL}
+};
+
+
+static void createstructmeta (lua_State *L) {
+  luaL_newmetatable(L, STRUCTHANDLE);
+  luaL_newlibtable(L, struct_meth);
+  luaL_setfuncs(L, struct_meth, 0);
+  lua_setfield(L, -2, "__index");  /* metatable.__index = methods */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
 
 static const luaL_Reg strlib[] = {
+  {"buffer", strbuf_new},
   {"byte", str_byte},
   {"char", str_char},
   {"dump", str_dump},
@@ -1845,6 +2588,7 @@ static const luaL_Reg strlib[] = {
   {"pack", str_pack},
   {"packsize", str_packsize},
   {"unpack", str_unpack},
+  {"struct", str_struct},
   {NULL, NULL}
 };
 
@@ -1869,6 +2613,8 @@ static void createmetatable (lua_State *L) {
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
   createmetatable(L);
+  createbufmeta(L);
+  createstructmeta(L);
   return 1;
 }
 
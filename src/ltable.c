@@ -21,6 +21,13 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** With LUAI_HASHPROBE, the hash part uses open addressing instead: a
+** key goes to the first free node at or after its main position
+** (linear probing, wrapping around), and a search stops at the first
+** node that was never used. Removed entries keep their keys (as in the
+** chained layout, for 'next'), so they do not stop searches; a new key
+** may reuse them. 'lastfree' then counts the never-used nodes that can
+** still take keys before a rehash, keeping the load under 7/8.
 */
 
 #include <math.h>
@@ -88,6 +95,21 @@
 #define hashpointer(t,p)	hashmod(t, point2uint(p))
 
 
+/*
+** Next node to search for a key after node 'n', or NULL if the key
+** cannot be further on.
+*/
+#if LUAI_HASHPROBE
+#define nextprobe(t,n)	gnode(t, lmod(cast_int((n) - gnode(t, 0)) + 1, \
+                                      sizenode(t)))
+#define nextnode(t,n)	(!keyisnil(n) ? nextprobe(t, n) : NULL)
+#define freenodes(size)	hashmaxfill(size)
+#else
+#define nextnode(t,n)	(gnext(n) != 0 ? (n) + gnext(n) : NULL)
+#define freenodes(size)	(size)
+#endif
+
+
 #define dummynode		(&dummynode_)
 
 static const Node dummynode_ = {
@@ -301,12 +323,8 @@ static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (equalkey(key, n, deadok))
       return gval(n);  /* that's it */
-    else {
-      int nx = gnext(n);
-      if (nx == 0)
-        return &absentkey;  /* not found */
-      n += nx;
-    }
+    else if ((n = nextnode(t, n)) == NULL)
+      return &absentkey;  /* not found */
   }
 }
 
@@ -346,14 +364,20 @@ static unsigned int findindex (lua_State *L, Table *t, TValue *key,
 }
 
 
-int luaH_next (lua_State *L, Table *t, StkId key) {
+/*
+** Puts in 'key' and 'key + 1' the first entry of 't' at or after the
+** traversal index 'i' (array entries come first, then the nodes).
+** Returns the traversal index after that entry, or 0 if there are no
+** more entries.
+*/
+unsigned int luaH_nextfrom (lua_State *L, Table *t, unsigned int i,
+                            StkId key) {
   unsigned int asize = luaH_realasize(t);
-  unsigned int i = findindex(L, t, s2v(key), asize);  /* find original key */
   for (; i < asize; i++) {  /* try first array part */
     if (!isempty(&t->array[i])) {  /* a non-empty entry? */
       setivalue(s2v(key), i + 1);
       setobj2s(L, key + 1, &t->array[i]);
-      return 1;
+      return i + 1;
     }
   }
   for (i -= asize; cast_int(i) < sizenode(t); i++) {  /* hash part */
@@ -361,13 +385,38 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       Node *n = gnode(t, i);
       getnodekey(L, s2v(key), n);
       setobj2s(L, key + 1, gval(n));
-      return 1;
+      return (i + 1) + asize;
     }
   }
   return 0;  /* no more elements */
 }
 
 
+int luaH_next (lua_State *L, Table *t, StkId key) {
+  unsigned int i = findindex(L, t, s2v(key), luaH_realasize(t));
+  return (luaH_nextfrom(L, t, i, key) != 0);
+}
+
+
+/*
+** True if the traversal index 'i' comes right after the entry with
+** key 'key' (or is 0 and 'key' is nil), that is, if 'i' is the index
+** that 'findindex' would compute for 'key'. The key may be dead, as
+** the traversal may have cleared its entry.
+*/
+int luaH_iscursor (Table *t, lua_Unsigned i, const TValue *key) {
+  unsigned int asize = luaH_realasize(t);
+  if (i == 0)
+    return ttisnil(key);
+  else if (i <= asize)
+    return (ttisinteger(key) && l_castS2U(ivalue(key)) == i);
+  else if (i - asize <= cast_uint(sizenode(t)))
+    return (!ttisnil(key) && equalkey(key, gnode(t, i - asize - 1), 1));
+  else
+    return 0;
+}
+
+
 static void freehash (lua_State *L, Table *t) {
   if (!isdummy(t))
     luaM_freearray(L, t->node, cast_sizet(sizenode(t)));
@@ -380,6 +429,9 @@ static void freehash (lua_State *L, Table *t) {
 ** ==============================================================
 */
 
+static void newhashkey (lua_State *L, Table *t, const TValue *key,
+                                                TValue *value);
+
 /*
 ** Compute the optimal size for the array part of table 't'. 'nums' is a
 ** "count array" where 'nums[i]' is the number of integers in the table
@@ -486,6 +538,10 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   else {
     int i;
     int lsize = luaO_ceillog2(size);
+#if LUAI_HASHPROBE
+    while (cast_uint(hashmaxfill(twoto(lsize))) < size)  /* too full for probing? */
+      lsize++;
+#endif
     if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
@@ -497,13 +553,17 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
       setempty(gval(n));
     }
     t->lsizenode = cast_byte(lsize);
-    t->lastfree = gnode(t, size);  /* all positions are free */
+    t->lastfree = gnode(t, freenodes(size));  /* all positions are free */
   }
 }
 
 
 /*
 ** (Re)insert all elements from the hash part of 'ot' into table 't'.
+** The keys are new to 't', so they are stored directly: 'luaH_set'
+** could reach 'appendarray', whose allocation could run an emergency
+** collection while the entries not yet reinserted are only in 'ot',
+** where the collector cannot see them.
 */
 static void reinsert (lua_State *L, Table *ot, Table *t) {
   int j;
@@ -513,9 +573,15 @@ static void reinsert (lua_State *L, Table *ot, Table *t) {
     if (!isempty(gval(old))) {
       /* doesn't need barrier/invalidate cache, as entry was
          already present in the table */
-      TValue k;
-      getnodekey(L, &k, old);
-      luaH_set(L, t, &k, gval(old));
+      if (keyisinteger(old) &&
+          l_castS2U(keyival(old)) - 1u < luaH_realasize(t)) {
+        setobj2t(L, &t->array[keyival(old) - 1], gval(old));
+      }
+      else {
+        TValue k;
+        getnodekey(L, &k, old);
+        newhashkey(L, t, &k, gval(old));
+      }
     }
   }
 }
@@ -561,10 +627,14 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
   if (newasize < oldasize) {  /* will array shrink? */
     t->alimit = newasize;  /* pretend array has new size... */
     exchangehashpart(t, &newt);  /* and new hash */
-    /* re-insert into the new hash the elements from vanishing slice */
+    /* re-insert into the new hash the elements from vanishing slice
+       (directly, as 'appendarray' would reallocate this array) */
     for (i = newasize; i < oldasize; i++) {
-      if (!isempty(&t->array[i]))
-        luaH_setint(L, t, i + 1, &t->array[i]);
+      if (!isempty(&t->array[i])) {
+        TValue k;
+        setivalue(&k, i + 1);
+        newhashkey(L, t, &k, &t->array[i]);
+      }
     }
     t->alimit = oldasize;  /* restore current size... */
     exchangehashpart(t, &newt);  /* and hash (in case of errors) */
@@ -588,7 +658,7 @@ void luaH_resize (lua_State *L, Table *t, unsigned int newasize,
 
 
 void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize) {
-  int nsize = allocsizenode(t);
+  int nsize = luaH_hashcapacity(t);
   luaH_resize(L, t, nasize, nsize);
 }
 
@@ -635,6 +705,29 @@ Table *luaH_new (lua_State *L) {
 }
 
 
+/*
+** Remove all entries from table 't', keeping its array part and its
+** node vector with their current sizes.
+*/
+void luaH_clear (Table *t) {
+  unsigned int i;
+  unsigned int asize = luaH_realasize(t);
+  for (i = 0; i < asize; i++)
+    setempty(&t->array[i]);
+  if (!isdummy(t)) {
+    int j;
+    int size = sizenode(t);
+    for (j = 0; j < size; j++) {
+      Node *n = gnode(t, j);
+      gnext(n) = 0;
+      setnilkey(n);
+      setempty(gval(n));
+    }
+    t->lastfree = gnode(t, freenodes(size));  /* all positions are free again */
+  }
+}
+
+
 void luaH_free (lua_State *L, Table *t) {
   freehash(L, t);
   luaM_freearray(L, t->array, luaH_realasize(t));
@@ -642,6 +735,7 @@ void luaH_free (lua_State *L, Table *t) {
 }
 
 
+#if !LUAI_HASHPROBE
 static Node *getfreepos (Table *t) {
   if (!isdummy(t)) {
     while (t->lastfree > t->node) {
@@ -652,8 +746,66 @@ static Node *getfreepos (Table *t) {
   }
   return NULL;  /* could not find a free place */
 }
+#endif
+
+
+
+/*
+** Search an integer key in the hash part of a table.
+*/
+static const TValue *getintfromhash (Table *t, lua_Integer key) {
+  Node *n = hashint(t, key);
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    if (keyisinteger(n) && keyival(n) == key)
+      return gval(n);  /* that's it */
+    else if ((n = nextnode(t, n)) == NULL)
+      return &absentkey;  /* not found */
+  }
+}
 
 
+/*
+** Try to insert a key that is just after the end of a (presumably)
+** full array part by growing that part to the next power of 2. Without
+** this, a table with free positions in its hash part would put the
+** next elements of its sequence there, where finding the border needs
+** a search ('hash_search'); with it, appends stay in the array part,
+** where the border is tracked by 'alimit'. Entries of the hash part
+** that fall into the array slice are moved into it, leaving their
+** nodes empty, as if removed. (A table without a hash part gets its
+** array grown by the normal rehash.) Return true if the key was
+** inserted.
+*/
+static int appendarray (lua_State *L, Table *t, lua_Integer key,
+                                               TValue *value) {
+  unsigned int asize = luaH_realasize(t);
+  unsigned int nsize, i;
+  TValue *newarray;
+  if (l_castS2U(key) != asize + 1u || isdummy(t) ||
+      (asize > 0 && isempty(&t->array[asize - 1])))
+    return 0;  /* not an append to a full array */
+  nsize = twoto(luaO_ceillog2(asize + 1));
+  if (nsize > MAXASIZE)
+    return 0;
+  newarray = luaM_reallocvector(L, t->array, asize, nsize, TValue);
+  if (l_unlikely(newarray == NULL))
+    return 0;  /* let the normal insertion handle it */
+  t->array = newarray;
+  for (i = asize; i < nsize; i++) {  /* fill new slice of the array */
+    TValue *slot = cast(TValue *, getintfromhash(t, i + 1));
+    if (isempty(slot))
+      setempty(&t->array[i]);
+    else {  /* move entry from the hash part */
+      setobj2t(L, &t->array[i], slot);
+      setempty(slot);
+    }
+  }
+  t->alimit = nsize;
+  setrealasize(t);
+  setobj2t(L, &t->array[key - 1], value);
+  return 1;
+}
+
 
 /*
 ** inserts a new key into a hash table; first, check whether key's main
@@ -663,7 +815,6 @@ static Node *getfreepos (Table *t) {
 ** position), new key goes to an empty position.
 */
 void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
-  Node *mp;
   TValue aux;
   if (l_unlikely(ttisnil(key)))
     luaG_runerror(L, "table index is nil");
@@ -679,7 +830,32 @@ void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
   }
   if (ttisnil(value))
     return;  /* do not insert nil values */
-  mp = mainpositionTV(t, key);
+  if (ttisinteger(key) && appendarray(L, t, ivalue(key), value))
+    return;  /* key went into the array part */
+  newhashkey(L, t, key, value);
+}
+
+
+/*
+** Inserts a new key, not nil and normalized, into the hash part of
+** table 't' (or into a grown table, if the hash part is full).
+*/
+static void newhashkey (lua_State *L, Table *t, const TValue *key,
+                                                TValue *value) {
+  Node *mp = mainpositionTV(t, key);
+#if LUAI_HASHPROBE
+  while (!isempty(gval(mp)))  /* find first free node from main position */
+    mp = nextprobe(t, mp);
+  if (keyisnil(mp)) {  /* never used node? */
+    if (t->lastfree == t->node || isdummy(t)) {  /* table is full? */
+      rehash(L, t, key);  /* grow table */
+      /* whatever called 'newkey' takes care of TM cache */
+      luaH_set(L, t, key, value);  /* insert key into grown table */
+      return;
+    }
+    t->lastfree--;  /* one less never-used node to take keys */
+  }
+#else
   if (!isempty(gval(mp)) || isdummy(t)) {  /* main position is taken? */
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
@@ -712,6 +888,7 @@ void luaH_newkey (lua_State *L, Table *t, const TValue *key, TValue *value) {
       mp = f;
     }
   }
+#endif
   setnodekey(L, mp, key);
   luaC_barrierback(L, obj2gco(t), key);
   lua_assert(isempty(gval(mp)));
@@ -736,19 +913,8 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
     t->alimit = cast_uint(key);  /* probably '#t' is here now */
     return &t->array[key - 1];
   }
-  else {
-    Node *n = hashint(t, key);
-    for (;;) {  /* check whether 'key' is somewhere in the chain */
-      if (keyisinteger(n) && keyival(n) == key)
-        return gval(n);  /* that's it */
-      else {
-        int nx = gnext(n);
-        if (nx == 0) break;
-        n += nx;
-      }
-    }
-    return &absentkey;
-  }
+  else
+    return getintfromhash(t, key);
 }
 
 
@@ -761,12 +927,27 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (keyisshrstr(n) && eqshrstr(keystrval(n), key))
       return gval(n);  /* that's it */
-    else {
-      int nx = gnext(n);
-      if (nx == 0)
-        return &absentkey;  /* not found */
-      n += nx;
+    else if ((n = nextnode(t, n)) == NULL)
+      return &absentkey;  /* not found */
+  }
+}
+
+
+/*
+** Same as 'luaH_getshortstr', but also stores in 'hint' the index of
+** the node where the key was found. (Misses leave the hint unchanged.)
+*/
+const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                      unsigned int *hint) {
+  Node *n = hashstr(t, key);
+  lua_assert(key->tt == LUA_VSHRSTR);
+  for (;;) {  /* check whether 'key' is somewhere in the chain */
+    if (keyisshrstr(n) && eqshrstr(keystrval(n), key)) {
+      *hint = cast_uint(n - gnode(t, 0));
+      return gval(n);  /* that's it */
     }
+    else if ((n = nextnode(t, n)) == NULL)
+      return &absentkey;  /* not found */
   }
 }
 
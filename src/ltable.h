@@ -31,14 +31,41 @@
 #define allocsizenode(t)	(isdummy(t) ? 0 : sizenode(t))
 
 
+/*
+** Number of keys that the hash part of 't' can hold. With open
+** addressing, a node vector of size 'n' takes at most 'hashmaxfill(n)'
+** keys, so that there is always a never-used node ending a search.
+*/
+#if LUAI_HASHPROBE
+#define hashmaxfill(n)		((n) - 1 - ((n) >> 3))
+#define luaH_hashcapacity(t)	(isdummy(t) ? 0 : hashmaxfill(sizenode(t)))
+#else
+#define luaH_hashcapacity(t)	allocsizenode(t)
+#endif
+
+
 /* returns the Node, given the value of a table entry */
 #define nodefromval(v)	cast(Node *, (v))
 
 
+/*
+** Short-string lookup with a slot hint: if node 'h' of table 't' holds
+** key 'k', that is the result; otherwise, do a regular search, which
+** updates the hint. (The hint is only an optimization: a stale one
+** just fails the test.)
+*/
+#define luaH_getshortstrhint(t,k,h)  \
+  ((*(h) < cast_uint(sizenode(t)) && keyisshrstr(gnode(t, *(h))) &&  \
+    keystrval(gnode(t, *(h))) == (k))  \
+    ? gval(gnode(t, *(h))) : luaH_getshortstrcached(t, k, h))
+
+
 LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
 LUAI_FUNC const TValue *luaH_getshortstr (Table *t, TString *key);
+LUAI_FUNC const TValue *luaH_getshortstrcached (Table *t, TString *key,
+                                                unsigned int *hint);
 LUAI_FUNC const TValue *luaH_getstr (Table *t, TString *key);
 LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
 LUAI_FUNC void luaH_newkey (lua_State *L, Table *t, const TValue *key,
@@ -51,8 +78,12 @@ LUAI_FUNC Table *luaH_new (lua_State *L);
 LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
                                                     unsigned int nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize);
+LUAI_FUNC void luaH_clear (Table *t);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
+LUAI_FUNC unsigned int luaH_nextfrom (lua_State *L, Table *t,
+                                      unsigned int i, StkId key);
+LUAI_FUNC int luaH_iscursor (Table *t, lua_Unsigned i, const TValue *key);
 LUAI_FUNC lua_Unsigned luaH_getn (Table *t);
 LUAI_FUNC unsigned int luaH_realasize (const Table *t);
 
@@ -147,8 +147,8 @@ static int tmove (lua_State *L) {
 static void addfield (lua_State *L, luaL_Buffer *b, lua_Integer i) {
   lua_geti(L, 1, i);
   if (l_unlikely(!lua_isstring(L, -1)))
-    luaL_error(L, "invalid value (%s) at index %I in table for 'concat'",
-                  luaL_typename(L, -1), (LUAI_UACINT)i);
+    luaL_error(L, "invalid value (at index %I) in table for 'concat'",
+                  (LUAI_UACINT)i);
   luaL_addvalue(b);
 }
 
@@ -160,6 +160,8 @@ static int tconcat (lua_State *L) {
   const char *sep = luaL_optlstring(L, 2, "", &lsep);
   lua_Integer i = luaL_optinteger(L, 3, 1);
   last = luaL_optinteger(L, 4, last);
+  if (lua_rawconcat(L, 1, i, last, sep, lsep))  /* plain array of strings? */
+    return 1;
   luaL_buffinit(L, &b);
   for (; i < last; i++) {
     addfield(L, &b, i);
@@ -172,6 +174,31 @@ static int tconcat (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Create/clear
+** =======================================================
+*/
+
+static int tcreate (lua_State *L) {
+  lua_Integer narr = luaL_checkinteger(L, 1);
+  lua_Integer nrec = luaL_optinteger(L, 2, 0);
+  luaL_argcheck(L, 0 <= narr && narr <= INT_MAX, 1, "out of range");
+  luaL_argcheck(L, 0 <= nrec && nrec <= INT_MAX, 2, "out of range");
+  lua_createtable(L, (int)narr, (int)nrec);
+  return 1;
+}
+
+
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);
+  return 0;
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Pack/unpack
@@ -396,14 +423,215 @@ static void auxsort (lua_State *L, IdxT lo, IdxT up,
 }
 
 
+/*
+** Sorting of plain arrays of numbers. When there is no order function
+** and the list is a table without a metatable whose elements are all
+** integers or all floats (none of them NaN), the elements are copied
+** to a C array, sorted there with the same quicksort used by 'auxsort'
+** (including its pivot randomization), and copied back.
+*/
+
+typedef union SortNum {
+  lua_Integer i;
+  lua_Number f;
+} SortNum;
+
+
+#define numlt(isint,a,b)	((isint) ? (a).i < (b).i : (a).f < (b).f)
+
+#define numswap(a,x,y)	{ SortNum t_ = a[x]; a[x] = a[y]; a[y] = t_; }
+
+
+static void numsort (SortNum *a, IdxT lo, IdxT up, int isint,
+                                  unsigned int rnd) {
+  while (lo < up) {  /* loop for tail recursion */
+    IdxT p;  /* Pivot index */
+    IdxT n;  /* to be used later */
+    IdxT i, j;
+    SortNum P;
+    if (numlt(isint, a[up], a[lo]))
+      numswap(a, lo, up);
+    if (up - lo == 1)  /* only 2 elements? */
+      return;  /* already sorted */
+    if (up - lo < RANLIMIT || rnd == 0)  /* small interval or no randomize? */
+      p = (lo + up)/2;  /* middle element is a good pivot */
+    else  /* for larger intervals, it is worth a random pivot */
+      p = choosePivot(lo, up, rnd);
+    if (numlt(isint, a[p], a[lo]))
+      numswap(a, p, lo)
+    else if (numlt(isint, a[up], a[p]))
+      numswap(a, p, up);
+    if (up - lo == 2)  /* only 3 elements? */
+      return;  /* already sorted */
+    P = a[p];
+    numswap(a, p, up - 1);
+    /* partition; a[lo] <= P == a[up - 1] stop both loops */
+    i = lo; j = up - 1;
+    for (;;) {
+      while (numlt(isint, a[++i], P)) ;
+      while (numlt(isint, P, a[--j])) ;
+      if (j < i) break;
+      numswap(a, i, j);
+    }
+    numswap(a, up - 1, i);
+    p = i;
+    /* a[lo .. p - 1] <= a[p] == P <= a[p + 1 .. up] */
+    if (p - lo < up - p) {  /* lower interval is smaller? */
+      numsort(a, lo, p - 1, isint, rnd);
+      n = p - lo;  /* size of smaller interval */
+      lo = p + 1;  /* tail call for [p + 1 .. up] (upper interval) */
+    }
+    else {
+      numsort(a, p + 1, up, isint, rnd);
+      n = up - p;  /* size of smaller interval */
+      up = p - 1;  /* tail call for [lo .. p - 1]  (lower interval) */
+    }
+    if ((up - lo) / 128 > n) /* partition too imbalanced? */
+      rnd = l_randomizePivot();  /* try a new randomization */
+  }  /* tail call numsort(a, lo, up, isint, rnd) */
+}
+
+
+/*
+** Try to sort list 1[1..n] as a plain array of numbers. Return false
+** (with the list untouched) if it is not one. Equal integers cannot be
+** told apart, so this also works for stable sorts of integers; equal
+** floats can (0.0 and -0.0), so stable sorts of floats are excluded.
+*/
+static int sortnumbers (lua_State *L, IdxT n, int stable) {
+  SortNum *a;
+  IdxT i;
+  int isint;
+  if (lua_getmetatable(L, 1)) {  /* list has a metatable? */
+    lua_pop(L, 1);
+    return 0;
+  }
+  if (lua_rawgeti(L, 1, 1) != LUA_TNUMBER) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  isint = lua_isinteger(L, -1);
+  lua_pop(L, 1);
+  if (stable && !isint)
+    return 0;
+  /* array cannot overflow: 'n' list elements already fit in memory */
+  a = (SortNum *)lua_newuserdatauv(L, n * sizeof(SortNum), 0);
+  for (i = 0; i < n; i++) {
+    if (lua_rawgeti(L, 1, i + 1) != LUA_TNUMBER ||
+        lua_isinteger(L, -1) != isint) {
+      lua_pop(L, 2);  /* remove element and array */
+      return 0;  /* not a homogeneous array of numbers */
+    }
+    if (isint)
+      a[i].i = lua_tointeger(L, -1);
+    else {
+      a[i].f = lua_tonumber(L, -1);
+      if (a[i].f != a[i].f) {  /* NaN? */
+        lua_pop(L, 2);  /* remove element and array */
+        return 0;
+      }
+    }
+    lua_pop(L, 1);
+  }
+  numsort(a, 0, n - 1, isint, 0);
+  for (i = 0; i < n; i++) {
+    if (isint)
+      lua_pushinteger(L, a[i].i);
+    else
+      lua_pushnumber(L, a[i].f);
+    lua_rawseti(L, 1, i + 1);
+  }
+  lua_pop(L, 1);  /* remove array */
+  return 1;
+}
+
+
+/*
+** Stable sort: merge sort over list 1, using the table at stack index
+** 3 as a buffer for the lower half of each merge; short intervals are
+** sorted by insertion.
+*/
+
+/* intervals shorter than this are sorted by insertion */
+#define MERGEMIN	12u
+
+
+static void inssort (lua_State *L, IdxT lo, IdxT up) {
+  IdxT i, j;
+  for (i = lo + 1; i <= up; i++) {
+    lua_geti(L, 1, i);  /* value to be inserted */
+    for (j = i; j > lo; j--) {
+      lua_geti(L, 1, j - 1);
+      if (!sort_comp(L, -2, -1)) {  /* not a[i] < a[j - 1]? */
+        lua_pop(L, 1);  /* remove a[j - 1] */
+        break;
+      }
+      lua_seti(L, 1, j);  /* a[j] = a[j - 1] */
+    }
+    lua_seti(L, 1, j);  /* a[j] = a[i] */
+  }
+}
+
+
+static void mergesort (lua_State *L, IdxT lo, IdxT up) {
+  if (up - lo < MERGEMIN)
+    inssort(L, lo, up);
+  else {
+    IdxT mid = lo + (up - lo) / 2;
+    IdxT nl = mid - lo + 1;  /* size of lower half */
+    IdxT i, j, k;
+    mergesort(L, lo, mid);
+    mergesort(L, mid + 1, up);
+    lua_geti(L, 1, mid + 1);
+    lua_geti(L, 1, mid);
+    i = sort_comp(L, -2, -1);  /* a[mid + 1] < a[mid]? */
+    lua_pop(L, 2);
+    if (!i)
+      return;  /* halves are already in order */
+    for (i = 0; i < nl; i++) {  /* copy lower half to the buffer */
+      lua_geti(L, 1, lo + i);
+      lua_rawseti(L, 3, i + 1);
+    }
+    i = 1; j = mid + 1; k = lo;
+    while (i <= nl && j <= up) {
+      lua_geti(L, 1, j);
+      lua_rawgeti(L, 3, i);
+      if (sort_comp(L, -2, -1)) {  /* a[j] < buffer[i]? */
+        lua_pop(L, 1);  /* remove buffer[i] */
+        lua_seti(L, 1, k++);  /* a[k] = a[j] */
+        j++;
+      }
+      else {  /* on ties, the element from the lower half goes first */
+        lua_seti(L, 1, k++);  /* a[k] = buffer[i] */
+        lua_pop(L, 1);  /* remove a[j] */
+        i++;
+      }
+    }
+    while (i <= nl) {  /* rest of lower half (upper one is in place) */
+      lua_rawgeti(L, 3, i++);
+      lua_seti(L, 1, k++);
+    }
+  }
+}
+
+
 static int sort (lua_State *L) {
+  static const char *const opts[] = {"unstable", "stable", NULL};
   lua_Integer n = aux_getn(L, 1, TAB_RW);
+  int stable = luaL_checkoption(L, 3, "unstable", opts);
   if (n > 1) {  /* non-trivial interval? */
     luaL_argcheck(L, n < INT_MAX, 1, "array too big");
     if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
       luaL_checktype(L, 2, LUA_TFUNCTION);  /* must be a function */
     lua_settop(L, 2);  /* make sure there are two arguments */
-    auxsort(L, 1, (IdxT)n, 0);
+    if (lua_isnil(L, 2) && sortnumbers(L, (IdxT)n, stable))
+      return 0;  /* sorted as an array of numbers */
+    if (stable) {
+      lua_createtable(L, (int)(n / 2 + 1), 0);  /* buffer */
+      mergesort(L, 1, (IdxT)n);
+    }
+    else
+      auxsort(L, 1, (IdxT)n, 0);
   }
   return 0;
 }
@@ -412,7 +640,9 @@ static int sort (lua_State *L) {
 
 
 static const luaL_Reg tab_funcs[] = {
+  {"clear", tclear},
   {"concat", tconcat},
+  {"create", tcreate},
   {"insert", tinsert},
   {"pack", tpack},
   {"unpack", tunpack},
@@ -75,6 +75,11 @@ typedef struct lua_State lua_State;
 #define LUA_NUMTYPES		9
 
 
+/* kinds of numeric arrays */
+#define LUA_ARRNUMBER		1
+#define LUA_ARRINTEGER		2
+
+
 
 /* minimum Lua stack available to a C function */
 #define LUA_MINSTACK	20
@@ -131,6 +136,23 @@ typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize);
 typedef void (*lua_WarnFunction) (void *ud, const char *msg, int tocont);
 
 
+/*
+** Type for native finalizers of userdata
+*/
+typedef void (*lua_Finalizer) (void *p, size_t sz);
+
+
+/*
+** Type for descriptions of the numeric fields of C structures, used in
+** bulk transfers to and from tables (lists end with a NULL 'name')
+*/
+typedef struct lua_Field {
+  const char *name;
+  int kind;  /* LUA_ARRNUMBER or LUA_ARRINTEGER */
+  size_t offset;  /* offset of the field in the structure */
+} lua_Field;
+
+
 /*
 ** Type used by the debug API to collect debug information
 */
@@ -205,6 +227,8 @@ LUA_API const char     *(lua_tolstring) (lua_State *L, int idx, size_t *len);
 LUA_API lua_Unsigned    (lua_rawlen) (lua_State *L, int idx);
 LUA_API lua_CFunction   (lua_tocfunction) (lua_State *L, int idx);
 LUA_API void	       *(lua_touserdata) (lua_State *L, int idx);
+LUA_API void	       *(lua_toarray) (lua_State *L, int idx, int *kind,
+                                              lua_Unsigned *n);
 LUA_API lua_State      *(lua_tothread) (lua_State *L, int idx);
 LUA_API const void     *(lua_topointer) (lua_State *L, int idx);
 
@@ -265,9 +289,16 @@ LUA_API int (lua_geti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawget) (lua_State *L, int idx);
 LUA_API int (lua_rawgeti) (lua_State *L, int idx, lua_Integer n);
 LUA_API int (lua_rawgetp) (lua_State *L, int idx, const void *p);
+LUA_API lua_Unsigned (lua_rawgetiarray) (lua_State *L, int idx,
+                      lua_Integer first, lua_Unsigned n, int kind, void *v);
+LUA_API int (lua_rawgetfields) (lua_State *L, int idx, const lua_Field *f,
+                                void *s);
 
 LUA_API void  (lua_createtable) (lua_State *L, int narr, int nrec);
 LUA_API void *(lua_newuserdatauv) (lua_State *L, size_t sz, int nuvalue);
+LUA_API void *(lua_newuserdatafin) (lua_State *L, size_t sz, int nuvalue,
+                                    lua_Finalizer f);
+LUA_API void *(lua_newarray) (lua_State *L, int kind, lua_Unsigned n);
 LUA_API int   (lua_getmetatable) (lua_State *L, int objindex);
 LUA_API int  (lua_getiuservalue) (lua_State *L, int idx, int n);
 
@@ -282,6 +313,11 @@ LUA_API void  (lua_seti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawset) (lua_State *L, int idx);
 LUA_API void  (lua_rawseti) (lua_State *L, int idx, lua_Integer n);
 LUA_API void  (lua_rawsetp) (lua_State *L, int idx, const void *p);
+LUA_API void  (lua_rawsetiarray) (lua_State *L, int idx, lua_Integer first,
+                                  lua_Unsigned n, int kind, const void *v);
+LUA_API void  (lua_rawsetfields) (lua_State *L, int idx, const lua_Field *f,
+                                  const void *s);
+LUA_API void  (lua_cleartable) (lua_State *L, int idx);
 LUA_API int   (lua_setmetatable) (lua_State *L, int objindex);
 LUA_API int   (lua_setiuservalue) (lua_State *L, int idx, int n);
 
@@ -338,10 +374,57 @@ LUA_API void (lua_warning)  (lua_State *L, const char *msg, int tocont);
 #define LUA_GCISRUNNING		9
 #define LUA_GCGEN		10
 #define LUA_GCINC		11
+#define LUA_GCSTEPTIME		12
 
 LUA_API int (lua_gc) (lua_State *L, int what, ...);
 
 
+/*
+** phases of the garbage collector, for statistics and hooks
+*/
+#define LUA_GCPPROPAGATE	0
+#define LUA_GCPATOMIC		1
+#define LUA_GCPSWEEP		2
+#define LUA_GCPCALLFIN		3
+#define LUA_GCPMINOR		4
+#define LUA_GCPMAJOR		5
+
+#define LUA_GCNPHASES		6
+
+#define LUA_GCPPAUSE		LUA_GCNPHASES  /* only for hooks */
+
+typedef struct lua_GCStats {
+  lua_Unsigned cycles;  /* complete cycles (including major collections) */
+  lua_Unsigned minors;  /* minor collections */
+  lua_Unsigned steps;  /* steps (each one a minor or major collection in
+                          generational mode) */
+  lua_Unsigned freed;  /* bytes freed */
+  lua_Unsigned time[LUA_GCNPHASES];  /* microseconds spent in each phase */
+} lua_GCStats;
+
+/*
+** Type for functions called when the collector changes phase
+*/
+typedef void (*lua_GCHook) (void *ud, lua_State *L, int phase);
+
+LUA_API void (lua_gcstats) (lua_State *L, lua_GCStats *stats);
+LUA_API void (lua_setgchook) (lua_State *L, lua_GCHook f, void *ud);
+
+
+/*
+** memory limits
+*/
+
+/*
+** Type for functions called when memory use stays above the soft limit
+*/
+typedef void (*lua_MemHook) (void *ud, lua_State *L, size_t used);
+
+LUA_API void (lua_setmemlimit) (lua_State *L, size_t soft, size_t hard);
+LUA_API void (lua_setmemhook) (lua_State *L, lua_MemHook f, void *ud);
+LUA_API size_t (lua_threadalloc) (lua_State *L);
+
+
 /*
 ** miscellaneous functions
 */
@@ -350,7 +433,15 @@ LUA_API int   (lua_error) (lua_State *L);
 
 LUA_API int   (lua_next) (lua_State *L, int idx);
 
+/* iterators that a generic 'for' can run without calling them */
+#define LUA_ITERNEXT	0	/* works like 'next' */
+#define LUA_ITERIPAIRS	1	/* works like the iterator from 'ipairs' */
+
+LUA_API void  (lua_setiterator) (lua_State *L, int what, lua_CFunction f);
+
 LUA_API void  (lua_concat) (lua_State *L, int n);
+LUA_API int   (lua_rawconcat) (lua_State *L, int idx, lua_Integer i,
+                               lua_Integer j, const char *sep, size_t lsep);
 LUA_API void  (lua_len)    (lua_State *L, int idx);
 
 LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
@@ -361,6 +452,10 @@ LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 LUA_API void (lua_toclose) (lua_State *L, int idx);
 LUA_API void (lua_closeslot) (lua_State *L, int idx);
 
+LUA_API int  (lua_setstrcache) (lua_State *L, int nsets, int maxsets);
+LUA_API void (lua_strcachestats) (lua_State *L, lua_Unsigned *hits,
+                                                lua_Unsigned *misses);
+
 
 /*
 ** {==============================================================
@@ -470,6 +565,15 @@ LUA_API lua_Hook (lua_gethook) (lua_State *L);
 LUA_API int (lua_gethookmask) (lua_State *L);
 LUA_API int (lua_gethookcount) (lua_State *L);
 
+LUA_API void (lua_setprofhook) (lua_State *L, lua_Hook func);
+LUA_API void (lua_profrequest) (lua_State *L);
+LUA_API void (lua_setallochook) (lua_State *L, lua_Hook func,
+                                               lua_Integer rate);
+LUA_API const char *(lua_allocsample) (lua_State *L, size_t *bytes);
+
+LUA_API void (lua_setbudget) (lua_State *L, lua_Hook func, lua_Integer count);
+LUA_API void (lua_interrupt) (lua_State *L);
+
 LUA_API int (lua_setcstacklimit) (lua_State *L, unsigned int limit);
 
 struct lua_Debug {
@@ -37,6 +37,8 @@ static int stripping=0;			/* strip debug information? */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
+static const char* outdir=NULL;		/* output directory for '-d' */
+static int jobs=1;			/* number of parallel jobs for '-d' */
 static TString **tmname;
 
 static void fatal(const char* message)
@@ -60,6 +62,8 @@ static void usage(const char* message)
  fprintf(stderr,
   "usage: %s [options] [filenames]\n"
   "Available options are:\n"
+  "  -d dir   compile each file separately into directory 'dir'\n"
+  "  -j n     run n compilation jobs in parallel (with -d)\n"
   "  -l       list (use -l -l for full listing)\n"
   "  -o name  output to file 'name' (default is \"%s\")\n"
   "  -p       parse only\n"
@@ -90,6 +94,16 @@ static int doargs(int argc, char* argv[])
   }
   else if (IS("-"))			/* end of options; use stdin */
    break;
+  else if (IS("-d"))			/* output directory */
+  {
+   outdir=argv[++i];
+   if (outdir==NULL || *outdir==0) usage("'-d' needs argument");
+  }
+  else if (IS("-j"))			/* parallel jobs */
+  {
+   jobs=(argv[i+1]!=NULL) ? atoi(argv[++i]) : 0;
+   if (jobs<1) usage("'-j' needs a positive number");
+  }
   else if (IS("-l"))			/* list */
    ++listing;
   else if (IS("-o"))			/* output file */
@@ -159,6 +173,13 @@ static const Proto* combine(lua_State* L, int n)
  }
 }
 
+static void loaddebug(lua_State* L, Proto* f)
+{
+ int i;
+ luaU_checkdebug(L,f);
+ for (i=0; i<f->sizep; i++) loaddebug(L,f->p[i]);
+}
+
 static int writer(lua_State* L, const void* p, size_t size, void* u)
 {
  UNUSED(L);
@@ -179,7 +200,13 @@ static int pmain(lua_State* L)
   if (luaL_loadfile(L,filename)!=LUA_OK) fatal(lua_tostring(L,-1));
  }
  f=combine(L,argc);
- if (listing) luaU_print(f,listing>1);
+ if (listing)
+ {
+  lua_lock(L);
+  loaddebug(L,(Proto*)f);		/* precompiled input keeps it encoded */
+  lua_unlock(L);
+  luaU_print(f,listing>1);
+ }
  if (dumping)
  {
   FILE* D= (output==NULL) ? stdout : fopen(output,"wb");
@@ -193,12 +220,211 @@ static int pmain(lua_State* L)
  return 0;
 }
 
+/*
+** With '-d', each file is compiled on its own and dumped to 'outdir',
+** under its own name with the extension ".lua" replaced by ".luac".
+** An output whose contents would not change is not written, so that
+** its time stamp still reflects the last real change. With '-j', the
+** files are shared among worker processes, each with its own state.
+*/
+
+#define EXT	".lua"
+#define EXTC	".luac"
+
+static int bufwriter(lua_State* L, const void* p, size_t size, void* b)
+{
+ UNUSED(L);
+ luaL_addlstring((luaL_Buffer*)b,(const char*)p,size);
+ return 0;
+}
+
+static const char* outname(lua_State* L, const char* filename)
+{
+ size_t l=strlen(filename);
+ if (l>=sizeof(EXT)-1 && strcmp(filename+l-(sizeof(EXT)-1),EXT)==0)
+  l-=sizeof(EXT)-1;
+ return lua_pushfstring(L,"%s" LUA_DIRSEP "%s" EXTC,
+			outdir,lua_pushlstring(L,filename,l));
+}
+
+/*
+** Is the output for 'filename' outside 'outdir'? (That is the case for
+** absolute names and for names with a ".." component.)
+*/
+#define issep(c)	((c)=='/' || (c)==*LUA_DIRSEP)
+
+static int outside(const char* filename)
+{
+ const char* p=filename;
+ if (issep(*p)) return 1;				/* absolute name */
+ if (*LUA_DIRSEP=='\\' && *p!=0 && p[1]==':') return 1;	/* drive name */
+ for (;;)
+ {
+  const char* e=p;
+  while (*e!=0 && !issep(*e)) e++;
+  if (e-p==2 && p[0]=='.' && p[1]=='.') return 1;
+  if (*e==0) return 0;
+  p=e+1;
+ }
+}
+
+static int samecontents(const char* name, const char* s, size_t l)
+{
+ char buff[BUFSIZ];
+ size_t n;
+ int same=1;
+ FILE* f=fopen(name,"rb");
+ if (f==NULL) return 0;
+ while (same && (n=fread(buff,1,sizeof(buff),f))>0)
+ {
+  same=(n<=l && memcmp(buff,s,n)==0);
+  s+=n; l-=n;
+ }
+ same=same && l==0 && !ferror(f);
+ fclose(f);
+ return same;
+}
+
+#if defined(LUA_USE_POSIX)
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static void makedirs(lua_State* L, const char* name)
+{
+ const char* p;
+ for (p=strchr(name+1,*LUA_DIRSEP); p!=NULL; p=strchr(p+1,*LUA_DIRSEP))
+ {
+  mkdir(lua_pushlstring(L,name,p-name),0777);	/* may already exist */
+  lua_pop(L,1);
+ }
+}
+#else
+#define makedirs(L,name)	((void)0)
+#endif
+
+static int writeout(lua_State* L, const char* name, const char* s, size_t l)
+{
+ FILE* D;
+ if (samecontents(name,s,l)) return 1;
+ D=fopen(name,"wb");
+ if (D==NULL && errno==ENOENT)		/* missing directory? */
+ {
+  makedirs(L,name);
+  D=fopen(name,"wb");
+ }
+ if (D!=NULL)
+ {
+  int err=(fwrite(s,1,l,D)!=l);
+  err=(fclose(D)!=0) || err;
+  if (!err) return 1;
+ }
+ fprintf(stderr,"%s: cannot write %s: %s\n",progname,name,strerror(errno));
+ return 0;
+}
+
+static int pcompile(lua_State* L)
+{
+ int argc=(int)lua_tointeger(L,1);
+ char** argv=(char**)lua_touserdata(L,2);
+ int i=(int)lua_tointeger(L,3);
+ int step=(int)lua_tointeger(L,4);
+ int ok=1;
+ tmname=G(L)->tmname;
+ for (; i<argc; i+=step)
+ {
+  const Proto* f;
+  if (luaL_loadfile(L,argv[i])!=LUA_OK)
+  {
+   fprintf(stderr,"%s: %s\n",progname,lua_tostring(L,-1));
+   ok=0;
+   lua_pop(L,1);
+   continue;
+  }
+  f=toproto(L,-1);
+  if (listing)
+  {
+   lua_lock(L);
+   loaddebug(L,(Proto*)f);
+   lua_unlock(L);
+   luaU_print(f,listing>1);
+  }
+  if (dumping)
+  {
+   luaL_Buffer b;
+   const char* name=outname(L,argv[i]);
+   luaL_buffinit(L,&b);
+   lua_lock(L);
+   luaU_dump(L,f,bufwriter,&b,stripping);
+   lua_unlock(L);
+   ok=writeout(L,name,luaL_buffaddr(&b),luaL_bufflen(&b)) && ok;
+  }
+  lua_settop(L,0);
+ }
+ lua_pushboolean(L,ok);
+ return 1;
+}
+
+static int compile(int argc, char* argv[], int first, int step)
+{
+ int ok;
+ lua_State* L=luaL_newstate();
+ if (L==NULL) fatal("cannot create state: not enough memory");
+ lua_pushcfunction(L,&pcompile);
+ lua_pushinteger(L,argc);
+ lua_pushlightuserdata(L,argv);
+ lua_pushinteger(L,first);
+ lua_pushinteger(L,step);
+ if (lua_pcall(L,4,1,0)!=LUA_OK) fatal(lua_tostring(L,-1));
+ ok=lua_toboolean(L,-1);
+ lua_close(L);
+ return ok;
+}
+
+static int separate(int argc, char* argv[])
+{
+ int ok=1;
+ int i;
+ for (i=0; i<argc; i++)
+  if (IS("-")) usage("'-d' cannot compile stdin");
+  else if (outside(argv[i]))
+  {
+   fprintf(stderr,"%s: '-d' cannot write %s outside %s\n",
+		  progname,argv[i],outdir);
+   return 0;
+  }
+#if defined(LUA_USE_POSIX)
+ if (jobs>1 && argc>1)
+ {
+  int k,status;
+  if (jobs>argc) jobs=argc;
+  fflush(stdout);
+  fflush(stderr);
+  for (k=0; k<jobs; k++)
+  {
+   pid_t pid=fork();
+   if (pid==0)				/* worker */
+    exit(compile(argc,argv,k,jobs) ? EXIT_SUCCESS : EXIT_FAILURE);
+   else if (pid<0)			/* cannot fork: do its share here */
+    ok=compile(argc,argv,k,jobs) && ok;
+  }
+  while (wait(&status)>0)
+   ok=ok && WIFEXITED(status) && WEXITSTATUS(status)==EXIT_SUCCESS;
+  return ok;
+ }
+#endif
+ return compile(argc,argv,0,1) && ok;
+}
+
 int main(int argc, char* argv[])
 {
  lua_State* L;
  int i=doargs(argc,argv);
  argc-=i; argv+=i;
  if (argc<=0) usage("no input files given");
+ if (outdir!=NULL)
+  return separate(argc,argv) ? EXIT_SUCCESS : EXIT_FAILURE;
  L=luaL_newstate();
  if (L==NULL) fatal("cannot create state: not enough memory");
  lua_pushcfunction(L,&pmain);
@@ -338,7 +564,7 @@ static void PrintCode(const Proto* f)
  for (pc=0; pc<n; pc++)
  {
   Instruction i=code[pc];
-  OpCode o=GET_OPCODE(i);
+  OpCode o=GET_BASICOP(i);
   int a=GETARG_A(i);
   int b=GETARG_B(i);
   int c=GETARG_C(i);
@@ -351,7 +577,7 @@ static void PrintCode(const Proto* f)
   int line=luaG_getfuncline(f,pc);
   printf("\t%d\t",pc+1);
   if (line>0) printf("[%d]\t",line); else printf("[-]\t");
-  printf("%-9s\t",opnames[o]);
+  printf("%-9s\t",opnames[GET_OPCODE(i)]);
   switch (o)
   {
    case OP_MOVE:
@@ -650,6 +876,9 @@ static void PrintCode(const Proto* f)
    case OP_EXTRAARG:
 	printf("%d",ax);
 	break;
+   case OP_GETFIELD2: case OP_GETFIELDEQK: case OP_GETFIELDADD:
+   case OP_GETTABUPFIELD: case OP_SETFIELD2:
+	break;	/* not reached: operands printed for the basic opcode */
 #if 0
    default:
 	printf("%d %d %d",a,b,c);
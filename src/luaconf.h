@@ -257,6 +257,16 @@
 
 #endif
 
+
+/*
+@@ LUA_USE_CACHEDIRENV lets the environment variable LUA_CACHEDIR set
+** 'package.cachedir' at start-up. Compiled modules are loaded from that
+** directory without any verification, so whoever controls the variable
+** can run arbitrary code in the host; define it only where the
+** environment is trusted.
+*/
+/* #define LUA_USE_CACHEDIRENV */
+
 /* }================================================================== */
 
 
@@ -397,6 +407,8 @@
 ** by prefixing it with one of FLT/DBL/LDBL.
 @@ LUA_NUMBER_FRMLEN is the length modifier for writing floats.
 @@ LUA_NUMBER_FMT is the format for writing floats.
+@@ LUAI_NUMFMTDIGITS (optional) is the precision of a "%.<n>g" format in
+** LUA_NUMBER_FMT, which enables a faster conversion of short decimals.
 @@ lua_number2str converts a float to a string.
 @@ l_mathop allows the addition of an 'l' or 'f' to all math operations.
 @@ l_floor takes the floor of a float.
@@ -469,6 +481,7 @@
 
 #define LUA_NUMBER_FRMLEN	""
 #define LUA_NUMBER_FMT		"%.14g"
+#define LUAI_NUMFMTDIGITS	14	/* precision of LUA_NUMBER_FMT */
 
 #define l_mathop(op)		op
 
@@ -709,6 +722,27 @@
 /* #define LUA_NOCVTS2N */
 
 
+/*
+@@ LUA_USE_THREADLOCK allows several OS threads to run threads of the
+** same Lua state, each one calling the API on its own 'lua_State'.
+** The core is serialized by a mutex, which is released while C
+** functions run and at the safe points where the collector may run
+** (see 'lua_lock' in llimits.h). It needs POSIX threads; link with
+** -pthread.
+*/
+/* #define LUA_USE_THREADLOCK */
+
+
+/*
+@@ LUA_USE_FINALIZERTHREAD runs the native finalizers of userdata (see
+** 'lua_newuserdatafin') in a background thread, which receives them in
+** batches at the end of each collector step. The memory-allocation
+** function must then be thread safe (so not LUAL_ARENA). It needs
+** POSIX threads; link with -pthread.
+*/
+/* #define LUA_USE_FINALIZERTHREAD */
+
+
 /*
 @@ LUA_USE_APICHECK turns on several consistency checks on the C API.
 ** Define it as a help when debugging C code.
@@ -759,6 +793,30 @@
 #define LUA_IDSIZE	60
 
 
+/*
+@@ LUA_SHAREDSTRINGS makes all states in the process share the short
+** strings that are constants of their code (field names, keys, etc.)
+** through one lock-free table of immortal strings.
+** CHANGE it (define it) if you run many states with the same code.
+** It needs a compiler with GCC-style atomic builtins.
+*/
+/* #define LUA_SHAREDSTRINGS */
+
+
+/*
+@@ LUAL_ARENA makes 'luaL_newstate' use an arena allocator, which
+** serves small blocks from per-state size classes instead of calling
+** 'realloc'/'free' for each object.
+** CHANGE it (define it) if your states allocate and free many small
+** objects and 'malloc' fragments under that churn.
+*/
+/* #define LUAL_ARENA */
+
+#if defined(LUAL_ARENA) && defined(LUA_USE_FINALIZERTHREAD)
+#error "LUAL_ARENA cannot be used with LUA_USE_FINALIZERTHREAD"
+#endif
+
+
 /*
 @@ LUAL_BUFFERSIZE is the initial buffer size used by the lauxlib
 ** buffer system.
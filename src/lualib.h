@@ -44,9 +44,24 @@ LUAMOD_API int (luaopen_debug) (lua_State *L);
 #define LUA_LOADLIBNAME	"package"
 LUAMOD_API int (luaopen_package) (lua_State *L);
 
+#define LUA_ARRAYLIBNAME	"array"
+LUAMOD_API int (luaopen_array) (lua_State *L);
+
+#define LUA_PROFLIBNAME	"profile"
+LUAMOD_API int (luaopen_profile) (lua_State *L);
+
+#define LUA_JSONLIBNAME	"json"
+LUAMOD_API int (luaopen_json) (lua_State *L);
+
+#define LUA_MSGPACKLIBNAME	"msgpack"
+LUAMOD_API int (luaopen_msgpack) (lua_State *L);
+
 
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L);
 
+/* make all previous libraries available, opening each one on first use */
+LUALIB_API void (luaL_openlibslazy) (lua_State *L);
+
 
 #endif
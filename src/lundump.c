@@ -20,6 +20,7 @@
 #include "lfunc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstring.h"
 #include "lundump.h"
 #include "lzio.h"
@@ -34,6 +35,7 @@ typedef struct {
   lua_State *L;
   ZIO *Z;
   const char *name;
+  int ndebug;  /* bytes used in the 'debuginfo' being copied */
 } LoadState;
 
 
@@ -116,7 +118,7 @@ static TString *loadStringN (LoadState *S, Proto *p) {
   else if (--size <= LUAI_MAXSHORTLEN) {  /* short string? */
     char buff[LUAI_MAXSHORTLEN];
     loadVector(S, buff, size);  /* load string into buffer */
-    ts = luaS_newlstr(L, buff, size);  /* create string */
+    ts = luaS_newkstr(L, buff, size);  /* create string */
   }
   else {  /* long string */
     ts = luaS_createlngstrobj(L, size);  /* create string */
@@ -146,6 +148,7 @@ static void loadCode (LoadState *S, Proto *f) {
   f->code = luaM_newvectorchecked(S->L, n, Instruction);
   f->sizecode = n;
   loadVector(S, f->code, n);
+  luaP_fuse(f->code, n);
 }
 
 
@@ -224,7 +227,10 @@ static void loadUpvalues (LoadState *S, Proto *f) {
 }
 
 
-static void loadDebug (LoadState *S, Proto *f) {
+/*
+** Load the line information and the local variables of a function.
+*/
+static void loadDebugInfo (LoadState *S, Proto *f) {
   int i, n;
   n = loadInt(S);
   f->lineinfo = luaM_newvectorchecked(S->L, n, ls_byte);
@@ -247,6 +253,98 @@ static void loadDebug (LoadState *S, Proto *f) {
     f->locvars[i].startpc = loadInt(S);
     f->locvars[i].endpc = loadInt(S);
   }
+}
+
+
+#if LUAI_LAZYDEBUG
+
+/*
+** Make room for 'size' more bytes in the 'debuginfo' of 'f'.
+*/
+static void growdebuginfo (LoadState *S, Proto *f, size_t size) {
+  if (cast_sizet(f->sizedebuginfo - S->ndebug) < size) {
+    int newsize;
+    if (size > cast_sizet(MAX_INT - S->ndebug))
+      error(S, "debug information too large");
+    newsize = S->ndebug + cast_int(size);
+    if (f->sizedebuginfo <= MAX_INT / 2 && newsize < f->sizedebuginfo * 2)
+      newsize = f->sizedebuginfo * 2;  /* grow geometrically */
+    f->debuginfo = luaM_reallocvector(S->L, f->debuginfo, f->sizedebuginfo,
+                                      newsize, lu_byte);
+    f->sizedebuginfo = newsize;
+  }
+}
+
+
+static void copyBlock (LoadState *S, Proto *f, size_t size) {
+  growdebuginfo(S, f, size);
+  loadBlock(S, f->debuginfo + S->ndebug, size);
+  S->ndebug += cast_int(size);
+}
+
+
+static size_t copyUnsigned (LoadState *S, Proto *f, size_t limit) {
+  size_t x = 0;
+  int b;
+  limit >>= 7;
+  do {
+    b = loadByte(S);
+    if (x >= limit)
+      error(S, "integer overflow");
+    growdebuginfo(S, f, 1);
+    f->debuginfo[S->ndebug++] = cast_byte(b);
+    x = (x << 7) | (b & 0x7f);
+  } while ((b & 0x80) == 0);
+  return x;
+}
+
+
+static int copyInt (LoadState *S, Proto *f) {
+  return cast_int(copyUnsigned(S, f, INT_MAX));
+}
+
+
+/*
+** Copy the line information and the local variables of a function,
+** still encoded, to its 'debuginfo', to be decoded only if needed.
+** Stripped functions keep nothing.
+*/
+static void copyDebugInfo (LoadState *S, Proto *f) {
+  int i, n, any;
+  S->ndebug = 0;
+  n = copyInt(S, f);  /* line information */
+  copyBlock(S, f, cast_sizet(n));
+  any = n;
+  n = copyInt(S, f);  /* absolute line information */
+  for (i = 0; i < n; i++) {
+    copyInt(S, f);  /* pc */
+    copyInt(S, f);  /* line */
+  }
+  any |= n;
+  n = copyInt(S, f);  /* local variables */
+  for (i = 0; i < n; i++) {
+    size_t size = copyUnsigned(S, f, ~(size_t)0);
+    if (size > 0)  /* not a NULL name? */
+      copyBlock(S, f, size - 1);
+    copyInt(S, f);  /* startpc */
+    copyInt(S, f);  /* endpc */
+  }
+  any |= n;
+  if (any == 0)  /* no debug information? */
+    S->ndebug = 0;  /* keep nothing */
+  luaM_shrinkvector(S->L, f->debuginfo, f->sizedebuginfo, S->ndebug, lu_byte);
+}
+
+#endif
+
+
+static void loadDebug (LoadState *S, Proto *f) {
+  int i, n;
+#if LUAI_LAZYDEBUG
+  copyDebugInfo(S, f);
+#else
+  loadDebugInfo(S, f);
+#endif
   n = loadInt(S);
   if (n != 0)  /* does it have debug information? */
     n = f->sizeupvalues;  /* must be this many */
@@ -333,3 +431,63 @@ LClosure *luaU_undump(lua_State *L, ZIO *Z, const char *name) {
   return cl;
 }
 
+
+/* the whole input is already in the ZIO */
+static const char *noreader (lua_State *L, void *ud, size_t *size) {
+  UNUSED(L); UNUSED(ud);
+  *size = 0;
+  return NULL;
+}
+
+
+typedef struct {
+  LoadState S;
+  Proto *f;
+} SLoadDebug;
+
+
+static void f_loaddebug (lua_State *L, void *ud) {
+  SLoadDebug *ld = cast(SLoadDebug *, ud);
+  UNUSED(L);
+  loadDebugInfo(&ld->S, ld->f);
+}
+
+
+/*
+** Decode the debug information that 'copyDebugInfo' kept encoded in
+** 'f'. This is called where errors are not expected (e.g., from
+** 'lua_getlocal'), so it runs protected. If it fails, which can only
+** happen by lack of memory, 'f' stays without that information for
+** now, and a later call tries again.
+*/
+void luaU_loaddebug (lua_State *L, Proto *f) {
+  SLoadDebug ld;
+  ZIO z;
+  ptrdiff_t top = savestack(L, L->top.p);
+  lua_assert(f->debuginfo != NULL);
+  luaZ_init(L, &z, noreader, NULL);
+  z.n = cast_sizet(f->sizedebuginfo);
+  z.p = cast_charp(f->debuginfo);
+  ld.S.L = L;
+  ld.S.Z = &z;
+  ld.S.name = "debug information";
+  ld.f = f;
+  if (luaD_rawrunprotected(L, f_loaddebug, &ld) == LUA_OK) {
+    luaM_freearray(L, f->debuginfo, f->sizedebuginfo);
+    f->debuginfo = NULL;
+    f->sizedebuginfo = 0;
+  }
+  else {  /* undo partial decoding */
+    L->top.p = restorestack(L, top);
+    luaM_freearray(L, f->lineinfo, f->sizelineinfo);
+    luaM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
+    luaM_freearray(L, f->locvars, f->sizelocvars);
+    f->lineinfo = NULL;
+    f->sizelineinfo = 0;
+    f->abslineinfo = NULL;
+    f->sizeabslineinfo = 0;
+    f->locvars = NULL;
+    f->sizelocvars = 0;
+  }
+}
+
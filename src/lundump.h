@@ -29,6 +29,13 @@
 /* load one chunk; from lundump.c */
 LUAI_FUNC LClosure* luaU_undump (lua_State* L, ZIO* Z, const char* name);
 
+/* decode the debug information kept by the undumper; from lundump.c */
+LUAI_FUNC void luaU_loaddebug (lua_State* L, Proto* f);
+
+/* make sure that the debug information of 'f' is decoded */
+#define luaU_checkdebug(L,f)  \
+	((f)->debuginfo == NULL ? (void)0 : luaU_loaddebug(L, f))
+
 /* dump one chunk; from ldump.c */
 LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w,
                          void* data, int strip);
@@ -88,37 +88,137 @@ static const char *utf8_decode (const char *s, utfint *val, int strict) {
 }
 
 
+/*
+** {======================================================
+** Word-at-a-time scanning
+** =======================================================
+*/
+
+/*
+** Strings are scanned WORDSIZE bytes at a time where possible (read
+** with 'memcpy', so alignment does not matter): a word with no high
+** bits set is all ASCII, and the continuation bytes in a word can be
+** counted with a few arithmetic operations.
+*/
+typedef size_t utfword;
+
+#define WORDSIZE	((lua_Integer)sizeof(utfword))
+
+#define ONES		(~(utfword)0 / 0xFF)	/* 0x01 in each byte */
+#define HIGHS		(ONES * 0x80)		/* 0x80 in each byte */
+
+
+static utfword getword (const char *s) {
+  utfword w;
+  memcpy(&w, s, sizeof(w));
+  return w;
+}
+
+
+/*
+** Number of continuation bytes (10xxxxxx) in word 'w': mark them with
+** their high bit (bit 7 set and bit 6 clear) and add the marks.
+*/
+static int contbytes (utfword w) {
+  w = ((w & ~(w << 1) & HIGHS) >> 7) * ONES;
+  return (int)(w >> ((sizeof(utfword) - 1) * CHAR_BIT));
+}
+
+
+/*
+** Count the characters that start in s[i..j] (0-based), checking that
+** they are well formed; ASCII runs go one word at a time. (Otherwise,
+** all characters starting in the word are decoded before the next
+** check.) If there is an invalid sequence, return -1 with its position
+** in '*err'.
+*/
+static lua_Integer utf8_count (const char *s, lua_Integer i, lua_Integer j,
+                               int strict, lua_Integer *err) {
+  lua_Integer n = 0;
+  while (i <= j) {
+    lua_Integer e = i + WORDSIZE;  /* end of current word */
+    if (e - 1 <= j && (getword(s + i) & HIGHS) == 0) {
+      i = e;  /* a word of ASCII characters */
+      n += WORDSIZE;
+    }
+    else {
+      do {
+        if ((unsigned char)s[i] < 0x80)  /* ascii? */
+          i++;
+        else {
+          const char *s1 = utf8_decode(s + i, NULL, strict);
+          if (s1 == NULL) {  /* conversion error? */
+            *err = i;
+            return -1;
+          }
+          i = s1 - s;
+        }
+        n++;
+      } while (i < e && i <= j);
+    }
+  }
+  return n;
+}
+
+/* }====================================================== */
+
+
+/*
+** Check the range [i,j] given in arguments 2 and 3 of a function over
+** string 's' and translate it to 0-based positions.
+*/
+static void getrange (lua_State *L, size_t len, lua_Integer *posi,
+                                    lua_Integer *posj) {
+  *posi = u_posrelat(luaL_optinteger(L, 2, 1), len);
+  *posj = u_posrelat(luaL_optinteger(L, 3, -1), len);
+  luaL_argcheck(L, 1 <= *posi && --*posi <= (lua_Integer)len, 2,
+                   "initial position out of bounds");
+  luaL_argcheck(L, --*posj < (lua_Integer)len, 3,
+                   "final position out of bounds");
+}
+
+
 /*
 ** utf8len(s [, i [, j [, lax]]]) --> number of characters that
 ** start in the range [i,j], or nil + current position if 's' is not
 ** well formed in that interval
 */
 static int utflen (lua_State *L) {
-  lua_Integer n = 0;  /* counter for the number of characters */
   size_t len;  /* string length in bytes */
   const char *s = luaL_checklstring(L, 1, &len);
-  lua_Integer posi = u_posrelat(luaL_optinteger(L, 2, 1), len);
-  lua_Integer posj = u_posrelat(luaL_optinteger(L, 3, -1), len);
-  int lax = lua_toboolean(L, 4);
-  luaL_argcheck(L, 1 <= posi && --posi <= (lua_Integer)len, 2,
-                   "initial position out of bounds");
-  luaL_argcheck(L, --posj < (lua_Integer)len, 3,
-                   "final position out of bounds");
-  while (posi <= posj) {
-    const char *s1 = utf8_decode(s + posi, NULL, !lax);
-    if (s1 == NULL) {  /* conversion error? */
-      luaL_pushfail(L);  /* return fail ... */
-      lua_pushinteger(L, posi + 1);  /* ... and current position */
-      return 2;
-    }
-    posi = s1 - s;
-    n++;
+  lua_Integer posi, posj, err;
+  lua_Integer n;  /* number of characters */
+  getrange(L, len, &posi, &posj);
+  n = utf8_count(s, posi, posj, !lua_toboolean(L, 4), &err);
+  if (n < 0) {  /* conversion error? */
+    luaL_pushfail(L);  /* return fail ... */
+    lua_pushinteger(L, err + 1);  /* ... and current position */
+    return 2;
   }
   lua_pushinteger(L, n);
   return 1;
 }
 
 
+/*
+** valid(s [, i [, j [, lax]]]) --> true if 's' is well formed in the
+** range [i,j], or fail + position of the first invalid sequence
+*/
+static int utfvalid (lua_State *L) {
+  size_t len;
+  const char *s = luaL_checklstring(L, 1, &len);
+  lua_Integer posi, posj, err;
+  getrange(L, len, &posi, &posj);
+  if (utf8_count(s, posi, posj, !lua_toboolean(L, 4), &err) < 0) {
+    luaL_pushfail(L);
+    lua_pushinteger(L, err + 1);
+    return 2;
+  }
+  lua_pushboolean(L, 1);
+  return 1;
+}
+
+
 /*
 ** codepoint(s, [i, [j [, lax]]]) -> returns codepoints for all
 ** characters that start in the range [i,j]
@@ -152,6 +252,45 @@ static int codepoint (lua_State *L) {
 }
 
 
+/* size of the buffer for code points in 'decode' */
+#define DECODEBUFF	128
+
+/*
+** decode(s [, i [, j [, lax]]]) -> table with the codepoints of all
+** characters that start in the range [i,j]. The string is validated
+** (and the characters counted) first, so that the table is created
+** with its final size; codepoints then go to it in batches.
+*/
+static int decode (lua_State *L) {
+  size_t len;
+  const char *s = luaL_checklstring(L, 1, &len);
+  int lax = lua_toboolean(L, 4);
+  lua_Integer posi, posj, err, k;
+  lua_Integer n;  /* number of characters */
+  lua_Integer codes[DECODEBUFF];
+  const char *se;  /* end of range */
+  int m = 0;  /* number of codes in the buffer */
+  getrange(L, len, &posi, &posj);
+  n = utf8_count(s, posi, posj, !lax, &err);
+  if (n < 0)
+    return luaL_error(L, MSGInvalid);
+  luaL_argcheck(L, n < INT_MAX, 1, "string slice too long");
+  lua_createtable(L, (int)n, 0);
+  se = s + posj + 1;
+  for (s += posi, k = 1; s < se;) {
+    utfint code;
+    s = utf8_decode(s, &code, !lax);  /* (already checked) */
+    codes[m++] = (lua_Integer)code;
+    if (m == DECODEBUFF || s >= se) {  /* buffer full or last code? */
+      lua_rawsetiarray(L, -1, k, (lua_Unsigned)m, LUA_ARRINTEGER, codes);
+      k += m;
+      m = 0;
+    }
+  }
+  return 1;
+}
+
+
 static void pushutfchar (lua_State *L, int arg) {
   lua_Unsigned code = (lua_Unsigned)luaL_checkinteger(L, arg);
   luaL_argcheck(L, code <= MAXUTF, arg, "value out of range");
@@ -209,6 +348,11 @@ static int byteoffset (lua_State *L) {
      }
      else {
        n--;  /* do not move for 1st character */
+       /* skip whole words with fewer than 'n' character starts */
+       while (n > WORDSIZE && posi + WORDSIZE < (lua_Integer)len) {
+         n -= WORDSIZE - contbytes(getword(s + posi + 1));
+         posi += WORDSIZE;
+       }
        while (n > 0 && posi < (lua_Integer)len) {
          do {  /* find beginning of next character */
            posi++;
@@ -275,6 +419,8 @@ static const luaL_Reg funcs[] = {
   {"codepoint", codepoint},
   {"char", utfchar},
   {"len", utflen},
+  {"valid", utfvalid},
+  {"decode", decode},
   {"codes", iter_codes},
   /* placeholders */
   {"charpattern", NULL},
@@ -279,6 +279,70 @@ static int floatforloop (StkId ra) {
 }
 
 
+/*
+** {==================================================================
+** Numeric arrays
+** ===================================================================
+*/
+
+/*
+** Convert 'key' to a 0-based index into numeric array 'u'. Returns
+** false when 'key' is not a valid index for the array.
+*/
+static int arrayindex (Udata *u, const TValue *key, lua_Unsigned *i) {
+  lua_Integer k;
+  if (ttisinteger(key))
+    k = ivalue(key);
+  else if (!(ttisfloat(key) && luaV_flttointeger(fltvalue(key), &k, F2Ieq)))
+    return 0;
+  *i = l_castS2U(k) - 1u;
+  return (*i < arraysize(u));
+}
+
+
+/*
+** Try 'val = u[key]' over numeric array 'u'.
+*/
+static int getarray (Udata *u, const TValue *key, StkId val) {
+  lua_Unsigned i;
+  if (!arrayindex(u, key, &i))
+    return 0;
+  if (u->arraykind == LUA_ARRNUMBER) {
+    setfltvalue(s2v(val), arraynumbers(u)[i]);
+  }
+  else {
+    setivalue(s2v(val), arrayintegers(u)[i]);
+  }
+  return 1;
+}
+
+
+/*
+** Try 'u[key] = val' over numeric array 'u'. Values that the array
+** cannot store go, like invalid indices, to the metamethods.
+*/
+static int setarray (Udata *u, const TValue *key, const TValue *val) {
+  lua_Unsigned i;
+  if (!ttisnumber(val) || !arrayindex(u, key, &i))
+    return 0;
+  if (u->arraykind == LUA_ARRNUMBER)
+    arraynumbers(u)[i] = nvalue(val);
+  else if (ttisinteger(val))
+    arrayintegers(u)[i] = ivalue(val);
+  else
+    return luaV_flttointeger(fltvalue(val), &arrayintegers(u)[i], F2Ieq);
+  return 1;
+}
+
+
+/* fast track for numeric arrays, used by the VM before calling
+   'luaV_finishget'/'luaV_finishset' */
+#define arrayget(t,k,v)	(ttisarray(t) && getarray(uvalue(t), k, v))
+#define arrayset(t,k,v)	(ttisarray(t) && setarray(uvalue(t), k, v))
+
+/* }================================================================== */
+
+
 /*
 ** Finish the table access 'val = t[key]'.
 ** if 'slot' is NULL, 't' is not a table; otherwise, 'slot' points to
@@ -291,6 +355,8 @@ void luaV_finishget (lua_State *L, const TValue *t, TValue *key, StkId val,
   for (loop = 0; loop < MAXTAGLOOP; loop++) {
     if (slot == NULL) {  /* 't' is not a table? */
       lua_assert(!ttistable(t));
+      if (arrayget(t, key, val))
+        return;  /* done */
       tm = luaT_gettmbyobj(L, t, TM_INDEX);
       if (l_unlikely(notm(tm)))
         luaG_typeerror(L, t, "index");  /* no metamethod */
@@ -345,6 +411,8 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
       /* else will try the metamethod */
     }
     else {  /* not a table; check metamethod */
+      if (arrayset(t, key, val))
+        return;  /* done */
       tm = luaT_gettmbyobj(L, t, TM_NEWINDEX);
       if (l_unlikely(notm(tm)))
         luaG_typeerror(L, t, "index");
@@ -700,6 +768,13 @@ void luaV_objlen (lua_State *L, StkId ra, const TValue *rb) {
       setivalue(s2v(ra), tsvalue(rb)->u.lnglen);
       return;
     }
+    case LUA_VUSERDATA: {
+      Udata *u = uvalue(rb);
+      if (u->arraykind != 0) {  /* numeric array? */
+        setivalue(s2v(ra), l_castU2S(arraysize(u)));
+        return;
+      }
+    }  /* FALLTHROUGH */
     default: {  /* try metamethod */
       tm = luaT_gettmbyobj(L, rb, TM_LEN);
       if (l_unlikely(notm(tm)))  /* no metamethod? */
@@ -810,7 +885,7 @@ void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->func.p + 1;
   Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
-  OpCode op = GET_OPCODE(inst);
+  OpCode op = GET_BASICOP(inst);
   switch (op) {  /* finish its execution */
     case OP_MMBIN: case OP_MMBINI: case OP_MMBINK: {
       setobjs2s(L, base + GETARG_A(*(ci->u.l.savedpc - 2)), --L->top.p);
@@ -1045,6 +1120,56 @@ void luaV_finishOp (lua_State *L) {
 /* }================================================================== */
 
 
+/*
+** Is 'o' the iterator registered as 'what' (see 'lua_setiterator')?
+*/
+#define isiterator(L,o,what)  \
+	(ttislcf(o) && fvalue(o) == G(L)->iterf[what])
+
+
+/*
+** Runs one step of a generic 'for' (see OP_TFORCALL) without calling
+** its iterator, when the iterator is 'next' with a cursor (see
+** OP_TFORPREP) or the one from 'ipairs' over a table where it would
+** not call '__index'. Returns 0 when it must call the iterator.
+*/
+static int forinline (lua_State *L, StkId ra, int nvars) {
+  if (ttisinteger(s2v(ra + 3)) && ttistable(s2v(ra + 1))) {
+    /* the cursor is the traversal index after the control variable */
+    Table *h = hvalue(s2v(ra + 1));
+    lua_Unsigned c = l_castS2U(ivalue(s2v(ra + 3)));
+    unsigned int cur;
+    if (l_unlikely(!luaH_iscursor(h, c, s2v(ra + 2))))
+      return 0;  /* cursor or key changed (by the debug library?) */
+    cur = luaH_nextfrom(L, h, cast_uint(c), ra + 4);
+    if (cur == 0) {  /* no more entries? */
+      setnilvalue(s2v(ra + 4));  /* end the loop */
+      return 1;
+    }
+    setivalue(s2v(ra + 3), cur);
+  }
+  else if (isiterator(L, s2v(ra), LUA_ITERIPAIRS) &&
+           ttisinteger(s2v(ra + 2))) {
+    lua_Integer n = intop(+, ivalue(s2v(ra + 2)), 1);
+    const TValue *slot;
+    if (!luaV_fastgeti(L, s2v(ra + 1), n, slot)) {
+      if (slot == NULL ||  /* not a table? */
+          fasttm(L, hvalue(s2v(ra + 1))->metatable, TM_INDEX) != NULL)
+        return 0;  /* let the iterator do the indexing */
+      setnilvalue(s2v(ra + 4));  /* end the loop */
+      return 1;
+    }
+    setivalue(s2v(ra + 4), n);
+    setobj2s(L, ra + 5, slot);
+  }
+  else
+    return 0;
+  for (; nvars > 2; nvars--)
+    setnilvalue(s2v(ra + 3 + nvars));  /* extra variables are nil */
+  return 1;
+}
+
+
 /*
 ** {==================================================================
 ** Function 'luaV_execute': main interpreter loop
@@ -1066,8 +1191,98 @@ void luaV_finishOp (lua_State *L) {
 #define RKC(i)	((TESTARG_k(i)) ? k + GETARG_C(i) : s2v(base + GETARG_C(i)))
 
 
+/*
+** Fast get for a short-string key, through the inline cache of the
+** current instruction when caches are enabled. The caches of a
+** prototype are created on its first field access. (Creating them may
+** raise a memory error, so the state must be saved first.)
+*/
+#if LUAI_FIELDCACHE
+#define fieldcache()  \
+	((l_likely(cl->p->icache != NULL) ? cl->p->icache  \
+	   : (savestate(L,ci), luaF_newcache(L, cl->p))) + pcRel(pc, cl->p))
+
+#define fastgetfield(t,key,slot)  \
+	luaV_fastgetfield(L, t, key, slot, fieldcache())
+#define getfieldin(h,key)	luaH_getshortstrhint(h, key, fieldcache())
+#else
+#define fastgetfield(t,key,slot)  \
+	luaV_fastget(L, t, key, slot, luaH_getshortstr)
+#define getfieldin(h,key)	luaH_getshortstr(h, key)
+#endif
+
+
+/*
+** Fast get for a short-string key in a full userdata whose metatable
+** has a table as its '__index' metavalue, which is how bindings usually
+** give methods to C objects: get the field directly from that table,
+** skipping 'luaV_finishget'. On failure with a userdata, 'slot' is NULL
+** again, as 'luaV_finishget' expects for a non-table.
+*/
+#define udfastgetfield(t,key,slot)  \
+  (ttisfulluserdata(t)  \
+   && (((slot = fasttm(L, uvalue(t)->metatable, TM_INDEX)) != NULL  \
+        && ttistable(slot)  \
+        && (slot = getfieldin(hvalue(slot), key), !isempty(slot)))  \
+       || (slot = NULL, 0)))
+
+
+/*
+** Bodies of the instructions that are components of superinstructions
+** (see 'luaP_fuse').
+*/
+#define op_gettabup(L) {  \
+  StkId ra = RA(i);  \
+  const TValue *slot;  \
+  TValue *upval = cl->upvals[GETARG_B(i)]->v.p;  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  if (fastgetfield(upval, key, slot)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(luaV_finishget(L, upval, rc, ra, slot)); }
+
+
+#define op_getfield(L) {  \
+  StkId ra = RA(i);  \
+  const TValue *slot;  \
+  TValue *rb = vRB(i);  \
+  TValue *rc = KC(i);  \
+  TString *key = tsvalue(rc);  /* key must be a string */  \
+  if (fastgetfield(rb, key, slot) || udfastgetfield(rb, key, slot)) {  \
+    setobj2s(L, ra, slot);  \
+  }  \
+  else  \
+    Protect(luaV_finishget(L, rb, rc, ra, slot)); }
 
-#define updatetrap(ci)  (trap = ci->u.l.trap)
+
+#define op_setfield(L) {  \
+  StkId ra = RA(i);  \
+  const TValue *slot;  \
+  TValue *rb = KB(i);  \
+  TValue *rc = RKC(i);  \
+  TString *key = tsvalue(rb);  /* key must be a string */  \
+  if (fastgetfield(s2v(ra), key, slot)) {  \
+    luaV_finishfastset(L, s2v(ra), slot, rc);  \
+  }  \
+  else  \
+    Protect(luaV_finishset(L, s2v(ra), rb, rc, slot)); }
+
+
+#define op_eqk(L) {  \
+  StkId ra = RA(i);  \
+  TValue *rb = KB(i);  \
+  /* basic types do not use '__eq'; we can use raw equality */  \
+  int cond = luaV_rawequalobj(s2v(ra), rb);  \
+  docondjump(); }
+
+
+
+#define updatetrap(ci)  (trap = ci->u.l.trap, updatedisp())
+
+/* keep the dispatch table in sync with 'trap' (see 'ljumptab.h') */
+#define updatedisp()	((void)0)
 
 #define updatebase(ci)	(base = ci->func.p + 1)
 
@@ -1083,8 +1298,27 @@ void luaV_finishOp (lua_State *L) {
 #define dojump(ci,i,e)	{ pc += GETARG_sJ(i) + e; updatetrap(ci); }
 
 
-/* for test instructions, execute the jump instruction that follows it */
-#define donextjump(ci)	{ Instruction ni = *pc; dojump(ci, ni, 1); }
+/*
+** Count a safepoint (a call or the back edge of a loop) against the
+** execution budget and check for interrupts. When the budget runs out
+** or an interrupt is requested, turn on the trap, so that
+** 'luaG_traceexec' handles it before the next instruction (see
+** 'budgetstop').
+*/
+#define safepoint(ci)  \
+	{ global_State *g_ = G(L); \
+	  if (l_unlikely(--g_->budget <= 0 || g_->interrupt)) \
+	    { ci->u.l.trap = 1; updatetrap(ci); } }
+
+
+/*
+** For test instructions, execute the jump instruction that follows it.
+** (A backward jump closes a 'repeat' loop.)
+*/
+#define donextjump(ci)  \
+	{ Instruction ni = *pc; \
+	  if (GETARG_sJ(ni) < 0) safepoint(ci); \
+	  dojump(ci, ni, 1); }
 
 /*
 ** do a conditional jump: skip next instruction if 'cond' is not what
@@ -1122,26 +1356,49 @@ void luaV_finishOp (lua_State *L) {
 */
 #define halfProtect(exp)  (savestate(L,ci), (exp))
 
+/*
+** Let other OS threads run (see 'luai_threadyield'). While the lock is
+** released, a collection in another thread may shrink this stack
+** (which turns on the trap of this 'ci'), so reload 'trap' and 'base'.
+*/
+#if defined(LUAI_THREADLOCK)
+#define threadyield(ci)	\
+	{ luai_threadyield(L); updatetrap(ci); updatebase(ci); }
+#else
+#define threadyield(ci)	luai_threadyield(L)
+#endif
+
 /* 'c' is the limit of live values in the stack */
 #define checkGC(L,c)  \
 	{ luaC_condGC(L, (savepc(L), L->top.p = (c)), \
                          updatetrap(ci)); \
-           luai_threadyield(L); }
+           threadyield(ci); }
 
 
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
     trap = luaG_traceexec(L, pc);  /* handle hooks */ \
+    updatedisp(); \
     updatebase(ci);  /* correct stack */ \
   } \
   i = *(pc++); \
 }
 
+/*
+** Fetch the second component of a superinstruction, which then runs
+** without a dispatch. With a trap (e.g., hooks), the superinstruction
+** runs only its first component and the next one is fetched as usual.
+*/
+#define vmfetchnext()	if (l_unlikely(trap)) { vmbreak; } else i = *(pc++)
+
 #define vmdispatch(o)	switch(o)
 #define vmcase(l)	case l:
 #define vmbreak		break
 
+/* entry point of the main loop for instructions dispatched with a trap */
+#define vmtrapentry()	/* empty */
+
 
 void luaV_execute (lua_State *L, CallInfo *ci) {
   LClosure *cl;
@@ -1154,12 +1411,14 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
 #endif
  startfunc:
   trap = L->hookmask;
+  safepoint(ci);
  returning:  /* trap already set */
   cl = clLvalue(s2v(ci->func.p));
   k = cl->p->k;
   pc = ci->u.l.savedpc;
   if (l_unlikely(trap)) {
-    if (pc == cl->p->code) {  /* first instruction (not resuming)? */
+    if (pc == cl->p->code &&  /* first instruction (not resuming)? */
+        !(ci->callstatus & CIST_HOOKYIELD)) {
       if (cl->p->is_vararg)
         trap = 0;  /* hooks will start after VARARGPREP instruction */
       else  /* check 'call' hook */
@@ -1167,10 +1426,12 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
     }
     ci->u.l.trap = 1;  /* assume trap is on, for now */
   }
+  updatedisp();
   base = ci->func.p + 1;
   /* main loop of interpreter */
   for (;;) {
     Instruction i;  /* instruction being executed */
+    vmtrapentry();
     vmfetch();
     #if 0
       /* low-level line tracing for debugging Lua */
@@ -1249,16 +1510,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_GETTABUP) {
-        StkId ra = RA(i);
-        const TValue *slot;
-        TValue *upval = cl->upvals[GETARG_B(i)]->v.p;
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(luaV_finishget(L, upval, rc, ra, slot));
+        op_gettabup(L);
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
@@ -1272,7 +1524,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             : luaV_fastget(L, rb, rc, slot, luaH_get)) {
           setobj2s(L, ra, slot);
         }
-        else
+        else if (!arrayget(rb, rc, ra))
           Protect(luaV_finishget(L, rb, rc, ra, slot));
         vmbreak;
       }
@@ -1287,21 +1539,13 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         else {
           TValue key;
           setivalue(&key, c);
-          Protect(luaV_finishget(L, rb, &key, ra, slot));
+          if (!arrayget(rb, &key, ra))
+            Protect(luaV_finishget(L, rb, &key, ra, slot));
         }
         vmbreak;
       }
       vmcase(OP_GETFIELD) {
-        StkId ra = RA(i);
-        const TValue *slot;
-        TValue *rb = vRB(i);
-        TValue *rc = KC(i);
-        TString *key = tsvalue(rc);  /* key must be a string */
-        if (luaV_fastget(L, rb, key, slot, luaH_getshortstr)) {
-          setobj2s(L, ra, slot);
-        }
-        else
-          Protect(luaV_finishget(L, rb, rc, ra, slot));
+        op_getfield(L);
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1310,7 +1554,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a string */
-        if (luaV_fastget(L, upval, key, slot, luaH_getshortstr)) {
+        if (fastgetfield(upval, key, slot)) {
           luaV_finishfastset(L, upval, slot, rc);
         }
         else
@@ -1328,7 +1572,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             : luaV_fastget(L, s2v(ra), rb, slot, luaH_get)) {
           luaV_finishfastset(L, s2v(ra), slot, rc);
         }
-        else
+        else if (!arrayset(s2v(ra), rb, rc))
           Protect(luaV_finishset(L, s2v(ra), rb, rc, slot));
         vmbreak;
       }
@@ -1343,21 +1587,13 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         else {
           TValue key;
           setivalue(&key, c);
-          Protect(luaV_finishset(L, s2v(ra), &key, rc, slot));
+          if (!arrayset(s2v(ra), &key, rc))
+            Protect(luaV_finishset(L, s2v(ra), &key, rc, slot));
         }
         vmbreak;
       }
       vmcase(OP_SETFIELD) {
-        StkId ra = RA(i);
-        const TValue *slot;
-        TValue *rb = KB(i);
-        TValue *rc = RKC(i);
-        TString *key = tsvalue(rb);  /* key must be a string */
-        if (luaV_fastget(L, s2v(ra), key, slot, luaH_getshortstr)) {
-          luaV_finishfastset(L, s2v(ra), slot, rc);
-        }
-        else
-          Protect(luaV_finishset(L, s2v(ra), rb, rc, slot));
+        op_setfield(L);
         vmbreak;
       }
       vmcase(OP_NEWTABLE) {
@@ -1386,7 +1622,9 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobj2s(L, ra + 1, rb);
-        if (luaV_fastget(L, rb, key, slot, luaH_getstr)) {
+        if (key->tt == LUA_VSHRSTR
+            ? fastgetfield(rb, key, slot) || udfastgetfield(rb, key, slot)
+            : luaV_fastget(L, rb, key, slot, luaH_getstr)) {
           setobj2s(L, ra, slot);
         }
         else
@@ -1589,7 +1827,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
       }
       vmcase(OP_CLOSE) {
         StkId ra = RA(i);
-        Protect(luaF_close(L, ra, LUA_OK, 1));
+        if (luaF_hasclose(L, ra))
+          Protect(luaF_close(L, ra, LUA_OK, 1));
         vmbreak;
       }
       vmcase(OP_TBC) {
@@ -1599,6 +1838,10 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_JMP) {
+        if (GETARG_sJ(i) < 0) {  /* back edge? */
+          luaF_hotcount(L, cl->p);
+          safepoint(ci);
+        }
         dojump(ci, i, 0);
         vmbreak;
       }
@@ -1619,11 +1862,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         vmbreak;
       }
       vmcase(OP_EQK) {
-        StkId ra = RA(i);
-        TValue *rb = KB(i);
-        /* basic types do not use '__eq'; we can use raw equality */
-        int cond = luaV_rawequalobj(s2v(ra), rb);
-        docondjump();
+        op_eqk(L);
         vmbreak;
       }
       vmcase(OP_EQI) {
@@ -1722,7 +1961,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (n < 0)  /* not fixed? */
           n = cast_int(L->top.p - ra);  /* get what is available */
         savepc(ci);
-        if (TESTARG_k(i)) {  /* may there be open upvalues? */
+        /* may there be open upvalues, and are there any? */
+        if (TESTARG_k(i) && luaF_hasclose(L, base)) {
           ci->u2.nres = n;  /* save number of returns */
           if (L->top.p < ci->top.p)
             L->top.p = ci->top.p;
@@ -1795,10 +2035,15 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
             chgivalue(s2v(ra), idx);  /* update internal index */
             setivalue(s2v(ra + 3), idx);  /* and control variable */
             pc -= GETARG_Bx(i);  /* jump back */
+            luaF_hotcount(L, cl->p);
+            safepoint(ci);
           }
         }
-        else if (floatforloop(ra))  /* float loop */
+        else if (floatforloop(ra)) {  /* float loop */
           pc -= GETARG_Bx(i);  /* jump back */
+          luaF_hotcount(L, cl->p);
+          safepoint(ci);
+        }
         updatetrap(ci);  /* allows a signal to break the loop */
         vmbreak;
       }
@@ -1813,6 +2058,9 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
        StkId ra = RA(i);
         /* create to-be-closed upvalue (if needed) */
         halfProtect(luaF_newtbcupval(L, ra + 3));
+        if (isiterator(L, s2v(ra), LUA_ITERNEXT) && ttistable(s2v(ra + 1)) &&
+            ttisnil(s2v(ra + 2)) && ttisnil(s2v(ra + 3)))
+          setivalue(s2v(ra + 3), 0);  /* traverse with a cursor */
         pc += GETARG_Bx(i);
         i = *(pc++);  /* go to next instruction */
         lua_assert(GET_OPCODE(i) == OP_TFORCALL && ra == RA(i));
@@ -1826,11 +2074,13 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
            to-be-closed variable. The call will use the stack after
            these values (starting at 'ra + 4')
         */
-        /* push function, state, and control variable */
-        memcpy(ra + 4, ra, 3 * sizeof(*ra));
-        L->top.p = ra + 4 + 3;
-        ProtectNT(luaD_call(L, ra + 4, GETARG_C(i)));  /* do the call */
-        updatestack(ci);  /* stack may have changed */
+        if (!forinline(L, ra, GETARG_C(i))) {
+          /* push function, state, and control variable */
+          memcpy(ra + 4, ra, 3 * sizeof(*ra));
+          L->top.p = ra + 4 + 3;
+          ProtectNT(luaD_call(L, ra + 4, GETARG_C(i)));  /* do the call */
+          updatestack(ci);  /* stack may have changed */
+        }
         i = *(pc++);  /* go to next instruction */
         lua_assert(GET_OPCODE(i) == OP_TFORLOOP && ra == RA(i));
         goto l_tforloop;
@@ -1841,6 +2091,8 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         if (!ttisnil(s2v(ra + 4))) {  /* continue loop? */
           setobjs2s(L, ra + 2, ra + 4);  /* save control variable */
           pc -= GETARG_Bx(i);  /* jump back */
+          luaF_hotcount(L, cl->p);
+          safepoint(ci);
         }
         vmbreak;
       }}
@@ -1890,6 +2142,36 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         updatebase(ci);  /* function has new base after adjustment */
         vmbreak;
       }
+      vmcase(OP_GETFIELD2) {
+        op_getfield(L);
+        vmfetchnext();
+        op_getfield(L);
+        vmbreak;
+      }
+      vmcase(OP_GETFIELDEQK) {
+        op_getfield(L);
+        vmfetchnext();
+        op_eqk(L);
+        vmbreak;
+      }
+      vmcase(OP_GETFIELDADD) {
+        op_getfield(L);
+        vmfetchnext();
+        op_arith(L, l_addi, luai_numadd);
+        vmbreak;
+      }
+      vmcase(OP_GETTABUPFIELD) {
+        op_gettabup(L);
+        vmfetchnext();
+        op_getfield(L);
+        vmbreak;
+      }
+      vmcase(OP_SETFIELD2) {
+        op_setfield(L);
+        vmfetchnext();
+        op_setfield(L);
+        vmbreak;
+      }
       vmcase(OP_EXTRAARG) {
         lua_assert(0);
         vmbreak;
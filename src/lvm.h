@@ -89,6 +89,17 @@ typedef enum {
       !isempty(slot)))  /* result not empty? */
 
 
+/*
+** Special case of 'luaV_fastget' for short strings, using the slot
+** hint 'h' to try the node where the key was last found.
+*/
+#define luaV_fastgetfield(L,t,k,slot,h) \
+  (!ttistable(t)  \
+   ? (slot = NULL, 0)  /* not a table; 'slot' is NULL and result is 0 */  \
+   : (slot = luaH_getshortstrhint(hvalue(t), k, h),  \
+      !isempty(slot)))  /* result not empty? */
+
+
 /*
 ** Special case of 'luaV_fastget' for integers, inlining the fast case
 ** of 'luaH_getint'.